@@ -68,6 +68,8 @@ void main(void)
   AntInitialize();
   AntApiInitialize();
   SdCardInitialize();
+  FatInitialize();
+  RawLogInitialize();
 
   /* Application initialization */
 
@@ -99,6 +101,8 @@ void main(void)
     AntRunActiveState();
     AntApiRunActiveState();
     SdCardRunActiveState();
+    FatRunActiveState();
+    RawLogRunActiveState();
 
     /* Applications */
     UserApp1RunActiveState();
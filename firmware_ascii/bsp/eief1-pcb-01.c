@@ -39,6 +39,36 @@ Function Definitions
 /* Public Functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SystemTimeUs
+
+Description:
+Returns the system time in microseconds by adding the SysTick count to G_u32SystemTime1ms.  Use the difference
+of two readings to time short operations (the value wraps after about 71 minutes).
+
+Requires:
+  - SysTick is running from SysTickSetup() and its interrupt is not masked
+
+Promises:
+  - Returns G_u32SystemTime1ms * 1000 plus the microseconds elapsed in the current tick
+*/
+u32 SystemTimeUs(void)
+{
+  u32 u32Milliseconds;
+  u32 u32Count;
+
+  /* Read again if the tick interrupt ran between the two reads */
+  do
+  {
+    u32Milliseconds = G_u32SystemTime1ms;
+    u32Count = AT91C_BASE_NVIC->NVIC_STICKCVR;
+  } while(u32Milliseconds != G_u32SystemTime1ms);
+
+  /* The counter runs down from SYSTICK_COUNT - 1 */
+  return( (u32Milliseconds * 1000) + ( (SYSTICK_COUNT - 1 - u32Count) / (SYSTICK_COUNT / 1000) ) );
+
+} /* end SystemTimeUs() */
+
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Protected Functions */
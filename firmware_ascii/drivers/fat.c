@@ -0,0 +1,2464 @@
+/**********************************************************************************************************************
+File: fat.c
+
+Description:
+Read-only FAT16 / FAT32 file system on top of the SD card driver.  The task waits for the SD card to become ready,
+finds the volume (either a partition in the MBR or a card formatted without a partition table) and then lets one
+client open a file by path and read it.  Every SD access is a state in the state machine, so no call blocks the
+super loop.
+
+FAT, directory and partial data sectors go through a write-back cache of FAT_CACHE_SECTORS sectors with least
+recently used replacement, so following a cluster chain only reloads the FAT every 128 (FAT32) or 256 (FAT16)
+clusters and a directory sector that is updated at every log checkpoint stays in RAM.  Changed sectors are only
+written to the card when they are evicted or flushed; changed FAT sectors are written to every copy of the FAT.
+Whole sectors of file data bypass the cache and are read straight into the client buffer with multi-block reads of
+up to one cluster.  Sector reads and cache write-backs go through the SD request queue so other SD clients can share
+the card; log data is streamed with SdWriteBlocks() when the card is free.
+
+Only 8.3 names are matched; long file name entries are skipped.
+
+API
+Client applications may use the following functions to access this driver:
+
+FatGetStatus() - returns a variable of type FatStatusType which may have the following value:
+  FAT_NO_VOLUME: no card or no FAT volume has been found yet.
+  FAT_MOUNTING: the card is being checked for a FAT volume.
+  FAT_READY: a volume is mounted and the last request is done.
+  FAT_BUSY: a FatOpen() or FatRead() request is in progress.
+  FAT_ERROR: the last request failed; FatGetError() tells why.
+
+u8 FatGetError(void) - returns the FAT_ERROR_ code of the last failed request.
+
+bool FatOpen(u8* pu8Path_) - starts looking up the file at pu8Path_ e.g. "LOGS/DATA.TXT" (case is ignored, a leading
+'/' is optional).  Returns TRUE if the request was accepted.  When FatGetStatus() returns FAT_READY the file is open
+at position 0.
+
+bool FatRead(u8* pu8Destination_, u32 u32Size_) - starts reading up to u32Size_ bytes from the current position
+into pu8Destination_.  Returns TRUE if the request was accepted.  When FatGetStatus() returns FAT_READY,
+FatGetBytesRead() tells how many bytes arrived (fewer than requested only at the end of the file).
+e.g.
+if(FatGetStatus() == FAT_READY)
+{
+  u32Bytes = FatGetBytesRead();
+  ...process au8Data...
+  FatRead(au8Data, sizeof(au8Data));
+}
+
+bool FatSeek(u32 u32Position_) - moves the read position (limited to the file size).  Seeking forward continues
+along the cached cluster chain; seeking backward restarts from the first cluster.
+
+void FatClose(void) - closes the file.
+
+u32 FatGetFileSize(void), u32 FatGetPosition(void) - size and read position of the open file.
+
+Log files
+A log file is written separately from the file being read.  FatLogOpen() creates the file and reserves a contiguous
+run of free clusters big enough for u32MaxSize_ bytes, so appending never has to search the FAT.  Data is buffered
+in FAT_LOG_BUFFER_SECTORS sectors of RAM1 and written with multi-block writes straight into the reserved run.  The FAT
+chain and the directory entry size are only written at checkpoints: every FAT_LOG_CHECKPOINT_MS, on
+FatLogCheckpoint() and on FatLogClose().  Data, then FAT, then directory entry are written in that order so the file
+on the card never claims data that is not there; a power failure loses at most the data since the last checkpoint
+(failing between the FAT and directory writes of the first checkpoint leaves lost clusters for a disk check).  The
+reserved clusters are not marked in the FAT until they hold data, so clusters never used by a closed log stay free.
+(The FAT32 FSInfo free cluster count is not updated; PCs recalculate it.)  tools/sd_emulator/fat_log_test.c runs this
+writer on a host against a FAT32 disk image and checks the volume is clean at a checkpoint and after closing.
+
+bool FatLogOpen(u8* pu8Path_, u32 u32MaxSize_) - starts creating a new log file (the file must not exist and its
+directory must have a free entry).  Returns TRUE if the request was accepted.  When FatGetStatus() returns FAT_READY
+FatLogIsOpen() is TRUE.
+
+bool FatLogWrite(u8* pu8Data_, u32 u32Size_) - copies all u32Size_ bytes to the log buffer, or nothing if they do not
+fit (the buffer is full or the file would exceed its reserved size).  Returns TRUE if the data was taken.
+e.g.
+if( FatLogIsOpen() )
+{
+  if( !FatLogWrite(au8Record, sizeof(au8Record)) )
+  {
+    u32DroppedRecords++;
+  }
+}
+
+bool FatLogCheckpoint(void) - requests a checkpoint now.
+
+bool FatLogClose(void) - requests a final checkpoint after which the log is closed.
+
+bool FatLogIsOpen(void) - returns TRUE while a log file is open (until the close checkpoint is done).
+
+u8* FatBorrowLogBuffer(u32 u32Size_) - lends the log buffer to another task while no log file is open, so on-demand
+jobs like the "Run SD benchmark" debug command need no RAM of their own.  Returns NULL if a log is open or being
+created, the buffer is already lent, or u32Size_ is bigger than FAT_LOG_BUFFER_SECTORS sectors.  FatLogOpen() is
+refused until FatReturnLogBuffer() is called.
+
+Sector cache
+bool FatFlush(void) - requests that every changed sector in the cache be written to the card (log checkpoints do
+this themselves).  Returns TRUE if the request was accepted; FatGetStatus() returns FAT_READY when it is done.
+
+void FatGetCacheStats(u32* pu32Hits_, u32* pu32Misses_, u32* pu32WriteBacks_) - returns the number of cache
+lookups that found their sector, the number that had to read it from the card, and the number of changed sectors
+written back.  The debug command "Show SD cache statistics" prints them.
+
+bool FatGetVolumeStart(u32* pu32Sector_) - loads the first sector of the mounted volume.  Sectors 1 to
+*pu32Sector_ - 1 belong to no file system; the debug command "Run SD benchmark" uses them as scratch space.
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemFlags;                  /* From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /* From main.c */
+
+extern volatile u32 G_u32SystemTime1ms;                /* From board-specific source file */
+extern volatile u32 G_u32SystemTime1s;                 /* From board-specific source file */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "FAT_" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type FAT_pfStateMachine;             /* The FAT state machine function pointer */
+
+static u32 FAT_u32Flags;                           /* Application flags for the file system */
+static FatStatusType FAT_eStatus;                  /* Status reported to the client */
+static u8  FAT_u8ErrorCode;                        /* Error code of the last failed request */
+static u32 FAT_u32Timeout;                         /* Timeout counter used across states */
+
+/* Volume layout (all in absolute SD sectors) */
+static u32 FAT_u32FatStart;                        /* First sector of the first FAT */
+static u32 FAT_u32RootStart;                       /* First sector of the FAT16 root directory */
+static u32 FAT_u32RootSectors;                     /* Size of the FAT16 root directory (0 for FAT32) */
+static u32 FAT_u32RootCluster;                     /* First cluster of the FAT32 root directory (0 for FAT16) */
+static u32 FAT_u32DataStart;                       /* Sector of cluster 2 */
+static u32 FAT_u32ClusterCount;                    /* Number of data clusters */
+static u8  FAT_u8ClusterShift;                     /* log2(sectors per cluster) */
+static u32 FAT_u32FatSize;                         /* Sectors in each copy of the FAT */
+static u8  FAT_u8NumberOfFats;                     /* Copies of the FAT */
+
+static u32 FAT_u32VolumeStart;                     /* Sector of the volume boot sector */
+
+/* Sector cache (bulk buffer: placed in RAM1 by sam3u2-flash.icf) */
+#pragma location = ".ram1"
+static FatCacheEntryType FAT_asCache[FAT_CACHE_SECTORS]; /* FAT, directory and partial data sectors */
+static u32 FAT_u32CacheClock;                      /* Counts cache lookups to find the least recently used entry */
+static FatCacheEntryType* FAT_psCacheFill;         /* Entry being loaded after a miss */
+static u32 FAT_u32CacheFillSector;                 /* Sector being loaded into FAT_psCacheFill */
+static fnCode_type FAT_pfCacheReturnState;         /* State to run when the missing sector is in the cache */
+static bool FAT_bCacheRefilled;                    /* TRUE until the lookup that missed is repeated */
+static FatCacheEntryType* FAT_psWriteBack;         /* Entry being written back */
+static u8  FAT_u8WriteBackCopy;                    /* FAT copy being written for a FAT sector */
+static fnCode_type FAT_pfWriteBackReturnState;     /* State to run when the write-back is done */
+static fnCode_type FAT_pfFlushReturnState;         /* State to run when no changed sectors are left */
+static u32 FAT_u32CacheHits;                       /* Lookups that found the sector in the cache */
+static u32 FAT_u32CacheMisses;                     /* Lookups that had to read the sector from the card */
+static u32 FAT_u32CacheWriteBacks;                 /* Changed sectors written to the card */
+
+/* Sector request in progress */
+static u32 FAT_u32RequestSector;                   /* First sector requested */
+static u32 FAT_u32RequestCount;                    /* Number of sectors requested */
+static u32 FAT_u32RequestReceived;                 /* Sectors received so far */
+static u8* FAT_pu8RequestBuffer;                   /* Where the first sector goes */
+static fnCode_type FAT_pfRequestReturnState;       /* State to run when all sectors have arrived */
+
+/* Cluster chain cursor (directory being searched, then the open file) */
+static u32 FAT_u32ChainStart;                      /* First cluster (0 for the FAT16 root directory) */
+static u32 FAT_u32ChainCluster;                    /* Cluster at FAT_u32ChainIndex */
+static u32 FAT_u32ChainIndex;                      /* Position of FAT_u32ChainCluster in the chain */
+static u32 FAT_u32ChainTarget;                     /* Position being walked to */
+static fnCode_type FAT_pfChainEndState;            /* State to run if the chain ends before FAT_u32ChainTarget */
+static fnCode_type FAT_pfChainReturnState;         /* State to run when FAT_u32ChainTarget is reached */
+
+/* File lookup */
+static u8 FAT_au8Path[FAT_MAX_PATH];               /* Copy of the path being opened */
+static u8* FAT_pu8PathNext;                        /* Next path component */
+static u8 FAT_au8Name[FAT_NAME_SIZE];              /* Current path component in directory entry format */
+static u32 FAT_u32DirSector;                       /* Sector index within the directory being searched */
+static u32 FAT_u32DirSectorNumber;                 /* Absolute sector of FAT_u32DirSector */
+static bool FAT_bLastComponent;                    /* TRUE while searching for the last path component */
+static u32 FAT_u32FreeEntrySector;                 /* Sector of the first free directory entry seen or FAT_NO_SECTOR */
+static u16 FAT_u16FreeEntryOffset;                 /* Offset of that entry in its sector */
+
+/* Open file */
+static u32 FAT_u32FileStart;                       /* First cluster of the open file */
+static u32 FAT_u32FileSize;                        /* Size of the open file in bytes */
+static u32 FAT_u32Position;                        /* Read position in the open file */
+static u8* FAT_pu8ReadDestination;                 /* Next byte of the client buffer */
+static u32 FAT_u32ReadRemaining;                   /* Bytes left in the current FatRead() */
+static u32 FAT_u32BytesRead;                       /* Bytes delivered by the current FatRead() */
+
+/* Log file */
+#pragma location = ".ram1"
+static u8 FAT_au8LogBuffer[FAT_LOG_BUFFER_SECTORS][FAT_SECTOR_SIZE]; /* Log data waiting to be written */
+static u32 FAT_u32LogFilled;                       /* Complete sectors put in FAT_au8LogBuffer by the client */
+static u32 FAT_u32LogWritten;                      /* Complete sectors sent to the card */
+static u16 FAT_u16LogOffset;                       /* Bytes in the sector being filled */
+static u32 FAT_u32LogMaxSize;                      /* Size requested in FatLogOpen() */
+static u32 FAT_u32LogClusters;                     /* Clusters reserved for the log */
+static u32 FAT_u32LogStartCluster;                 /* First cluster of the reserved run */
+static u32 FAT_u32LogLinked;                       /* Clusters linked in the FAT on the card */
+static u32 FAT_u32LogDurableSize;                  /* Bytes on the card when the current checkpoint started */
+static u32 FAT_u32LogCheckpointSize;               /* File size in the directory entry on the card */
+static u32 FAT_u32LogDirSector;                    /* Sector of the log directory entry */
+static u16 FAT_u16LogDirOffset;                    /* Offset of the log directory entry in its sector */
+static u32 FAT_u32LogTimer;                        /* Time of the last checkpoint */
+static u32 FAT_u32LogFatCluster;                   /* Next FAT entry to write during a checkpoint */
+static u32 FAT_u32LogFatLast;                      /* Last FAT entry to write during a checkpoint */
+static u32 FAT_u32LogRunStart;                     /* Start of the free run found so far */
+static u32 FAT_u32LogRunLength;                    /* Length of the free run found so far */
+static u32 FAT_u32LogSearchCluster;                /* Next cluster to check for the free run */
+
+static u8 FAT_au8Fat16Mounted[]    = "FAT16 volume mounted\n\r";
+static u8 FAT_au8Fat32Mounted[]    = "FAT32 volume mounted\n\r";
+static u8 FAT_au8NoFileSystem[]    = "FAT: no volume found\n\r";
+
+
+/***********************************************************************************************************************
+Function Definitions
+***********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Public functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatGetStatus
+
+Description:
+Returns the status of the file system.
+
+Requires:
+  -
+
+Promises:
+  - Returns FAT_eStatus
+*/
+FatStatusType FatGetStatus(void)
+{
+  return FAT_eStatus;
+
+} /* end FatGetStatus() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatGetError
+
+Description:
+Returns the reason for the last FAT_ERROR.
+
+Requires:
+  -
+
+Promises:
+  - Returns FAT_u8ErrorCode
+*/
+u8 FatGetError(void)
+{
+  return FAT_u8ErrorCode;
+
+} /* end FatGetError() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatOpen
+
+Description:
+Requests that a file be opened for reading.  Any file already open is closed.
+
+Requires:
+  - pu8Path_ is a NULL-terminated path of 8.3 names separated by '/'
+
+Promises:
+  - If a volume is mounted, no request is in progress and the path fits: the path is copied, FAT_eStatus is
+    FAT_BUSY and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool FatOpen(u8* pu8Path_)
+{
+  if( (FAT_u32Flags & _FAT_MOUNTED) &&
+      ( (FAT_eStatus == FAT_READY) || (FAT_eStatus == FAT_ERROR) ) &&
+      (strlen((char*)pu8Path_) < FAT_MAX_PATH) )
+  {
+    strcpy((char*)FAT_au8Path, (char*)pu8Path_);
+    FAT_u32Flags &= ~_FAT_FILE_OPEN;
+    FAT_u32Flags |= _FAT_OPEN_REQUESTED;
+    FAT_eStatus = FAT_BUSY;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end FatOpen() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatRead
+
+Description:
+Requests up to u32Size_ bytes from the open file.
+
+Requires:
+  - pu8Destination_ has room for u32Size_ bytes and stays valid until the read is done
+
+Promises:
+  - If a file is open and no request is in progress: FAT_eStatus is FAT_BUSY and returns TRUE.
+    The read stops at the end of the file; FatGetBytesRead() tells how much arrived.
+  - Otherwise returns FALSE
+*/
+bool FatRead(u8* pu8Destination_, u32 u32Size_)
+{
+  if( (FAT_u32Flags & _FAT_FILE_OPEN) &&
+      ( (FAT_eStatus == FAT_READY) || (FAT_eStatus == FAT_ERROR) ) )
+  {
+    if(u32Size_ > (FAT_u32FileSize - FAT_u32Position))
+    {
+      u32Size_ = FAT_u32FileSize - FAT_u32Position;
+    }
+
+    FAT_pu8ReadDestination = pu8Destination_;
+    FAT_u32ReadRemaining = u32Size_;
+    FAT_u32BytesRead = 0;
+    FAT_u32Flags |= _FAT_READ_REQUESTED;
+    FAT_eStatus = FAT_BUSY;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end FatRead() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatSeek
+
+Description:
+Moves the read position of the open file.  The cluster chain is followed on the next read.
+
+Requires:
+  -
+
+Promises:
+  - If a file is open and no request is in progress: FAT_u32Position = u32Position_ (limited to the file size)
+    and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool FatSeek(u32 u32Position_)
+{
+  if( (FAT_u32Flags & _FAT_FILE_OPEN) && (FAT_eStatus != FAT_BUSY) )
+  {
+    if(u32Position_ > FAT_u32FileSize)
+    {
+      u32Position_ = FAT_u32FileSize;
+    }
+
+    FAT_u32Position = u32Position_;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end FatSeek() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatClose
+
+Description:
+Closes the open file.
+
+Requires:
+  - No request is in progress
+
+Promises:
+  - _FAT_FILE_OPEN is cleared
+*/
+void FatClose(void)
+{
+  if(FAT_eStatus != FAT_BUSY)
+  {
+    FAT_u32Flags &= ~_FAT_FILE_OPEN;
+  }
+
+} /* end FatClose() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatGetBytesRead
+
+Description:
+Returns the number of bytes delivered by the last FatRead().
+
+Requires:
+  -
+
+Promises:
+  - Returns FAT_u32BytesRead
+*/
+u32 FatGetBytesRead(void)
+{
+  return FAT_u32BytesRead;
+
+} /* end FatGetBytesRead() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatGetFileSize
+
+Description:
+Returns the size of the open file.
+
+Requires:
+  -
+
+Promises:
+  - Returns the file size in bytes or 0 if no file is open
+*/
+u32 FatGetFileSize(void)
+{
+  if(FAT_u32Flags & _FAT_FILE_OPEN)
+  {
+    return FAT_u32FileSize;
+  }
+
+  return 0;
+
+} /* end FatGetFileSize() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatGetPosition
+
+Description:
+Returns the read position in the open file.
+
+Requires:
+  -
+
+Promises:
+  - Returns FAT_u32Position
+*/
+u32 FatGetPosition(void)
+{
+  return FAT_u32Position;
+
+} /* end FatGetPosition() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatLogOpen
+
+Description:
+Requests that a new log file be created with room for u32MaxSize_ bytes.
+
+Requires:
+  - pu8Path_ is a NULL-terminated path of 8.3 names separated by '/'; the file must not exist
+
+Promises:
+  - If a volume is mounted, no request is in progress, no log is open, the log buffer is not lent and the path fits:
+    the path is copied,
+    FAT_eStatus is FAT_BUSY and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool FatLogOpen(u8* pu8Path_, u32 u32MaxSize_)
+{
+  if( (FAT_u32Flags & _FAT_MOUNTED) && !(FAT_u32Flags & (_FAT_LOG_OPEN | _FAT_LOG_BUFFER_LENT)) && (u32MaxSize_ != 0) &&
+      ( (FAT_eStatus == FAT_READY) || (FAT_eStatus == FAT_ERROR) ) &&
+      (strlen((char*)pu8Path_) < FAT_MAX_PATH) )
+  {
+    strcpy((char*)FAT_au8Path, (char*)pu8Path_);
+    FAT_u32LogMaxSize = u32MaxSize_;
+    FAT_u32Flags |= (_FAT_OPEN_REQUESTED | _FAT_CREATE_REQUESTED);
+    FAT_eStatus = FAT_BUSY;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end FatLogOpen() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatLogWrite
+
+Description:
+Appends data to the log buffer.  The data is all taken or none of it is.
+
+Requires:
+  -
+
+Promises:
+  - If a log is open (and not closing), the buffer has room and the file stays within its reserved clusters:
+    the data is copied and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool FatLogWrite(u8* pu8Data_, u32 u32Size_)
+{
+  u32 u32Free;
+  u32 u32Copy;
+
+  if( !(FAT_u32Flags & _FAT_LOG_OPEN) || (FAT_u32Flags & _FAT_LOG_CLOSE) )
+  {
+    return FALSE;
+  }
+
+  /* Room in RAM and room in the file */
+  u32Free = ( (FAT_LOG_BUFFER_SECTORS - (FAT_u32LogFilled - FAT_u32LogWritten)) << FAT_SECTOR_SHIFT ) - FAT_u16LogOffset;
+  if( (u32Size_ > u32Free) ||
+      (u32Size_ > ( (FAT_u32LogClusters << (FAT_SECTOR_SHIFT + FAT_u8ClusterShift)) -
+                    ((FAT_u32LogFilled << FAT_SECTOR_SHIFT) + FAT_u16LogOffset) )) )
+  {
+    return FALSE;
+  }
+
+  while(u32Size_ != 0)
+  {
+    u32Copy = FAT_SECTOR_SIZE - FAT_u16LogOffset;
+    if(u32Copy > u32Size_)
+    {
+      u32Copy = u32Size_;
+    }
+
+    memcpy(&FAT_au8LogBuffer[FAT_u32LogFilled & (FAT_LOG_BUFFER_SECTORS - 1)][FAT_u16LogOffset], pu8Data_, u32Copy);
+    pu8Data_ += u32Copy;
+    u32Size_ -= u32Copy;
+    FAT_u16LogOffset += u32Copy;
+
+    if(FAT_u16LogOffset == FAT_SECTOR_SIZE)
+    {
+      FAT_u16LogOffset = 0;
+      FAT_u32LogFilled++;
+    }
+  }
+
+  return TRUE;
+
+} /* end FatLogWrite() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatLogCheckpoint
+
+Description:
+Requests that everything logged so far be made durable on the card.
+
+Requires:
+  -
+
+Promises:
+  - If a log is open: _FAT_LOG_CHECKPOINT is set and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool FatLogCheckpoint(void)
+{
+  if(FAT_u32Flags & _FAT_LOG_OPEN)
+  {
+    FAT_u32Flags |= _FAT_LOG_CHECKPOINT;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end FatLogCheckpoint() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatLogClose
+
+Description:
+Requests a final checkpoint and closes the log.  FatLogWrite() is refused from now on.
+
+Requires:
+  -
+
+Promises:
+  - If a log is open: _FAT_LOG_CHECKPOINT and _FAT_LOG_CLOSE are set and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool FatLogClose(void)
+{
+  if(FAT_u32Flags & _FAT_LOG_OPEN)
+  {
+    FAT_u32Flags |= (_FAT_LOG_CHECKPOINT | _FAT_LOG_CLOSE);
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end FatLogClose() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatLogIsOpen
+
+Description:
+Reports if a log file is open.
+
+Requires:
+  -
+
+Promises:
+  - Returns TRUE if _FAT_LOG_OPEN is set
+*/
+bool FatLogIsOpen(void)
+{
+  return( (FAT_u32Flags & _FAT_LOG_OPEN) != 0 );
+
+} /* end FatLogIsOpen() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatBorrowLogBuffer
+
+Description:
+Lends the log buffer while it is not needed for a log file.
+
+Requires:
+  -
+
+Promises:
+  - If no log is open or being created, the buffer is not lent and u32Size_ fits: _FAT_LOG_BUFFER_LENT is set and
+    returns the start of FAT_au8LogBuffer
+  - Otherwise returns NULL
+*/
+u8* FatBorrowLogBuffer(u32 u32Size_)
+{
+  if( (FAT_u32Flags & (_FAT_LOG_OPEN | _FAT_CREATE_REQUESTED | _FAT_LOG_BUFFER_LENT)) ||
+      (u32Size_ > sizeof(FAT_au8LogBuffer)) )
+  {
+    return NULL;
+  }
+
+  FAT_u32Flags |= _FAT_LOG_BUFFER_LENT;
+  return &FAT_au8LogBuffer[0][0];
+
+} /* end FatBorrowLogBuffer() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatReturnLogBuffer
+
+Description:
+Takes back the log buffer lent by FatBorrowLogBuffer().
+
+Requires:
+  - The borrower has no SD request left that uses the buffer
+
+Promises:
+  - _FAT_LOG_BUFFER_LENT is cleared
+*/
+void FatReturnLogBuffer(void)
+{
+  FAT_u32Flags &= ~_FAT_LOG_BUFFER_LENT;
+
+} /* end FatReturnLogBuffer() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatFlush
+
+Description:
+Requests that all changed sectors in the cache be written to the card.
+
+Requires:
+  -
+
+Promises:
+  - If a volume is mounted and no request is in progress: _FAT_FLUSH_REQUESTED is set, FAT_eStatus is FAT_BUSY and
+    returns TRUE
+  - Otherwise returns FALSE
+*/
+bool FatFlush(void)
+{
+  if( (FAT_u32Flags & _FAT_MOUNTED) &&
+      ( (FAT_eStatus == FAT_READY) || (FAT_eStatus == FAT_ERROR) ) )
+  {
+    FAT_u32Flags |= _FAT_FLUSH_REQUESTED;
+    FAT_eStatus = FAT_BUSY;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end FatFlush() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatGetCacheStats
+
+Description:
+Reports how well the sector cache is working.
+
+Requires:
+  - The pointers are valid
+
+Promises:
+  - *pu32Hits_, *pu32Misses_ and *pu32WriteBacks_ are loaded with the counts since FatInitialize()
+*/
+void FatGetCacheStats(u32* pu32Hits_, u32* pu32Misses_, u32* pu32WriteBacks_)
+{
+  *pu32Hits_       = FAT_u32CacheHits;
+  *pu32Misses_     = FAT_u32CacheMisses;
+  *pu32WriteBacks_ = FAT_u32CacheWriteBacks;
+
+} /* end FatGetCacheStats() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatGetVolumeStart
+
+Description:
+Reports where the mounted volume starts on the card.
+
+Requires:
+  - pu32Sector_ is valid
+
+Promises:
+  - If a volume is mounted: *pu32Sector_ is the sector of its boot sector (0 if the card has no partition table)
+    and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool FatGetVolumeStart(u32* pu32Sector_)
+{
+  if(FAT_u32Flags & _FAT_MOUNTED)
+  {
+    *pu32Sector_ = FAT_u32VolumeStart;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end FatGetVolumeStart() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Protected functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: FatInitialize
+
+Description:
+Initializes the file system task.  Mounting starts once the SD card is ready.
+
+Requires:
+  - SdCardInitialize() has run
+
+Promises:
+  - No volume is mounted and the state machine waits for the SD card
+*/
+void FatInitialize(void)
+{
+  u8 au8FatStartedMsg[] = "FAT task ready\n\r";
+
+  FAT_u32Flags = 0;
+  FAT_eStatus = FAT_NO_VOLUME;
+  FAT_u8ErrorCode = FAT_ERROR_NONE;
+  FAT_u32CacheHits = 0;
+  FAT_u32CacheMisses = 0;
+  FAT_u32CacheWriteBacks = 0;
+  FatCacheClear();
+
+  /* Start with the retry time already elapsed so the first mount is attempted as soon as the card is ready */
+  FAT_u32Timeout = G_u32SystemTime1ms - FAT_MOUNT_RETRY_MS;
+  FAT_pfStateMachine = FatSM_NoVolume;
+
+  DebugPrintf(au8FatStartedMsg);
+  G_u32ApplicationFlags |= _APPLICATION_FLAGS_FAT;
+
+} /* end FatInitialize() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function FatRunActiveState()
+
+Description:
+Selects and runs one iteration of the current state in the state machine.
+All state machines have a TOTAL of 1ms to execute, so on average n state machines
+may take 1ms / n to execute.
+
+Requires:
+  - State machine function pointer points at current state
+
+Promises:
+  - Unmounts the volume if the card has been removed
+  - Calls the function to pointed by the state machine function pointer
+*/
+void FatRunActiveState(void)
+{
+  if( (FAT_eStatus != FAT_NO_VOLUME) && (SdGetStatus() == SD_NO_CARD) )
+  {
+    FatUnmount();
+  }
+
+  FAT_pfStateMachine();
+
+} /* end FatRunActiveState */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Private functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatGet16 / FatGet32
+
+Description:
+Read little-endian values from unaligned on-disk structures.
+
+Requires:
+  - pu8Data_ points to the least significant byte
+
+Promises:
+  - Returns the value
+*/
+static u16 FatGet16(u8* pu8Data_)
+{
+  return( (u16)pu8Data_[0] | ((u16)pu8Data_[1] << 8) );
+
+} /* end FatGet16() */
+
+static u32 FatGet32(u8* pu8Data_)
+{
+  return( (u32)pu8Data_[0]         | ((u32)pu8Data_[1] << 8) |
+         ((u32)pu8Data_[2] << 16) | ((u32)pu8Data_[3] << 24) );
+
+} /* end FatGet32() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatIsBootSector
+
+Description:
+Checks if a sector looks like a FAT boot sector with 512 byte sectors.
+
+Requires:
+  - pu8Sector_ points to a 512 byte sector
+
+Promises:
+  - Returns TRUE if the signature, jump instruction, sector size and FAT count are valid
+*/
+static bool FatIsBootSector(u8* pu8Sector_)
+{
+  return( (pu8Sector_[FAT_BOOT_SIGNATURE_INDEX]     == FAT_BOOT_SIGNATURE_0) &&
+          (pu8Sector_[FAT_BOOT_SIGNATURE_INDEX + 1] == FAT_BOOT_SIGNATURE_1) &&
+          ( (pu8Sector_[0] == FAT_BOOT_JUMP_SHORT) || (pu8Sector_[0] == FAT_BOOT_JUMP_NEAR) ) &&
+          (FatGet16(&pu8Sector_[FAT_BPB_BYTES_PER_SECTOR]) == FAT_SECTOR_SIZE) &&
+          (pu8Sector_[FAT_BPB_NUMBER_OF_FATS] != 0) );
+
+} /* end FatIsBootSector() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatParseBootSector
+
+Description:
+Works out the volume layout from a boot sector.
+
+Requires:
+  - pu8Sector_ points to the boot sector of the volume starting at u32VolumeStart_
+
+Promises:
+  - If the volume is FAT16 or FAT32: the layout variables are loaded, _FAT_TYPE_FAT32 is set/clear and returns TRUE
+  - Otherwise returns FALSE
+*/
+static bool FatParseBootSector(u8* pu8Sector_, u32 u32VolumeStart_)
+{
+  u8 u8SectorsPerCluster;
+  u32 u32TotalSectors;
+  u32 u32FatSize;
+
+  if( !FatIsBootSector(pu8Sector_) )
+  {
+    return FALSE;
+  }
+
+  /* Sectors per cluster must be a power of 2 */
+  u8SectorsPerCluster = pu8Sector_[FAT_BPB_SECTORS_PER_CLUS];
+  if( (u8SectorsPerCluster == 0) || (u8SectorsPerCluster & (u8SectorsPerCluster - 1)) )
+  {
+    return FALSE;
+  }
+
+  FAT_u8ClusterShift = 0;
+  while( (1 << FAT_u8ClusterShift) != u8SectorsPerCluster )
+  {
+    FAT_u8ClusterShift++;
+  }
+
+  /* The 16-bit fields are 0 when the 32-bit fields are used */
+  u32TotalSectors = FatGet16(&pu8Sector_[FAT_BPB_TOTAL_SECTORS_16]);
+  if(u32TotalSectors == 0)
+  {
+    u32TotalSectors = FatGet32(&pu8Sector_[FAT_BPB_TOTAL_SECTORS_32]);
+  }
+
+  u32FatSize = FatGet16(&pu8Sector_[FAT_BPB_FAT_SIZE_16]);
+  if(u32FatSize == 0)
+  {
+    u32FatSize = FatGet32(&pu8Sector_[FAT_BPB_FAT_SIZE_32]);
+  }
+
+  /* Reserved sectors, FATs, FAT16 root directory, then the data clusters */
+  FAT_u32FatSize     = u32FatSize;
+  FAT_u8NumberOfFats = pu8Sector_[FAT_BPB_NUMBER_OF_FATS];
+  FAT_u32FatStart    = u32VolumeStart_ + FatGet16(&pu8Sector_[FAT_BPB_RESERVED_SECTORS]);
+  FAT_u32RootStart   = FAT_u32FatStart + (FAT_u8NumberOfFats * u32FatSize);
+  FAT_u32RootSectors = ( (FatGet16(&pu8Sector_[FAT_BPB_ROOT_ENTRIES]) * FAT_DIR_ENTRY_SIZE) +
+                         (FAT_SECTOR_SIZE - 1) ) >> FAT_SECTOR_SHIFT;
+  FAT_u32DataStart   = FAT_u32RootStart + FAT_u32RootSectors;
+
+  if(u32TotalSectors <= (FAT_u32DataStart - u32VolumeStart_))
+  {
+    return FALSE;
+  }
+
+  /* The FAT type is decided by the cluster count alone */
+  FAT_u32ClusterCount = (u32TotalSectors - (FAT_u32DataStart - u32VolumeStart_)) >> FAT_u8ClusterShift;
+  if(FAT_u32ClusterCount < FAT16_MIN_CLUSTERS)
+  {
+    return FALSE;
+  }
+
+  if(FAT_u32ClusterCount >= FAT32_MIN_CLUSTERS)
+  {
+    FAT_u32Flags |= _FAT_TYPE_FAT32;
+    FAT_u32RootCluster = FatGet32(&pu8Sector_[FAT_BPB_ROOT_CLUSTER]);
+  }
+  else
+  {
+    FAT_u32Flags &= ~_FAT_TYPE_FAT32;
+    FAT_u32RootCluster = 0;
+  }
+
+  return TRUE;
+
+} /* end FatParseBootSector() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatParseName
+
+Description:
+Converts the next component of a path to the space-padded 11 character directory entry format.
+
+Requires:
+  - *ppu8Path_ points into a NULL-terminated path
+  - pu8Name_ has room for FAT_NAME_SIZE bytes
+
+Promises:
+  - Leading '/' are skipped; *ppu8Path_ is left at the '/' or NULL after the component
+  - Returns TRUE if the component is a valid 8.3 name, upper case in pu8Name_
+*/
+static bool FatParseName(u8** ppu8Path_, u8* pu8Name_)
+{
+  u8* pu8Path = *ppu8Path_;
+  u8 u8Index = 0;
+  u8 u8Limit = 8;
+
+  while(*pu8Path == '/')
+  {
+    pu8Path++;
+  }
+
+  memset(pu8Name_, ' ', FAT_NAME_SIZE);
+  while( (*pu8Path != '/') && (*pu8Path != '\0') )
+  {
+    if(*pu8Path == '.')
+    {
+      /* Only one dot and not at the start */
+      if( (u8Limit != 8) || (u8Index == 0) )
+      {
+        return FALSE;
+      }
+      u8Index = 8;
+      u8Limit = FAT_NAME_SIZE;
+    }
+    else
+    {
+      if(u8Index == u8Limit)
+      {
+        return FALSE;
+      }
+
+      if( (*pu8Path >= 'a') && (*pu8Path <= 'z') )
+      {
+        pu8Name_[u8Index++] = *pu8Path - 'a' + 'A';
+      }
+      else
+      {
+        pu8Name_[u8Index++] = *pu8Path;
+      }
+    }
+    pu8Path++;
+  }
+
+  *ppu8Path_ = pu8Path;
+  return(u8Index != 0);
+
+} /* end FatParseName() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatClusterToSector
+
+Description:
+Returns the first sector of a data cluster.
+
+Requires:
+  - u32Cluster_ >= FAT_FIRST_CLUSTER
+
+Promises:
+  - Returns the absolute SD sector number
+*/
+static u32 FatClusterToSector(u32 u32Cluster_)
+{
+  return( FAT_u32DataStart + ((u32Cluster_ - FAT_FIRST_CLUSTER) << FAT_u8ClusterShift) );
+
+} /* end FatClusterToSector() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatEntrySector / FatGetEntry / FatSetEntry
+
+Description:
+Locate, read and write the FAT entry of a cluster.
+
+Requires:
+  - FatGetEntry / FatSetEntry: pu8FatSector_ points to sector FatEntrySector(u32Cluster_) of the first FAT
+
+Promises:
+  - FatEntrySector returns the sector of the first FAT that holds the entry
+  - FatGetEntry returns the entry (reserved FAT32 bits removed)
+  - FatSetEntry writes u32Value_ into pu8FatSector_ (reserved FAT32 bits kept)
+*/
+static u32 FatEntrySector(u32 u32Cluster_)
+{
+  if(FAT_u32Flags & _FAT_TYPE_FAT32)
+  {
+    return( FAT_u32FatStart + (u32Cluster_ >> FAT32_ENTRY_SHIFT) );
+  }
+
+  return( FAT_u32FatStart + (u32Cluster_ >> FAT16_ENTRY_SHIFT) );
+
+} /* end FatEntrySector() */
+
+static u32 FatGetEntry(u8* pu8FatSector_, u32 u32Cluster_)
+{
+  if(FAT_u32Flags & _FAT_TYPE_FAT32)
+  {
+    return( FatGet32(&pu8FatSector_[(u32Cluster_ & 0x7F) << 2]) & FAT32_CLUSTER_MASK );
+  }
+
+  return( FatGet16(&pu8FatSector_[(u32Cluster_ & 0xFF) << 1]) );
+
+} /* end FatGetEntry() */
+
+static void FatSetEntry(u8* pu8FatSector_, u32 u32Cluster_, u32 u32Value_)
+{
+  u8* pu8Entry;
+
+  if(FAT_u32Flags & _FAT_TYPE_FAT32)
+  {
+    pu8Entry = &pu8FatSector_[(u32Cluster_ & 0x7F) << 2];
+    u32Value_ |= FatGet32(pu8Entry) & FAT32_RESERVED_BITS;
+    pu8Entry[2] = (u8)(u32Value_ >> 16);
+    pu8Entry[3] = (u8)(u32Value_ >> 24);
+  }
+  else
+  {
+    pu8Entry = &pu8FatSector_[(u32Cluster_ & 0xFF) << 1];
+  }
+
+  pu8Entry[0] = (u8)u32Value_;
+  pu8Entry[1] = (u8)(u32Value_ >> 8);
+
+} /* end FatSetEntry() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatReadSectors
+
+Description:
+Sets up a read of consecutive sectors and sends the state machine to wait for them.
+
+Requires:
+  - pu8Buffer_ has room for u32Count_ sectors
+
+Promises:
+  - FatSM_WaitSector runs until the sectors arrive, then pfNextState_ runs
+*/
+static void FatReadSectors(u32 u32Sector_, u32 u32Count_, u8* pu8Buffer_, fnCode_type pfNextState_)
+{
+  FAT_u32RequestSector = u32Sector_;
+  FAT_u32RequestCount = u32Count_;
+  FAT_u32RequestReceived = 0;
+  FAT_pu8RequestBuffer = pu8Buffer_;
+  FAT_pfRequestReturnState = pfNextState_;
+
+  FAT_u32Flags &= ~(_FAT_SD_REQUESTED | _FAT_SD_DONE | _FAT_SD_FAILED);
+  FAT_u32Timeout = G_u32SystemTime1ms;
+  FAT_pfStateMachine = FatSM_WaitSector;
+
+} /* end FatReadSectors() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatWriteSector
+
+Description:
+Sets up a single sector write and sends the state machine to wait for it.
+
+Requires:
+  - pu8Buffer_ holds the sector and does not change until the write is done
+
+Promises:
+  - FatSM_WaitWrite runs until the card has written the sector, then pfNextState_ runs
+*/
+static void FatWriteSector(u32 u32Sector_, u8* pu8Buffer_, fnCode_type pfNextState_)
+{
+  FAT_u32RequestSector = u32Sector_;
+  FAT_u32RequestCount = 1;
+  FAT_pu8RequestBuffer = pu8Buffer_;
+  FAT_pfRequestReturnState = pfNextState_;
+
+  FAT_u32Flags &= ~(_FAT_SD_REQUESTED | _FAT_SD_DONE | _FAT_SD_FAILED);
+  FAT_u32Timeout = G_u32SystemTime1ms;
+  FAT_pfStateMachine = FatSM_WaitWrite;
+
+} /* end FatWriteSector() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatSdCallback
+
+Description:
+SD request queue callback for the sector read or write in progress (called from the SD task).
+
+Requires:
+  - 
+
+Promises:
+  - If a request is outstanding, _FAT_SD_DONE is set and _FAT_SD_FAILED is set too if bSuccess_ is FALSE
+  - A request left over from before an unmount is ignored
+*/
+static void FatSdCallback(u8* pu8Buffer_, bool bSuccess_)
+{
+  if(FAT_u32Flags & _FAT_SD_REQUESTED)
+  {
+    FAT_u32Flags |= _FAT_SD_DONE;
+    if(!bSuccess_)
+    {
+      FAT_u32Flags |= _FAT_SD_FAILED;
+    }
+  }
+
+} /* end FatSdCallback() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatCacheGet
+
+Description:
+Looks up a sector in the cache.  On a miss the least recently used entry is written back if it has changed and
+then loaded with the sector; the calling state runs again once it is there.  No entry pointer is kept across
+states since the entry may be replaced by the next lookup.
+
+Requires:
+  - Called from a state that can simply be run again (pfRetryState_ is normally the calling state)
+
+Promises:
+  - If the sector is cached: returns its entry and marks it most recently used
+  - Otherwise returns NULL and the state machine loads the sector, then runs pfRetryState_
+*/
+static FatCacheEntryType* FatCacheGet(u32 u32Sector_, fnCode_type pfRetryState_)
+{
+  FatCacheEntryType* psVictim = &FAT_asCache[0];
+
+  FAT_u32CacheClock++;
+  for(u8 i = 0; i < FAT_CACHE_SECTORS; i++)
+  {
+    if(FAT_asCache[i].u32Sector == u32Sector_)
+    {
+      /* The lookup repeated after a miss is not a hit */
+      if(FAT_bCacheRefilled)
+      {
+        FAT_bCacheRefilled = FALSE;
+      }
+      else
+      {
+        FAT_u32CacheHits++;
+      }
+
+      FAT_asCache[i].u32LastUse = FAT_u32CacheClock;
+      return &FAT_asCache[i];
+    }
+
+    /* Empty entries have u32LastUse = 0 so they are used before anything is evicted */
+    if(FAT_asCache[i].u32LastUse < psVictim->u32LastUse)
+    {
+      psVictim = &FAT_asCache[i];
+    }
+  }
+
+  FAT_u32CacheMisses++;
+  FAT_psCacheFill = psVictim;
+  FAT_u32CacheFillSector = u32Sector_;
+  FAT_pfCacheReturnState = pfRetryState_;
+
+  if(psVictim->bDirty)
+  {
+    FatCacheWriteBack(psVictim, FatSM_CacheFill);
+  }
+  else
+  {
+    FAT_pfStateMachine = FatSM_CacheFill;
+  }
+
+  return NULL;
+
+} /* end FatCacheGet() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatCacheWriteBack
+
+Description:
+Writes a changed cache entry to the card.  A sector of the first FAT is written to every copy of the FAT.
+
+Requires:
+  - psEntry_->bDirty is TRUE
+
+Promises:
+  - The sector is written, then psEntry_->bDirty is cleared and pfNextState_ runs
+*/
+static void FatCacheWriteBack(FatCacheEntryType* psEntry_, fnCode_type pfNextState_)
+{
+  FAT_psWriteBack = psEntry_;
+  FAT_u8WriteBackCopy = 0;
+  FAT_pfWriteBackReturnState = pfNextState_;
+  FAT_u32CacheWriteBacks++;
+
+  FatWriteSector(psEntry_->u32Sector, psEntry_->au8Data, FatSM_CacheWriteBackCopy);
+
+} /* end FatCacheWriteBack() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatCacheFlush
+
+Description:
+Writes every changed cache entry to the card.  FAT sectors go first so a directory entry on the card never
+refers to clusters that are not linked yet.
+
+Requires:
+  -
+
+Promises:
+  - FatSM_CacheFlush runs until no entry is dirty, then pfNextState_ runs
+*/
+static void FatCacheFlush(fnCode_type pfNextState_)
+{
+  FAT_pfFlushReturnState = pfNextState_;
+  FAT_pfStateMachine = FatSM_CacheFlush;
+
+} /* end FatCacheFlush() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatCacheDiscard / FatCacheClear
+
+Description:
+Drop cache entries without writing them back.
+
+Requires:
+  -
+
+Promises:
+  - FatCacheDiscard empties entries for sectors u32Sector_ to u32Sector_ + u32Count_ - 1 (sectors about to be written
+    around the cache)
+  - FatCacheClear empties every entry
+*/
+static void FatCacheDiscard(u32 u32Sector_, u32 u32Count_)
+{
+  for(u8 i = 0; i < FAT_CACHE_SECTORS; i++)
+  {
+    if( (FAT_asCache[i].u32Sector - u32Sector_) < u32Count_ )
+    {
+      FAT_asCache[i].u32Sector = FAT_NO_SECTOR;
+      FAT_asCache[i].u32LastUse = 0;
+      FAT_asCache[i].bDirty = FALSE;
+    }
+  }
+
+} /* end FatCacheDiscard() */
+
+static void FatCacheClear(void)
+{
+  for(u8 i = 0; i < FAT_CACHE_SECTORS; i++)
+  {
+    FAT_asCache[i].u32Sector = FAT_NO_SECTOR;
+    FAT_asCache[i].u32LastUse = 0;
+    FAT_asCache[i].bDirty = FALSE;
+  }
+
+  FAT_bCacheRefilled = FALSE;
+
+} /* end FatCacheClear() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatSetChain
+
+Description:
+Points the cluster chain cursor at the start of a new chain.
+
+Requires:
+  -
+
+Promises:
+  - The cursor is at position 0 of the chain starting at u32StartCluster_
+*/
+static void FatSetChain(u32 u32StartCluster_)
+{
+  FAT_u32ChainStart   = u32StartCluster_;
+  FAT_u32ChainCluster = u32StartCluster_;
+  FAT_u32ChainIndex   = 0;
+
+} /* end FatSetChain() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatPositionChain
+
+Description:
+Moves the cluster chain cursor to a cluster index.  Moving forward continues from the current cluster so
+sequential access follows each link once; moving backward starts over.
+
+Requires:
+  - FatSetChain() has been called for the chain
+  - FAT_pfChainEndState holds the state to run if the chain is too short
+
+Promises:
+  - FatSM_WalkChain runs until FAT_u32ChainCluster is cluster number u32ClusterIndex_ of the chain,
+    then pfNextState_ runs
+*/
+static void FatPositionChain(u32 u32ClusterIndex_, fnCode_type pfNextState_)
+{
+  if(u32ClusterIndex_ < FAT_u32ChainIndex)
+  {
+    FatSetChain(FAT_u32ChainStart);
+  }
+
+  FAT_u32ChainTarget = u32ClusterIndex_;
+  FAT_pfChainReturnState = pfNextState_;
+  FAT_pfStateMachine = FatSM_WalkChain;
+
+} /* end FatPositionChain() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatOpenEntry
+
+Description:
+Handles a directory entry that matches the current path component.
+
+Requires:
+  - pu8Entry_ points to the matching 32 byte directory entry
+  - FAT_pu8PathNext points after the matching component
+
+Promises:
+  - If more components follow and the entry is a directory, the search continues in it
+  - If this was the last component and the entry is a file, the file is open at position 0 and FAT_eStatus
+    is FAT_READY
+  - Otherwise the request fails with FAT_ERROR_NOT_FOUND
+*/
+static void FatOpenEntry(u8* pu8Entry_)
+{
+  u32 u32Cluster = FatGet16(&pu8Entry_[FAT_DIR_CLUSTER_LO]);
+  bool bDirectory = (pu8Entry_[FAT_DIR_ATTRIBUTES] & FAT_ATTR_DIRECTORY) != 0;
+
+  /* The high word is only used by FAT32 */
+  if(FAT_u32Flags & _FAT_TYPE_FAT32)
+  {
+    u32Cluster |= (u32)FatGet16(&pu8Entry_[FAT_DIR_CLUSTER_HI]) << 16;
+  }
+
+  while(*FAT_pu8PathNext == '/')
+  {
+    FAT_pu8PathNext++;
+  }
+
+  /* More path to go: this must be a directory */
+  if(*FAT_pu8PathNext != '\0')
+  {
+    if(!bDirectory)
+    {
+      FatFail(FAT_ERROR_NOT_FOUND);
+      return;
+    }
+
+    /* ".." back to the root is stored as cluster 0 */
+    if(u32Cluster == 0)
+    {
+      u32Cluster = FAT_u32RootCluster;
+    }
+    FatSetChain(u32Cluster);
+    FAT_pfStateMachine = FatSM_OpenComponent;
+    return;
+  }
+
+  if(bDirectory)
+  {
+    FatFail(FAT_ERROR_NOT_FOUND);
+    return;
+  }
+
+  FAT_u32FileStart = u32Cluster;
+  FAT_u32FileSize = FatGet32(&pu8Entry_[FAT_DIR_FILE_SIZE]);
+  FAT_u32Position = 0;
+  FatSetChain(u32Cluster);
+
+  FAT_u32Flags |= _FAT_FILE_OPEN;
+  FAT_eStatus = FAT_READY;
+  FAT_pfStateMachine = FatSM_Idle;
+
+} /* end FatOpenEntry() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatAdvance
+
+Description:
+Accounts for bytes delivered to the client.
+
+Requires:
+  - u32Bytes_ <= FAT_u32ReadRemaining
+
+Promises:
+  - Position, destination and counters are updated
+*/
+static void FatAdvance(u32 u32Bytes_)
+{
+  FAT_u32Position        += u32Bytes_;
+  FAT_pu8ReadDestination += u32Bytes_;
+  FAT_u32ReadRemaining   -= u32Bytes_;
+  FAT_u32BytesRead       += u32Bytes_;
+
+} /* end FatAdvance() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatFail
+
+Description:
+Ends the current request with an error.  The volume stays mounted.
+
+Requires:
+  -
+
+Promises:
+  - Errors while mounting are passed to FatMountFailed()
+  - FAT_u8ErrorCode is loaded, FAT_eStatus is FAT_ERROR and the state machine is idle
+  - The sector cache is cleared (changes not yet on the card are lost) and any log file is abandoned after a
+    disk error
+*/
+static void FatFail(u8 u8ErrorCode_)
+{
+  if( !(FAT_u32Flags & _FAT_MOUNTED) )
+  {
+    FatMountFailed(u8ErrorCode_);
+    return;
+  }
+
+  if(u8ErrorCode_ == FAT_ERROR_DISK)
+  {
+    FatCacheClear();
+    FAT_u32Flags &= ~(_FAT_LOG_OPEN | _FAT_LOG_CHECKPOINT | _FAT_LOG_CLOSE);
+  }
+
+  FAT_u32Flags &= ~(_FAT_OPEN_REQUESTED | _FAT_READ_REQUESTED | _FAT_CREATE_REQUESTED |
+                    _FAT_FLUSH_REQUESTED | _FAT_SD_REQUESTED | _FAT_SD_DONE | _FAT_SD_FAILED);
+  FAT_u8ErrorCode = u8ErrorCode_;
+  FAT_eStatus = FAT_ERROR;
+  FAT_pfStateMachine = FatSM_Idle;
+
+} /* end FatFail() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatMountFailed
+
+Description:
+Ends a mount attempt.  Another attempt is made after FAT_MOUNT_RETRY_MS.
+
+Requires:
+  -
+
+Promises:
+  - FAT_u8ErrorCode is loaded, FAT_eStatus is FAT_ERROR and the state machine waits to retry
+*/
+static void FatMountFailed(u8 u8ErrorCode_)
+{
+  if(u8ErrorCode_ == FAT_ERROR_NO_FILESYSTEM)
+  {
+    DebugPrintf(FAT_au8NoFileSystem);
+  }
+
+  FAT_u32Flags &= ~(_FAT_SD_REQUESTED | _FAT_SD_DONE | _FAT_SD_FAILED);
+  FatCacheClear();
+  FAT_u8ErrorCode = u8ErrorCode_;
+  FAT_eStatus = FAT_ERROR;
+  FAT_u32Timeout = G_u32SystemTime1ms;
+  FAT_pfStateMachine = FatSM_NoVolume;
+
+} /* end FatMountFailed() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatUnmount
+
+Description:
+Forgets the volume after the card is removed.
+
+Requires:
+  -
+
+Promises:
+  - All flags except _FAT_LOG_BUFFER_LENT and the caches are cleared, FAT_eStatus is FAT_NO_VOLUME and the state
+    machine waits for a card
+*/
+static void FatUnmount(void)
+{
+  /* A borrower may still have requests in flight that will fail; it returns the buffer when they are done */
+  FAT_u32Flags &= _FAT_LOG_BUFFER_LENT;
+  FatCacheClear();
+  FAT_eStatus = FAT_NO_VOLUME;
+  FAT_u32Timeout = G_u32SystemTime1ms - FAT_MOUNT_RETRY_MS;
+  FAT_pfStateMachine = FatSM_NoVolume;
+
+} /* end FatUnmount() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FatLogFlush
+
+Description:
+Starts writing the buffered log sectors to the reserved run.
+
+Requires:
+  - A log is open and the state machine is idle
+
+Promises:
+  - All complete buffered sectors are written with one multi-block write
+  - If bCheckpoint_ is TRUE, the sector being filled is written too and FatSM_LogCheckpoint runs afterwards
+    with FAT_u32LogDurableSize holding the bytes that are on the card
+*/
+static void FatLogFlush(bool bCheckpoint_)
+{
+  FAT_u32RequestSector = FatClusterToSector(FAT_u32LogStartCluster) + FAT_u32LogWritten;
+  FAT_u32RequestCount = FAT_u32LogFilled - FAT_u32LogWritten;
+  FAT_u32RequestReceived = 0;
+  FAT_pfRequestReturnState = FatSM_Idle;
+
+  if(bCheckpoint_)
+  {
+    FAT_u32LogDurableSize = (FAT_u32LogFilled << FAT_SECTOR_SHIFT) + FAT_u16LogOffset;
+    if(FAT_u16LogOffset != 0)
+    {
+      FAT_u32RequestCount++;
+    }
+    FAT_pfRequestReturnState = FatSM_LogCheckpoint;
+  }
+
+  if(FAT_u32RequestCount == 0)
+  {
+    FAT_pfStateMachine = FAT_pfRequestReturnState;
+    return;
+  }
+
+  /* A partial read of the log file may have cached one of these sectors */
+  FatCacheDiscard(FAT_u32RequestSector, FAT_u32RequestCount);
+
+  FAT_u32Timeout = G_u32SystemTime1ms;
+  FAT_pfStateMachine = FatSM_LogWriteStart;
+
+} /* end FatLogFlush() */
+
+
+/***********************************************************************************************************************
+State Machine Function Definitions
+***********************************************************************************************************************/
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the SD card to be ready, then look for a volume */
+static void FatSM_NoVolume(void)
+{
+  if( (SdGetStatus() == SD_IDLE) && IsTimeUp(&FAT_u32Timeout, FAT_MOUNT_RETRY_MS) )
+  {
+    FAT_eStatus = FAT_MOUNTING;
+    FAT_pfStateMachine = FatSM_MountSector0;
+  }
+
+} /* end FatSM_NoVolume() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Sector 0 is either a boot sector (no partition table) or an MBR */
+static void FatSM_MountSector0(void)
+{
+  FatCacheEntryType* psEntry = FatCacheGet(0, FatSM_MountSector0);
+  u8* pu8Partition;
+
+  if(psEntry == NULL)
+  {
+    return;
+  }
+
+  if( FatIsBootSector(psEntry->au8Data) )
+  {
+    FAT_u32VolumeStart = 0;
+    FAT_pfStateMachine = FatSM_MountPartition;
+    return;
+  }
+
+  /* Use the first FAT16 or FAT32 partition */
+  if( (psEntry->au8Data[FAT_BOOT_SIGNATURE_INDEX]     == FAT_BOOT_SIGNATURE_0) &&
+      (psEntry->au8Data[FAT_BOOT_SIGNATURE_INDEX + 1] == FAT_BOOT_SIGNATURE_1) )
+  {
+    pu8Partition = &psEntry->au8Data[FAT_MBR_PARTITION_TABLE];
+    for(u8 i = 0; i < FAT_MBR_PARTITIONS; i++)
+    {
+      switch(pu8Partition[FAT_PARTITION_TYPE_INDEX])
+      {
+        case FAT_PARTITION_FAT16_SMALL:
+        case FAT_PARTITION_FAT16:
+        case FAT_PARTITION_FAT32_CHS:
+        case FAT_PARTITION_FAT32_LBA:
+        case FAT_PARTITION_FAT16_LBA:
+        {
+          FAT_u32VolumeStart = FatGet32(&pu8Partition[FAT_PARTITION_LBA_INDEX]);
+          FAT_pfStateMachine = FatSM_MountPartition;
+          return;
+        }
+
+        default:
+          break;
+      }
+      pu8Partition += FAT_MBR_PARTITION_SIZE;
+    }
+  }
+
+  FatMountFailed(FAT_ERROR_NO_FILESYSTEM);
+
+} /* end FatSM_MountSector0() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Parse the boot sector of the volume at FAT_u32VolumeStart */
+static void FatSM_MountPartition(void)
+{
+  FatCacheEntryType* psEntry = FatCacheGet(FAT_u32VolumeStart, FatSM_MountPartition);
+
+  if(psEntry == NULL)
+  {
+    return;
+  }
+
+  if( !FatParseBootSector(psEntry->au8Data, FAT_u32VolumeStart) )
+  {
+    FatMountFailed(FAT_ERROR_NO_FILESYSTEM);
+    return;
+  }
+
+  if(FAT_u32Flags & _FAT_TYPE_FAT32)
+  {
+    DebugPrintf(FAT_au8Fat32Mounted);
+  }
+  else
+  {
+    DebugPrintf(FAT_au8Fat16Mounted);
+  }
+
+  FAT_u32Flags |= _FAT_MOUNTED;
+  FAT_u8ErrorCode = FAT_ERROR_NONE;
+  FAT_eStatus = FAT_READY;
+  FAT_pfStateMachine = FatSM_Idle;
+
+} /* end FatSM_MountPartition() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Volume mounted: wait for a request */
+static void FatSM_Idle(void)
+{
+  if(FAT_u32Flags & _FAT_OPEN_REQUESTED)
+  {
+    FAT_u32Flags &= ~_FAT_OPEN_REQUESTED;
+
+    /* Search starts in the root directory */
+    FAT_pu8PathNext = FAT_au8Path;
+    FatSetChain(FAT_u32RootCluster);
+    FAT_pfStateMachine = FatSM_OpenComponent;
+  }
+  else if(FAT_u32Flags & _FAT_READ_REQUESTED)
+  {
+    FAT_u32Flags &= ~_FAT_READ_REQUESTED;
+    FAT_pfChainEndState = FatSM_BadChain;
+    FAT_pfStateMachine = FatSM_ReadData;
+  }
+  else if(FAT_u32Flags & _FAT_FLUSH_REQUESTED)
+  {
+    FAT_u32Flags &= ~_FAT_FLUSH_REQUESTED;
+    FatCacheFlush(FatSM_FlushDone);
+  }
+  else if(FAT_u32Flags & _FAT_LOG_OPEN)
+  {
+    if( IsTimeUp(&FAT_u32LogTimer, FAT_LOG_CHECKPOINT_MS) )
+    {
+      FAT_u32Flags |= _FAT_LOG_CHECKPOINT;
+    }
+
+    if(FAT_u32Flags & _FAT_LOG_CHECKPOINT)
+    {
+      FatLogFlush(TRUE);
+    }
+    else if( (FAT_u32LogFilled - FAT_u32LogWritten) >= FAT_LOG_BURST_SECTORS )
+    {
+      FatLogFlush(FALSE);
+    }
+  }
+
+} /* end FatSM_Idle() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Search the current directory for the next path component */
+static void FatSM_OpenComponent(void)
+{
+  u8* pu8Path;
+
+  if( !FatParseName(&FAT_pu8PathNext, FAT_au8Name) )
+  {
+    FatFail(FAT_ERROR_BAD_PATH);
+    return;
+  }
+
+  /* Only the last component is created by FatLogOpen() */
+  pu8Path = FAT_pu8PathNext;
+  while(*pu8Path == '/')
+  {
+    pu8Path++;
+  }
+  FAT_bLastComponent = (*pu8Path == '\0');
+
+  FAT_u32DirSector = 0;
+  FAT_u32FreeEntrySector = FAT_NO_SECTOR;
+  FAT_pfChainEndState = FatSM_DirEnd;
+  FAT_pfStateMachine = FatSM_DirSector;
+
+} /* end FatSM_OpenComponent() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Load sector FAT_u32DirSector of the directory */
+static void FatSM_DirSector(void)
+{
+  /* The FAT16 root directory is a fixed run of sectors instead of a cluster chain */
+  if(FAT_u32ChainStart == 0)
+  {
+    if(FAT_u32DirSector >= FAT_u32RootSectors)
+    {
+      FAT_pfStateMachine = FatSM_DirEnd;
+      return;
+    }
+
+    FAT_u32DirSectorNumber = FAT_u32RootStart + FAT_u32DirSector;
+    FAT_pfStateMachine = FatSM_DirScan;
+    return;
+  }
+
+  FatPositionChain(FAT_u32DirSector >> FAT_u8ClusterShift, FatSM_DirSectorInCluster);
+
+} /* end FatSM_DirSector() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The chain cursor is on the directory cluster that holds FAT_u32DirSector */
+static void FatSM_DirSectorInCluster(void)
+{
+  FAT_u32DirSectorNumber = FatClusterToSector(FAT_u32ChainCluster) +
+                           (FAT_u32DirSector & ((1 << FAT_u8ClusterShift) - 1));
+  FAT_pfStateMachine = FatSM_DirScan;
+
+} /* end FatSM_DirSectorInCluster() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Compare each entry in the directory sector with the name being searched */
+static void FatSM_DirScan(void)
+{
+  FatCacheEntryType* psSector = FatCacheGet(FAT_u32DirSectorNumber, FatSM_DirScan);
+  u8* pu8Entry;
+
+  if(psSector == NULL)
+  {
+    return;
+  }
+
+  pu8Entry = &psSector->au8Data[0];
+
+  for(u16 i = 0; i < FAT_DIR_ENTRIES_PER_SECTOR; i++)
+  {
+    /* Remember the first free entry in case the name is being created */
+    if( ( (pu8Entry[0] == FAT_DIR_END) || (pu8Entry[0] == FAT_DIR_DELETED) ) &&
+        (FAT_u32FreeEntrySector == FAT_NO_SECTOR) )
+    {
+      FAT_u32FreeEntrySector = FAT_u32DirSectorNumber;
+      FAT_u16FreeEntryOffset = i * FAT_DIR_ENTRY_SIZE;
+    }
+
+    if(pu8Entry[0] == FAT_DIR_END)
+    {
+      FAT_pfStateMachine = FatSM_DirEnd;
+      return;
+    }
+
+    /* Volume labels and long file name entries both have the volume ID bit set */
+    if( (pu8Entry[0] != FAT_DIR_DELETED) &&
+        !(pu8Entry[FAT_DIR_ATTRIBUTES] & FAT_ATTR_VOLUME_ID) &&
+        (memcmp(pu8Entry, FAT_au8Name, FAT_NAME_SIZE) == 0) )
+    {
+      if( (FAT_u32Flags & _FAT_CREATE_REQUESTED) && FAT_bLastComponent )
+      {
+        FatFail(FAT_ERROR_EXISTS);
+      }
+      else
+      {
+        FatOpenEntry(pu8Entry);
+      }
+      return;
+    }
+
+    pu8Entry += FAT_DIR_ENTRY_SIZE;
+  }
+
+  FAT_u32DirSector++;
+  FAT_pfStateMachine = FatSM_DirSector;
+
+} /* end FatSM_DirScan() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The whole directory has been searched without a match */
+static void FatSM_DirEnd(void)
+{
+  if( !(FAT_u32Flags & _FAT_CREATE_REQUESTED) || !FAT_bLastComponent )
+  {
+    FatFail(FAT_ERROR_NOT_FOUND);
+    return;
+  }
+
+  if(FAT_u32FreeEntrySector == FAT_NO_SECTOR)
+  {
+    FatFail(FAT_ERROR_DIR_FULL);
+    return;
+  }
+
+  /* Find room for the log before the directory entry is written */
+  FAT_u32LogClusters = (FAT_u32LogMaxSize + (FAT_SECTOR_SIZE << FAT_u8ClusterShift) - 1) >>
+                       (FAT_SECTOR_SHIFT + FAT_u8ClusterShift);
+  FAT_u32LogSearchCluster = FAT_FIRST_CLUSTER;
+  FAT_u32LogRunLength = 0;
+  FAT_pfStateMachine = FatSM_LogFindRun;
+
+} /* end FatSM_DirEnd() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Move to the cluster that holds the read position */
+static void FatSM_ReadData(void)
+{
+  if(FAT_u32ReadRemaining == 0)
+  {
+    FAT_eStatus = FAT_READY;
+    FAT_pfStateMachine = FatSM_Idle;
+    return;
+  }
+
+  /* A file with data must have a valid first cluster */
+  if(FAT_u32FileStart < FAT_FIRST_CLUSTER)
+  {
+    FatFail(FAT_ERROR_BAD_CHAIN);
+    return;
+  }
+
+  /* A log file lookup may have used the chain cursor since the last read */
+  if(FAT_u32ChainStart != FAT_u32FileStart)
+  {
+    FatSetChain(FAT_u32FileStart);
+  }
+
+  FatPositionChain(FAT_u32Position >> (FAT_SECTOR_SHIFT + FAT_u8ClusterShift), FatSM_ReadSector);
+
+} /* end FatSM_ReadData() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The chain cursor is on the cluster that holds the read position */
+static void FatSM_ReadSector(void)
+{
+  u32 u32SectorInCluster = (FAT_u32Position >> FAT_SECTOR_SHIFT) & ((1 << FAT_u8ClusterShift) - 1);
+  u32 u32Sector = FatClusterToSector(FAT_u32ChainCluster) + u32SectorInCluster;
+  u16 u16Offset = (u16)(FAT_u32Position & (FAT_SECTOR_SIZE - 1));
+  u32 u32Bytes;
+  FatCacheEntryType* psSector;
+
+  /* Whole sectors go straight to the client, up to the end of the cluster in one multi-block read */
+  if( (u16Offset == 0) && (FAT_u32ReadRemaining >= FAT_SECTOR_SIZE) )
+  {
+    u32Bytes = FAT_u32ReadRemaining >> FAT_SECTOR_SHIFT;
+    if(u32Bytes > ((1 << FAT_u8ClusterShift) - u32SectorInCluster))
+    {
+      u32Bytes = (1 << FAT_u8ClusterShift) - u32SectorInCluster;
+    }
+
+    FatReadSectors(u32Sector, u32Bytes, FAT_pu8ReadDestination, FatSM_ReadDirectDone);
+    return;
+  }
+
+  /* Partial sectors go through the cache */
+  psSector = FatCacheGet(u32Sector, FatSM_ReadSector);
+  if(psSector == NULL)
+  {
+    return;
+  }
+
+  u32Bytes = FAT_SECTOR_SIZE - u16Offset;
+  if(u32Bytes > FAT_u32ReadRemaining)
+  {
+    u32Bytes = FAT_u32ReadRemaining;
+  }
+
+  memcpy(FAT_pu8ReadDestination, &psSector->au8Data[u16Offset], u32Bytes);
+  FatAdvance(u32Bytes);
+  FAT_pfStateMachine = FatSM_ReadData;
+
+} /* end FatSM_ReadSector() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* A run of whole sectors has been read into the client buffer */
+static void FatSM_ReadDirectDone(void)
+{
+  FatAdvance(FAT_u32RequestCount << FAT_SECTOR_SHIFT);
+  FAT_pfStateMachine = FatSM_ReadData;
+
+} /* end FatSM_ReadDirectDone() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The file's cluster chain is shorter than its size */
+static void FatSM_BadChain(void)
+{
+  FatFail(FAT_ERROR_BAD_CHAIN);
+
+} /* end FatSM_BadChain() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* FatFlush() request finished */
+static void FatSM_FlushDone(void)
+{
+  FAT_eStatus = FAT_READY;
+  FAT_pfStateMachine = FatSM_Idle;
+
+} /* end FatSM_FlushDone() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Search one FAT sector per pass for FAT_u32LogClusters free clusters in a row */
+static void FatSM_LogFindRun(void)
+{
+  u32 u32Sector = FatEntrySector(FAT_u32LogSearchCluster);
+  FatCacheEntryType* psFatSector = FatCacheGet(u32Sector, FatSM_LogFindRun);
+
+  if(psFatSector == NULL)
+  {
+    return;
+  }
+
+  while(FatEntrySector(FAT_u32LogSearchCluster) == u32Sector)
+  {
+    if(FAT_u32LogSearchCluster >= (FAT_u32ClusterCount + FAT_FIRST_CLUSTER))
+    {
+      FatFail(FAT_ERROR_FULL);
+      return;
+    }
+
+    if(FatGetEntry(psFatSector->au8Data, FAT_u32LogSearchCluster) == 0)
+    {
+      if(FAT_u32LogRunLength == 0)
+      {
+        FAT_u32LogRunStart = FAT_u32LogSearchCluster;
+      }
+
+      FAT_u32LogRunLength++;
+      if(FAT_u32LogRunLength == FAT_u32LogClusters)
+      {
+        FAT_u32LogStartCluster = FAT_u32LogRunStart;
+        FAT_pfStateMachine = FatSM_LogCreateEntry;
+        return;
+      }
+    }
+    else
+    {
+      FAT_u32LogRunLength = 0;
+    }
+
+    FAT_u32LogSearchCluster++;
+  }
+
+} /* end FatSM_LogFindRun() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Write an empty file entry; its first cluster and size are filled in at the first checkpoint */
+static void FatSM_LogCreateEntry(void)
+{
+  FatCacheEntryType* psSector = FatCacheGet(FAT_u32FreeEntrySector, FatSM_LogCreateEntry);
+  u8* pu8Entry;
+
+  if(psSector == NULL)
+  {
+    return;
+  }
+
+  pu8Entry = &psSector->au8Data[FAT_u16FreeEntryOffset];
+  memset(pu8Entry, 0, FAT_DIR_ENTRY_SIZE);
+  memcpy(pu8Entry, FAT_au8Name, FAT_NAME_SIZE);
+  pu8Entry[FAT_DIR_ATTRIBUTES] = FAT_ATTR_ARCHIVE;
+
+  FAT_u32LogDirSector = FAT_u32FreeEntrySector;
+  FAT_u16LogDirOffset = FAT_u16FreeEntryOffset;
+  psSector->bDirty = TRUE;
+  FatCacheFlush(FatSM_LogOpened);
+
+} /* end FatSM_LogCreateEntry() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The log file exists on the card and is ready for data */
+static void FatSM_LogOpened(void)
+{
+  FAT_u32LogFilled = 0;
+  FAT_u32LogWritten = 0;
+  FAT_u16LogOffset = 0;
+  FAT_u32LogLinked = 0;
+  FAT_u32LogCheckpointSize = 0;
+  FAT_u32LogTimer = G_u32SystemTime1ms;
+
+  FAT_u32Flags &= ~(_FAT_CREATE_REQUESTED | _FAT_LOG_CHECKPOINT | _FAT_LOG_CLOSE);
+  FAT_u32Flags |= _FAT_LOG_OPEN;
+  FAT_eStatus = FAT_READY;
+  FAT_pfStateMachine = FatSM_Idle;
+
+} /* end FatSM_LogOpened() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Start the multi-block write of buffered log sectors when the card is free */
+static void FatSM_LogWriteStart(void)
+{
+  if( SdWriteBlocks(FAT_u32RequestSector, FAT_u32RequestCount) )
+  {
+    FAT_u32Timeout = G_u32SystemTime1ms;
+    FAT_pfStateMachine = FatSM_LogPutData;
+  }
+  else if( IsTimeUp(&FAT_u32Timeout, FAT_SD_TIMEOUT_MS) )
+  {
+    FatFail(FAT_ERROR_DISK);
+  }
+
+} /* end FatSM_LogWriteStart() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Hand buffered sectors to the SD driver as its block buffers free up */
+static void FatSM_LogPutData(void)
+{
+  u8* pu8Source;
+
+  while(FAT_u32RequestReceived != FAT_u32RequestCount)
+  {
+    /* A partial sector at a checkpoint stays in the buffer and is written again when it is complete */
+    pu8Source = FAT_au8LogBuffer[FAT_u32LogWritten & (FAT_LOG_BUFFER_SECTORS - 1)];
+    if( !SdPutWriteData(pu8Source) )
+    {
+      break;
+    }
+
+    if(FAT_u32LogWritten != FAT_u32LogFilled)
+    {
+      FAT_u32LogWritten++;
+    }
+    FAT_u32RequestReceived++;
+    FAT_u32Timeout = G_u32SystemTime1ms;
+  }
+
+  if(FAT_u32RequestReceived == FAT_u32RequestCount)
+  {
+    /* Wait for the card to finish programming */
+    FAT_pfStateMachine = FatSM_LogWaitWrite;
+    return;
+  }
+
+  if( (SdGetStatus() != SD_WRITING) || IsTimeUp(&FAT_u32Timeout, FAT_SD_TIMEOUT_MS) )
+  {
+    FatFail(FAT_ERROR_DISK);
+  }
+
+} /* end FatSM_LogPutData() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait until the card has programmed the last log sector */
+static void FatSM_LogWaitWrite(void)
+{
+  switch( SdGetStatus() )
+  {
+    case SD_WRITING:
+    {
+      if( IsTimeUp(&FAT_u32Timeout, FAT_SD_TIMEOUT_MS) )
+      {
+        FatFail(FAT_ERROR_DISK);
+      }
+      break;
+    }
+
+    case SD_NO_CARD:
+    case SD_CARD_ERROR:
+    {
+      FatFail(FAT_ERROR_DISK);
+      break;
+    }
+
+    default:
+    {
+      /* The write is done (the card may already be busy with another client) */
+      FAT_pfStateMachine = FAT_pfRequestReturnState;
+      break;
+    }
+  } /* end switch */
+
+} /* end FatSM_LogWaitWrite() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Data is on the card: link the clusters that now hold data, then update the directory entry */
+static void FatSM_LogCheckpoint(void)
+{
+  u32 u32Used = (FAT_u32LogDurableSize + (FAT_SECTOR_SIZE << FAT_u8ClusterShift) - 1) >>
+                (FAT_SECTOR_SHIFT + FAT_u8ClusterShift);
+
+  if(u32Used > FAT_u32LogLinked)
+  {
+    /* The previous last cluster changes from end of chain to a link */
+    FAT_u32LogFatCluster = FAT_u32LogStartCluster;
+    if(FAT_u32LogLinked != 0)
+    {
+      FAT_u32LogFatCluster += FAT_u32LogLinked - 1;
+    }
+    FAT_u32LogFatLast = FAT_u32LogStartCluster + u32Used - 1;
+    FAT_pfStateMachine = FatSM_LogFatSector;
+  }
+  else if(FAT_u32LogDurableSize != FAT_u32LogCheckpointSize)
+  {
+    FAT_pfStateMachine = FatSM_LogDirUpdate;
+  }
+  else
+  {
+    FAT_pfStateMachine = FatSM_LogCheckpointDone;
+  }
+
+} /* end FatSM_LogCheckpoint() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Update the FAT entries in one cached FAT sector; the cache writes it to every FAT copy */
+static void FatSM_LogFatSector(void)
+{
+  u32 u32Sector = FatEntrySector(FAT_u32LogFatCluster);
+  FatCacheEntryType* psFatSector = FatCacheGet(u32Sector, FatSM_LogFatSector);
+
+  if(psFatSector == NULL)
+  {
+    return;
+  }
+
+  /* The reserved run is contiguous so each cluster links to the next */
+  while( (FAT_u32LogFatCluster <= FAT_u32LogFatLast) && (FatEntrySector(FAT_u32LogFatCluster) == u32Sector) )
+  {
+    if(FAT_u32LogFatCluster == FAT_u32LogFatLast)
+    {
+      if(FAT_u32Flags & _FAT_TYPE_FAT32)
+      {
+        FatSetEntry(psFatSector->au8Data, FAT_u32LogFatCluster, FAT32_END_OF_CHAIN);
+      }
+      else
+      {
+        FatSetEntry(psFatSector->au8Data, FAT_u32LogFatCluster, FAT16_END_OF_CHAIN);
+      }
+    }
+    else
+    {
+      FatSetEntry(psFatSector->au8Data, FAT_u32LogFatCluster, FAT_u32LogFatCluster + 1);
+    }
+    FAT_u32LogFatCluster++;
+  }
+
+  psFatSector->bDirty = TRUE;
+
+  /* Stay in this state for the next FAT sector */
+  if(FAT_u32LogFatCluster > FAT_u32LogFatLast)
+  {
+    FAT_u32LogLinked = FAT_u32LogFatLast - FAT_u32LogStartCluster + 1;
+    FAT_pfStateMachine = FatSM_LogDirUpdate;
+  }
+
+} /* end FatSM_LogFatSector() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Record the first cluster and the durable size in the directory entry, then write the changed FAT and directory
+sectors (FAT first) */
+static void FatSM_LogDirUpdate(void)
+{
+  FatCacheEntryType* psSector = FatCacheGet(FAT_u32LogDirSector, FatSM_LogDirUpdate);
+  u8* pu8Entry;
+
+  if(psSector == NULL)
+  {
+    return;
+  }
+
+  pu8Entry = &psSector->au8Data[FAT_u16LogDirOffset];
+
+  if(FAT_u32LogLinked != 0)
+  {
+    pu8Entry[FAT_DIR_CLUSTER_LO]     = (u8)FAT_u32LogStartCluster;
+    pu8Entry[FAT_DIR_CLUSTER_LO + 1] = (u8)(FAT_u32LogStartCluster >> 8);
+    pu8Entry[FAT_DIR_CLUSTER_HI]     = (u8)(FAT_u32LogStartCluster >> 16);
+    pu8Entry[FAT_DIR_CLUSTER_HI + 1] = (u8)(FAT_u32LogStartCluster >> 24);
+  }
+
+  pu8Entry[FAT_DIR_FILE_SIZE]     = (u8)FAT_u32LogDurableSize;
+  pu8Entry[FAT_DIR_FILE_SIZE + 1] = (u8)(FAT_u32LogDurableSize >> 8);
+  pu8Entry[FAT_DIR_FILE_SIZE + 2] = (u8)(FAT_u32LogDurableSize >> 16);
+  pu8Entry[FAT_DIR_FILE_SIZE + 3] = (u8)(FAT_u32LogDurableSize >> 24);
+
+  psSector->bDirty = TRUE;
+  FatCacheFlush(FatSM_LogCheckpointDone);
+
+} /* end FatSM_LogDirUpdate() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Checkpoint finished: close the log if requested */
+static void FatSM_LogCheckpointDone(void)
+{
+  FAT_u32LogCheckpointSize = FAT_u32LogDurableSize;
+  FAT_u32LogTimer = G_u32SystemTime1ms;
+  FAT_u32Flags &= ~_FAT_LOG_CHECKPOINT;
+
+  if(FAT_u32Flags & _FAT_LOG_CLOSE)
+  {
+    FAT_u32Flags &= ~(_FAT_LOG_OPEN | _FAT_LOG_CLOSE);
+  }
+
+  FAT_pfStateMachine = FatSM_Idle;
+
+} /* end FatSM_LogCheckpointDone() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The entry picked by FatCacheGet() is clean: read the missing sector into it */
+static void FatSM_CacheFill(void)
+{
+  FAT_psCacheFill->u32Sector = FAT_NO_SECTOR;
+  FAT_psCacheFill->u32LastUse = 0;
+  FatReadSectors(FAT_u32CacheFillSector, 1, FAT_psCacheFill->au8Data, FatSM_CacheFilled);
+
+} /* end FatSM_CacheFill() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The missing sector has arrived: go back to the state that looked it up */
+static void FatSM_CacheFilled(void)
+{
+  FAT_psCacheFill->u32Sector = FAT_u32CacheFillSector;
+  FAT_psCacheFill->u32LastUse = FAT_u32CacheClock;
+  FAT_psCacheFill->bDirty = FALSE;
+  FAT_bCacheRefilled = TRUE;
+  FAT_pfStateMachine = FAT_pfCacheReturnState;
+
+} /* end FatSM_CacheFilled() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* A sector has been written back: write the other FAT copies if it is a FAT sector */
+static void FatSM_CacheWriteBackCopy(void)
+{
+  if( ((FAT_psWriteBack->u32Sector - FAT_u32FatStart) < FAT_u32FatSize) &&
+      (++FAT_u8WriteBackCopy < FAT_u8NumberOfFats) )
+  {
+    FatWriteSector(FAT_psWriteBack->u32Sector + (FAT_u8WriteBackCopy * FAT_u32FatSize),
+                   FAT_psWriteBack->au8Data, FatSM_CacheWriteBackCopy);
+    return;
+  }
+
+  FAT_psWriteBack->bDirty = FALSE;
+  FAT_pfStateMachine = FAT_pfWriteBackReturnState;
+
+} /* end FatSM_CacheWriteBackCopy() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Write back one changed entry per pass: FAT sectors first, then the rest */
+static void FatSM_CacheFlush(void)
+{
+  bool bFatSector;
+
+  for(u8 u8Pass = 0; u8Pass < 2; u8Pass++)
+  {
+    for(u8 i = 0; i < FAT_CACHE_SECTORS; i++)
+    {
+      bFatSector = (FAT_asCache[i].u32Sector - FAT_u32FatStart) < FAT_u32FatSize;
+      if( FAT_asCache[i].bDirty && (bFatSector == (u8Pass == 0)) )
+      {
+        FatCacheWriteBack(&FAT_asCache[i], FatSM_CacheFlush);
+        return;
+      }
+    }
+  }
+
+  FAT_pfStateMachine = FAT_pfFlushReturnState;
+
+} /* end FatSM_CacheFlush() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Follow the FAT from FAT_u32ChainIndex to FAT_u32ChainTarget, loading FAT sectors as needed */
+static void FatSM_WalkChain(void)
+{
+  FatCacheEntryType* psFatSector;
+  u32 u32Next;
+  u16 u16Steps = 0;
+
+  while(FAT_u32ChainIndex < FAT_u32ChainTarget)
+  {
+    /* Give the rest of the system a turn during long walks */
+    if(u16Steps++ == FAT_CHAIN_STEPS_PER_PASS)
+    {
+      return;
+    }
+
+    psFatSector = FatCacheGet(FatEntrySector(FAT_u32ChainCluster), FatSM_WalkChain);
+    if(psFatSector == NULL)
+    {
+      return;
+    }
+
+    /* End of chain marks, free and bad clusters are all out of this range */
+    u32Next = FatGetEntry(psFatSector->au8Data, FAT_u32ChainCluster);
+    if( (u32Next < FAT_FIRST_CLUSTER) || (u32Next >= (FAT_u32ClusterCount + FAT_FIRST_CLUSTER)) )
+    {
+      FAT_pfStateMachine = FAT_pfChainEndState;
+      return;
+    }
+
+    FAT_u32ChainCluster = u32Next;
+    FAT_u32ChainIndex++;
+  }
+
+  FAT_pfStateMachine = FAT_pfChainReturnState;
+
+} /* end FatSM_WalkChain() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Queue the sector read, then wait until the SD driver has put every sector in the request buffer (no copy is made
+here).  The SD task always calls back, so only a full queue is timed. */
+static void FatSM_WaitSector(void)
+{
+  if( !(FAT_u32Flags & _FAT_SD_REQUESTED) )
+  {
+    /* The queue may be full of other clients' requests */
+    if( SdQueueRead(FAT_u32RequestSector, FAT_u32RequestCount, FAT_pu8RequestBuffer, FatSdCallback) )
+    {
+      FAT_u32Flags |= _FAT_SD_REQUESTED;
+    }
+    else if( IsTimeUp(&FAT_u32Timeout, FAT_SD_TIMEOUT_MS) )
+    {
+      FatFail(FAT_ERROR_DISK);
+    }
+    return;
+  }
+
+  if(FAT_u32Flags & _FAT_SD_DONE)
+  {
+    if(FAT_u32Flags & _FAT_SD_FAILED)
+    {
+      /* The read failed or the card was removed */
+      FatFail(FAT_ERROR_DISK);
+      return;
+    }
+
+    FAT_u32RequestReceived = FAT_u32RequestCount;
+    FAT_u32Flags &= ~(_FAT_SD_REQUESTED | _FAT_SD_DONE);
+    FAT_pfStateMachine = FAT_pfRequestReturnState;
+  }
+
+} /* end FatSM_WaitSector() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Queue the sector write, then wait until the card has programmed it */
+static void FatSM_WaitWrite(void)
+{
+  if( !(FAT_u32Flags & _FAT_SD_REQUESTED) )
+  {
+    if( SdQueueWrite(FAT_u32RequestSector, 1, FAT_pu8RequestBuffer, FatSdCallback) )
+    {
+      FAT_u32Flags |= _FAT_SD_REQUESTED;
+    }
+    else if( IsTimeUp(&FAT_u32Timeout, FAT_SD_TIMEOUT_MS) )
+    {
+      FatFail(FAT_ERROR_DISK);
+    }
+    return;
+  }
+
+  if(FAT_u32Flags & _FAT_SD_DONE)
+  {
+    if(FAT_u32Flags & _FAT_SD_FAILED)
+    {
+      FatFail(FAT_ERROR_DISK);
+      return;
+    }
+
+    FAT_u32Flags &= ~(_FAT_SD_REQUESTED | _FAT_SD_DONE);
+    FAT_pfStateMachine = FAT_pfRequestReturnState;
+  }
+
+} /* end FatSM_WaitWrite() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
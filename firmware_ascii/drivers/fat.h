@@ -0,0 +1,239 @@
+/**********************************************************************************************************************
+File: fat.h
+
+Description:
+Header file for fat.c
+**********************************************************************************************************************/
+
+#ifndef __FAT_H
+#define __FAT_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+typedef enum {FAT_NO_VOLUME, FAT_MOUNTING, FAT_READY, FAT_BUSY, FAT_ERROR} FatStatusType;
+
+typedef struct
+{
+  u32 u32Sector;                      /* Sector held or FAT_NO_SECTOR */
+  u32 u32LastUse;                     /* Cache clock at the last access (0 when empty) */
+  bool bDirty;                        /* TRUE if changed since it was read from the card */
+  u8 au8Data[SD_BLOCK_SIZE];          /* Sector contents */
+} FatCacheEntryType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+/* FAT_u32Flags */
+#define _FAT_MOUNTED              (u32)0x00000001      /* Set when a FAT16/FAT32 volume has been found and parsed */
+#define _FAT_TYPE_FAT32           (u32)0x00000002      /* Set if the volume is FAT32 (clear for FAT16) */
+#define _FAT_FILE_OPEN            (u32)0x00000004      /* Set when a file is open for reading */
+#define _FAT_OPEN_REQUESTED       (u32)0x00000008      /* Set by FatOpen(); cleared when the state machine starts the lookup */
+#define _FAT_READ_REQUESTED       (u32)0x00000010      /* Set by FatRead(); cleared when the state machine starts the read */
+#define _FAT_SD_REQUESTED         (u32)0x00000020      /* Set while a sector read or write is queued on the SD card */
+#define _FAT_CREATE_REQUESTED     (u32)0x00000040      /* Set by FatLogOpen(); cleared when the log file has been created */
+#define _FAT_LOG_OPEN             (u32)0x00000080      /* Set while a log file is open for writing */
+#define _FAT_LOG_CHECKPOINT       (u32)0x00000100      /* Set when the log FAT chain and directory entry must be updated */
+#define _FAT_LOG_CLOSE            (u32)0x00000200      /* Set by FatLogClose(); the log closes after the next checkpoint */
+#define _FAT_FLUSH_REQUESTED      (u32)0x00000400      /* Set by FatFlush(); cleared when the state machine starts the flush */
+#define _FAT_SD_DONE              (u32)0x00000800      /* Set by FatSdCallback() when the queued sector request is finished */
+#define _FAT_SD_FAILED            (u32)0x00001000      /* Set by FatSdCallback() if the queued sector request failed */
+#define _FAT_LOG_BUFFER_LENT      (u32)0x00002000      /* Set by FatBorrowLogBuffer(); no log can be opened until it is returned */
+/* end of FAT_u32Flags */
+
+#define FAT_SECTOR_SIZE           (u16)512             /* Only 512 byte sectors are supported */
+#define FAT_SECTOR_SHIFT          (u8)9                /* log2(FAT_SECTOR_SIZE) */
+#define FAT_NO_SECTOR             (u32)0xFFFFFFFF      /* Sector number for an empty sector buffer */
+#define FAT_NAME_SIZE             (u8)11               /* 8.3 name without the dot */
+#define FAT_MAX_PATH              (u8)64               /* Longest path accepted by FatOpen() including the NULL */
+
+#define FAT_FIRST_CLUSTER         (u32)2               /* Cluster numbers 0 and 1 are reserved */
+#define FAT32_CLUSTER_MASK        (u32)0x0FFFFFFF      /* The top 4 bits of a FAT32 entry are reserved */
+#define FAT16_MIN_CLUSTERS        (u32)4085            /* Fewer clusters than this is FAT12 (not supported) */
+#define FAT32_MIN_CLUSTERS        (u32)65525           /* This many clusters or more is FAT32 */
+#define FAT32_END_OF_CHAIN        (u32)0x0FFFFFFF      /* FAT entry of the last cluster in a chain */
+#define FAT16_END_OF_CHAIN        (u32)0x0000FFFF
+#define FAT32_RESERVED_BITS       (u32)0xF0000000      /* Preserved when a FAT32 entry is written */
+#define FAT32_ENTRY_SHIFT         (u8)7                /* log2(FAT entries per sector) */
+#define FAT16_ENTRY_SHIFT         (u8)8
+
+#define FAT_CHAIN_STEPS_PER_PASS  (u16)64              /* FAT entries followed per call so long seeks do not overrun 1ms */
+#define FAT_SD_TIMEOUT_MS         (u32)2000            /* Time to wait for the SD card to accept or deliver a sector */
+#define FAT_MOUNT_RETRY_MS        (u32)1000            /* Time between mount attempts */
+
+#define FAT_CACHE_SECTORS         (u8)4                /* Sector cache size: each entry costs about 520 bytes of RAM */
+
+#define FAT_LOG_BUFFER_SECTORS    (u32)8               /* Log data buffered in RAM (power of 2) */
+#define FAT_LOG_BURST_SECTORS     (u32)4               /* Buffered sectors that start a multi-block write */
+#define FAT_LOG_CHECKPOINT_MS     (u32)2000            /* Longest time between log checkpoints = most data lost on power failure */
+
+/* Boot sector / BIOS parameter block */
+#define FAT_BOOT_SIGNATURE_INDEX  (u16)510
+#define FAT_BOOT_SIGNATURE_0      (u8)0x55
+#define FAT_BOOT_SIGNATURE_1      (u8)0xAA
+#define FAT_BOOT_JUMP_SHORT       (u8)0xEB             /* First byte of a boot sector is a jump instruction */
+#define FAT_BOOT_JUMP_NEAR        (u8)0xE9
+#define FAT_BPB_BYTES_PER_SECTOR  (u16)11
+#define FAT_BPB_SECTORS_PER_CLUS  (u16)13
+#define FAT_BPB_RESERVED_SECTORS  (u16)14
+#define FAT_BPB_NUMBER_OF_FATS    (u16)16
+#define FAT_BPB_ROOT_ENTRIES      (u16)17
+#define FAT_BPB_TOTAL_SECTORS_16  (u16)19
+#define FAT_BPB_FAT_SIZE_16       (u16)22
+#define FAT_BPB_TOTAL_SECTORS_32  (u16)32
+#define FAT_BPB_FAT_SIZE_32       (u16)36
+#define FAT_BPB_ROOT_CLUSTER      (u16)44
+
+/* Master boot record */
+#define FAT_MBR_PARTITION_TABLE   (u16)446
+#define FAT_MBR_PARTITION_SIZE    (u16)16
+#define FAT_MBR_PARTITIONS        (u8)4
+#define FAT_PARTITION_TYPE_INDEX  (u8)4
+#define FAT_PARTITION_LBA_INDEX   (u8)8
+
+#define FAT_PARTITION_FAT16_SMALL (u8)0x04
+#define FAT_PARTITION_FAT16       (u8)0x06
+#define FAT_PARTITION_FAT32_CHS   (u8)0x0B
+#define FAT_PARTITION_FAT32_LBA   (u8)0x0C
+#define FAT_PARTITION_FAT16_LBA   (u8)0x0E
+
+/* Directory entries */
+#define FAT_DIR_ENTRY_SIZE        (u16)32
+#define FAT_DIR_ENTRIES_PER_SECTOR (u16)(FAT_SECTOR_SIZE / FAT_DIR_ENTRY_SIZE)
+#define FAT_DIR_ATTRIBUTES        (u8)11
+#define FAT_DIR_CLUSTER_HI        (u8)20
+#define FAT_DIR_CLUSTER_LO        (u8)26
+#define FAT_DIR_FILE_SIZE         (u8)28
+
+#define FAT_DIR_END               (u8)0x00             /* First name byte of the entry after the last one */
+#define FAT_DIR_DELETED           (u8)0xE5             /* First name byte of a deleted entry */
+#define FAT_ATTR_VOLUME_ID        (u8)0x08             /* Also set in long file name entries */
+#define FAT_ATTR_DIRECTORY        (u8)0x10
+#define FAT_ATTR_ARCHIVE          (u8)0x20
+
+/* FAT Error Codes */
+#define FAT_ERROR_NONE            (u8)0x00      /* No error */
+#define FAT_ERROR_NO_FILESYSTEM   (u8)0x01      /* No FAT16/FAT32 volume on the card */
+#define FAT_ERROR_DISK            (u8)0x02      /* The SD card did not deliver a sector */
+#define FAT_ERROR_NOT_FOUND       (u8)0x03      /* A path component does not exist */
+#define FAT_ERROR_BAD_PATH        (u8)0x04      /* The path is not made of 8.3 names */
+#define FAT_ERROR_BAD_CHAIN       (u8)0x05      /* A cluster chain ends before the file does */
+#define FAT_ERROR_EXISTS          (u8)0x06      /* FatLogOpen() found a file with the same name */
+#define FAT_ERROR_DIR_FULL        (u8)0x07      /* No free entry in the directory (directories are not extended) */
+#define FAT_ERROR_FULL            (u8)0x08      /* No contiguous run of free clusters large enough */
+
+
+/**********************************************************************************************************************
+* Function Declarations
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Public functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+FatStatusType FatGetStatus(void);
+u8 FatGetError(void);
+bool FatOpen(u8* pu8Path_);
+bool FatRead(u8* pu8Destination_, u32 u32Size_);
+bool FatSeek(u32 u32Position_);
+void FatClose(void);
+u32 FatGetBytesRead(void);
+u32 FatGetFileSize(void);
+u32 FatGetPosition(void);
+
+bool FatLogOpen(u8* pu8Path_, u32 u32MaxSize_);
+bool FatLogWrite(u8* pu8Data_, u32 u32Size_);
+bool FatLogCheckpoint(void);
+bool FatLogClose(void);
+bool FatLogIsOpen(void);
+u8* FatBorrowLogBuffer(u32 u32Size_);
+void FatReturnLogBuffer(void);
+
+bool FatFlush(void);
+void FatGetCacheStats(u32* pu32Hits_, u32* pu32Misses_, u32* pu32WriteBacks_);
+bool FatGetVolumeStart(u32* pu32Sector_);
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Protected functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void FatInitialize(void);
+void FatRunActiveState(void);
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Private functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u16 FatGet16(u8* pu8Data_);
+static u32 FatGet32(u8* pu8Data_);
+static bool FatIsBootSector(u8* pu8Sector_);
+static bool FatParseBootSector(u8* pu8Sector_, u32 u32VolumeStart_);
+static bool FatParseName(u8** ppu8Path_, u8* pu8Name_);
+static u32 FatClusterToSector(u32 u32Cluster_);
+static u32 FatEntrySector(u32 u32Cluster_);
+static u32 FatGetEntry(u8* pu8FatSector_, u32 u32Cluster_);
+static void FatSetEntry(u8* pu8FatSector_, u32 u32Cluster_, u32 u32Value_);
+static void FatReadSectors(u32 u32Sector_, u32 u32Count_, u8* pu8Buffer_, fnCode_type pfNextState_);
+static void FatWriteSector(u32 u32Sector_, u8* pu8Buffer_, fnCode_type pfNextState_);
+static void FatSdCallback(u8* pu8Buffer_, bool bSuccess_);
+static FatCacheEntryType* FatCacheGet(u32 u32Sector_, fnCode_type pfRetryState_);
+static void FatCacheWriteBack(FatCacheEntryType* psEntry_, fnCode_type pfNextState_);
+static void FatCacheFlush(fnCode_type pfNextState_);
+static void FatCacheDiscard(u32 u32Sector_, u32 u32Count_);
+static void FatCacheClear(void);
+static void FatSetChain(u32 u32StartCluster_);
+static void FatPositionChain(u32 u32ClusterIndex_, fnCode_type pfNextState_);
+static void FatOpenEntry(u8* pu8Entry_);
+static void FatAdvance(u32 u32Bytes_);
+static void FatFail(u8 u8ErrorCode_);
+static void FatMountFailed(u8 u8ErrorCode_);
+static void FatUnmount(void);
+static void FatLogFlush(bool bCheckpoint_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void FatSM_NoVolume(void);
+static void FatSM_MountSector0(void);
+static void FatSM_MountPartition(void);
+
+static void FatSM_Idle(void);
+static void FatSM_OpenComponent(void);
+static void FatSM_DirSector(void);
+static void FatSM_DirSectorInCluster(void);
+static void FatSM_DirScan(void);
+static void FatSM_DirEnd(void);
+static void FatSM_ReadData(void);
+static void FatSM_ReadSector(void);
+static void FatSM_ReadDirectDone(void);
+static void FatSM_BadChain(void);
+static void FatSM_FlushDone(void);
+
+static void FatSM_LogFindRun(void);
+static void FatSM_LogCreateEntry(void);
+static void FatSM_LogOpened(void);
+static void FatSM_LogWriteStart(void);
+static void FatSM_LogPutData(void);
+static void FatSM_LogWaitWrite(void);
+static void FatSM_LogCheckpoint(void);
+static void FatSM_LogFatSector(void);
+static void FatSM_LogDirUpdate(void);
+static void FatSM_LogCheckpointDone(void);
+
+static void FatSM_CacheFill(void);
+static void FatSM_CacheFilled(void);
+static void FatSM_CacheWriteBackCopy(void);
+static void FatSM_CacheFlush(void);
+
+static void FatSM_WalkChain(void);
+static void FatSM_WaitSector(void);
+static void FatSM_WaitWrite(void);
+
+
+#endif /* __FAT_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
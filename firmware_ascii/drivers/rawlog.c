@@ -0,0 +1,889 @@
+/**********************************************************************************************************************
+File: rawlog.c
+
+Description:
+Circular log of fixed-size records written straight to a reserved range of SD card blocks with no file system.  It is
+meant for captures (ADC samples, ANT messages) at rates the FAT log cannot sustain: there is no FAT, directory or
+cache traffic, just one multi-block write per page of records through the SD request queue.
+
+The first block of the range is a header that holds the layout (record size, ring size) and a format sequence
+number.  The rest of the range is a ring of pages of RAWLOG_PAGE_BLOCKS blocks.  Every page carries its own page
+sequence number in its first block and again in a trailer at the end of its last block, so a page cut short by a
+power failure is seen as invalid.  Page sequence n is always stored in page n % pages.  Records never span pages;
+the unused end of a page is filled with RAWLOG_PAGE_FILL.
+
+When the log is opened the newest page is found with a binary search over the page sequence numbers: the pages from
+page 0 up to the newest one follow on from the sequence in page 0, and every page after it is either from the
+previous lap or was never written.  That takes about log2(pages) page reads rather than a scan of the whole range.
+If the header does not describe the same layout, the range is formatted with the next format sequence number, which
+makes every old page invalid without erasing it.
+
+The host tool firmware_ascii/tools/rawlog_extract.c reads the records back from a card image in sequence order.
+
+API
+Client applications may use the following functions to access this driver:
+
+RawLogGetStatus() - returns a variable of type RawLogStatusType which may have the following value:
+  RAWLOG_CLOSED: no log is open.
+  RAWLOG_OPENING: the header is being checked and the newest page found (or the range formatted).
+  RAWLOG_READY: records may be written.
+  RAWLOG_ERROR: the log was closed because of an error; RawLogGetError() tells why.
+
+u8 RawLogGetError(void) - returns the RAWLOG_ERROR_ code of the last failure.
+
+bool RawLogOpen(u32 u32FirstBlock_, u32 u32BlockCount_, u16 u16RecordSize_) - starts opening the log in the
+u32BlockCount_ blocks from u32FirstBlock_ (which nothing else may use, e.g. a partition of its own).  Records are
+u16RecordSize_ bytes.  Logging continues after the newest page already there if the header matches, otherwise the
+range is formatted.  Returns TRUE if the request was accepted.
+e.g.
+if( RawLogOpen(u32LogFirstBlock, u32LogBlocks, sizeof(SampleType)) )
+{
+  ...wait for RawLogGetStatus() == RAWLOG_READY...
+}
+
+bool RawLogWrite(u8* pu8Record_) - copies one record to the page being filled.  A full page is written to the card
+by the task.  Returns FALSE (and the record is counted as dropped) if all RAWLOG_PAGE_BUFFERS page buffers are
+waiting for the card.
+
+bool RawLogFlush(void) - ends the page being filled so the records in it go to the card now (the rest of the page
+is left unused).
+
+bool RawLogClose(void) - flushes the log; RawLogGetStatus() returns RAWLOG_CLOSED when every page is on the card.
+
+u32 RawLogGetSequence(void) - returns the sequence number of the page being filled (pages written since the
+range was formatted).
+
+u32 RawLogGetDropped(void) - returns the number of records refused by RawLogWrite() since RawLogOpen().
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemFlags;                  /* From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /* From main.c */
+
+extern volatile u32 G_u32SystemTime1ms;                /* From board-specific source file */
+extern volatile u32 G_u32SystemTime1s;                 /* From board-specific source file */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "RawLog_" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type RawLog_pfStateMachine;          /* The raw log state machine function pointer */
+
+static u32 RawLog_u32Flags;                        /* Application flags for the raw log */
+static RawLogStatusType RawLog_eStatus;            /* Status reported to the client */
+static u8  RawLog_u8ErrorCode;                     /* Error code of the last failure */
+static u32 RawLog_u32Timeout;                      /* Timeout counter used across states */
+
+/* Layout */
+static u32 RawLog_u32FirstBlock;                   /* Header block */
+static u32 RawLog_u32Pages;                        /* Pages in the ring */
+static u16 RawLog_u16RecordSize;                   /* Bytes in each record */
+static u16 RawLog_u16RecordsPerPage;               /* Records that fit in a page */
+static u32 RawLog_u32FormatSequence;               /* Format sequence in the header */
+
+/* Pages (buffer 0 is also used for the header and the probes while opening; bulk buffer placed in RAM1 by
+sam3u2-flash.icf) */
+#pragma location = ".ram1"
+static u8 RawLog_au8Pages[RAWLOG_PAGE_BUFFERS][RAWLOG_PAGE_SIZE]; /* Pages being filled or waiting for the card */
+static u32 RawLog_u32FillSequence;                 /* Sequence of the page being filled */
+static u16 RawLog_u16FillRecords;                  /* Records in the page being filled */
+static u32 RawLog_u32QueueSequence;                /* Next page to hand to the SD queue */
+static u32 RawLog_u32WrittenSequence;              /* Next page to be called back */
+static u32 RawLog_u32Dropped;                      /* Records refused because every buffer was busy */
+
+/* Header and probe requests */
+static u32 RawLog_u32RequestBlock;                 /* First block of the request */
+static u32 RawLog_u32RequestCount;                 /* Blocks in the request */
+static bool RawLog_bRequestWrite;                  /* TRUE to write buffer 0, FALSE to read into it */
+static u8 RawLog_u8RequestsOut;                    /* Requests queued and not yet called back */
+static fnCode_type RawLog_pfRequestReturnState;    /* State to run when the request is done */
+
+/* Newest page search */
+static u32 RawLog_u32SearchBase;                   /* Sequence in page 0 */
+static u32 RawLog_u32SearchLow;                    /* Highest page known to follow on from page 0 */
+static u32 RawLog_u32SearchHigh;                   /* Lowest page known not to (RawLog_u32Pages if none) */
+static u32 RawLog_u32SearchProbe;                  /* Page being read */
+
+static u8 RawLog_au8Formatted[] = "Raw log formatted\n\r";
+static u8 RawLog_au8Resumed[]   = "Raw log resumed at page ";
+
+
+/***********************************************************************************************************************
+Function Definitions
+***********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Public functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogGetStatus
+
+Description:
+Returns the status of the raw log.
+
+Requires:
+  -
+
+Promises:
+  - Returns RawLog_eStatus
+*/
+RawLogStatusType RawLogGetStatus(void)
+{
+  return RawLog_eStatus;
+
+} /* end RawLogGetStatus() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogGetError
+
+Description:
+Returns the reason for the last RAWLOG_ERROR.
+
+Requires:
+  -
+
+Promises:
+  - Returns RawLog_u8ErrorCode
+*/
+u8 RawLogGetError(void)
+{
+  return RawLog_u8ErrorCode;
+
+} /* end RawLogGetError() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogOpen
+
+Description:
+Requests that the log in a reserved block range be opened (or the range formatted).
+
+Requires:
+  - Blocks u32FirstBlock_ to u32FirstBlock_ + u32BlockCount_ - 1 exist on the card and belong to the log only
+
+Promises:
+  - If no log is open, nothing from an earlier log is still queued on the card, a card is present, the record fits
+    in a page and the range holds the header and at least RAWLOG_MIN_PAGES pages: RawLog_eStatus is
+    RAWLOG_OPENING and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool RawLogOpen(u32 u32FirstBlock_, u32 u32BlockCount_, u16 u16RecordSize_)
+{
+  if( ( (RawLog_eStatus == RAWLOG_CLOSED) || (RawLog_eStatus == RAWLOG_ERROR) ) &&
+      (RawLog_u32QueueSequence == RawLog_u32WrittenSequence) && (RawLog_u8RequestsOut == 0) &&
+      (SdGetStatus() != SD_NO_CARD) &&
+      (u16RecordSize_ != 0) && (u16RecordSize_ <= RAWLOG_PAGE_PAYLOAD) &&
+      (u32BlockCount_ >= 1 + (RAWLOG_MIN_PAGES * RAWLOG_PAGE_BLOCKS)) )
+  {
+    RawLog_u32FirstBlock = u32FirstBlock_;
+    RawLog_u32Pages = (u32BlockCount_ - 1) / RAWLOG_PAGE_BLOCKS;
+    RawLog_u16RecordSize = u16RecordSize_;
+    RawLog_u16RecordsPerPage = RAWLOG_PAGE_PAYLOAD / u16RecordSize_;
+    RawLog_u32Dropped = 0;
+    RawLog_u32Flags = 0;
+    RawLog_u8ErrorCode = RAWLOG_ERROR_NONE;
+    RawLog_eStatus = RAWLOG_OPENING;
+
+    RawLogRequest(FALSE, RawLog_u32FirstBlock, 1, RawLogSM_Header);
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end RawLogOpen() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogWrite
+
+Description:
+Adds one record to the page being filled.
+
+Requires:
+  - pu8Record_ points to RawLog_u16RecordSize bytes
+
+Promises:
+  - If the log is ready (and not closing) and the page being filled has a buffer: the record is copied, a full page
+    is passed to the task to write and returns TRUE
+  - If every buffer is waiting for the card: RawLog_u32Dropped is incremented and returns FALSE
+  - Otherwise returns FALSE
+*/
+bool RawLogWrite(u8* pu8Record_)
+{
+  u8* pu8Page;
+
+  if( (RawLog_eStatus != RAWLOG_READY) || (RawLog_u32Flags & _RAWLOG_CLOSE) )
+  {
+    return FALSE;
+  }
+
+  if( (RawLog_u32FillSequence - RawLog_u32WrittenSequence) >= RAWLOG_PAGE_BUFFERS )
+  {
+    RawLog_u32Dropped++;
+    return FALSE;
+  }
+
+  pu8Page = &RawLog_au8Pages[RawLog_u32FillSequence & (RAWLOG_PAGE_BUFFERS - 1)][0];
+  memcpy(&pu8Page[RAWLOG_PAGE_HEADER_SIZE + (RawLog_u16FillRecords * RawLog_u16RecordSize)],
+         pu8Record_, RawLog_u16RecordSize);
+  RawLog_u16FillRecords++;
+
+  if(RawLog_u16FillRecords == RawLog_u16RecordsPerPage)
+  {
+    RawLogClosePage();
+  }
+
+  return TRUE;
+
+} /* end RawLogWrite() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogFlush
+
+Description:
+Ends the page being filled so it is written now.
+
+Requires:
+  -
+
+Promises:
+  - If the log is ready: a page holding any records is passed to the task to write and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool RawLogFlush(void)
+{
+  if(RawLog_eStatus == RAWLOG_READY)
+  {
+    if(RawLog_u16FillRecords != 0)
+    {
+      RawLogClosePage();
+    }
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end RawLogFlush() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogClose
+
+Description:
+Flushes the log and closes it once every page is on the card.  RawLogWrite() is refused from now on.
+
+Requires:
+  -
+
+Promises:
+  - If the log is ready: the page being filled is flushed, _RAWLOG_CLOSE is set and returns TRUE
+  - Otherwise returns FALSE
+*/
+bool RawLogClose(void)
+{
+  if( RawLogFlush() )
+  {
+    RawLog_u32Flags |= _RAWLOG_CLOSE;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end RawLogClose() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogGetSequence
+
+Description:
+Returns the sequence number of the page being filled.
+
+Requires:
+  -
+
+Promises:
+  - Returns RawLog_u32FillSequence
+*/
+u32 RawLogGetSequence(void)
+{
+  return RawLog_u32FillSequence;
+
+} /* end RawLogGetSequence() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogGetDropped
+
+Description:
+Returns the number of records refused because the card could not keep up.
+
+Requires:
+  -
+
+Promises:
+  - Returns RawLog_u32Dropped
+*/
+u32 RawLogGetDropped(void)
+{
+  return RawLog_u32Dropped;
+
+} /* end RawLogGetDropped() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Protected functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: RawLogInitialize
+
+Description:
+Initializes the raw log task.  Nothing is read from the card until RawLogOpen().
+
+Requires:
+  -
+
+Promises:
+  - RawLog_eStatus is RAWLOG_CLOSED and the state machine is idle
+*/
+void RawLogInitialize(void)
+{
+  u8 au8RawLogStartedMsg[] = "Raw log task ready\n\r";
+
+  RawLog_u32Flags = 0;
+  RawLog_eStatus = RAWLOG_CLOSED;
+  RawLog_u8ErrorCode = RAWLOG_ERROR_NONE;
+  RawLog_u32FillSequence = 0;
+  RawLog_u32QueueSequence = 0;
+  RawLog_u32WrittenSequence = 0;
+  RawLog_u8RequestsOut = 0;
+  RawLog_pfStateMachine = RawLogSM_Closed;
+
+  DebugPrintf(au8RawLogStartedMsg);
+  G_u32ApplicationFlags |= _APPLICATION_FLAGS_RAWLOG;
+
+} /* end RawLogInitialize() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function RawLogRunActiveState()
+
+Description:
+Selects and runs one iteration of the current state in the state machine.
+All state machines have a TOTAL of 1ms to execute, so on average n state machines
+may take 1ms / n to execute.
+
+Requires:
+  - State machine function pointer points at current state
+
+Promises:
+  - Closes the log with RAWLOG_ERROR_NO_CARD if the card has been removed
+  - Calls the function to pointed by the state machine function pointer
+*/
+void RawLogRunActiveState(void)
+{
+  if( ( (RawLog_eStatus == RAWLOG_OPENING) || (RawLog_eStatus == RAWLOG_READY) ) &&
+      (SdGetStatus() == SD_NO_CARD) )
+  {
+    RawLogFail(RAWLOG_ERROR_NO_CARD);
+  }
+
+  RawLog_pfStateMachine();
+
+} /* end RawLogRunActiveState */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Private functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogGet16 / RawLogGet32 / RawLogPut16 / RawLogPut32
+
+Description:
+Read and write the little-endian values in the header and page headers.
+
+Requires:
+  - pu8Data_ points to the least significant byte
+
+Promises:
+  - Returns or stores the value
+*/
+static u16 RawLogGet16(u8* pu8Data_)
+{
+  return( (u16)pu8Data_[0] | ((u16)pu8Data_[1] << 8) );
+
+} /* end RawLogGet16() */
+
+static u32 RawLogGet32(u8* pu8Data_)
+{
+  return( (u32)pu8Data_[0]         | ((u32)pu8Data_[1] << 8) |
+         ((u32)pu8Data_[2] << 16) | ((u32)pu8Data_[3] << 24) );
+
+} /* end RawLogGet32() */
+
+static void RawLogPut16(u8* pu8Data_, u16 u16Value_)
+{
+  pu8Data_[0] = (u8)u16Value_;
+  pu8Data_[1] = (u8)(u16Value_ >> 8);
+
+} /* end RawLogPut16() */
+
+static void RawLogPut32(u8* pu8Data_, u32 u32Value_)
+{
+  pu8Data_[0] = (u8)u32Value_;
+  pu8Data_[1] = (u8)(u32Value_ >> 8);
+  pu8Data_[2] = (u8)(u32Value_ >> 16);
+  pu8Data_[3] = (u8)(u32Value_ >> 24);
+
+} /* end RawLogPut32() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogPageBlock
+
+Description:
+Finds where a page is stored.
+
+Requires:
+  - The layout is loaded
+
+Promises:
+  - Returns the first block of the page that holds page sequence u32Sequence_
+*/
+static u32 RawLogPageBlock(u32 u32Sequence_)
+{
+  return( RawLog_u32FirstBlock + 1 + ((u32Sequence_ % RawLog_u32Pages) * RAWLOG_PAGE_BLOCKS) );
+
+} /* end RawLogPageBlock() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogProbeValid
+
+Description:
+Checks the page read into buffer 0.
+
+Requires:
+  - A whole page has been read into RawLog_au8Pages[0]
+
+Promises:
+  - Returns TRUE and loads *pu32Sequence_ if the page was completely written under the current format with the
+    current record size
+  - Otherwise returns FALSE
+*/
+static bool RawLogProbeValid(u32* pu32Sequence_)
+{
+  u8* pu8Page = &RawLog_au8Pages[0][0];
+  u8* pu8Trailer = &RawLog_au8Pages[0][RAWLOG_PAGE_SIZE - RAWLOG_PAGE_TRAILER_SIZE];
+
+  if( (RawLogGet32(&pu8Page[RAWLOG_PAGE_MAGIC_INDEX]) != RAWLOG_PAGE_MAGIC) ||
+      (RawLogGet32(&pu8Page[RAWLOG_PAGE_FORMAT_INDEX]) != RawLog_u32FormatSequence) ||
+      (RawLogGet16(&pu8Page[RAWLOG_PAGE_RECORD_INDEX]) != RawLog_u16RecordSize) ||
+      (RawLogGet16(&pu8Page[RAWLOG_PAGE_COUNT_INDEX]) > RawLog_u16RecordsPerPage) )
+  {
+    return FALSE;
+  }
+
+  /* A page cut short by a power failure has a stale or blank trailer */
+  *pu32Sequence_ = RawLogGet32(&pu8Page[RAWLOG_PAGE_SEQUENCE_INDEX]);
+  return( (RawLogGet32(&pu8Trailer[0]) == *pu32Sequence_) &&
+          (RawLogGet32(&pu8Trailer[4]) == RawLog_u32FormatSequence) );
+
+} /* end RawLogProbeValid() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogRequest
+
+Description:
+Sets up a header or probe transfer through buffer 0.
+
+Requires:
+  - Buffer 0 is not holding a page (the log is opening)
+
+Promises:
+  - RawLogSM_WaitBlocks queues the transfer, then runs pfNextState_ when it is done
+*/
+static void RawLogRequest(bool bWrite_, u32 u32Block_, u32 u32Count_, fnCode_type pfNextState_)
+{
+  RawLog_bRequestWrite = bWrite_;
+  RawLog_u32RequestBlock = u32Block_;
+  RawLog_u32RequestCount = u32Count_;
+  RawLog_pfRequestReturnState = pfNextState_;
+  RawLog_u32Timeout = G_u32SystemTime1ms;
+  RawLog_pfStateMachine = RawLogSM_WaitBlocks;
+
+} /* end RawLogRequest() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogClosePage
+
+Description:
+Completes the page being filled with its header, fill bytes and trailer.
+
+Requires:
+  - The page being filled has a buffer
+
+Promises:
+  - The page is ready for RawLogSM_Ready to write and RawLog_u32FillSequence moves to the next page
+*/
+static void RawLogClosePage(void)
+{
+  u8* pu8Page = &RawLog_au8Pages[RawLog_u32FillSequence & (RAWLOG_PAGE_BUFFERS - 1)][0];
+  u16 u16Used = RAWLOG_PAGE_HEADER_SIZE + (RawLog_u16FillRecords * RawLog_u16RecordSize);
+
+  memset(&pu8Page[u16Used], RAWLOG_PAGE_FILL, RAWLOG_PAGE_SIZE - RAWLOG_PAGE_TRAILER_SIZE - u16Used);
+
+  RawLogPut32(&pu8Page[RAWLOG_PAGE_MAGIC_INDEX], RAWLOG_PAGE_MAGIC);
+  RawLogPut32(&pu8Page[RAWLOG_PAGE_FORMAT_INDEX], RawLog_u32FormatSequence);
+  RawLogPut32(&pu8Page[RAWLOG_PAGE_SEQUENCE_INDEX], RawLog_u32FillSequence);
+  RawLogPut16(&pu8Page[RAWLOG_PAGE_COUNT_INDEX], RawLog_u16FillRecords);
+  RawLogPut16(&pu8Page[RAWLOG_PAGE_RECORD_INDEX], RawLog_u16RecordSize);
+  RawLogPut32(&pu8Page[RAWLOG_PAGE_SIZE - RAWLOG_PAGE_TRAILER_SIZE], RawLog_u32FillSequence);
+  RawLogPut32(&pu8Page[RAWLOG_PAGE_SIZE - RAWLOG_PAGE_TRAILER_SIZE + 4], RawLog_u32FormatSequence);
+
+  RawLog_u32FillSequence++;
+  RawLog_u16FillRecords = 0;
+
+} /* end RawLogClosePage() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogSdCallback
+
+Description:
+SD request queue callback for header and probe transfers (called from the SD task).
+
+Requires:
+  -
+
+Promises:
+  - RawLog_u8RequestsOut is decremented
+  - If a request is outstanding, _RAWLOG_SD_DONE is set and _RAWLOG_SD_FAILED is set too if bSuccess_ is FALSE
+*/
+static void RawLogSdCallback(u8* pu8Buffer_, bool bSuccess_)
+{
+  RawLog_u8RequestsOut--;
+
+  if(RawLog_u32Flags & _RAWLOG_SD_REQUESTED)
+  {
+    RawLog_u32Flags |= _RAWLOG_SD_DONE;
+    if(!bSuccess_)
+    {
+      RawLog_u32Flags |= _RAWLOG_SD_FAILED;
+    }
+  }
+
+} /* end RawLogSdCallback() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogPageCallback
+
+Description:
+SD request queue callback for page writes (called from the SD task in the order the pages were queued).
+
+Requires:
+  -
+
+Promises:
+  - RawLog_u32WrittenSequence is incremented so the page buffer can be filled again
+  - _RAWLOG_PAGE_FAILED is set if bSuccess_ is FALSE
+*/
+static void RawLogPageCallback(u8* pu8Buffer_, bool bSuccess_)
+{
+  RawLog_u32WrittenSequence++;
+
+  if(!bSuccess_)
+  {
+    RawLog_u32Flags |= _RAWLOG_PAGE_FAILED;
+  }
+
+} /* end RawLogPageCallback() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogFail
+
+Description:
+Closes the log after an error.  Pages not yet on the card are lost.
+
+Requires:
+  -
+
+Promises:
+  - RawLog_u8ErrorCode is loaded, RawLog_eStatus is RAWLOG_ERROR and the state machine is idle
+  - Transfers still queued are left to call back
+*/
+static void RawLogFail(u8 u8ErrorCode_)
+{
+  RawLog_u32Flags = 0;
+  RawLog_u8ErrorCode = u8ErrorCode_;
+  RawLog_eStatus = RAWLOG_ERROR;
+  RawLog_pfStateMachine = RawLogSM_Closed;
+
+} /* end RawLogFail() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: RawLogStart
+
+Description:
+Makes the log ready to take records.
+
+Requires:
+  - The header is on the card
+
+Promises:
+  - The next page written is page sequence u32NextSequence_, RawLog_eStatus is RAWLOG_READY
+*/
+static void RawLogStart(u32 u32NextSequence_)
+{
+  RawLog_u32FillSequence = u32NextSequence_;
+  RawLog_u32QueueSequence = u32NextSequence_;
+  RawLog_u32WrittenSequence = u32NextSequence_;
+  RawLog_u16FillRecords = 0;
+  RawLog_eStatus = RAWLOG_READY;
+  RawLog_pfStateMachine = RawLogSM_Ready;
+
+} /* end RawLogStart() */
+
+
+/***********************************************************************************************************************
+State Machine Function Definitions
+***********************************************************************************************************************/
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* No log is open */
+static void RawLogSM_Closed(void)
+{
+
+} /* end RawLogSM_Closed() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Queue the header or probe transfer, then wait for it.  The SD task always calls back, so only a full queue is
+timed. */
+static void RawLogSM_WaitBlocks(void)
+{
+  bool bQueued;
+
+  if( !(RawLog_u32Flags & _RAWLOG_SD_REQUESTED) )
+  {
+    if(RawLog_bRequestWrite)
+    {
+      bQueued = SdQueueWrite(RawLog_u32RequestBlock, RawLog_u32RequestCount, &RawLog_au8Pages[0][0], RawLogSdCallback);
+    }
+    else
+    {
+      bQueued = SdQueueRead(RawLog_u32RequestBlock, RawLog_u32RequestCount, &RawLog_au8Pages[0][0], RawLogSdCallback);
+    }
+
+    if(bQueued)
+    {
+      RawLog_u8RequestsOut++;
+      RawLog_u32Flags |= _RAWLOG_SD_REQUESTED;
+    }
+    else if( IsTimeUp(&RawLog_u32Timeout, RAWLOG_SD_TIMEOUT_MS) )
+    {
+      RawLogFail(RAWLOG_ERROR_DISK);
+    }
+    return;
+  }
+
+  if(RawLog_u32Flags & _RAWLOG_SD_DONE)
+  {
+    if(RawLog_u32Flags & _RAWLOG_SD_FAILED)
+    {
+      RawLogFail(RAWLOG_ERROR_DISK);
+      return;
+    }
+
+    RawLog_u32Flags &= ~(_RAWLOG_SD_REQUESTED | _RAWLOG_SD_DONE);
+    RawLog_pfStateMachine = RawLog_pfRequestReturnState;
+  }
+
+} /* end RawLogSM_WaitBlocks() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The header block is in buffer 0: keep the log if it has the same layout, otherwise format the range */
+static void RawLogSM_Header(void)
+{
+  u8* pu8Header = &RawLog_au8Pages[0][0];
+
+  if( (RawLogGet32(&pu8Header[RAWLOG_HEADER_MAGIC_INDEX]) == RAWLOG_HEADER_MAGIC) &&
+      (RawLogGet16(&pu8Header[RAWLOG_HEADER_CRC_INDEX]) == Crc16Ccitt(pu8Header, RAWLOG_HEADER_CRC_INDEX)) &&
+      (RawLogGet16(&pu8Header[RAWLOG_HEADER_VERSION_INDEX]) == RAWLOG_VERSION) &&
+      (RawLogGet16(&pu8Header[RAWLOG_HEADER_RECORD_INDEX]) == RawLog_u16RecordSize) &&
+      (RawLogGet16(&pu8Header[RAWLOG_HEADER_PAGE_BLOCKS_INDEX]) == RAWLOG_PAGE_BLOCKS) &&
+      (RawLogGet32(&pu8Header[RAWLOG_HEADER_FIRST_INDEX]) == RawLog_u32FirstBlock) &&
+      (RawLogGet32(&pu8Header[RAWLOG_HEADER_PAGES_INDEX]) == RawLog_u32Pages) )
+  {
+    RawLog_u32FormatSequence = RawLogGet32(&pu8Header[RAWLOG_HEADER_FORMAT_INDEX]);
+    RawLogRequest(FALSE, RawLogPageBlock(0), RAWLOG_PAGE_BLOCKS, RawLogSM_FirstPage);
+    return;
+  }
+
+  /* A new format sequence makes every page already in the range invalid */
+  RawLog_u32FormatSequence = RawLogGet32(&pu8Header[RAWLOG_HEADER_FORMAT_INDEX]) + 1;
+
+  memset(pu8Header, 0, SD_BLOCK_SIZE);
+  RawLogPut32(&pu8Header[RAWLOG_HEADER_MAGIC_INDEX], RAWLOG_HEADER_MAGIC);
+  RawLogPut16(&pu8Header[RAWLOG_HEADER_VERSION_INDEX], RAWLOG_VERSION);
+  RawLogPut16(&pu8Header[RAWLOG_HEADER_RECORD_INDEX], RawLog_u16RecordSize);
+  RawLogPut16(&pu8Header[RAWLOG_HEADER_PAGE_BLOCKS_INDEX], RAWLOG_PAGE_BLOCKS);
+  RawLogPut32(&pu8Header[RAWLOG_HEADER_FIRST_INDEX], RawLog_u32FirstBlock);
+  RawLogPut32(&pu8Header[RAWLOG_HEADER_PAGES_INDEX], RawLog_u32Pages);
+  RawLogPut32(&pu8Header[RAWLOG_HEADER_FORMAT_INDEX], RawLog_u32FormatSequence);
+  RawLogPut16(&pu8Header[RAWLOG_HEADER_CRC_INDEX], Crc16Ccitt(pu8Header, RAWLOG_HEADER_CRC_INDEX));
+
+  RawLogRequest(TRUE, RawLog_u32FirstBlock, 1, RawLogSM_Formatted);
+
+} /* end RawLogSM_Header() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The new header is on the card: start from page 0 */
+static void RawLogSM_Formatted(void)
+{
+  DebugPrintf(RawLog_au8Formatted);
+  RawLogStart(0);
+
+} /* end RawLogSM_Formatted() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Page 0 is in buffer 0.  If it is valid, its sequence is the base of the search.  If not, either nothing has been
+written or the write of page 0 was cut short after a full lap, in which case the last page is the newest. */
+static void RawLogSM_FirstPage(void)
+{
+  u32 u32Sequence;
+
+  if( RawLogProbeValid(&u32Sequence) && ((u32Sequence % RawLog_u32Pages) == 0) )
+  {
+    RawLog_u32SearchBase = u32Sequence;
+    RawLog_u32SearchLow = 0;
+    RawLog_u32SearchHigh = RawLog_u32Pages;
+    RawLog_pfStateMachine = RawLogSM_Search;
+    return;
+  }
+
+  RawLogRequest(FALSE, RawLogPageBlock(RawLog_u32Pages - 1), RAWLOG_PAGE_BLOCKS, RawLogSM_LastPage);
+
+} /* end RawLogSM_FirstPage() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The last page is in buffer 0 */
+static void RawLogSM_LastPage(void)
+{
+  u32 u32Sequence;
+
+  if( RawLogProbeValid(&u32Sequence) && ((u32Sequence % RawLog_u32Pages) == (RawLog_u32Pages - 1)) )
+  {
+    u32Sequence++;
+  }
+  else
+  {
+    u32Sequence = 0;
+  }
+
+  DebugPrintf(RawLog_au8Resumed);
+  DebugPrintNumber(u32Sequence);
+  DebugLineFeed();
+  RawLogStart(u32Sequence);
+
+} /* end RawLogSM_LastPage() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Binary search for the newest page: pages up to RawLog_u32SearchLow follow on from page 0 and pages from
+RawLog_u32SearchHigh do not */
+static void RawLogSM_Search(void)
+{
+  if( (RawLog_u32SearchHigh - RawLog_u32SearchLow) > 1 )
+  {
+    RawLog_u32SearchProbe = RawLog_u32SearchLow + ((RawLog_u32SearchHigh - RawLog_u32SearchLow) / 2);
+    RawLogRequest(FALSE, RawLogPageBlock(RawLog_u32SearchProbe), RAWLOG_PAGE_BLOCKS, RawLogSM_SearchProbe);
+    return;
+  }
+
+  DebugPrintf(RawLog_au8Resumed);
+  DebugPrintNumber(RawLog_u32SearchBase + RawLog_u32SearchLow + 1);
+  DebugLineFeed();
+  RawLogStart(RawLog_u32SearchBase + RawLog_u32SearchLow + 1);
+
+} /* end RawLogSM_Search() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The probed page is in buffer 0 */
+static void RawLogSM_SearchProbe(void)
+{
+  u32 u32Sequence;
+
+  if( RawLogProbeValid(&u32Sequence) &&
+      ((u32Sequence - RawLog_u32SearchBase) == RawLog_u32SearchProbe) )
+  {
+    RawLog_u32SearchLow = RawLog_u32SearchProbe;
+  }
+  else
+  {
+    RawLog_u32SearchHigh = RawLog_u32SearchProbe;
+  }
+
+  RawLog_pfStateMachine = RawLogSM_Search;
+
+} /* end RawLogSM_SearchProbe() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Hand every full page to the SD queue.  Pages next to each other on the card that are queued together go out in
+one multi-block write. */
+static void RawLogSM_Ready(void)
+{
+  if(RawLog_u32Flags & _RAWLOG_PAGE_FAILED)
+  {
+    RawLogFail(RAWLOG_ERROR_DISK);
+    return;
+  }
+
+  /* A full queue is tried again next time; RawLogWrite() drops records if it stays full */
+  while( (RawLog_u32QueueSequence != RawLog_u32FillSequence) &&
+         SdQueueWrite(RawLogPageBlock(RawLog_u32QueueSequence), RAWLOG_PAGE_BLOCKS,
+                      &RawLog_au8Pages[RawLog_u32QueueSequence & (RAWLOG_PAGE_BUFFERS - 1)][0], RawLogPageCallback) )
+  {
+    RawLog_u32QueueSequence++;
+  }
+
+  if( (RawLog_u32Flags & _RAWLOG_CLOSE) && (RawLog_u32WrittenSequence == RawLog_u32FillSequence) )
+  {
+    RawLog_u32Flags = 0;
+    RawLog_eStatus = RAWLOG_CLOSED;
+    RawLog_pfStateMachine = RawLogSM_Closed;
+  }
+
+} /* end RawLogSM_Ready() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,124 @@
+/**********************************************************************************************************************
+File: rawlog.h
+
+Description:
+Header file for rawlog.c
+**********************************************************************************************************************/
+
+#ifndef __RAWLOG_H
+#define __RAWLOG_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+typedef enum {RAWLOG_CLOSED, RAWLOG_OPENING, RAWLOG_READY, RAWLOG_ERROR} RawLogStatusType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+/* RawLog_u32Flags */
+#define _RAWLOG_SD_REQUESTED      (u32)0x00000001      /* Set while a header or probe request is queued on the SD card */
+#define _RAWLOG_SD_DONE           (u32)0x00000002      /* Set by RawLogSdCallback() when that request is finished */
+#define _RAWLOG_SD_FAILED         (u32)0x00000004      /* Set by RawLogSdCallback() if that request failed */
+#define _RAWLOG_PAGE_FAILED       (u32)0x00000008      /* Set by RawLogPageCallback() if a page write failed */
+#define _RAWLOG_CLOSE             (u32)0x00000010      /* Set by RawLogClose(); the log closes once every page is written */
+/* end of RawLog_u32Flags */
+
+#define RAWLOG_PAGE_BLOCKS        (u32)2               /* SD blocks in each record page (one multi-block write) */
+#define RAWLOG_PAGE_SIZE          (u32)(RAWLOG_PAGE_BLOCKS * SD_BLOCK_SIZE)
+#define RAWLOG_PAGE_BUFFERS       (u32)4               /* Pages buffered in RAM (power of 2) */
+#define RAWLOG_SD_TIMEOUT_MS      (u32)2000            /* Time to wait for the SD queue to take a header or probe request */
+#define RAWLOG_MIN_PAGES          (u32)2               /* Smallest ring accepted by RawLogOpen() */
+
+/* Header block (first block of the range); all values little-endian */
+#define RAWLOG_HEADER_MAGIC       (u32)0x474F4C52      /* "RLOG" */
+#define RAWLOG_VERSION            (u16)1
+#define RAWLOG_HEADER_MAGIC_INDEX (u16)0
+#define RAWLOG_HEADER_VERSION_INDEX (u16)4
+#define RAWLOG_HEADER_RECORD_INDEX (u16)6              /* Record size in bytes */
+#define RAWLOG_HEADER_PAGE_BLOCKS_INDEX (u16)8         /* RAWLOG_PAGE_BLOCKS when formatted */
+#define RAWLOG_HEADER_FIRST_INDEX (u16)12              /* Block of the header */
+#define RAWLOG_HEADER_PAGES_INDEX (u16)16              /* Pages in the ring */
+#define RAWLOG_HEADER_FORMAT_INDEX (u16)20             /* Format sequence: incremented each time the range is formatted */
+#define RAWLOG_HEADER_CRC_INDEX   (u16)24              /* CRC16 (CCITT) of the bytes before it */
+
+/* Record pages (the blocks after the header); page sequence n is stored in page n % pages */
+#define RAWLOG_PAGE_MAGIC         (u32)0x47415052      /* "RPAG" */
+#define RAWLOG_PAGE_MAGIC_INDEX   (u16)0
+#define RAWLOG_PAGE_FORMAT_INDEX  (u16)4               /* Format sequence of the header the page was written under */
+#define RAWLOG_PAGE_SEQUENCE_INDEX (u16)8              /* Page sequence number */
+#define RAWLOG_PAGE_COUNT_INDEX   (u16)12              /* Records in this page */
+#define RAWLOG_PAGE_RECORD_INDEX  (u16)14              /* Record size in bytes */
+#define RAWLOG_PAGE_HEADER_SIZE   (u16)16              /* Records start here */
+#define RAWLOG_PAGE_TRAILER_SIZE  (u16)8               /* Copy of the page sequence and format sequence in the last block */
+#define RAWLOG_PAGE_PAYLOAD       (u16)(RAWLOG_PAGE_SIZE - RAWLOG_PAGE_HEADER_SIZE - RAWLOG_PAGE_TRAILER_SIZE)
+#define RAWLOG_PAGE_FILL          (u8)0xFF             /* Value of unused payload bytes */
+
+/* Raw log Error Codes */
+#define RAWLOG_ERROR_NONE         (u8)0x00      /* No error */
+#define RAWLOG_ERROR_DISK         (u8)0x01      /* The SD card did not read or write a block */
+#define RAWLOG_ERROR_NO_CARD      (u8)0x02      /* The card was removed while the log was open */
+
+
+/**********************************************************************************************************************
+* Function Declarations
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Public functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+RawLogStatusType RawLogGetStatus(void);
+u8 RawLogGetError(void);
+bool RawLogOpen(u32 u32FirstBlock_, u32 u32BlockCount_, u16 u16RecordSize_);
+bool RawLogWrite(u8* pu8Record_);
+bool RawLogFlush(void);
+bool RawLogClose(void);
+u32 RawLogGetSequence(void);
+u32 RawLogGetDropped(void);
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Protected functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void RawLogInitialize(void);
+void RawLogRunActiveState(void);
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Private functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u16 RawLogGet16(u8* pu8Data_);
+static u32 RawLogGet32(u8* pu8Data_);
+static void RawLogPut16(u8* pu8Data_, u16 u16Value_);
+static void RawLogPut32(u8* pu8Data_, u32 u32Value_);
+static u32 RawLogPageBlock(u32 u32Sequence_);
+static bool RawLogProbeValid(u32* pu32Sequence_);
+static void RawLogRequest(bool bWrite_, u32 u32Block_, u32 u32Count_, fnCode_type pfNextState_);
+static void RawLogClosePage(void);
+static void RawLogSdCallback(u8* pu8Buffer_, bool bSuccess_);
+static void RawLogPageCallback(u8* pu8Buffer_, bool bSuccess_);
+static void RawLogFail(u8 u8ErrorCode_);
+static void RawLogStart(u32 u32NextSequence_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void RawLogSM_Closed(void);
+static void RawLogSM_WaitBlocks(void);
+static void RawLogSM_Header(void);
+static void RawLogSM_Formatted(void);
+static void RawLogSM_FirstPage(void);
+static void RawLogSM_LastPage(void);
+static void RawLogSM_Search(void);
+static void RawLogSM_SearchProbe(void);
+static void RawLogSM_Ready(void);
+
+
+#endif /* __RAWLOG_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
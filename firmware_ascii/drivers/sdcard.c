@@ -20,9 +20,85 @@ bool SdReadBlock(u32 u32SectorAddress_) - initiates read of one 512 byte block o
 Returns TRUE if the card is available and can start reading. 
 User must use SdGetStatus() and wait until the card status is SD_DATA_READY which means the read is done.
 
-bool SdWriteBlock(u32 u32BlockAddress_) - not yet implemented
+bool SdReadBlocks(u32 u32BlockAddress_, u32 u32BlockCount_) - initiates a streaming read (CMD18) of u32BlockCount_
+consecutive blocks.  Blocks are double buffered: each time SdGetStatus() shows SD_DATA_READY, call SdGetReadData()
+to take the next block while the following one is clocked in.  The card state returns to SD_IDLE after the last block
+is taken.  The stream pauses (the SPI clock stops) if the client has not taken a block by the time both buffers are full.
+e.g.
+if(SdGetStatus() == SD_DATA_READY)
+{
+  SdGetReadData(au8Block);
+  ...process au8Block...
+}
+
+bool SdReadBlocksDirect(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Destination_) - like SdReadBlocks() but 
+the blocks are received straight into pu8Destination_ (u32BlockCount_ * 512 bytes) by the PDC with no copy; only the 
+start tokens and CRCs pass through the driver's receive buffer.  The card state is SD_READING until every block is in 
+pu8Destination_ and then SD_IDLE (SD_DATA_READY is not used and SdGetReadData() is not called).
+e.g.
+if(SdGetStatus() == SD_IDLE)
+{
+  ...au8Sectors holds the data...
+}
+
+bool SdWriteBlock(u32 u32BlockAddress_, u8* pu8Source_) - initiates a single block write (CMD24) of the 512 bytes
+at pu8Source_ (copied immediately).  The card state is SD_WRITING until the card has finished programming the block
+and then returns to SD_IDLE.
+
+bool SdWriteBlocks(u32 u32BlockAddress_, u32 u32BlockCount_) - initiates a multi-block write (ACMD23 pre-erase hint,
+then CMD25) of u32BlockCount_ consecutive blocks.  Supply the data one block at a time with SdPutWriteData() which 
+returns FALSE while both block buffers are still waiting to go out.  The stop token is sent after the last block and 
+the card state returns to SD_IDLE when the card is no longer busy.
+e.g.
+if( (SdGetStatus() == SD_WRITING) && (u32BlocksLeft != 0) )
+{
+  if(SdPutWriteData(au8Block))
+  {
+    u32BlocksLeft--;
+  }
+}
+
+bool SdPutWriteData(u8* pu8Source_) - copies the next 512 byte block of a write into a free block buffer.
+
+bool SdGetReadData(u8* pu8Destination_) - transfers the next block of read data to the client.  
+The card state will return to SD_IDLE once all of the requested blocks have been taken.
+
+bool SdQueueRead(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Buffer_, SdRequestCallbackType pfCallback_)
+bool SdQueueWrite(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Buffer_, SdRequestCallbackType pfCallback_)
+Queue a read into (or a write from) pu8Buffer_ instead of waiting for SD_IDLE.  Up to SD_REQUEST_QUEUE_SIZE requests
+from any number of tasks are held and run back-to-back in order.  Requests at the head of the queue in the same 
+direction with consecutive block addresses are merged into one CMD18 / CMD25 transfer: reads are received straight
+into each request's buffer and writes are sent from them.  pfCallback_(pu8Buffer_, bSuccess_) is called from the SD 
+task when the transfer holding the request is finished; the buffer belongs to the driver until then.  The direct API 
+above is refused while a queued transfer runs; each time one finishes, the direct API gets one pass to start before 
+the next queued transfer.
+e.g.
+static void UserAppSdDone(u8* pu8Buffer_, bool bSuccess_)
+{
+  ...pu8Buffer_ holds the data if bSuccess_...
+}
+
+if( SdQueueRead(u32Block, 4, au8Sectors, UserAppSdDone) )
+{
+  ...wait for the callback...
+}
 
-bool SdGetReadData(u8* pu8Destination_) - transfers the read data to the client.  The card state will return to SD_IDLE.
+Reads are chained from the SSP ENDRX interrupt (fnMasterRxCallback): each transfer holds the rest of the current 
+block and a few look-ahead bytes to catch the next start token, so sequential reads are limited by the SPI clock
+rather than the 1ms super loop.  Writes work the same way: each block goes out in one SspTransferData() straight 
+from its buffer together with the data response, and busy polling is chained from the interrupt for up to 
+SD_BUSY_ISR_POLLS polls before the main loop takes over, so a busy card never blocks the super loop.
+
+Every command carries its CRC7 and CRC checking is turned on with CMD59 when the card is initialized (cards that 
+refuse CMD59 run without it).  Each block read is checked against its CRC16 in the interrupt as soon as its CRC bytes
+arrive, and each block written carries its CRC16.  A block that fails (a bad read CRC or a CRC error data response)
+stops the transfer, which is then resumed from that block up to SD_CRC_RETRIES times before SD_CARD_ERROR.
+SdGetCrcErrorCount() counts the failed blocks to show whether the SPI clock is too fast for the hardware.
+
+Multi-block writes are timed with SystemTimeUs() from the write command until the card is no longer busy after the
+stop token, so the time includes ACMD23, the card's programming time and any time spent waiting for the client's
+data.  SdGetWriteThroughput() reports the rate of the last multi-block write and the sustained rate over all of 
+them in KB/s (1000 bytes/s).
 
 
 **********************************************************************************************************************/
@@ -70,6 +146,34 @@ static u32 SD_u32Timeout;                          /* Timeout counter used acros
 static u32 SD_u32CurrentMsgToken;                  /* Token of message currently being sent */
 static u32 SD_u32Address;                          /* Current read/write sector address */
 
+static u8 SD_au8BlockBuffer[SD_STREAM_BUFFERS][SD_FRAME_SIZE]; /* Block frames on their way to the client or the card */
+static u32 SD_u32BlockCount;                       /* Number of blocks in the current read or write */
+static volatile u32 SD_u32BlocksFilled;            /* Blocks put in SD_au8BlockBuffer (by the ISR for reads, the client for writes) */
+static volatile u32 SD_u32BlocksDelivered;         /* Blocks taken out (by the client for reads, written to the card for writes) */
+static volatile bool SD_bStreamRunning;            /* TRUE while reads are chained from the SSP interrupt */
+static volatile bool SD_bStreamError;              /* Set by the ISR if the card sends an error token */
+static volatile bool SD_bStreamCrcError;           /* Set by the ISR if a block fails its CRC16 */
+static u16 SD_u16BlockCrc;                         /* CRC16 received after the current read block */
+static u8 SD_u8CrcRetries;                         /* Retries left for the current transfer */
+static u32 SD_u32CrcErrors;                        /* Blocks that failed their CRC since power up */
+static u32 SD_u32WriteStartTime;                   /* SystemTimeUs() when the current write was started */
+static u32 SD_u32WriteLastRate;                    /* KB/s of the last multi-block write */
+static u32 SD_u32WriteTotalBlocks;                 /* Blocks written by multi-block writes since power up */
+static u32 SD_u32WriteTotalUs;                     /* Time taken by those writes in us */
+static SdStreamPhaseType SD_eStreamPhase;          /* Position in the current block: token, data or CRC */
+static u16 SD_u16StreamIndex;                      /* Bytes received in the current phase */
+static u16 SD_u16StreamChunk;                      /* Size of the read in progress */
+static u8* SD_pu8ReadDestination;                  /* Client buffer for SdReadBlocksDirect() or NULL for buffered reads */
+static u8* SD_pu8ReadBlock;                        /* Client buffer location of the block a direct read is filling */
+static u8 SD_au8ReadIdleBytes[SD_BLOCK_SIZE];      /* 0xFF bytes clocked out while a block is received straight to the client */
+
+static SdRequestType SD_asRequestQueue[SD_REQUEST_QUEUE_SIZE]; /* Queued client requests */
+static u8 SD_u8QueueHead;                          /* Index of the oldest queued request */
+static u8 SD_u8QueueCount;                         /* Number of queued requests (including the running transfer) */
+static u8 SD_u8RunRequests;                        /* Requests merged into the running transfer (0 if none) */
+static u8 SD_u8RunIndex;                           /* Request being read into or written from */
+static u32 SD_u32RunBlock;                         /* Block within SD_asRequestQueue[SD_u8RunIndex] */
+
 static u8 SD_au8CardInMessage[]    = "SD card inserted\n\r";
 static u8 SD_au8SspRequestFailed[] = "SdCard denied SSP\n\r";
 static u8 SD_au8CardReady[]        = "SD ready\n\r";
@@ -80,17 +184,27 @@ static u8 SD_au8CardError2[]       = "CARD_VOLTAGE\n\r ";
 static u8 SD_au8CardError3[]       = "BAD_RESPONSE\n\r ";
 static u8 SD_au8CardError4[]       = "NO_TOKEN\n\r";
 static u8 SD_au8CardError5[]       = "NO_SD_TOKEN\n\r";
+static u8 SD_au8CardError6[]       = "DATA_REJECTED\n\r";
+static u8 SD_au8CardError7[]       = "DATA_CRC\n\r";
 
 
 static u8 SD_au8CMD0[]   = {SD_HOST_CMD | SD_CMD0,  0, 0, 0, 0, SD_CMD0_CRC};
 static u8 SD_au8CMD8[]   = {SD_HOST_CMD | SD_CMD8,  0, 0, SD_VHS_VALUE, SD_CHECK_PATTERN, SD_CMD8_CRC};
 static u8 SD_au8CMD16[]  = {SD_HOST_CMD | SD_CMD16, 0, 0, 0x02, 0x00, SD_NO_CRC};
+static u8 SD_au8CMD12[]  = {SD_HOST_CMD | SD_CMD12, 0, 0, 0, 0, SD_NO_CRC, SD_IDLE_BYTE}; /* Extra byte skips the stuff byte */
 static u8 SD_au8CMD17[]  = {SD_HOST_CMD | SD_CMD17, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD18[]  = {SD_HOST_CMD | SD_CMD18, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD24[]  = {SD_HOST_CMD | SD_CMD24, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD25[]  = {SD_HOST_CMD | SD_CMD25, 0, 0, 0, 0, SD_NO_CRC};
 static u8 SD_au8CMD55[]  = {SD_HOST_CMD | SD_CMD55, 0, 0, 0 ,0, SD_NO_CRC};
 static u8 SD_au8CMD58[]  = {SD_HOST_CMD | SD_CMD58, 0, 0, 0 ,0, SD_NO_CRC};
+static u8 SD_au8CMD59[]  = {SD_HOST_CMD | SD_CMD59, 0, 0, 0 ,1, SD_NO_CRC}; /* CRC on */
 
+static u8 SD_au8ACMD23[] = {SD_HOST_CMD | SD_ACMD23,0, 0, 0, 0, SD_NO_CRC};
 static u8 SD_au8ACMD41[] = {SD_HOST_CMD | SD_ACMD41,0, 0, 0, 0, SD_NO_CRC};
 
+static u8 SD_au8StopTransfer[] = {TOKEN_STOP_BLOCK_MULT, SD_IDLE_BYTE, SD_IDLE_BYTE, SD_IDLE_BYTE}; /* Stop token, stuff byte, busy check */
+
 
 /**********************************************************************************************************************
 Function Definitions
@@ -147,10 +261,18 @@ Requires:
   - SD_CardState up to date.
 
 Promises:
-  - Returns SD_CardState
+  - Returns SD_DATA_READY if a buffered read is in progress and a block is waiting in the buffers
+  - Otherwise returns SD_CardState
 */
 SdCardStateType SdGetStatus(void)
 {
+  /* Blocks are reported as soon as the interrupt has finished them */
+  if( (SD_CardState == SD_READING) && (SD_pu8ReadDestination == NULL) &&
+      (SD_u32BlocksFilled != SD_u32BlocksDelivered) )
+  {
+    return SD_DATA_READY;
+  }
+  
   return SD_CardState;
   
 } /* end SdGetStatus() */
@@ -169,74 +291,209 @@ Requires:
   - u32SectorAddress_ is a valid SD card address
 
 Promises:
-  - If the card is currently SD_IDLE, initiates the read, changes card state to "SD_READING" and returns TRUE.
+  - If the card is currently SD_IDLE (or SD_CARD_ERROR after a failed transfer), initiates the read, 
+    changes card state to "SD_READING" and returns TRUE.
 */
 bool SdReadBlock(u32 u32SectorAddress_)
 {
-  if(SD_CardState == SD_IDLE)
+  return( SdStartRead(u32SectorAddress_, 1, NULL) );
+  
+} /* end SdReadBlock() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdReadBlocks
+
+Description:
+Reads u32BlockCount_ consecutive blocks starting at u32BlockAddress_ with one READ_MULTIPLE_BLOCK command.
+
+Requires:
+  - _SD_TYPE_SD1, _SD_TYPE_SD2, _SD_CARD_HC are correctly set/clear to indicate card type.
+  - u32BlockAddress_ through u32BlockAddress_ + u32BlockCount_ - 1 are valid SD card block addresses
+  - The client calls SdGetReadData() for every block
+
+Promises:
+  - If the card is currently SD_IDLE (or SD_CARD_ERROR) and u32BlockCount_ is not 0, initiates the read, 
+    changes card state to "SD_READING" and returns TRUE.
+*/
+bool SdReadBlocks(u32 u32BlockAddress_, u32 u32BlockCount_)
+{
+  if(u32BlockCount_ == 0)
   {
-    /* Capture the card address of interest with adjustment for byte-accessed cards as required */
-    SD_u32Address = u32SectorAddress_;
-    if( !(SD_u32Flags & _SD_CARD_HC) )
-    {
-      SD_u32Address *= 512;
-    }
-    
-    /* Update the card state which will trigger the start of the read sequence */
-    SD_CardState = SD_READING;
-    return TRUE;
+    return FALSE;
   }
   
-  return FALSE;
+  return( SdStartRead(u32BlockAddress_, u32BlockCount_, NULL) );
   
-} /* end SdReadBlock() */
+} /* end SdReadBlocks() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdReadBlocksDirect
+
+Description:
+Reads u32BlockCount_ consecutive blocks starting at u32BlockAddress_ straight into the client's buffer.  CMD17 is used
+for one block and CMD18 for more, exactly as for SdReadBlocks().
+
+Requires:
+  - _SD_TYPE_SD1, _SD_TYPE_SD2, _SD_CARD_HC are correctly set/clear to indicate card type.
+  - u32BlockAddress_ through u32BlockAddress_ + u32BlockCount_ - 1 are valid SD card block addresses
+  - pu8Destination_ has room for u32BlockCount_ blocks and is not used by the client until the read is done
+
+Promises:
+  - If the card is currently SD_IDLE (or SD_CARD_ERROR), u32BlockCount_ is not 0 and pu8Destination_ is not NULL,
+    initiates the read, changes card state to "SD_READING" and returns TRUE.  The state returns to SD_IDLE when all
+    of the blocks are in pu8Destination_.
+*/
+bool SdReadBlocksDirect(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Destination_)
+{
+  if( (u32BlockCount_ == 0) || (pu8Destination_ == NULL) )
+  {
+    return FALSE;
+  }
+  
+  return( SdStartRead(u32BlockAddress_, u32BlockCount_, pu8Destination_) );
+  
+} /* end SdReadBlocksDirect() */
 
 
 /*----------------------------------------------------------------------------------------------------------------------
 Function: SdWriteBlock
 
 Description:
-Writes a block at the address provided.
+Writes one block at the address provided with CMD24.
 
 Requires:
-  - 
+  - _SD_CARD_HC is correctly set/clear to indicate card type.
+  - u32BlockAddress_ is a valid SD card block address
+  - pu8Source_ points to 512 bytes of data
 
 Promises:
-  - 
+  - If the card is currently SD_IDLE (or SD_CARD_ERROR), the data is copied to a block buffer, the write is 
+    initiated, card state changes to SD_WRITING and returns TRUE.
 */
-bool SdWriteBlock(u32 u32BlockAddress_)
+bool SdWriteBlock(u32 u32BlockAddress_, u8* pu8Source_)
 {
+  if( SdStartWrite(u32BlockAddress_, 1) )
+  {
+    SdPutWriteData(pu8Source_);
+    return TRUE;
+  }
+  
   return FALSE;
     
 } /* end SdWriteBlock() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdWriteBlocks
+
+Description:
+Writes u32BlockCount_ consecutive blocks starting at u32BlockAddress_ with one WRITE_MULTIPLE_BLOCK command.  
+The card is told the block count first (ACMD23) so it can pre-erase.  Data is supplied with SdPutWriteData().
+
+Requires:
+  - _SD_CARD_HC is correctly set/clear to indicate card type.
+  - u32BlockAddress_ through u32BlockAddress_ + u32BlockCount_ - 1 are valid SD card block addresses
+  - The client calls SdPutWriteData() for every block
+
+Promises:
+  - If the card is currently SD_IDLE (or SD_CARD_ERROR) and u32BlockCount_ is not 0, initiates the write, 
+    changes card state to SD_WRITING and returns TRUE.
+*/
+bool SdWriteBlocks(u32 u32BlockAddress_, u32 u32BlockCount_)
+{
+  return( SdStartWrite(u32BlockAddress_, u32BlockCount_) );
+    
+} /* end SdWriteBlocks() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdPutWriteData
+
+Description:
+Copies the next block of a write into a free block buffer.  The block is framed with its start token and CRC16
+so it can be sent to the card in one transfer.
+
+Requires:
+  - pu8Source_ points to 512 bytes of data
+  - A write was started with SdWriteBlocks() (SdWriteBlock() calls this itself)
+
+Promises:
+  - If the card is SD_WRITING, more blocks are expected and a buffer is free: the block is copied, 
+    SD_u32BlocksFilled is incremented and returns TRUE
+  - else returns FALSE
+*/
+bool SdPutWriteData(u8* pu8Source_)
+{
+  u8* pu8Frame;
+  u16 u16Crc;
+  
+  if( (SD_CardState == SD_WRITING) && (SD_u32BlocksFilled != SD_u32BlockCount) &&
+      ( (SD_u32BlocksFilled - SD_u32BlocksDelivered) < SD_STREAM_BUFFERS ) )
+  {
+    pu8Frame = SD_au8BlockBuffer[SD_u32BlocksFilled & (SD_STREAM_BUFFERS - 1)];
+    
+    /* One idle byte before the token, then the token and the data */
+    pu8Frame[0] = SD_IDLE_BYTE;
+    if(SD_u32BlockCount == 1)
+    {
+      pu8Frame[1] = TOKEN_START_BLOCK;
+    }
+    else
+    {
+      pu8Frame[1] = TOKEN_START_BLOCK_MULT;
+    }
+    memcpy(&pu8Frame[SD_FRAME_DATA_INDEX], pu8Source_, SD_BLOCK_SIZE);
+    
+    /* The data response and busy bytes are clocked out as 0xFF; the CRC is ignored while CRC mode is off */
+    memset(&pu8Frame[SD_FRAME_DATA_INDEX + SD_BLOCK_SIZE], SD_IDLE_BYTE, SD_FRAME_SIZE - SD_FRAME_DATA_INDEX - SD_BLOCK_SIZE);
+    if(SD_u32Flags & _SD_CRC_ON)
+    {
+      u16Crc = Crc16Ccitt(&pu8Frame[SD_FRAME_DATA_INDEX], SD_BLOCK_SIZE);
+      pu8Frame[SD_FRAME_DATA_INDEX + SD_BLOCK_SIZE]     = (u8)(u16Crc >> 8);
+      pu8Frame[SD_FRAME_DATA_INDEX + SD_BLOCK_SIZE + 1] = (u8)u16Crc;
+    }
+    
+    SD_u32BlocksFilled++;
+    return TRUE;
+  }
+  
+  return FALSE;
+  
+} /* end SdPutWriteData() */
+
+
 /*----------------------------------------------------------------------------------------------------------------------
 Function: SdGetReadData
 
 Description:
-Transfers the data that was just read from the card.
+Transfers the oldest block that has been read from the card and frees its buffer for the stream.
 
 Requires:
   - pu8Destination points to the start of a 512 byte buffer where the data will be read.
-  - The 512 bytes of data that was just read is at SD_au8RxBuffer[0] thru SD_au8RxBuffer[511] -
-    this will set SD_CardState to SD_DATA_READY.
+  - SdGetStatus() reports SD_DATA_READY
 
 Promises:
-  - if SD_CardState = SD_DATA_READY, loads 512 bytes to pu8Destination_ and returns TRUE
+  - if a block is ready, loads 512 bytes to pu8Destination_ and returns TRUE; SD_CardState returns to 
+    SD_IDLE when the last block of the request has been taken and the state machine has finished the stream
+    (otherwise SdCardSM_StreamData() sets it when it finishes)
   - else returns FALSE
 */
 bool SdGetReadData(u8* pu8Destination_)
 {
-  /* To ensure data integrity, card state must be SD_DATA_READY */
-  if(SD_CardState == SD_DATA_READY)
+  /* To ensure data integrity, a finished block must be waiting */
+  if( (SD_CardState == SD_READING) && (SD_pu8ReadDestination == NULL) &&
+      (SD_u32BlocksFilled != SD_u32BlocksDelivered) )
   {
-    SD_CardState = SD_IDLE;
-
-    for(u16 i = 0; i < 512; i++)
+    memcpy(pu8Destination_, &SD_au8BlockBuffer[SD_u32BlocksDelivered & (SD_STREAM_BUFFERS - 1)][SD_FRAME_DATA_INDEX], SD_BLOCK_SIZE);
+    SD_u32BlocksDelivered++;
+    
+    /* The state machine may still be finishing the stream, and a new request now would reset its counters */
+    if( (SD_u32BlocksDelivered == SD_u32BlockCount) && (SD_u32Flags & _SD_STREAM_FINISHED) )
     {
-      *pu8Destination_ = SD_au8RxBuffer[i];
-      pu8Destination_++;
+      SD_u32Flags &= ~_SD_STREAM_FINISHED;
+      SD_CardState = SD_IDLE;
     }
     
     return TRUE;
@@ -250,6 +507,93 @@ bool SdGetReadData(u8* pu8Destination_)
 } /* end SdGetReadData() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdQueueRead
+
+Description:
+Queues a read of u32BlockCount_ consecutive blocks into pu8Buffer_.  The blocks are received straight into the 
+buffer as for SdReadBlocksDirect().
+
+Requires:
+  - u32BlockAddress_ through u32BlockAddress_ + u32BlockCount_ - 1 are valid SD card block addresses
+  - pu8Buffer_ has room for u32BlockCount_ blocks and is not used by the client until pfCallback_ runs
+
+Promises:
+  - If a card is in, u32BlockCount_ is not 0, pu8Buffer_ is not NULL and the queue has room, the request is 
+    queued and returns TRUE.  pfCallback_ (if not NULL) is called from the SD task when the read is done.
+  - Otherwise returns FALSE
+*/
+bool SdQueueRead(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Buffer_, SdRequestCallbackType pfCallback_)
+{
+  return( SdQueueRequest(FALSE, u32BlockAddress_, u32BlockCount_, pu8Buffer_, pfCallback_) );
+  
+} /* end SdQueueRead() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdQueueWrite
+
+Description:
+Queues a write of u32BlockCount_ consecutive blocks from pu8Buffer_.  Each block is copied to a block buffer by 
+the SD task just before it is sent.
+
+Requires:
+  - u32BlockAddress_ through u32BlockAddress_ + u32BlockCount_ - 1 are valid SD card block addresses
+  - pu8Buffer_ holds u32BlockCount_ blocks and is not changed by the client until pfCallback_ runs
+
+Promises:
+  - If a card is in, u32BlockCount_ is not 0, pu8Buffer_ is not NULL and the queue has room, the request is 
+    queued and returns TRUE.  pfCallback_ (if not NULL) is called from the SD task when the card has programmed
+    the data.
+  - Otherwise returns FALSE
+*/
+bool SdQueueWrite(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Buffer_, SdRequestCallbackType pfCallback_)
+{
+  return( SdQueueRequest(TRUE, u32BlockAddress_, u32BlockCount_, pu8Buffer_, pfCallback_) );
+  
+} /* end SdQueueWrite() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdGetCrcErrorCount
+
+Description:
+Reports how many blocks have failed their CRC (and were retried) since power up.
+
+Requires:
+  - 
+
+Promises:
+  - Returns SD_u32CrcErrors
+*/
+u32 SdGetCrcErrorCount(void)
+{
+  return SD_u32CrcErrors;
+  
+} /* end SdGetCrcErrorCount() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdGetWriteThroughput
+
+Description:
+Reports the measured throughput of multi-block writes.
+
+Requires:
+  - pu32LastKBps_ and pu32SustainedKBps_ point to where the results go
+
+Promises:
+  - *pu32LastKBps_ is the rate of the last multi-block write in KB/s (0 if there has not been one)
+  - *pu32SustainedKBps_ is the rate over all multi-block writes since power up in KB/s
+*/
+void SdGetWriteThroughput(u32* pu32LastKBps_, u32* pu32SustainedKBps_)
+{
+  *pu32LastKBps_ = SD_u32WriteLastRate;
+  *pu32SustainedKBps_ = SdKBps(SD_u32WriteTotalBlocks, SD_u32WriteTotalUs);
+  
+} /* end SdGetWriteThroughput() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Protected Functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -273,6 +617,10 @@ void SdCardInitialize(void)
 
   /* Reset the receive buffer to dummies for a known starting state */
   memset(SD_au8RxBuffer, SSP_DUMMY_BYTE, SDCARD_RX_BUFFER_SIZE);
+  memset(SD_au8ReadIdleBytes, SD_IDLE_BYTE, SD_BLOCK_SIZE);
+  
+  /* CMD12 is sent straight from its array so its CRC is set once */
+  SdSetCommandCrc(SD_au8CMD12);
 
   /* Initailze startup values and the command array */
   SD_pu8RxBufferNextByte = &SD_au8RxBuffer[0];
@@ -286,6 +634,8 @@ void SdCardInitialize(void)
   SD_sSspConfig.u16RxBufferSize    = SDCARD_RX_BUFFER_SIZE;
   SD_sSspConfig.eBitOrder          = MSB_FIRST;
   SD_sSspConfig.eSspMode           = SPI_MASTER_MANUAL_CS;
+  SD_sSspConfig.u32ClockDivider    = 0;  /* SD_US_BRGR_INIT (400 kHz) until the card is initialized */
+  SD_sSspConfig.fnMasterRxCallback = SdStreamCallback;
   
   /* Always start in SdCardSM_IdleNoCard but display different message if card is already in */
   SD_pfStateMachine = SdCardSM_IdleNoCard;
@@ -353,23 +703,852 @@ Promises:
 void SdCommand(u8* pau8Command_)
 {
   /* Queue the transmit message with this command */
+  SdSetCommandCrc(pau8Command_);
   SD_u32CurrentMsgToken = SspWriteData(SD_Ssp, SD_CMD_SIZE, pau8Command_);
   if(SD_u32CurrentMsgToken)
   {
     SspAssertCS(SD_Ssp);
 
-    /* Set up time-outs and next state */
-    SD_u32Timeout = G_u32SystemTime1ms;
-    SD_pfStateMachine = SdCardSM_WaitCommand;
-  }
-  else
+    /* Set up time-outs and next state */
+    SD_u32Timeout = G_u32SystemTime1ms;
+    SD_pfStateMachine = SdCardSM_WaitCommand;
+  }
+  else
+  {
+    /* We didn't get a return token, so abort */
+    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+    SD_pfStateMachine = SdCardSM_Error;
+  }
+    
+} /* end SdCommand() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdStartRead
+
+Description:
+Records a read request for the state machine.
+
+Requires:
+  - u32BlockCount_ is at least 1
+  - pu8Destination_ is the client buffer for a direct read or NULL for a buffered read
+
+Promises:
+  - If the card is SD_IDLE or SD_CARD_ERROR and no queued transfer is running: SD_u32Address holds the card 
+    address (byte address for standard capacity cards), SD_u32BlockCount, SD_pu8ReadDestination and 
+    SD_pu8ReadBlock are loaded, the block counters are reset, _SD_READ_REQUESTED is set, SD_CardState is 
+    SD_READING and returns TRUE
+  - Otherwise returns FALSE
+*/
+static bool SdStartRead(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Destination_)
+{
+  if( (SD_u8RunRequests == 0) &&
+      ( (SD_CardState == SD_IDLE) || (SD_CardState == SD_CARD_ERROR) ) )
+  {
+    /* Capture the card address of interest with adjustment for byte-accessed cards as required */
+    SD_u32Address = u32BlockAddress_;
+    if( !(SD_u32Flags & _SD_CARD_HC) )
+    {
+      SD_u32Address *= SD_BLOCK_SIZE;
+    }
+    
+    /* No stream is running in SD_IDLE so the counters are safe to reset */
+    SD_u32BlockCount      = u32BlockCount_;
+    SD_u32BlocksFilled    = 0;
+    SD_u32BlocksDelivered = 0;
+    SD_pu8ReadDestination = pu8Destination_;
+    SD_pu8ReadBlock       = pu8Destination_;
+    
+    /* Flag the request which will trigger the start of the read sequence */
+    SD_u32Flags &= ~_SD_STREAM_FINISHED;
+    SD_u32Flags |= _SD_READ_REQUESTED;
+    SD_CardState = SD_READING;
+    return TRUE;
+  }
+  
+  return FALSE;
+  
+} /* end SdStartRead() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdStartWrite
+
+Description:
+Records a write request for the state machine.
+
+Requires:
+  - 
+
+Promises:
+  - If the card is SD_IDLE or SD_CARD_ERROR, no queued transfer is running and u32BlockCount_ is not 0: 
+    SD_u32Address holds the card address, SD_u32BlockCount is loaded, the block counters are reset, 
+    _SD_WRITE_REQUESTED is set, SD_CardState is SD_WRITING and returns TRUE
+  - Otherwise returns FALSE
+*/
+static bool SdStartWrite(u32 u32BlockAddress_, u32 u32BlockCount_)
+{
+  if( (u32BlockCount_ != 0) && (SD_u8RunRequests == 0) &&
+      ( (SD_CardState == SD_IDLE) || (SD_CardState == SD_CARD_ERROR) ) )
+  {
+    SD_u32Address = u32BlockAddress_;
+    if( !(SD_u32Flags & _SD_CARD_HC) )
+    {
+      SD_u32Address *= SD_BLOCK_SIZE;
+    }
+    
+    /* The client may start filling buffers before the state machine starts the write */
+    SD_u32BlockCount      = u32BlockCount_;
+    SD_u32BlocksFilled    = 0;
+    SD_u32BlocksDelivered = 0;
+    
+    SD_u32Flags |= _SD_WRITE_REQUESTED;
+    SD_CardState = SD_WRITING;
+    return TRUE;
+  }
+  
+  return FALSE;
+  
+} /* end SdStartWrite() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdSetCommandArgument
+
+Description:
+Loads the 32-bit argument into a command array (MSB first).
+
+Requires:
+  - pau8Command_ points to an SD_CMD_SIZE command array
+
+Promises:
+  - pau8Command_[1] to pau8Command_[4] hold u32Argument_
+*/
+static void SdSetCommandArgument(u8* pau8Command_, u32 u32Argument_)
+{
+  pau8Command_[1] = (u8)(u32Argument_ >> 24);
+  pau8Command_[2] = (u8)(u32Argument_ >> 16);
+  pau8Command_[3] = (u8)(u32Argument_ >> 8);
+  pau8Command_[4] = (u8)u32Argument_;
+  
+} /* end SdSetCommandArgument() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdSetCommandCrc
+
+Description:
+Loads the CRC7 and end bit into the last byte of a command.
+
+Requires:
+  - pau8Command_ points to an SD_CMD_SIZE command array with its argument loaded
+
+Promises:
+  - pau8Command_[SD_CMD_CRC_INDEX] holds (CRC7 << 1) | end bit
+*/
+static void SdSetCommandCrc(u8* pau8Command_)
+{
+  pau8Command_[SD_CMD_CRC_INDEX] = (u8)( (Crc7(pau8Command_, SD_CMD_CRC_INDEX) << 1) | SD_CMD_END_BIT );
+  
+} /* end SdSetCommandCrc() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdBlockAddress
+
+Description:
+Works out the card address u32Blocks_ blocks into the current transfer (to resume it after a CRC error).
+
+Requires:
+  - SD_u32Address holds the card address of the first block of the transfer
+
+Promises:
+  - Returns the command argument for the block (byte address for standard capacity cards)
+*/
+static u32 SdBlockAddress(u32 u32Blocks_)
+{
+  if(SD_u32Flags & _SD_CARD_HC)
+  {
+    return(SD_u32Address + u32Blocks_);
+  }
+  
+  return(SD_u32Address + (u32Blocks_ * SD_BLOCK_SIZE));
+  
+} /* end SdBlockAddress() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdKBps
+
+Description:
+Works out a transfer rate in KB/s (1000 bytes/s, i.e. bytes per ms) without overflowing 32 bits.
+
+Requires:
+  - u32Blocks_ is the number of blocks transferred in u32Us_ microseconds
+
+Promises:
+  - Returns the rate in KB/s (0 if nothing was transferred)
+*/
+static u32 SdKBps(u32 u32Blocks_, u32 u32Us_)
+{
+  u32 u32Bytes = u32Blocks_ * SD_BLOCK_SIZE;
+  
+  if(u32Us_ == 0)
+  {
+    u32Us_ = 1;
+  }
+  
+  /* Small transfers keep full precision; large ones divide the time down instead */
+  if(u32Bytes < (0xFFFFFFFF / 1000))
+  {
+    return( (u32Bytes * 1000) / u32Us_ );
+  }
+  
+  if(u32Us_ < 1000)
+  {
+    u32Us_ = 1000;
+  }
+  return( u32Bytes / (u32Us_ / 1000) );
+  
+} /* end SdKBps() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdWriteTimed
+
+Description:
+Records the time taken by a multi-block write that has just finished.
+
+Requires:
+  - SD_u32BlockCount is the number of blocks written
+  - u32Us_ is the time from the write command to the end of the card's busy time
+
+Promises:
+  - SD_u32WriteLastRate is the rate of this write
+  - The write is added to SD_u32WriteTotalBlocks and SD_u32WriteTotalUs (both are halved before they can overflow
+    so the sustained rate follows the recent writes)
+*/
+static void SdWriteTimed(u32 u32Us_)
+{
+  SD_u32WriteLastRate = SdKBps(SD_u32BlockCount, u32Us_);
+  
+  if( (SD_u32WriteTotalBlocks > 0x00400000) || (SD_u32WriteTotalUs > 0x80000000) )
+  {
+    SD_u32WriteTotalBlocks /= 2;
+    SD_u32WriteTotalUs /= 2;
+  }
+  SD_u32WriteTotalBlocks += SD_u32BlockCount;
+  SD_u32WriteTotalUs += u32Us_;
+  
+} /* end SdWriteTimed() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdStreamChunkSize
+
+Description:
+Works out how many bytes the next streaming read should clock in.
+
+Requires:
+  - SD_eStreamPhase and SD_u16StreamIndex describe the position in the current block
+  - Called from the main loop when the stream is stopped or from SdStreamCallback()
+
+Promises:
+  - Direct reads: returns SD_DIRECT_TOKEN_BYTES while looking for the start token and the rest of the block data
+    while in the data (so the data transfer holds nothing else)
+  - Otherwise returns the bytes left in the current block (start token, data and CRC) plus SD_STREAM_LOOKAHEAD
+    if another block follows and will have a free buffer
+*/
+static u16 SdStreamChunkSize(void)
+{
+  u16 u16Size;
+  
+  if(SD_pu8ReadDestination != NULL)
+  {
+    if(SD_eStreamPhase == SD_STREAM_TOKEN)
+    {
+      return SD_DIRECT_TOKEN_BYTES;
+    }
+    
+    if(SD_eStreamPhase == SD_STREAM_DATA)
+    {
+      return(SD_BLOCK_SIZE - SD_u16StreamIndex);
+    }
+  }
+  
+  switch(SD_eStreamPhase)
+  {
+    case SD_STREAM_TOKEN:
+    {
+      u16Size = 1 + SD_BLOCK_SIZE + SD_DATA_CRC_SIZE;
+      break;
+    }
+    
+    case SD_STREAM_DATA:
+    {
+      u16Size = (SD_BLOCK_SIZE - SD_u16StreamIndex) + SD_DATA_CRC_SIZE;
+      break;
+    }
+    
+    default:
+    {
+      u16Size = SD_DATA_CRC_SIZE - SD_u16StreamIndex;
+      break;
+    }
+  } /* end switch */
+  
+  /* Read into the next block only if there is one and its buffer is already free (always for direct reads) */
+  if( ( (SD_u32BlockCount - SD_u32BlocksFilled) > 1 ) && 
+      ( (SD_pu8ReadDestination != NULL) || (SD_u32BlocksFilled == SD_u32BlocksDelivered) ) )
+  {
+    u16Size += SD_STREAM_LOOKAHEAD;
+  }
+  
+  return u16Size;
+  
+} /* end SdStreamChunkSize() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdStreamRead
+
+Description:
+Starts the next transfer of a streaming read.  For direct reads the block data is received straight into the client
+buffer; everything else goes to SD_au8RxBuffer.
+
+Requires:
+  - The SSP has no read in progress
+  - Called from the main loop when the stream is stopped or from SdStreamCallback()
+
+Promises:
+  - SD_u16StreamChunk is loaded from SdStreamChunkSize() and the transfer is queued
+  - Returns the result of the SSP request
+*/
+static bool SdStreamRead(void)
+{
+  SD_u16StreamChunk = SdStreamChunkSize();
+  
+  if( (SD_pu8ReadDestination != NULL) && (SD_eStreamPhase == SD_STREAM_DATA) )
+  {
+    return( SspReceiveData(SD_Ssp, SD_u16StreamChunk, 
+                           SD_pu8ReadBlock + SD_u16StreamIndex,
+                           SD_au8ReadIdleBytes) );
+  }
+  
+  return( SspReadData(SD_Ssp, SD_u16StreamChunk) );
+  
+} /* end SdStreamRead() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdStreamCallback
+
+Description:
+SSP ENDRX callback (interrupt context).  Parses a finished streaming read and chains the next one.  The bytes
+are sorted into start token (after any 0xFF fill), block data and CRC no matter where the transfer boundaries fall.
+
+Requires:
+  - SD_au8RxBuffer holds SD_u16StreamChunk new bytes from the card, or for a direct read in the data phase the
+    bytes are already in the client buffer
+  - SD_bStreamRunning is TRUE if the read belongs to a stream (other SD reads are ignored)
+
+Promises:
+  - Block data is copied to the free block buffer (or the client buffer for the few data bytes that arrive with a
+    start token in a direct read) and SD_u32BlocksFilled counts each finished block
+  - Direct reads move SD_pu8ReadBlock on to the next block's location after each block
+  - If blocks remain and a buffer is free, the next read is started; otherwise SD_bStreamRunning is cleared
+  - SD_bStreamError is set and the stream stops if the card sends an error token instead of a start token
+  - With CRC mode on, each block is checked when its CRC arrives: SD_bStreamCrcError is set and the stream stops 
+    (without counting the block) if it does not match
+*/
+static void SdStreamCallback(void)
+{
+  u8* pu8Byte = &SD_au8RxBuffer[0];
+  u16 u16Remaining = SD_u16StreamChunk;
+  u16 u16Copy;
+  u8* pu8Block;
+  
+  if(!SD_bStreamRunning)
+  {
+    return;
+  }
+  
+  if(SD_u32Flags & _SD_WRITE_STREAM)
+  {
+    SdWriteStreamCallback();
+    return;
+  }
+  
+  /* A direct data transfer has put the rest of the block in the client buffer: only the CRC is left */
+  if( (SD_pu8ReadDestination != NULL) && (SD_eStreamPhase == SD_STREAM_DATA) )
+  {
+    SD_eStreamPhase = SD_STREAM_CRC;
+    SD_u16StreamIndex = 0;
+    u16Remaining = 0;
+  }
+  
+  while( (u16Remaining != 0) && (SD_u32BlocksFilled != SD_u32BlockCount) )
+  {
+    switch(SD_eStreamPhase)
+    {
+      case SD_STREAM_TOKEN:
+      {
+        if(*pu8Byte == TOKEN_START_BLOCK)
+        {
+          SD_eStreamPhase = SD_STREAM_DATA;
+          SD_u16StreamIndex = 0;
+        }
+        else if(*pu8Byte != SD_IDLE_BYTE)
+        {
+          /* Data error token */
+          SD_bStreamError = TRUE;
+          SD_bStreamRunning = FALSE;
+          return;
+        }
+        
+        pu8Byte++;
+        u16Remaining--;
+        break;
+      }
+      
+      case SD_STREAM_DATA:
+      {
+        /* Copy as much of the block as this transfer holds */
+        u16Copy = SD_BLOCK_SIZE - SD_u16StreamIndex;
+        if(u16Copy > u16Remaining)
+        {
+          u16Copy = u16Remaining;
+        }
+        
+        if(SD_pu8ReadDestination != NULL)
+        {
+          pu8Block = SD_pu8ReadBlock;
+        }
+        else
+        {
+          pu8Block = &SD_au8BlockBuffer[SD_u32BlocksFilled & (SD_STREAM_BUFFERS - 1)][SD_FRAME_DATA_INDEX];
+        }
+        memcpy(&pu8Block[SD_u16StreamIndex], pu8Byte, u16Copy);
+        pu8Byte += u16Copy;
+        u16Remaining -= u16Copy;
+        SD_u16StreamIndex += u16Copy;
+        
+        if(SD_u16StreamIndex == SD_BLOCK_SIZE)
+        {
+          SD_eStreamPhase = SD_STREAM_CRC;
+          SD_u16StreamIndex = 0;
+        }
+        break;
+      }
+      
+      default:
+      {
+        /* The CRC arrives MSB first */
+        SD_u16BlockCrc = (u16)(SD_u16BlockCrc << 8) | *pu8Byte;
+        pu8Byte++;
+        u16Remaining--;
+        SD_u16StreamIndex++;
+        
+        if(SD_u16StreamIndex == SD_DATA_CRC_SIZE)
+        {
+          /* A bad block is not counted so the transfer can be resumed from it */
+          if(SD_u32Flags & _SD_CRC_ON)
+          {
+            if(SD_pu8ReadDestination != NULL)
+            {
+              pu8Block = SD_pu8ReadBlock;
+            }
+            else
+            {
+              pu8Block = &SD_au8BlockBuffer[SD_u32BlocksFilled & (SD_STREAM_BUFFERS - 1)][SD_FRAME_DATA_INDEX];
+            }
+            
+            if(Crc16Ccitt(pu8Block, SD_BLOCK_SIZE) != SD_u16BlockCrc)
+            {
+              SD_bStreamCrcError = TRUE;
+              SD_bStreamRunning = FALSE;
+              return;
+            }
+          }
+          
+          SD_eStreamPhase = SD_STREAM_TOKEN;
+          SD_u16StreamIndex = 0;
+          SD_u32BlocksFilled++;
+          
+          if(SD_pu8ReadDestination != NULL)
+          {
+            SdAdvanceReadBlock();
+          }
+        }
+        break;
+      }
+    } /* end switch */
+  }
+  
+  /* Chain the next read if there are blocks left and a free buffer for them (direct reads never wait) */
+  if( (SD_u32BlocksFilled != SD_u32BlockCount) && 
+      ( (SD_pu8ReadDestination != NULL) || ((SD_u32BlocksFilled - SD_u32BlocksDelivered) < SD_STREAM_BUFFERS) ) )
+  {
+    SdStreamRead();
+  }
+  else
+  {
+    SD_bStreamRunning = FALSE;
+  }
+  
+} /* end SdStreamCallback() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdWriteStreamCallback
+
+Description:
+Write half of SdStreamCallback() (interrupt context).  Checks the data response of a block that was just sent, 
+polls the busy signal and starts the next block or the stop token.
+
+Requires:
+  - SD_au8RxBuffer holds the SD_u16StreamChunk bytes clocked in during the last transfer
+  - SD_eStreamPhase tells what that transfer was
+
+Promises:
+  - A rejected block sets SD_bStreamError (or SD_bStreamCrcError for a CRC error) and stops the stream
+  - An accepted block increments SD_u32BlocksDelivered
+  - While the card is busy, up to SD_BUSY_ISR_POLLS polls are chained before the stream stops for the main loop
+  - Otherwise SdWriteStreamNext() decides what goes out next
+*/
+static void SdWriteStreamCallback(void)
+{
+  u8 u8Response;
+  
+  switch(SD_eStreamPhase)
+  {
+    case SD_STREAM_WRITE:
+    {
+      /* The data response token is the first byte after the CRC */
+      u8Response = SD_au8RxBuffer[SD_FRAME_RESPONSE_INDEX] & SD_DATA_RESPONSE_MASK;
+      if(u8Response != SD_DATA_ACCEPTED)
+      {
+        if(u8Response == SD_DATA_CRC_ERROR)
+        {
+          SD_bStreamCrcError = TRUE;
+        }
+        else
+        {
+          SD_bStreamError = TRUE;
+        }
+        SD_bStreamRunning = FALSE;
+        return;
+      }
+      
+      SD_u32BlocksDelivered++;
+      
+      /* Usually the card is now busy programming the block */
+      if(SD_au8RxBuffer[SD_FRAME_SIZE - 1] != SD_IDLE_BYTE)
+      {
+        SD_eStreamPhase = SD_STREAM_BUSY;
+        SD_u16StreamIndex = 0;
+        SD_u16StreamChunk = SD_WRITE_POLL_BYTES;
+        SD_bStreamRunning = SspReadData(SD_Ssp, SD_u16StreamChunk);
+        return;
+      }
+      break;
+    }
+    
+    case SD_STREAM_BUSY:
+    case SD_STREAM_STOP:
+    {
+      /* The card holds DO low while busy */
+      if(SD_au8RxBuffer[SD_u16StreamChunk - 1] != SD_IDLE_BYTE)
+      {
+        SD_u16StreamIndex++;
+        if(SD_u16StreamIndex < SD_BUSY_ISR_POLLS)
+        {
+          SD_u16StreamChunk = SD_WRITE_POLL_BYTES;
+          SD_bStreamRunning = SspReadData(SD_Ssp, SD_u16StreamChunk);
+        }
+        else
+        {
+          /* Let the main loop run; it restarts the polls */
+          SD_bStreamRunning = FALSE;
+        }
+        return;
+      }
+      
+      /* Not busy after the stop token means the write is finished */
+      if(SD_eStreamPhase == SD_STREAM_STOP)
+      {
+        SD_eStreamPhase = SD_STREAM_DONE;
+        SD_bStreamRunning = FALSE;
+        return;
+      }
+      
+      SD_eStreamPhase = SD_STREAM_WRITE;
+      break;
+    }
+    
+    default:
+    {
+      SD_bStreamRunning = FALSE;
+      return;
+    }
+  } /* end switch */
+  
+  SdWriteStreamNext();
+  
+} /* end SdWriteStreamCallback() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdWriteStreamNext
+
+Description:
+Starts whatever the write stream needs next once the card is not busy: the next block, the stop token, or nothing.
+
+Requires:
+  - The card is not busy and no transfer is in progress
+  - Called from SdWriteStreamCallback() or from the main loop while the stream is stopped
+
+Promises:
+  - If all blocks are written: the stop token is sent for multi-block writes (SD_STREAM_STOP) or 
+    SD_eStreamPhase is SD_STREAM_DONE
+  - Else if the client has filled the next buffer it is sent (SD_STREAM_WRITE)
+  - Else the stream pauses with SD_bStreamRunning FALSE until SdPutWriteData()
+*/
+static void SdWriteStreamNext(void)
+{
+  /* All blocks are written */
+  if(SD_u32BlocksDelivered == SD_u32BlockCount)
+  {
+    if(SD_u32Flags & _SD_MULTI_BLOCK)
+    {
+      SD_eStreamPhase = SD_STREAM_STOP;
+      SD_u16StreamIndex = 0;
+      SD_u16StreamChunk = sizeof(SD_au8StopTransfer);
+      SD_bStreamRunning = SspTransferData(SD_Ssp, SD_u16StreamChunk, SD_au8StopTransfer);
+    }
+    else
+    {
+      SD_eStreamPhase = SD_STREAM_DONE;
+      SD_bStreamRunning = FALSE;
+    }
+    return;
+  }
+  
+  /* Send the next block if the client has filled it */
+  SD_eStreamPhase = SD_STREAM_WRITE;
+  if(SD_u32BlocksFilled != SD_u32BlocksDelivered)
+  {
+    SD_u16StreamChunk = SD_FRAME_SIZE;
+    SD_bStreamRunning = SspTransferData(SD_Ssp, SD_u16StreamChunk, 
+                                        SD_au8BlockBuffer[SD_u32BlocksDelivered & (SD_STREAM_BUFFERS - 1)]);
+  }
+  else
+  {
+    SD_bStreamRunning = FALSE;
+  }
+  
+} /* end SdWriteStreamNext() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdAdvanceReadBlock
+
+Description:
+Moves a direct read on to the client location of its next block (interrupt context).  A merged queued read moves 
+to the next request's buffer when the current request has all of its blocks.
+
+Requires:
+  - A direct read has just finished a block
+  - For queued reads, SD_u8RunIndex and SD_u32RunBlock describe the block that just finished
+
+Promises:
+  - SD_pu8ReadBlock points at the location for the next block
+*/
+static void SdAdvanceReadBlock(void)
+{
+  SD_pu8ReadBlock += SD_BLOCK_SIZE;
+  
+  if(SD_u8RunRequests != 0)
+  {
+    SD_u32RunBlock++;
+    if(SD_u32RunBlock == SD_asRequestQueue[SD_u8RunIndex].u32BlockCount)
+    {
+      SD_u32RunBlock = 0;
+      SD_u8RunIndex = (SD_u8RunIndex + 1) & (SD_REQUEST_QUEUE_SIZE - 1);
+      SD_pu8ReadBlock = SD_asRequestQueue[SD_u8RunIndex].pu8Buffer;
+    }
+  }
+  
+} /* end SdAdvanceReadBlock() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdQueueRequest
+
+Description:
+Adds a read or write request to the end of the queue.
+
+Requires:
+  - Called from the main loop (not from an interrupt)
+
+Promises:
+  - If a card is in, u32BlockCount_ is not 0, pu8Buffer_ is not NULL and there is room, the request is 
+    queued and returns TRUE
+  - Otherwise returns FALSE
+*/
+static bool SdQueueRequest(bool bWrite_, u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Buffer_, SdRequestCallbackType pfCallback_)
+{
+  SdRequestType* psRequest;
+  
+  if( (u32BlockCount_ == 0) || (pu8Buffer_ == NULL) || (SD_CardState == SD_NO_CARD) ||
+      (SD_u8QueueCount == SD_REQUEST_QUEUE_SIZE) )
+  {
+    return FALSE;
+  }
+  
+  psRequest = &SD_asRequestQueue[(SD_u8QueueHead + SD_u8QueueCount) & (SD_REQUEST_QUEUE_SIZE - 1)];
+  psRequest->u32BlockAddress = u32BlockAddress_;
+  psRequest->u32BlockCount   = u32BlockCount_;
+  psRequest->pu8Buffer       = pu8Buffer_;
+  psRequest->pfCallback      = pfCallback_;
+  psRequest->bWrite          = bWrite_;
+  SD_u8QueueCount++;
+  
+  return TRUE;
+  
+} /* end SdQueueRequest() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdQueueStart
+
+Description:
+Starts one transfer for the request at the head of the queue and every following request in the same direction
+whose blocks continue on from it.
+
+Requires:
+  - At least one request is queued and no queued transfer is running
+  - The card is SD_IDLE or SD_CARD_ERROR (otherwise nothing happens)
+
+Promises:
+  - The transfer is started with SdStartRead() or SdStartWrite(), SD_u8RunRequests holds the number of requests
+    merged into it and the first write blocks are put in the block buffers
+*/
+static void SdQueueStart(void)
+{
+  SdRequestType* psFirst = &SD_asRequestQueue[SD_u8QueueHead];
+  SdRequestType* psNext;
+  u32 u32BlockCount = psFirst->u32BlockCount;
+  u8 u8Requests = 1;
+  bool bStarted;
+  
+  /* Merge while the next request picks up where the transfer ends */
+  while(u8Requests != SD_u8QueueCount)
+  {
+    psNext = &SD_asRequestQueue[(SD_u8QueueHead + u8Requests) & (SD_REQUEST_QUEUE_SIZE - 1)];
+    if( (psNext->bWrite != psFirst->bWrite) || 
+        (psNext->u32BlockAddress != (psFirst->u32BlockAddress + u32BlockCount)) )
+    {
+      break;
+    }
+    
+    u32BlockCount += psNext->u32BlockCount;
+    u8Requests++;
+  }
+  
+  if(psFirst->bWrite)
+  {
+    bStarted = SdStartWrite(psFirst->u32BlockAddress, u32BlockCount);
+  }
+  else
+  {
+    bStarted = SdStartRead(psFirst->u32BlockAddress, u32BlockCount, psFirst->pu8Buffer);
+  }
+  
+  if(bStarted)
+  {
+    SD_u8RunIndex = SD_u8QueueHead;
+    SD_u32RunBlock = 0;
+    SD_u8RunRequests = u8Requests;
+    
+    if(psFirst->bWrite)
+    {
+      SdQueueFeedWrite();
+    }
+  }
+  
+} /* end SdQueueStart() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdQueueFeedWrite
+
+Description:
+Puts the next blocks of a queued write in the free block buffers.
+
+Requires:
+  - A queued write is running; SD_u8RunIndex and SD_u32RunBlock describe the next block to put
+
+Promises:
+  - Blocks are taken from the requests in order until the block buffers are full or all blocks are put
+*/
+static void SdQueueFeedWrite(void)
+{
+  SdRequestType* psRequest;
+  
+  while(SD_u32BlocksFilled != SD_u32BlockCount)
+  {
+    psRequest = &SD_asRequestQueue[SD_u8RunIndex];
+    if( !SdPutWriteData(psRequest->pu8Buffer + (SD_u32RunBlock * SD_BLOCK_SIZE)) )
+    {
+      break;
+    }
+    
+    SD_u32RunBlock++;
+    if(SD_u32RunBlock == psRequest->u32BlockCount)
+    {
+      SD_u32RunBlock = 0;
+      SD_u8RunIndex = (SD_u8RunIndex + 1) & (SD_REQUEST_QUEUE_SIZE - 1);
+    }
+  }
+  
+} /* end SdQueueFeedWrite() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdQueueComplete
+
+Description:
+Removes the requests of the finished transfer from the queue and calls their callbacks.
+
+Requires:
+  - SD_u8RunRequests holds the number of requests at the head of the queue to finish
+
+Promises:
+  - The requests are removed, SD_u8RunRequests is 0 and each callback is called with bSuccess_
+  - A callback may queue a new request
+*/
+static void SdQueueComplete(bool bSuccess_)
+{
+  SdRequestType sRequest;
+  u8 u8Requests = SD_u8RunRequests;
+  
+  SD_u8RunRequests = 0;
+  while(u8Requests != 0)
   {
-    /* We didn't get a return token, so abort */
-    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-    SD_pfStateMachine = SdCardSM_Error;
-  }
+    /* Free the slot first so the callback can use it */
+    sRequest = SD_asRequestQueue[SD_u8QueueHead];
+    SD_u8QueueHead = (SD_u8QueueHead + 1) & (SD_REQUEST_QUEUE_SIZE - 1);
+    SD_u8QueueCount--;
+    u8Requests--;
     
-} /* end SdCommand() */
+    if(sRequest.pfCallback != NULL)
+    {
+      sRequest.pfCallback(sRequest.pu8Buffer, bSuccess_);
+    }
+  }
+  
+} /* end SdQueueComplete() */
 
 
 /*--------------------------------------------------------------------------------------------------------------------
@@ -451,6 +1630,12 @@ State Machine Function Definitions
 /* Wait for a card to be inserted */
 static void SdCardSM_IdleNoCard(void)
 {
+  /* Queued requests cannot be done without a card */
+  if(SD_u8QueueCount != 0)
+  {
+    SD_u8RunRequests = SD_u8QueueCount;
+    SdQueueComplete(FALSE);
+  }
 
   if( SdIsCardInserted() )
   {
@@ -726,14 +1911,9 @@ static void SdCardSM_ResponseCMD16(void)
   /* Check the response byte (response R1) */
   if(SD_au8RxBuffer[0] == SD_STATUS_READY)
   {
-    /* Success! Card is ready for read/write operations.  We can release the SSP resource for now. */
-    SspDeAssertCS(SD_Ssp);
-    SspRelease(SD_Ssp);
-
-    SD_CardState = SD_IDLE;
-    DebugPrintf(SD_au8CardReady);
-
-    SD_pfStateMachine = SdCardSM_ReadyIdle;
+    /* Turn on CRC checking */
+    SdCommand(&SD_au8CMD59[0]);
+    SD_pfWaitReturnState = SdCardSM_ResponseCMD59;
   }
   else
   {
@@ -764,13 +1944,9 @@ static void SdCardSM_ReadCMD58(void)
     {
       SD_u32Flags |= _SD_CARD_HC;
       
-      /* Success! Card is ready for read/write operations */
-      SspRelease(SD_Ssp);
-  
-      SD_CardState = SD_IDLE;
-      DebugPrintf(SD_au8CardReady);
-    
-      SD_pfStateMachine = SdCardSM_ReadyIdle;
+      /* Turn on CRC checking */
+      SdCommand(&SD_au8CMD59[0]);
+      SD_pfWaitReturnState = SdCardSM_ResponseCMD59;
     }
     /* For standard capacity, make sure block size is 512 */
     else
@@ -787,6 +1963,30 @@ static void SdCardSM_ReadCMD58(void)
   CheckTimeout(SD_SPI_WAIT_TIME_MS);
      
 } /* end SdCardSM_ReadCMD58() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Process response to CMD59: the card is ready with or without CRC checking */
+static void SdCardSM_ResponseCMD59(void)
+{
+  /* A card that refuses CMD59 still works without CRCs */
+  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  {
+    SD_u32Flags |= _SD_CRC_ON;
+  }
+  
+  /* Success! Card is ready for read/write operations.  We can release the SSP resource for now. */
+  SspDeAssertCS(SD_Ssp);
+  SspRelease(SD_Ssp);
+
+  /* All further transfers run at full speed */
+  SD_sSspConfig.u32ClockDivider = SD_US_BRGR_FAST;
+  SD_CardState = SD_IDLE;
+  DebugPrintf(SD_au8CardReady);
+
+  SD_pfStateMachine = SdCardSM_ReadyIdle;
+       
+} /* end SdCardSM_ResponseCMD59() */
            
 #if 0     
 /*-------------------------------------------------------------------------------------------------------------------*/
@@ -935,10 +2135,21 @@ static void SdCardSM_WaitSSP(void)
 /* SD card is initialized: wait for action request. */
 static void SdCardSM_ReadyIdle(void)          
 {
+  u8* pu8Command;
+  
+  /* A queued transfer is over (or failed): report it and let direct API clients have this pass */
+  if( (SD_u8RunRequests != 0) && (SD_CardState != SD_READING) && (SD_CardState != SD_WRITING) )
+  {
+    SdQueueComplete(SD_CardState == SD_IDLE);
+    return;
+  }
+  
   /* Check if the card is still in; if not return through WaitSSP to allow some debounce time */
   if( !SdIsCardInserted() )
   {
+    /* The next card must be initialized at the slow clock */
     SD_u32Flags &= SD_CLEAR_CARD_TYPE_BITS;
+    SD_sSspConfig.u32ClockDivider = 0;
     
     /* Exit through a wait state for effective debouncing */
     SD_u32Timeout = G_u32SystemTime1ms;
@@ -947,8 +2158,14 @@ static void SdCardSM_ReadyIdle(void)
   }
   else
   {
+    /* Queued requests start when the card is free */
+    if( (SD_u8QueueCount != 0) && (SD_u8RunRequests == 0) )
+    {
+      SdQueueStart();
+    }
+    
     /* Look for a request to read or write file data */
-    if( (SD_CardState == SD_WRITING) || (SD_CardState == SD_READING) )
+    if( SD_u32Flags & (_SD_READ_REQUESTED | _SD_WRITE_REQUESTED) )
     {
       /* Request the SSP resource to talk to the card */
       SD_Ssp = SspRequest(&SD_sSspConfig);
@@ -963,22 +2180,54 @@ static void SdCardSM_ReadyIdle(void)
       else
       {
         /* Got SSP, so start read or write */
-        if(SD_CardState == SD_WRITING)
+        SD_u8CrcRetries = SD_CRC_RETRIES;
+        SD_bStreamCrcError = FALSE;
+        if(SD_u32Flags & _SD_WRITE_REQUESTED)
         {
-          /* Not yet implemented */
-          SD_pfStateMachine = SdCardSM_ReadyIdle;
-          SD_CardState = SD_IDLE;
+          SD_u32Flags &= ~_SD_WRITE_REQUESTED;
+          SD_u32Flags |= _SD_WRITE_STREAM;
+          SD_eStreamPhase = SD_STREAM_WRITE;
+          SD_bStreamError = FALSE;
+          SD_u32WriteStartTime = SystemTimeUs();
+          
+          /* A single block uses CMD24; more blocks tell the card the count (ACMD23) and then use CMD25 */
+          if(SD_u32BlockCount == 1)
+          {
+            SD_u32Flags &= ~_SD_MULTI_BLOCK;
+            SdSetCommandArgument(SD_au8CMD24, SD_u32Address);
+            SdCommand(&SD_au8CMD24[0]);
+            SD_pfWaitReturnState = SdCardSM_ResponseWrite;
+          }
+          else
+          {
+            SD_u32Flags |= _SD_MULTI_BLOCK;
+            SdCommand(&SD_au8CMD55[0]);
+            SD_pfWaitReturnState = SdCardSM_WriteResponseCMD55;
+          }
         }
         else
         {
-          /* Parse out the bytes of the address into the command array */
-          SD_au8CMD17[1] = (u8)(SD_u32Address >> 24);
-          SD_au8CMD17[2] = (u8)(SD_u32Address >> 16);
-          SD_au8CMD17[3] = (u8)(SD_u32Address >> 8);
-          SD_au8CMD17[4] = (u8)SD_u32Address;
+          /* Reset the stream: nothing else touches these while it is stopped */
+          SD_u32Flags &= ~(_SD_READ_REQUESTED | _SD_WRITE_STREAM);
+          SD_eStreamPhase       = SD_STREAM_TOKEN;
+          SD_u16StreamIndex     = 0;
+          SD_bStreamError       = FALSE;
+          
+          /* A single block uses CMD17; more use CMD18 which must be stopped with CMD12 */
+          if(SD_u32BlockCount == 1)
+          {
+            SD_u32Flags &= ~_SD_MULTI_BLOCK;
+            pu8Command = &SD_au8CMD17[0];
+          }
+          else
+          {
+            SD_u32Flags |= _SD_MULTI_BLOCK;
+            pu8Command = &SD_au8CMD18[0];
+          }
           
-          SdCommand(&SD_au8CMD17[0]);
-          SD_pfWaitReturnState = SdCardSM_ResponseCMD17;
+          SdSetCommandArgument(pu8Command, SD_u32Address);
+          SdCommand(pu8Command);
+          SD_pfWaitReturnState = SdCardSM_ResponseRead;
         }
       }
     }
@@ -987,22 +2236,23 @@ static void SdCardSM_ReadyIdle(void)
      
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Start read sequence */
-static void SdCardSM_ResponseCMD17(void)
+/* Check the response to CMD17 or CMD18 and start the stream */
+static void SdCardSM_ResponseRead(void)
 {
   /* Check the response byte (response R1) */
   if(SD_au8RxBuffer[0] == SD_STATUS_READY)
   {
-    /* Queue a read looking to get TOKEN_START_BLOCK back from the card */
-    //SD_u32CurrentMsgToken = SspReadByte(SD_Ssp);
-    if(SspReadByte(SD_Ssp))
+    /* The rest of the read runs from the SSP interrupt */
+    SD_u32Timeout = G_u32SystemTime1ms;
+    SD_bStreamRunning = TRUE;
+    if( SdStreamRead() )
     {
-      SD_u32Timeout = G_u32SystemTime1ms;
-      SD_pfStateMachine = SdCardSM_WaitStartToken;
+      SD_pfStateMachine = SdCardSM_StreamData;
     }
     else
     {
       /* SSP read error - we'll just abort */
+      SD_bStreamRunning = FALSE;
       SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
       SD_pfStateMachine = SdCardSM_Error;
     }
@@ -1014,93 +2264,410 @@ static void SdCardSM_ResponseCMD17(void)
     SD_pfStateMachine = SdCardSM_FailedDataTransfer;
   }
 
-  /* Either way, advance the RxBuffer pointer */  
-  //AdvanceSD_pu8RxBufferParser(1);
-
-} /* end SdCardSM_ResponseCMD17() */
+} /* end SdCardSM_ResponseRead() */
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Look for the returned token that indicates the read or write process has begun */
-static void SdCardSM_WaitStartToken(void)          
+/* Supervise the stream: restart it when the client frees a buffer, stop the card when all blocks are in */
+static void SdCardSM_StreamData(void)
 {
-  /* Check if the SSP peripheral has sent the data request */
-//  if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
-  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+  static u32 u32BlocksSeen = 0;
+  
+  /* Any finished block restarts the timeout */
+  if(SD_u32BlocksFilled != u32BlocksSeen)
+  {
+    u32BlocksSeen = SD_u32BlocksFilled;
+    SD_u32Timeout = G_u32SystemTime1ms;
+  }
+  
+  /* Nothing to do while the interrupt is chaining reads except watch the time */
+  if(SD_bStreamRunning)
   {
-    /* Check the response byte */
-    if(SD_au8RxBuffer[0] == TOKEN_START_BLOCK)
+    if(IsTimeUp(&SD_u32Timeout, SD_SECTOR_READ_TIMEOUT_MS))
     {
-      /* Set the RxBuffer pointers to the start of the RxBuffer so the sector data occupies the beginning */
-      //SD_pu8RxBufferNextByte = &SD_au8RxBuffer[0];
-      //SD_pu8RxBufferParser   = &SD_au8RxBuffer[0];
-      
-      /* Queue a read for the entire sector plus two checksum bytes */
-      /* CS is still asserted since we are reading data */
-      if(SspReadData(SD_Ssp, 514))
+      SD_bStreamRunning = FALSE;
+      SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    }
+    return;
+  }
+  
+  /* The card sent an error token */
+  if(SD_bStreamError)
+  {
+    SD_u8ErrorCode = SD_ERROR_NO_SD_TOKEN;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    return;
+  }
+  
+  /* A block failed its CRC: stop the card and read again from that block */
+  if(SD_bStreamCrcError)
+  {
+    SD_bStreamCrcError = FALSE;
+    SD_u32CrcErrors++;
+    if(SD_u8CrcRetries == 0)
+    {
+      SD_u8ErrorCode = SD_ERROR_DATA_CRC;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+      return;
+    }
+    
+    SD_u8CrcRetries--;
+    SD_u32Flags |= _SD_RETRY;
+    if( !(SD_u32Flags & _SD_MULTI_BLOCK) )
+    {
+      SD_pfStateMachine = SdCardSM_RetryRead;
+      return;
+    }
+  }
+  
+  /* All blocks are in (or the read is being stopped for a retry) */
+  if( (SD_u32BlocksFilled == SD_u32BlockCount) || (SD_u32Flags & _SD_RETRY) )
+  {
+    /* A direct read is finished for the client now; buffered reads finish when the last block is taken */
+    if( !(SD_u32Flags & _SD_RETRY) )
+    {
+      if( (SD_pu8ReadDestination != NULL) || (SD_u32BlocksDelivered == SD_u32BlockCount) )
       {
-        SD_pfStateMachine = SdCardSM_DataTransfer;
+        SD_CardState = SD_IDLE;
       }
       else
       {
-        /* SSP read error - we'll just abort */
-        SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-        SD_pfStateMachine = SdCardSM_Error;
+        SD_u32Flags |= _SD_STREAM_FINISHED;
       }
     }
-    else
+    
+    if(SD_u32Flags & _SD_MULTI_BLOCK)
     {
-      /* Didn't get the start token so retry */
-      if(SspReadByte(SD_Ssp))
+      /* CMD12 goes out with an extra byte to skip the stuff byte before the response */
+      SD_u32CurrentMsgToken = SspWriteData(SD_Ssp, sizeof(SD_au8CMD12), SD_au8CMD12);
+      if(SD_u32CurrentMsgToken)
       {
-        SD_pfStateMachine = SdCardSM_WaitStartToken;
+        SD_u32Timeout = G_u32SystemTime1ms;
+        SD_pfWaitReturnState = SdCardSM_ResponseCMD12;
+        SD_pfStateMachine = SdCardSM_WaitCommand;
       }
       else
       {
-        /* SSP read error - we'll just abort */
         SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
         SD_pfStateMachine = SdCardSM_Error;
       }
     }
+    else
+    {
+      SspDeAssertCS(SD_Ssp);
+      SspRelease(SD_Ssp);
+      SD_pfStateMachine = SdCardSM_ReadyIdle;
+    }
+    
+    return;
   }
   
-  /* Monitor time */
-  if(IsTimeUp(&SD_u32Timeout, SD_READ_TOKEN_MS))
+  /* The stream is paused with both buffers full: restart as soon as the client takes a block */
+  SD_u32Timeout = G_u32SystemTime1ms;
+  if( (SD_u32BlocksFilled - SD_u32BlocksDelivered) < SD_STREAM_BUFFERS )
+  {
+    SD_bStreamRunning = TRUE;
+    if( !SdStreamRead() )
+    {
+      SD_bStreamRunning = FALSE;
+      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+      SD_pfStateMachine = SdCardSM_Error;
+    }
+  }
+
+} /* end SdCardSM_StreamData() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* CMD12 has stopped the multi-block read.  The R1 bits may describe the aborted transfer so they are not 
+checked; the card only has to finish being busy before the bus is released or the read is resumed. */
+static void SdCardSM_ResponseCMD12(void)
+{
+  if(SspReadData(SD_Ssp, SD_BUSY_POLL_BYTES))
+  {
+    SD_u32Timeout = G_u32SystemTime1ms;
+    SD_pfWaitReturnState = SdCardSM_TransferDone;
+    if(SD_u32Flags & _SD_RETRY)
+    {
+      SD_pfWaitReturnState = SdCardSM_RetryRead;
+    }
+    SD_pfStateMachine = SdCardSM_WaitNotBusy;
+  }
+  else
+  {
+    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+    SD_pfStateMachine = SdCardSM_Error;
+  }
+
+} /* end SdCardSM_ResponseCMD12() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Poll the card a few bytes at a time until it releases DO (reads 0xFF) without holding up the super loop.
+     
+REQUIRES: 
+  - A read of SD_BUSY_POLL_BYTES has been queued and SD_u32Timeout is loaded
+  - SD_pfWaitReturnState points to the function that should be accessed next.
+     
+PROMISES: 
+  - State machine set to SD_pfWaitReturnState once the card is not busy, or SdCardSM_FailedDataTransfer on timeout
+*/
+static void SdCardSM_WaitNotBusy(void)
+{
+  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+  {
+    if(SD_au8RxBuffer[SD_BUSY_POLL_BYTES - 1] == SD_IDLE_BYTE)
+    {
+      SD_pfStateMachine = SD_pfWaitReturnState;
+      return;
+    }
+    
+    if(!SspReadData(SD_Ssp, SD_BUSY_POLL_BYTES))
+    {
+      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+      SD_pfStateMachine = SdCardSM_Error;
+      return;
+    }
+  }
+
+  if(IsTimeUp(&SD_u32Timeout, SD_BUSY_TIMEOUT_MS))
   {
     SD_u8ErrorCode = SD_ERROR_TIMEOUT;
     SD_pfStateMachine = SdCardSM_FailedDataTransfer;
   }
   
-} /* end SdCardSM_WaitStartToken() */
+} /* end SdCardSM_WaitNotBusy() */
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Read the sector */
-static void SdCardSM_DataTransfer(void)
+/* CMD55 before the ACMD23 pre-erase hint of a multi-block write */
+static void SdCardSM_WriteResponseCMD55(void)
 {
-  /* Check if the SSP peripheral is finished with the data request */
-  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+  if( (SD_au8RxBuffer[0] == SD_STATUS_READY) )
+  {
+    if(SD_u32BlockCount > SD_ACMD23_MAX_COUNT)
+    {
+      SdSetCommandArgument(SD_au8ACMD23, SD_ACMD23_MAX_COUNT);
+    }
+    else
+    {
+      SdSetCommandArgument(SD_au8ACMD23, SD_u32BlockCount);
+    }
+    
+    SdCommand(&SD_au8ACMD23[0]);
+    SD_pfWaitReturnState = SdCardSM_ResponseACMD23;
+  }
+  else
   {
-    SD_CardState = SD_DATA_READY;
+    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+  
+} /* end SdCardSM_WriteResponseCMD55() */
 
-    SspDeAssertCS(SD_Ssp);
-    SspRelease(SD_Ssp);
 
-    /* Reset the RxBuffer pointers to the start of the RxBuffer */
-    //SD_pu8RxBufferNextByte = &SD_au8RxBuffer[0];
-    //SD_pu8RxBufferParser   = &SD_au8RxBuffer[0];
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* ACMD23 is only a hint so the write goes ahead with CMD25 even if the card rejects it (e.g. MMC) */
+static void SdCardSM_ResponseACMD23(void)
+{
+  SdSetCommandArgument(SD_au8CMD25, SD_u32Address);
+  SdCommand(&SD_au8CMD25[0]);
+  SD_pfWaitReturnState = SdCardSM_ResponseWrite;
+  
+} /* end SdCardSM_ResponseACMD23() */
+
 
-    SD_pfStateMachine = SdCardSM_ReadyIdle;
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Check the response to CMD24 or CMD25 and start sending blocks */
+static void SdCardSM_ResponseWrite(void)
+{
+  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  {
+    /* The rest of the write runs from the SSP interrupt whenever the client has a block ready */
+    SD_u32Timeout = G_u32SystemTime1ms;
+    SdWriteStreamNext();
+    SD_pfStateMachine = SdCardSM_WriteData;
   }
+  else
+  {
+    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+  
+} /* end SdCardSM_ResponseWrite() */
 
-  /* Monitor time */
-  if(IsTimeUp(&SD_u32Timeout, SD_SECTOR_READ_TIMEOUT_MS))
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Supervise the write stream: restart it when the client supplies a block or a long busy period needs more polls */
+static void SdCardSM_WriteData(void)
+{
+  static u32 u32BlocksSeen = 0;
+  
+  /* Any block written restarts the timeout */
+  if(SD_u32BlocksDelivered != u32BlocksSeen)
   {
-    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
-    SD_pfStateMachine = SdCardSM_Error;
+    u32BlocksSeen = SD_u32BlocksDelivered;
+    SD_u32Timeout = G_u32SystemTime1ms;
+  }
+  
+  /* A queued write supplies its own blocks */
+  if(SD_u8RunRequests != 0)
+  {
+    SdQueueFeedWrite();
+  }
+  
+  /* Nothing to do while the interrupt is chaining transfers except watch the time */
+  if(SD_bStreamRunning)
+  {
+    if(IsTimeUp(&SD_u32Timeout, SD_BUSY_TIMEOUT_MS))
+    {
+      SD_bStreamRunning = FALSE;
+      SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    }
+    return;
+  }
+  
+  /* The card did not accept a block */
+  if(SD_bStreamError)
+  {
+    SD_u8ErrorCode = SD_ERROR_DATA_REJECTED;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    return;
+  }
+  
+  /* The card saw a bad CRC: stop the write (the stop token for CMD25) and wait until the card is not busy, then 
+  resume from the rejected block which is still in its buffer */
+  if(SD_bStreamCrcError)
+  {
+    SD_bStreamCrcError = FALSE;
+    SD_u32CrcErrors++;
+    if(SD_u8CrcRetries == 0)
+    {
+      SD_u8ErrorCode = SD_ERROR_DATA_CRC;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+      return;
+    }
+    
+    SD_u8CrcRetries--;
+    SD_u32Flags |= _SD_RETRY;
+    SD_eStreamPhase = SD_STREAM_STOP;
+    SD_u16StreamIndex = 0;
+    if(SD_u32Flags & _SD_MULTI_BLOCK)
+    {
+      SD_u16StreamChunk = sizeof(SD_au8StopTransfer);
+      SD_bStreamRunning = SspTransferData(SD_Ssp, SD_u16StreamChunk, SD_au8StopTransfer);
+    }
+    else
+    {
+      SD_u16StreamChunk = SD_WRITE_POLL_BYTES;
+      SD_bStreamRunning = SspReadData(SD_Ssp, SD_u16StreamChunk);
+    }
+    return;
+  }
+  
+  switch(SD_eStreamPhase)
+  {
+    case SD_STREAM_DONE:
+    {
+      if(SD_u32Flags & _SD_RETRY)
+      {
+        SD_pfStateMachine = SdCardSM_RetryWrite;
+        break;
+      }
+      
+      /* Retries can finish with CMD24 so check the block count of the whole write */
+      if(SD_u32BlockCount > 1)
+      {
+        SdWriteTimed(SystemTimeUs() - SD_u32WriteStartTime);
+      }
+      
+      SD_CardState = SD_IDLE;
+      SD_pfStateMachine = SdCardSM_TransferDone;
+      break;
+    }
+    
+    case SD_STREAM_BUSY:
+    case SD_STREAM_STOP:
+    {
+      /* Still busy after the ISR's polls: start another round (the timeout keeps running) */
+      SD_u16StreamIndex = 0;
+      SD_u16StreamChunk = SD_WRITE_POLL_BYTES;
+      SD_bStreamRunning = SspReadData(SD_Ssp, SD_u16StreamChunk);
+      break;
+    }
+    
+    default:
+    {
+      /* Waiting for the client is not an error */
+      SD_u32Timeout = G_u32SystemTime1ms;
+      SdWriteStreamNext();
+      break;
+    }
+  } /* end switch */
+  
+} /* end SdCardSM_WriteData() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Resume a read at the block that failed its CRC */
+static void SdCardSM_RetryRead(void)
+{
+  u8* pu8Command;
+  
+  SD_u32Flags &= ~_SD_RETRY;
+  SD_eStreamPhase = SD_STREAM_TOKEN;
+  SD_u16StreamIndex = 0;
+  
+  if( (SD_u32BlockCount - SD_u32BlocksFilled) == 1 )
+  {
+    SD_u32Flags &= ~_SD_MULTI_BLOCK;
+    pu8Command = &SD_au8CMD17[0];
+  }
+  else
+  {
+    SD_u32Flags |= _SD_MULTI_BLOCK;
+    pu8Command = &SD_au8CMD18[0];
+  }
+  
+  SdSetCommandArgument(pu8Command, SdBlockAddress(SD_u32BlocksFilled));
+  SdCommand(pu8Command);
+  SD_pfWaitReturnState = SdCardSM_ResponseRead;
+  
+} /* end SdCardSM_RetryRead() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Resume a write at the block the card rejected (CMD25 skips ACMD23 which was only a hint) */
+static void SdCardSM_RetryWrite(void)
+{
+  u8* pu8Command = &SD_au8CMD24[0];
+  
+  SD_u32Flags &= ~_SD_RETRY;
+  SD_eStreamPhase = SD_STREAM_WRITE;
+  
+  if(SD_u32Flags & _SD_MULTI_BLOCK)
+  {
+    pu8Command = &SD_au8CMD25[0];
   }
+  
+  SdSetCommandArgument(pu8Command, SdBlockAddress(SD_u32BlocksDelivered));
+  SdCommand(pu8Command);
+  SD_pfWaitReturnState = SdCardSM_ResponseWrite;
+  
+} /* end SdCardSM_RetryWrite() */
 
-} /* end SdCardSM_DataTransfer() */
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* A data transfer is finished: give back the bus */
+static void SdCardSM_TransferDone(void)
+{
+  SspDeAssertCS(SD_Ssp);
+  SspRelease(SD_Ssp);
+  SD_pfStateMachine = SdCardSM_ReadyIdle;
+  
+} /* end SdCardSM_TransferDone() */
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
@@ -1108,12 +2675,16 @@ static void SdCardSM_DataTransfer(void)
 static void SdCardSM_FailedDataTransfer(void)
 {
   /* Reset the system variables */
+  SD_bStreamRunning = FALSE;
+  SD_u32Flags &= ~_SD_RETRY;
   SspDeAssertCS(SD_Ssp);
   SspRelease(SD_Ssp);
   //FlushSdRxBuffer();
   SD_CardState = SD_CARD_ERROR;
   
+  /* The card is still initialized so the next request can try again */
   SD_u32Timeout = G_u32SystemTime1ms;
+  SD_pfWaitReturnState = SdCardSM_ReadyIdle;
   SD_pfStateMachine = SdCardSM_WaitSSP;
   
 } /* end SdCardSM_FailedDataTransfer() */
@@ -1127,6 +2698,8 @@ static void SdCardSM_Error(void)
   //u8 u8MessageSize;
   
   /* Reset the system variables */
+  SD_bStreamRunning = FALSE;
+  SD_u32Flags &= ~_SD_RETRY;
   SspDeAssertCS(SD_Ssp);
   SspRelease(SD_Ssp);
   //FlushSdRxBuffer();
@@ -1169,6 +2742,18 @@ static void SdCardSM_Error(void)
       pu8ErrorMessage = SD_au8CardError5;
       break;
     }
+
+    case SD_ERROR_DATA_REJECTED:
+    {
+      pu8ErrorMessage = SD_au8CardError6;
+      break;
+    }
+
+    case SD_ERROR_DATA_CRC:
+    {
+      pu8ErrorMessage = SD_au8CardError7;
+      break;
+    }
     
    default:
    {
@@ -1181,6 +2766,8 @@ static void SdCardSM_Error(void)
   
   DebugPrintf(pu8ErrorMessage);
   
+  /* Re-initialization always starts at the slow clock */
+  SD_sSspConfig.u32ClockDivider = 0;
   SD_CardState = SD_NO_CARD;
   SD_u32Timeout = G_u32SystemTime1ms;
   SD_pfWaitReturnState = SdCardSM_IdleNoCard;
@@ -14,6 +14,20 @@ Header file for sdcard.c
 Type Definitions
 **********************************************************************************************************************/
 typedef enum {SD_NO_CARD, SD_CARD_ERROR, SD_IDLE, SD_READING, SD_DATA_READY, SD_WRITING} SdCardStateType;
+typedef enum {SD_STREAM_TOKEN, SD_STREAM_DATA, SD_STREAM_CRC, 
+              SD_STREAM_WRITE, SD_STREAM_BUSY, SD_STREAM_STOP, SD_STREAM_DONE} SdStreamPhaseType;
+
+/* Called from the SD task when a queued request is finished; bSuccess_ is FALSE if the transfer failed */
+typedef void(*SdRequestCallbackType)(u8* pu8Buffer_, bool bSuccess_);
+
+typedef struct
+{
+  u32 u32BlockAddress;                /* First block of the request */
+  u32 u32BlockCount;                  /* Number of consecutive blocks */
+  u8* pu8Buffer;                      /* Client data (u32BlockCount * 512 bytes) which must stay put until the callback */
+  SdRequestCallbackType pfCallback;   /* Completion callback (NULL if not used) */
+  bool bWrite;                        /* TRUE for a write, FALSE for a read */
+} SdRequestType;
 
 
 /**********************************************************************************************************************
@@ -27,28 +41,55 @@ Constants / Definitions
 #define _SD_TYPE_SD2		          (u32)0x00000010		   /* SD ver 2 */
 #define _SD_TYPE_MMC		          (u32)0x00000020	     /* SD ver 3 */
 #define _SD_TYPE_BLOCK		        (u32)0x00000040		   /* Block addressing */
+#define _SD_READ_REQUESTED        (u32)0x00000080      /* Set by the API when a read is requested; cleared when the state machine starts it */
+#define _SD_MULTI_BLOCK           (u32)0x00000100      /* Set if the current transfer uses CMD18 / CMD25 and must be stopped */
+#define _SD_STREAM_FINISHED       (u32)0x00000200      /* Set when the state machine is done with a buffered read that the client is still emptying */
+#define _SD_WRITE_REQUESTED       (u32)0x00000400      /* Set by the API when a write is requested; cleared when the state machine starts it */
+#define _SD_WRITE_STREAM          (u32)0x00000800      /* Set while the block stream is writing (clear for reading) */
+#define _SD_CRC_ON                (u32)0x00001000      /* Set when CMD59 has turned on CRC checking in the card */
+#define _SD_RETRY                 (u32)0x00002000      /* Set while a transfer is stopped to repeat a block that failed its CRC */
 //#define _SD_TYPE_SDSC             (u32)0x00000000      /* Standard Capacity SD Memory Card (SDSC): Up to and including 2 GB */
 //#define _SD_TYPE_SDHC             (u32)0x00000000      /* High Capacity SD Memory Card (SDHC): More than 2GB and up to and including 32GB */
 //#define _SD_TYPE_SDXC             (u32)0x00000000      /* Extended Capacity SD Memory Card (SDXC): More than 32GB and up to and including 2TB */
 /* end of SD_u32Flags */
 
-#define SD_CLEAR_CARD_TYPE_BITS  ~(_SD_CARD_HC | _SD_TYPE_MMC | _SD_TYPE_SD1 | _SD_TYPE_SD2 |_SD_TYPE_BLOCK)
+#define SD_CLEAR_CARD_TYPE_BITS  ~(_SD_CARD_HC | _SD_TYPE_MMC | _SD_TYPE_SD1 | _SD_TYPE_SD2 |_SD_TYPE_BLOCK | _SD_CRC_ON)
 #define _SD_TYPE_SDC		          (_SD_TYPE_SD1 | _SD_TYPE_SD2)	
 
 #define SDCARD_RX_BUFFER_SIZE     (u32)548             /* Size of buffer for incoming SD data */
 
+#define SD_BLOCK_SIZE             (u16)512             /* Bytes of data in a block */
+#define SD_DATA_CRC_SIZE          (u16)2               /* Bytes of CRC16 after each data block */
+#define SD_STREAM_BUFFERS         (u32)2               /* Number of block buffers for multi-block reads (double buffering) */
+#define SD_STREAM_LOOKAHEAD       (u16)8               /* Bytes read past a block to catch the next start token in the same transfer */
+#define SD_DIRECT_TOKEN_BYTES     (u16)16              /* Bytes read per start token poll when blocks go straight to the client */
+#define SD_BUSY_POLL_BYTES        (u16)8               /* Bytes read per poll while the card is busy */
+#define SD_WRITE_POLL_BYTES       (u16)32              /* Bytes read per busy poll from the ISR while writing (32us at 8MHz) */
+#define SD_BUSY_ISR_POLLS         (u16)16              /* Busy polls chained from the ISR before handing back to the main loop */
+#define SD_REQUEST_QUEUE_SIZE     (u8)8                /* Queued read / write requests (must be a power of 2) */
+
+/* Block buffer frame: [0xFF][token][512 data][2 CRC][data response][busy check].  Writes are sent straight from the frame */
+#define SD_FRAME_DATA_INDEX       (u16)2
+#define SD_FRAME_RESPONSE_INDEX   (u16)(SD_FRAME_DATA_INDEX + SD_BLOCK_SIZE + SD_DATA_CRC_SIZE)
+#define SD_FRAME_SIZE             (u16)(SD_FRAME_RESPONSE_INDEX + 2)
+#define SD_IDLE_BYTE              (u8)0xFF             /* Card drives DO high when idle / not busy */
+
 #define SD_RESPONSE_TIMEOUT       (u32)100             /* Time in ms for the SD card to respond to a command */
 #define SD_WAIT_TIME              (u32)1000            /* Time in ms for waiting for SD stuff to occur */
 #define SD_WAKEUP_BYTES           (u32)20              /* Number of dummy bytes sent to wake up new SD card */
 #define SD_CMD_RETRIES            (u8)20               /* Number of polls to retry a command response */
 
 #define SD_CMD_SIZE               (u8)6                /* Size of an SD card command */
+#define SD_CMD_CRC_INDEX          (u8)5                /* Command byte holding the CRC7 and end bit */
+#define SD_CMD_END_BIT            (u8)0x01             /* End bit after the CRC7 of a command */
+#define SD_CRC_RETRIES            (u8)3                /* Times a transfer is resumed after a block fails its CRC */
 
 #define SD_SPI_WAIT_TIME_MS	      (u32)(500)           /* Time to wait for the SPI resource to become available */
 #define SD_READ_TOKEN_MS		      (u32)(200)
 #define SD_INIT_TIMEOUT_MS		    (u32)(1000)
 #define SD_SECTOR_READ_TIMEOUT_MS	(u32)(1000)
 #define SD_ERASE_TIMEOUT_MS	      (u32)(30000)
+#define SD_BUSY_TIMEOUT_MS	      (u32)(500)
 
 
 /* SD Commands support in SPI mode */
@@ -66,6 +107,7 @@ Constants / Definitions
 #define SD_CMD18		              (u8)(18)			/* READ_MULTIPLE_BLOCK */
 #define SD_CMD23		              (u8)(23)			/* SET_BLOCK_COUNT (SD) */
 #define SD_ACMD23	                (u8)(23)   		/* SET_WR_BLK_ERASE_COUNT (SDC) */
+#define SD_ACMD23_MAX_COUNT       (u32)0x007FFFFF /* ACMD23 block count is 23 bits */
 #define SD_CMD24		              (u8)(24)			/* WRITE_BLOCK */
 #define SD_CMD25		              (u8)(25)			/* WRITE_MULTIPLE_BLOCK */
 #define SD_CMD32		              (u8)(32)			/* ERASE_ER_BLK_START */
@@ -112,6 +154,12 @@ Constants / Definitions
 #define TOKEN_START_BLOCK_MULT    (u8)0xFC      /* First byte of each block in multiple block write */
 #define TOKEN_STOP_BLOCK_MULT     (u8)0xFD      /* Stop transmission request token for multi-block write */
 
+/* Data response token after each written block */
+#define SD_DATA_RESPONSE_MASK     (u8)0x1F      /* Bits of the data response token */
+#define SD_DATA_ACCEPTED          (u8)0x05      /* Data accepted */
+#define SD_DATA_CRC_ERROR         (u8)0x0B      /* Data rejected due to a CRC error */
+#define SD_DATA_WRITE_ERROR       (u8)0x0D      /* Data rejected due to a write error */
+
 /* SD Error Codes */
 #define SD_ERROR_NONE             (u8)0x00      /* No error */
 #define SD_ERROR_TIMEOUT          (u8)0x01      /* SSP application did not deliver expected response */
@@ -119,6 +167,8 @@ Constants / Definitions
 #define SD_ERROR_BAD_RESPONSE     (u8)0x03      /* Unexpected or no response to a command */
 #define SD_ERROR_NO_TOKEN         (u8)0x04      /* Got '0' for a message token => message task is broken */
 #define SD_ERROR_NO_SD_TOKEN      (u8)0x05      /* Expected a token from the SD card but didn't get it */
+#define SD_ERROR_DATA_REJECTED    (u8)0x06      /* Card did not accept a written block */
+#define SD_ERROR_DATA_CRC         (u8)0x07      /* A data block still failed its CRC after SD_CRC_RETRIES retries */
 
 
 /**********************************************************************************************************************
@@ -135,8 +185,16 @@ Constants / Definitions
 /*--------------------------------------------------------------------------------------------------------------------*/
 SdCardStateType SdGetStatus(void);
 bool SdReadBlock(u32 u32BlockAddress_);
-bool SdWriteBlock(u32 u32BlockAddress_);             
+bool SdReadBlocks(u32 u32BlockAddress_, u32 u32BlockCount_);
+bool SdReadBlocksDirect(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Destination_);
+bool SdWriteBlock(u32 u32BlockAddress_, u8* pu8Source_);
+bool SdWriteBlocks(u32 u32BlockAddress_, u32 u32BlockCount_);
+bool SdPutWriteData(u8* pu8Source_);
 bool SdGetReadData(u8* pu8Destination_);
+bool SdQueueRead(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Buffer_, SdRequestCallbackType pfCallback_);
+bool SdQueueWrite(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Buffer_, SdRequestCallbackType pfCallback_);
+u32 SdGetCrcErrorCount(void);
+void SdGetWriteThroughput(u32* pu32LastKBps_, u32* pu32SustainedKBps_);
 void CheckTimeout(u32 u32Time_);
 
 
@@ -153,6 +211,23 @@ bool SdIsCardInserted(void);
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 static void SdCommand(u8* pau8Command_);
+static bool SdStartRead(u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Destination_);
+static bool SdStartWrite(u32 u32BlockAddress_, u32 u32BlockCount_);
+static void SdSetCommandArgument(u8* pau8Command_, u32 u32Argument_);
+static void SdSetCommandCrc(u8* pau8Command_);
+static u32 SdBlockAddress(u32 u32Blocks_);
+static u32 SdKBps(u32 u32Blocks_, u32 u32Us_);
+static void SdWriteTimed(u32 u32Us_);
+static u16 SdStreamChunkSize(void);
+static bool SdStreamRead(void);
+static void SdStreamCallback(void);
+static void SdWriteStreamCallback(void);
+static void SdWriteStreamNext(void);
+static void SdAdvanceReadBlock(void);
+static bool SdQueueRequest(bool bWrite_, u32 u32BlockAddress_, u32 u32BlockCount_, u8* pu8Buffer_, SdRequestCallbackType pfCallback_);
+static void SdQueueStart(void);
+static void SdQueueFeedWrite(void);
+static void SdQueueComplete(bool bSuccess_);
 //static void AdvanceSD_pu8RxBufferParser(u32 u32NumBytes_);
 //static void FlushSdRxBuffer(void);
 
@@ -174,11 +249,20 @@ static void SdCardSM_ResponseACMD41(void);
 static void SdCardSM_ResponseCMD58(void);
 static void SdCardSM_ResponseCMD16(void);
 static void SdCardSM_ReadCMD58(void);
+static void SdCardSM_ResponseCMD59(void);
 
 static void SdCardSM_ReadyIdle(void);          
-static void SdCardSM_ResponseCMD17(void);
-static void SdCardSM_WaitStartToken(void);          
-static void SdCardSM_DataTransfer(void);
+static void SdCardSM_ResponseRead(void);
+static void SdCardSM_StreamData(void);
+static void SdCardSM_ResponseCMD12(void);
+static void SdCardSM_WaitNotBusy(void);
+static void SdCardSM_WriteResponseCMD55(void);
+static void SdCardSM_ResponseACMD23(void);
+static void SdCardSM_ResponseWrite(void);
+static void SdCardSM_WriteData(void);
+static void SdCardSM_RetryRead(void);
+static void SdCardSM_RetryWrite(void);
+static void SdCardSM_TransferDone(void);
 static void SdCardSM_FailedDataTransfer(void);
 
 //static void SdCardSM_WaitReady(void);
@@ -0,0 +1,221 @@
+/**********************************************************************************************************************
+File: rawlog_extract.c
+
+Description:
+Host tool that reads the records of a raw log (see drivers/rawlog.c) from an SD card image and prints them in page
+sequence order, oldest first.  Pages that were never written, belong to an older format or were cut short are
+skipped and reported on stderr.
+
+Build and run on the host with any C99 compiler, e.g.
+cc -std=c99 -O2 -o rawlog_extract rawlog_extract.c
+dd if=/dev/sdX of=card.img bs=1M
+rawlog_extract card.img 2048          (first block of the log range as given to RawLogOpen())
+rawlog_extract card.img 2048 -raw > records.bin
+
+Text output is one record per line: page sequence, record index in the page, record bytes in hex.
+With -raw the records are written back to back as binary.
+**********************************************************************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Must match rawlog.h */
+#define BLOCK_SIZE                512u
+#define HEADER_MAGIC              0x474F4C52u          /* "RLOG" */
+#define VERSION                   1u
+#define HEADER_VERSION_INDEX      4u
+#define HEADER_RECORD_INDEX       6u
+#define HEADER_PAGE_BLOCKS_INDEX  8u
+#define HEADER_FIRST_INDEX        12u
+#define HEADER_PAGES_INDEX        16u
+#define HEADER_FORMAT_INDEX       20u
+#define HEADER_CRC_INDEX          24u
+
+#define PAGE_MAGIC                0x47415052u          /* "RPAG" */
+#define PAGE_FORMAT_INDEX         4u
+#define PAGE_SEQUENCE_INDEX       8u
+#define PAGE_COUNT_INDEX          12u
+#define PAGE_RECORD_INDEX         14u
+#define PAGE_HEADER_SIZE          16u
+#define PAGE_TRAILER_SIZE         8u
+
+
+static uint16_t Get16(const uint8_t* pu8Data_)
+{
+  return (uint16_t)(pu8Data_[0] | (pu8Data_[1] << 8));
+}
+
+static uint32_t Get32(const uint8_t* pu8Data_)
+{
+  return (uint32_t)pu8Data_[0] | ((uint32_t)pu8Data_[1] << 8) |
+         ((uint32_t)pu8Data_[2] << 16) | ((uint32_t)pu8Data_[3] << 24);
+}
+
+/* CRC16 CCITT (poly 0x1021, initial value 0) as Crc16Ccitt() in utilities.c */
+static uint16_t Crc16Ccitt(const uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  uint16_t u16Crc = 0;
+
+  while(u32Size_--)
+  {
+    u16Crc ^= (uint16_t)(*pu8Data_++ << 8);
+    for(int i = 0; i < 8; i++)
+    {
+      u16Crc = (u16Crc & 0x8000) ? (uint16_t)((u16Crc << 1) ^ 0x1021) : (uint16_t)(u16Crc << 1);
+    }
+  }
+
+  return u16Crc;
+}
+
+static int ReadBlocks(FILE* pFile_, uint64_t u64Block_, uint32_t u32Count_, uint8_t* pu8Buffer_)
+{
+  if(fseeko(pFile_, (off_t)(u64Block_ * BLOCK_SIZE), SEEK_SET) != 0)
+  {
+    return 0;
+  }
+
+  return fread(pu8Buffer_, BLOCK_SIZE, u32Count_, pFile_) == u32Count_;
+}
+
+
+int main(int argc, char* argv[])
+{
+  FILE* pImage;
+  uint8_t au8Header[BLOCK_SIZE];
+  uint8_t* pu8Page;
+  uint64_t u64First;
+  uint32_t u32PageBlocks, u32PageSize, u32Pages, u32Format, u32RecordSize;
+  uint32_t u32Newest = 0, u32Oldest, u32Sequence, u32Skipped = 0, u32Records = 0;
+  int bFound = 0, bRaw = 0;
+
+  if( (argc < 3) || (argc > 4) || ( (argc == 4) && strcmp(argv[3], "-raw") ) )
+  {
+    fprintf(stderr, "usage: %s <image> <first block> [-raw]\n", argv[0]);
+    return 2;
+  }
+  bRaw = (argc == 4);
+  u64First = strtoull(argv[2], NULL, 0);
+
+  pImage = fopen(argv[1], "rb");
+  if(pImage == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  /* Header */
+  if( !ReadBlocks(pImage, u64First, 1, au8Header) ||
+      (Get32(&au8Header[0]) != HEADER_MAGIC) ||
+      (Get16(&au8Header[HEADER_CRC_INDEX]) != Crc16Ccitt(au8Header, HEADER_CRC_INDEX)) ||
+      (Get16(&au8Header[HEADER_VERSION_INDEX]) != VERSION) )
+  {
+    fprintf(stderr, "no raw log header at block %llu\n", (unsigned long long)u64First);
+    return 1;
+  }
+
+  u32RecordSize = Get16(&au8Header[HEADER_RECORD_INDEX]);
+  u32PageBlocks = Get16(&au8Header[HEADER_PAGE_BLOCKS_INDEX]);
+  u32Pages      = Get32(&au8Header[HEADER_PAGES_INDEX]);
+  u32Format     = Get32(&au8Header[HEADER_FORMAT_INDEX]);
+  u32PageSize   = u32PageBlocks * BLOCK_SIZE;
+  if(Get32(&au8Header[HEADER_FIRST_INDEX]) != (uint32_t)u64First)
+  {
+    fprintf(stderr, "warning: header was written for block %lu\n", (unsigned long)Get32(&au8Header[HEADER_FIRST_INDEX]));
+  }
+  fprintf(stderr, "%lu pages of %lu blocks, %lu byte records, format %lu\n", (unsigned long)u32Pages,
+          (unsigned long)u32PageBlocks, (unsigned long)u32RecordSize, (unsigned long)u32Format);
+
+  pu8Page = malloc(u32PageSize);
+  if( (pu8Page == NULL) || (u32RecordSize == 0) || (u32Pages == 0) )
+  {
+    return 1;
+  }
+
+  /* Pass 1: find the newest complete page (the image is read in full, so no need for the firmware's search) */
+  for(uint32_t i = 0; i < u32Pages; i++)
+  {
+    if( ReadBlocks(pImage, u64First + 1 + ((uint64_t)i * u32PageBlocks), u32PageBlocks, pu8Page) &&
+        (Get32(&pu8Page[0]) == PAGE_MAGIC) && (Get32(&pu8Page[PAGE_FORMAT_INDEX]) == u32Format) &&
+        (Get32(&pu8Page[u32PageSize - PAGE_TRAILER_SIZE]) == Get32(&pu8Page[PAGE_SEQUENCE_INDEX])) &&
+        ((Get32(&pu8Page[PAGE_SEQUENCE_INDEX]) % u32Pages) == i) )
+    {
+      u32Sequence = Get32(&pu8Page[PAGE_SEQUENCE_INDEX]);
+      if( !bFound || (u32Sequence > u32Newest) )
+      {
+        u32Newest = u32Sequence;
+      }
+      bFound = 1;
+    }
+  }
+
+  if(!bFound)
+  {
+    fprintf(stderr, "log is empty\n");
+    return 0;
+  }
+
+  /* Pass 2: the ring holds at most the last u32Pages pages */
+  u32Oldest = (u32Newest >= u32Pages) ? (u32Newest - u32Pages + 1) : 0;
+  for(u32Sequence = u32Oldest; u32Sequence <= u32Newest; u32Sequence++)
+  {
+    uint32_t u32Count;
+
+    if( !ReadBlocks(pImage, u64First + 1 + ((uint64_t)(u32Sequence % u32Pages) * u32PageBlocks), u32PageBlocks, pu8Page) ||
+        (Get32(&pu8Page[0]) != PAGE_MAGIC) || (Get32(&pu8Page[PAGE_FORMAT_INDEX]) != u32Format) ||
+        (Get32(&pu8Page[PAGE_SEQUENCE_INDEX]) != u32Sequence) ||
+        (Get32(&pu8Page[u32PageSize - PAGE_TRAILER_SIZE]) != u32Sequence) ||
+        (Get32(&pu8Page[u32PageSize - PAGE_TRAILER_SIZE + 4]) != u32Format) ||
+        (Get16(&pu8Page[PAGE_RECORD_INDEX]) != u32RecordSize) )
+    {
+      u32Skipped++;
+      continue;
+    }
+
+    u32Count = Get16(&pu8Page[PAGE_COUNT_INDEX]);
+    if( (PAGE_HEADER_SIZE + (u32Count * u32RecordSize)) > (u32PageSize - PAGE_TRAILER_SIZE) )
+    {
+      u32Skipped++;
+      continue;
+    }
+
+    for(uint32_t i = 0; i < u32Count; i++)
+    {
+      const uint8_t* pu8Record = &pu8Page[PAGE_HEADER_SIZE + (i * u32RecordSize)];
+
+      if(bRaw)
+      {
+        fwrite(pu8Record, 1, u32RecordSize, stdout);
+      }
+      else
+      {
+        printf("%lu,%lu,", (unsigned long)u32Sequence, (unsigned long)i);
+        for(uint32_t j = 0; j < u32RecordSize; j++)
+        {
+          printf("%02X", pu8Record[j]);
+        }
+        printf("\n");
+      }
+    }
+    u32Records += u32Count;
+  }
+
+  fprintf(stderr, "pages %lu to %lu: %lu records, %lu pages skipped\n", (unsigned long)u32Oldest,
+          (unsigned long)u32Newest, (unsigned long)u32Records, (unsigned long)u32Skipped);
+
+  free(pu8Page);
+  fclose(pImage);
+  return 0;
+
+} /* end main() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
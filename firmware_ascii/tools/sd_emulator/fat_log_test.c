@@ -0,0 +1,792 @@
+/**********************************************************************************************************************
+File: fat_log_test.c
+
+Description:
+Runs the FAT log writer (drivers/fat.c over the unmodified SD, SSP and messaging drivers) on the host against the
+simulated card and checks that what it leaves on a FAT32 image is a clean volume for Linux and other PC hosts.
+
+The test formats its own image since no mkfs tools are needed: an MBR with one FAT32 (LBA) partition at block 8192,
+4 KB clusters, a LOGS directory and a README.TXT whose clusters are not contiguous (so the log's run search has to
+skip a hole).  It then mounts the volume with fat.c and
+  - logs LOGS/DATA.TXT across several FAT sectors, stopping halfway to let the timed checkpoint run
+  - logs a second small file in the root directory and checks that an existing name is refused
+  - reads both logs back through FatOpen() / FatRead()
+After the halfway checkpoint and again after FatLogClose() the image is checked the way fsck.fat would:
+  - MBR, boot sector and FSInfo signatures, and the BPB unchanged
+  - both FAT copies identical, media and end-of-chain entries in FAT[0] and FAT[1]
+  - every directory entry's cluster chain stays in the volume, has no loops or cross-links and is exactly as long as
+    the file size needs; no cluster is marked used without belonging to a file (lost clusters)
+  - each log's size and contents are exactly what was written up to the checkpoint
+The partition is also handed to "fsck.fat -n" (dosfstools).
+
+Build and run on the host from firmware_ascii/tools/sd_emulator (link -no-pie, see sim_host.h):
+cc -std=gnu99 -O2 -no-pie -DEIE1 -DENABLE_SD -include sim_host.h -I../../../firmware_common \
+   -I../../../firmware_common/cmsis -I../../../firmware_common/drivers -I../../../firmware_common/application \
+   -I../../application -I../../bsp -I../../drivers -o fat_log_test fat_log_test.c sim_hardware.c \
+   sd_card_model.c ../../drivers/fat.c ../../drivers/sdcard.c ../../../firmware_common/drivers/sam3u_ssp.c \
+   ../../../firmware_common/drivers/messaging.c ../../../firmware_common/drivers/utilities.c
+fat_log_test                           (on a temporary sparse 512 MB image)
+fat_log_test -image card.img -v        (keeps the image; on Linux: mount -o loop,offset=4194304 card.img /mnt)
+
+The exit status is the number of failed checks.  If every check passed but fsck.fat is not installed the test prints
+SKIPPED and exits with 77, the status test runners (ctest SKIP_RETURN_CODE, automake) report as skipped.
+**********************************************************************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "configuration.h"
+#include "sd_card_model.h"
+#include "sim_hardware.h"
+
+#define IMAGE_BLOCKS              (u32)1048576         /* 512 MB: enough 4 KB clusters for FAT32 */
+#define VOLUME_START              (u32)8192            /* Partition alignment used by SD card formatters */
+#define VOLUME_SECTORS            (IMAGE_BLOCKS - VOLUME_START)
+#define RESERVED_SECTORS          (u32)32
+#define SECTORS_PER_CLUSTER       (u32)8
+#define CLUSTER_BYTES             (SECTORS_PER_CLUSTER * SD_BLOCK_SIZE)
+#define NUMBER_OF_FATS            (u32)2
+#define ROOT_CLUSTER              (u32)2
+#define LOGS_CLUSTER              (u32)3
+#define README_CLUSTER_1          (u32)4               /* README.TXT is clusters 4 then 6: cluster 5 is a free hole */
+#define README_CLUSTER_2          (u32)6
+#define README_SIZE               (u32)6000
+
+#define LOG_PATH                  "LOGS/DATA.TXT"
+#define LOG_SIZE                  (u32)(640u * 1024u)  /* Crosses FAT sectors: 128 clusters is 512 KB */
+#define LOG_MAX_SIZE              (u32)(1024u * 1024u)
+#define LOG_HALFWAY               (u32)300000          /* Not a whole sector: the checkpoint writes a partial one */
+#define LOG2_PATH                 "EVENTS.LOG"
+#define LOG2_SIZE                 (u32)1500
+#define RECORD_SIZE               (u32)32
+#define TEST_TIMEOUT_MS           (u32)60000
+#define MAX_CLUSTERS              (u32)(VOLUME_SECTORS / SECTORS_PER_CLUSTER)
+#define EXIT_SKIPPED              77                   /* Test runners' "skipped" status */
+
+/* Everything the driver's PDC touches must be static (below 4 GB) */
+static u8 Test_au8Record[RECORD_SIZE];
+static u8 Test_au8Read[CLUSTER_BYTES];
+
+static u8 Test_au8Sector[SD_BLOCK_SIZE];
+static u8 Test_au8Sector2[SD_BLOCK_SIZE];
+static u8 Test_au8Cluster[CLUSTER_BYTES];
+static u8 Test_au8Expected[CLUSTER_BYTES];
+static u32 Test_au32Fat[MAX_CLUSTERS + ROOT_CLUSTER];
+static u8 Test_au8Used[MAX_CLUSTERS + ROOT_CLUSTER];
+
+static u32 Test_u32FatSize;                            /* Sectors in each FAT */
+static u32 Test_u32Clusters;                           /* Data clusters in the volume */
+static u32 Test_u32DataStart;                          /* Block of cluster 2 */
+static u32 Test_u32Failures;
+static bool Test_bVerbose;
+static bool Test_bFsckMissing;                         /* fsck.fat could not run: the result is incomplete */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Helpers */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/* One pass of the super loop with the tasks this build has, then sleep to the next tick */
+static void RunPass(void)
+{
+  SspRunActiveState();
+  SimUpdate();
+  MessagingRunActiveState();
+  SimUpdate();
+  SdCardRunActiveState();
+  SimUpdate();
+  FatRunActiveState();
+  SimUpdate();
+  SimSleep();
+}
+
+static bool WaitFat(void)
+{
+  for(u32 i = 0; (i < TEST_TIMEOUT_MS) && (FatGetStatus() == FAT_BUSY); i++)
+  {
+    RunPass();
+  }
+  return FatGetStatus() == FAT_READY;
+}
+
+static void Check(bool bPass_, const char* pcName_)
+{
+  printf("  %s  %s\n", bPass_ ? "pass" : "FAIL", pcName_);
+  if(!bPass_)
+  {
+    Test_u32Failures++;
+  }
+}
+
+static void Put16(u8* pu8Data_, u32 u32Value_)
+{
+  pu8Data_[0] = (u8)u32Value_;
+  pu8Data_[1] = (u8)(u32Value_ >> 8);
+}
+
+static void Put32(u8* pu8Data_, u32 u32Value_)
+{
+  Put16(pu8Data_, u32Value_);
+  Put16(pu8Data_ + 2, u32Value_ >> 16);
+}
+
+static u32 Get16(const u8* pu8Data_)
+{
+  return pu8Data_[0] | ((u32)pu8Data_[1] << 8);
+}
+
+static u32 Get32(const u8* pu8Data_)
+{
+  return Get16(pu8Data_) | (Get16(pu8Data_ + 2) << 16);
+}
+
+static u32 ClusterBlock(u32 u32Cluster_)
+{
+  return Test_u32DataStart + ((u32Cluster_ - ROOT_CLUSTER) * SECTORS_PER_CLUSTER);
+}
+
+/* Log files hold fixed size text records so they can be read with any editor: byte i of a file is LogByte(i) */
+static u8 LogByte(u8 u8Tag_, u32 u32Offset_)
+{
+  char acRecord[RECORD_SIZE + 1];
+
+  snprintf(acRecord, sizeof(acRecord), "%c record %08u  0123456789a\r\n", u8Tag_, (unsigned)(u32Offset_ / RECORD_SIZE));
+  return (u8)acRecord[u32Offset_ % RECORD_SIZE];
+}
+
+static u8 ReadmeByte(u32 u32Offset_)
+{
+  return (u8)("Formatted by fat_log_test.c\n"[u32Offset_ % 28]);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Formatting */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+static bool WriteBlock(int iFd_, u32 u32Block_, const u8* pu8Data_)
+{
+  return pwrite(iFd_, pu8Data_, SD_BLOCK_SIZE, (off_t)u32Block_ * SD_BLOCK_SIZE) == SD_BLOCK_SIZE;
+}
+
+static void DirEntry(u8* pu8Entry_, const char* pcName_, u8 u8Attributes_, u32 u32Cluster_, u32 u32Size_)
+{
+  memset(pu8Entry_, 0, FAT_DIR_ENTRY_SIZE);
+  memcpy(pu8Entry_, pcName_, FAT_NAME_SIZE);
+  pu8Entry_[FAT_DIR_ATTRIBUTES] = u8Attributes_;
+  Put16(&pu8Entry_[14], 0x6000);                        /* 12:00:00 */
+  Put16(&pu8Entry_[16], ((2024 - 1980) << 9) | (1 << 5) | 1);
+  Put16(&pu8Entry_[18], ((2024 - 1980) << 9) | (1 << 5) | 1);
+  Put16(&pu8Entry_[22], 0x6000);
+  Put16(&pu8Entry_[24], ((2024 - 1980) << 9) | (1 << 5) | 1);
+  Put16(&pu8Entry_[FAT_DIR_CLUSTER_HI], u32Cluster_ >> 16);
+  Put16(&pu8Entry_[FAT_DIR_CLUSTER_LO], u32Cluster_);
+  Put32(&pu8Entry_[FAT_DIR_FILE_SIZE], u32Size_);
+}
+
+/* The FAT32 layout from Microsoft's FAT specification (fatgen103), written into a new sparse image */
+static bool FormatImage(const char* pcImage_)
+{
+  static const u32 au32FatEntries[][2] =
+  {
+    {0, 0x0FFFFFF8}, {1, 0x0FFFFFFF}, {ROOT_CLUSTER, FAT32_END_OF_CHAIN}, {LOGS_CLUSTER, FAT32_END_OF_CHAIN},
+    {README_CLUSTER_1, README_CLUSTER_2}, {README_CLUSTER_2, FAT32_END_OF_CHAIN}
+  };
+  u8* pu8 = Test_au8Sector;
+  u32 u32Value;
+  bool bOk = TRUE;
+  int iFd;
+
+  Test_u32FatSize = ((VOLUME_SECTORS - RESERVED_SECTORS) + ((256 * SECTORS_PER_CLUSTER + NUMBER_OF_FATS) / 2) - 1) /
+                    ((256 * SECTORS_PER_CLUSTER + NUMBER_OF_FATS) / 2);
+  Test_u32DataStart = VOLUME_START + RESERVED_SECTORS + (NUMBER_OF_FATS * Test_u32FatSize);
+  Test_u32Clusters = (VOLUME_START + VOLUME_SECTORS - Test_u32DataStart) / SECTORS_PER_CLUSTER;
+  if(Test_u32Clusters < FAT32_MIN_CLUSTERS)
+  {
+    fprintf(stderr, "image too small for FAT32\n");
+    return FALSE;
+  }
+
+  iFd = open(pcImage_, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if( (iFd < 0) || (ftruncate(iFd, (off_t)IMAGE_BLOCKS * SD_BLOCK_SIZE) != 0) )
+  {
+    perror(pcImage_);
+    return FALSE;
+  }
+
+  /* MBR with one FAT32 LBA partition */
+  memset(pu8, 0, SD_BLOCK_SIZE);
+  pu8[FAT_MBR_PARTITION_TABLE + 1] = 0xFE;
+  pu8[FAT_MBR_PARTITION_TABLE + 2] = 0xFF;
+  pu8[FAT_MBR_PARTITION_TABLE + 3] = 0xFF;
+  pu8[FAT_MBR_PARTITION_TABLE + FAT_PARTITION_TYPE_INDEX] = FAT_PARTITION_FAT32_LBA;
+  pu8[FAT_MBR_PARTITION_TABLE + 5] = 0xFE;
+  pu8[FAT_MBR_PARTITION_TABLE + 6] = 0xFF;
+  pu8[FAT_MBR_PARTITION_TABLE + 7] = 0xFF;
+  Put32(&pu8[FAT_MBR_PARTITION_TABLE + FAT_PARTITION_LBA_INDEX], VOLUME_START);
+  Put32(&pu8[FAT_MBR_PARTITION_TABLE + FAT_PARTITION_LBA_INDEX + 4], VOLUME_SECTORS);
+  pu8[FAT_BOOT_SIGNATURE_INDEX] = FAT_BOOT_SIGNATURE_0;
+  pu8[FAT_BOOT_SIGNATURE_INDEX + 1] = FAT_BOOT_SIGNATURE_1;
+  bOk &= WriteBlock(iFd, 0, pu8);
+
+  /* Boot sector and its backup at sector 6 */
+  memset(pu8, 0, SD_BLOCK_SIZE);
+  memcpy(pu8, "\xEB\x58\x90" "MSWIN4.1", 11);
+  Put16(&pu8[FAT_BPB_BYTES_PER_SECTOR], SD_BLOCK_SIZE);
+  pu8[FAT_BPB_SECTORS_PER_CLUS] = SECTORS_PER_CLUSTER;
+  Put16(&pu8[FAT_BPB_RESERVED_SECTORS], RESERVED_SECTORS);
+  pu8[FAT_BPB_NUMBER_OF_FATS] = NUMBER_OF_FATS;
+  pu8[21] = 0xF8;
+  Put16(&pu8[24], 63);
+  Put16(&pu8[26], 255);
+  Put32(&pu8[28], VOLUME_START);
+  Put32(&pu8[FAT_BPB_TOTAL_SECTORS_32], VOLUME_SECTORS);
+  Put32(&pu8[FAT_BPB_FAT_SIZE_32], Test_u32FatSize);
+  Put32(&pu8[FAT_BPB_ROOT_CLUSTER], ROOT_CLUSTER);
+  Put16(&pu8[48], 1);
+  Put16(&pu8[50], 6);
+  pu8[64] = 0x80;
+  pu8[66] = 0x29;
+  Put32(&pu8[67], 0x20241010);
+  memcpy(&pu8[71], "NO NAME    FAT32   ", 19);
+  pu8[FAT_BOOT_SIGNATURE_INDEX] = FAT_BOOT_SIGNATURE_0;
+  pu8[FAT_BOOT_SIGNATURE_INDEX + 1] = FAT_BOOT_SIGNATURE_1;
+  bOk &= WriteBlock(iFd, VOLUME_START, pu8) && WriteBlock(iFd, VOLUME_START + 6, pu8);
+
+  /* FSInfo (free count unknown) and its backup */
+  memset(pu8, 0, SD_BLOCK_SIZE);
+  Put32(&pu8[0], 0x41615252);
+  Put32(&pu8[484], 0x61417272);
+  Put32(&pu8[488], 0xFFFFFFFF);
+  Put32(&pu8[492], 0xFFFFFFFF);
+  Put32(&pu8[508], 0xAA550000);
+  bOk &= WriteBlock(iFd, VOLUME_START + 1, pu8) && WriteBlock(iFd, VOLUME_START + 7, pu8);
+
+  /* First sector of both FATs (every entry used here is in it); the rest of the image is already zero */
+  memset(pu8, 0, SD_BLOCK_SIZE);
+  for(u32 i = 0; i < sizeof(au32FatEntries) / sizeof(au32FatEntries[0]); i++)
+  {
+    Put32(&pu8[au32FatEntries[i][0] * 4], au32FatEntries[i][1]);
+  }
+  for(u32 i = 0; i < NUMBER_OF_FATS; i++)
+  {
+    bOk &= WriteBlock(iFd, VOLUME_START + RESERVED_SECTORS + (i * Test_u32FatSize), pu8);
+  }
+
+  /* Root directory: LOGS and README.TXT */
+  memset(pu8, 0, SD_BLOCK_SIZE);
+  DirEntry(&pu8[0], "LOGS       ", FAT_ATTR_DIRECTORY, LOGS_CLUSTER, 0);
+  DirEntry(&pu8[FAT_DIR_ENTRY_SIZE], "README  TXT", FAT_ATTR_ARCHIVE, README_CLUSTER_1, README_SIZE);
+  bOk &= WriteBlock(iFd, ClusterBlock(ROOT_CLUSTER), pu8);
+
+  /* LOGS: "." and ".." (the root is cluster 0 in "..") */
+  memset(pu8, 0, SD_BLOCK_SIZE);
+  DirEntry(&pu8[0], ".          ", FAT_ATTR_DIRECTORY, LOGS_CLUSTER, 0);
+  DirEntry(&pu8[FAT_DIR_ENTRY_SIZE], "..         ", FAT_ATTR_DIRECTORY, 0, 0);
+  bOk &= WriteBlock(iFd, ClusterBlock(LOGS_CLUSTER), pu8);
+
+  /* README.TXT contents */
+  for(u32 i = 0; i < README_SIZE; i += SD_BLOCK_SIZE)
+  {
+    memset(pu8, 0, SD_BLOCK_SIZE);
+    for(u32 j = 0; (j < SD_BLOCK_SIZE) && (i + j < README_SIZE); j++)
+    {
+      pu8[j] = ReadmeByte(i + j);
+    }
+    u32Value = (i < CLUSTER_BYTES) ? ClusterBlock(README_CLUSTER_1) + (i / SD_BLOCK_SIZE) :
+                                     ClusterBlock(README_CLUSTER_2) + ((i - CLUSTER_BYTES) / SD_BLOCK_SIZE);
+    bOk &= WriteBlock(iFd, u32Value, pu8);
+  }
+
+  close(iFd);
+  return bOk;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Volume check */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  const char* pcName;                 /* 8.3 name as stored in the directory */
+  u8 u8Tag;                           /* First byte of every LogByte() record, 0 for README.TXT */
+  u32 u32Size;                        /* Expected file size */
+  bool bFound;
+} ExpectedFileType;
+
+/* Marks a chain in Test_au8Used and checks its length; returns FALSE on any problem */
+static bool CheckChain(u32 u32First_, u32 u32Size_, bool bDirectory_, const char* pcName_)
+{
+  u32 u32Cluster = u32First_;
+  u32 u32Length = 0;
+  u32 u32Expected = (u32Size_ + CLUSTER_BYTES - 1) / CLUSTER_BYTES;
+
+  if(u32First_ == 0)
+  {
+    return (u32Size_ == 0) && !bDirectory_;
+  }
+
+  while(TRUE)
+  {
+    if( (u32Cluster < ROOT_CLUSTER) || (u32Cluster >= Test_u32Clusters + ROOT_CLUSTER) )
+    {
+      printf("        %.11s: cluster %u is outside the volume\n", pcName_, (unsigned)u32Cluster);
+      return FALSE;
+    }
+    if(Test_au8Used[u32Cluster])
+    {
+      printf("        %.11s: cluster %u is cross-linked or loops\n", pcName_, (unsigned)u32Cluster);
+      return FALSE;
+    }
+    Test_au8Used[u32Cluster] = 1;
+    u32Length++;
+
+    if(Test_au32Fat[u32Cluster] >= 0x0FFFFFF8)
+    {
+      break;
+    }
+    if(Test_au32Fat[u32Cluster] == 0)
+    {
+      printf("        %.11s: chain runs into free cluster after %u\n", pcName_, (unsigned)u32Cluster);
+      return FALSE;
+    }
+    u32Cluster = Test_au32Fat[u32Cluster];
+  }
+
+  if(!bDirectory_ && (u32Length != u32Expected))
+  {
+    printf("        %.11s: %u clusters for %u bytes (needs %u)\n", pcName_, (unsigned)u32Length, (unsigned)u32Size_,
+           (unsigned)u32Expected);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Compares a file's contents with what was written */
+static bool CheckContents(u32 u32First_, u32 u32Size_, u8 u8Tag_)
+{
+  u32 u32Cluster = u32First_;
+
+  for(u32 u32Offset = 0; u32Offset < u32Size_; u32Offset += CLUSTER_BYTES)
+  {
+    u32 u32Bytes = (u32Size_ - u32Offset < CLUSTER_BYTES) ? (u32Size_ - u32Offset) : CLUSTER_BYTES;
+
+    if(!SdModelReadImage(ClusterBlock(u32Cluster), SECTORS_PER_CLUSTER, Test_au8Cluster))
+    {
+      return FALSE;
+    }
+    for(u32 i = 0; i < u32Bytes; i++)
+    {
+      Test_au8Expected[i] = u8Tag_ ? LogByte(u8Tag_, u32Offset + i) : ReadmeByte(u32Offset + i);
+    }
+    if(memcmp(Test_au8Cluster, Test_au8Expected, u32Bytes) != 0)
+    {
+      printf("        data differs in the cluster at offset %u\n", (unsigned)u32Offset);
+      return FALSE;
+    }
+    u32Cluster = Test_au32Fat[u32Cluster];
+  }
+  return TRUE;
+}
+
+/* Walks one directory and everything under it */
+static bool CheckDirectory(u32 u32First_, ExpectedFileType* psFiles_, u32 u32FileCount_, u32 u32Depth_)
+{
+  static u8 au8Entries[4][CLUSTER_BYTES];           /* One cluster per level: the walk below reuses Test_au8Cluster */
+  u32 u32Cluster = u32First_;
+  bool bOk = TRUE;
+
+  while( (u32Cluster >= ROOT_CLUSTER) && (u32Cluster < Test_u32Clusters + ROOT_CLUSTER) && (u32Depth_ < 4) )
+  {
+    if(!SdModelReadImage(ClusterBlock(u32Cluster), SECTORS_PER_CLUSTER, Test_au8Cluster))
+    {
+      return FALSE;
+    }
+    memcpy(au8Entries[u32Depth_], Test_au8Cluster, CLUSTER_BYTES);
+
+    for(u32 i = 0; i < CLUSTER_BYTES; i += FAT_DIR_ENTRY_SIZE)
+    {
+      u8* pu8Entry = &au8Entries[u32Depth_][i];
+      u32 u32Start = Get16(&pu8Entry[FAT_DIR_CLUSTER_LO]) | (Get16(&pu8Entry[FAT_DIR_CLUSTER_HI]) << 16);
+      u32 u32Size = Get32(&pu8Entry[FAT_DIR_FILE_SIZE]);
+      bool bDirectory = (pu8Entry[FAT_DIR_ATTRIBUTES] & FAT_ATTR_DIRECTORY) != 0;
+
+      if(pu8Entry[0] == FAT_DIR_END)
+      {
+        return bOk;
+      }
+      if( (pu8Entry[0] == FAT_DIR_DELETED) || (pu8Entry[FAT_DIR_ATTRIBUTES] & FAT_ATTR_VOLUME_ID) ||
+          (pu8Entry[0] == '.') )
+      {
+        continue;
+      }
+
+      if(Test_bVerbose)
+      {
+        printf("        %.11s  cluster %u  %u bytes\n", (char*)pu8Entry, (unsigned)u32Start, (unsigned)u32Size);
+      }
+
+      if(!CheckChain(u32Start, u32Size, bDirectory, (char*)pu8Entry))
+      {
+        bOk = FALSE;
+        continue;
+      }
+
+      if(bDirectory)
+      {
+        bOk &= CheckDirectory(u32Start, psFiles_, u32FileCount_, u32Depth_ + 1);
+        continue;
+      }
+
+      for(u32 j = 0; j < u32FileCount_; j++)
+      {
+        if(memcmp(pu8Entry, psFiles_[j].pcName, FAT_NAME_SIZE) == 0)
+        {
+          psFiles_[j].bFound = TRUE;
+          if(u32Size != psFiles_[j].u32Size)
+          {
+            printf("        %.11s: %u bytes, expected %u\n", (char*)pu8Entry, (unsigned)u32Size,
+                   (unsigned)psFiles_[j].u32Size);
+            bOk = FALSE;
+          }
+          else if(!CheckContents(u32Start, u32Size, psFiles_[j].u8Tag))
+          {
+            bOk = FALSE;
+          }
+        }
+      }
+    }
+
+    u32Cluster = Test_au32Fat[u32Cluster];
+  }
+  return bOk;
+}
+
+static void CheckVolume(const char* pcWhen_, ExpectedFileType* psFiles_, u32 u32FileCount_)
+{
+  u32 u32Lost = 0;
+  bool bSame = TRUE;
+  bool bFound = TRUE;
+
+  printf("%s:\n", pcWhen_);
+
+  /* MBR, boot sector, backup boot sector and FSInfo are only written by the formatter */
+  Check(SdModelReadImage(0, 1, Test_au8Sector) && (Test_au8Sector[FAT_BOOT_SIGNATURE_INDEX] == FAT_BOOT_SIGNATURE_0) &&
+        (Test_au8Sector[FAT_MBR_PARTITION_TABLE + FAT_PARTITION_TYPE_INDEX] == FAT_PARTITION_FAT32_LBA) &&
+        (Get32(&Test_au8Sector[FAT_MBR_PARTITION_TABLE + FAT_PARTITION_LBA_INDEX]) == VOLUME_START),
+        "MBR still describes the FAT32 partition");
+  Check(SdModelReadImage(VOLUME_START, 1, Test_au8Sector) && SdModelReadImage(VOLUME_START + 6, 1, Test_au8Sector2) &&
+        (memcmp(Test_au8Sector, Test_au8Sector2, SD_BLOCK_SIZE) == 0) &&
+        (Test_au8Sector[FAT_BOOT_SIGNATURE_INDEX + 1] == FAT_BOOT_SIGNATURE_1) &&
+        (Get32(&Test_au8Sector[FAT_BPB_FAT_SIZE_32]) == Test_u32FatSize) &&
+        (Get32(&Test_au8Sector[FAT_BPB_ROOT_CLUSTER]) == ROOT_CLUSTER) &&
+        SdModelReadImage(VOLUME_START + 1, 1, Test_au8Sector) && (Get32(&Test_au8Sector[0]) == 0x41615252) &&
+        (Get32(&Test_au8Sector[508]) == 0xAA550000),
+        "boot sector, backup boot sector and FSInfo are intact");
+
+  /* FAT copies */
+  for(u32 i = 0; i < Test_u32FatSize; i++)
+  {
+    if( !SdModelReadImage(VOLUME_START + RESERVED_SECTORS + i, 1, Test_au8Sector) ||
+        !SdModelReadImage(VOLUME_START + RESERVED_SECTORS + Test_u32FatSize + i, 1, Test_au8Sector2) ||
+        (memcmp(Test_au8Sector, Test_au8Sector2, SD_BLOCK_SIZE) != 0) )
+    {
+      bSame = FALSE;
+      printf("        FAT sector %u differs between the copies\n", (unsigned)i);
+    }
+    for(u32 j = 0; j < SD_BLOCK_SIZE / 4; j++)
+    {
+      u32 u32Entry = (i * (SD_BLOCK_SIZE / 4)) + j;
+      if(u32Entry < Test_u32Clusters + ROOT_CLUSTER)
+      {
+        Test_au32Fat[u32Entry] = Get32(&Test_au8Sector[j * 4]) & FAT32_CLUSTER_MASK;
+      }
+    }
+  }
+  Check(bSame, "both FAT copies are identical");
+  Check((Test_au32Fat[0] == 0x0FFFFFF8) && (Test_au32Fat[1] == 0x0FFFFFFF), "FAT[0] and FAT[1] are untouched");
+
+  /* Directory tree, chains and file contents */
+  memset(Test_au8Used, 0, sizeof(Test_au8Used));
+  for(u32 i = 0; i < u32FileCount_; i++)
+  {
+    psFiles_[i].bFound = FALSE;
+  }
+  Check(CheckChain(ROOT_CLUSTER, 0, TRUE, "root") && CheckDirectory(ROOT_CLUSTER, psFiles_, u32FileCount_, 0),
+        "every chain is in the volume, unshared, loop-free and as long as its file");
+  for(u32 i = 0; i < u32FileCount_; i++)
+  {
+    if(!psFiles_[i].bFound)
+    {
+      printf("        %.11s not found\n", psFiles_[i].pcName);
+      bFound = FALSE;
+    }
+  }
+  Check(bFound, "every file is in its directory with the size and data written");
+
+  for(u32 i = ROOT_CLUSTER; i < Test_u32Clusters + ROOT_CLUSTER; i++)
+  {
+    if( (Test_au32Fat[i] != 0) && !Test_au8Used[i] )
+    {
+      u32Lost++;
+    }
+  }
+  if(u32Lost)
+  {
+    printf("        %u lost clusters\n", (unsigned)u32Lost);
+  }
+  Check(u32Lost == 0, "no lost clusters (reserved log clusters beyond the data are still free)");
+}
+
+/* Copies the partition to its own sparse file and runs fsck.fat -n on it; notes when fsck.fat is not installed */
+static void RunFsck(const char* pcImage_)
+{
+  char acPartition[] = "/tmp/fat_log_test_partition_XXXXXX";
+  char acCommand[128];
+  static u8 au8Block[SD_BLOCK_SIZE];
+  static const u8 au8Zero[SD_BLOCK_SIZE];
+  int iIn, iOut, iStatus;
+
+  if(system("command -v fsck.fat > /dev/null 2>&1") != 0)
+  {
+    printf("  SKIP  fsck.fat not installed (dosfstools)\n");
+    Test_bFsckMissing = TRUE;
+    return;
+  }
+
+  iIn = open(pcImage_, O_RDONLY);
+  iOut = mkstemp(acPartition);
+  if( (iIn < 0) || (iOut < 0) || (ftruncate(iOut, (off_t)VOLUME_SECTORS * SD_BLOCK_SIZE) != 0) )
+  {
+    Check(FALSE, "partition copied for fsck.fat");
+    return;
+  }
+  for(u32 i = 0; i < VOLUME_SECTORS; i++)
+  {
+    if( (pread(iIn, au8Block, SD_BLOCK_SIZE, (off_t)(VOLUME_START + i) * SD_BLOCK_SIZE) == SD_BLOCK_SIZE) &&
+        (memcmp(au8Block, au8Zero, SD_BLOCK_SIZE) != 0) )
+    {
+      (void)pwrite(iOut, au8Block, SD_BLOCK_SIZE, (off_t)i * SD_BLOCK_SIZE);
+    }
+  }
+  close(iIn);
+  close(iOut);
+
+  snprintf(acCommand, sizeof(acCommand), "fsck.fat -n %s", acPartition);
+  iStatus = system(acCommand);
+  Check(iStatus == 0, "fsck.fat -n finds nothing to fix");
+  unlink(acPartition);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Logging through fat.c */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/* Writes records until u32Size_ bytes are in the log (the last one may be cut short), feeding whatever FatLogWrite()
+takes each pass */
+static bool LogData(u8 u8Tag_, u32 u32From_, u32 u32Size_)
+{
+  u32 u32Offset = u32From_;
+  u32 u32Bytes;
+
+  for(u32 i = 0; (i < TEST_TIMEOUT_MS) && (u32Offset < u32Size_); i++)
+  {
+    while(u32Offset < u32Size_)
+    {
+      u32Bytes = (u32Size_ - u32Offset < RECORD_SIZE) ? (u32Size_ - u32Offset) : RECORD_SIZE;
+      for(u32 j = 0; j < u32Bytes; j++)
+      {
+        Test_au8Record[j] = LogByte(u8Tag_, u32Offset + j);
+      }
+      if(!FatLogWrite(Test_au8Record, u32Bytes))
+      {
+        break;
+      }
+      u32Offset += u32Bytes;
+    }
+    RunPass();
+  }
+  return u32Offset == u32Size_;
+}
+
+static bool CloseLog(void)
+{
+  if(!FatLogClose())
+  {
+    return FALSE;
+  }
+  for(u32 i = 0; (i < TEST_TIMEOUT_MS) && FatLogIsOpen(); i++)
+  {
+    RunPass();
+  }
+  return !FatLogIsOpen() && (FatGetStatus() == FAT_READY);
+}
+
+/* Reads a whole file back with FatOpen() / FatRead() */
+static bool ReadBack(u8* pu8Path_, u8 u8Tag_, u32 u32Size_)
+{
+  u32 u32Offset = 0;
+
+  if( !FatOpen(pu8Path_) || !WaitFat() || (FatGetFileSize() != u32Size_) )
+  {
+    return FALSE;
+  }
+
+  while(u32Offset < u32Size_)
+  {
+    if( !FatRead(Test_au8Read, sizeof(Test_au8Read)) || !WaitFat() || (FatGetBytesRead() == 0) )
+    {
+      return FALSE;
+    }
+    for(u32 i = 0; i < FatGetBytesRead(); i++)
+    {
+      if(Test_au8Read[i] != LogByte(u8Tag_, u32Offset + i))
+      {
+        return FALSE;
+      }
+    }
+    u32Offset += FatGetBytesRead();
+  }
+
+  FatClose();
+  return u32Offset == u32Size_;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+int main(int argc, char* argv[])
+{
+  char acTemp[] = "/tmp/fat_log_test_XXXXXX";
+  ExpectedFileType asFiles[] =
+  {
+    {"README  TXT", 0,   README_SIZE, FALSE},
+    {"DATA    TXT", 'D', 0,           FALSE},
+    {"EVENTS  LOG", 'E', 0,           FALSE},
+  };
+  SdModelConfigType sModel;
+  u32 u32Hits, u32Misses, u32WriteBacks;
+  const char* pcImage = NULL;
+  bool bMounted;
+  int iFd;
+
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  for(int i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "-v"))
+    {
+      Test_bVerbose = TRUE;
+    }
+    else if( (i + 1 < argc) && !strcmp(argv[i], "-image") )
+    {
+      pcImage = argv[++i];
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-v] [-image file]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if(pcImage == NULL)
+  {
+    iFd = mkstemp(acTemp);
+    if(iFd < 0)
+    {
+      perror(acTemp);
+      return 2;
+    }
+    close(iFd);
+    pcImage = acTemp;
+  }
+
+  SdModelDefaultConfig(&sModel);
+  sModel.pcImage = pcImage;
+  if( !FormatImage(pcImage) || !SdModelOpen(&sModel) )
+  {
+    return 2;
+  }
+  printf("FAT32 image %s: %u clusters of %u bytes, %u sectors per FAT\n", pcImage, (unsigned)Test_u32Clusters,
+         (unsigned)CLUSTER_BYTES, (unsigned)Test_u32FatSize);
+
+  SimInitialize(TRUE, Test_bVerbose);
+  MessagingInitialize();
+  SspInitialize();
+  SdCardInitialize();
+  FatInitialize();
+
+  CheckVolume("Freshly formatted", asFiles, 1);
+
+  printf("Mount and log:\n");
+  for(u32 i = 0; (i < TEST_TIMEOUT_MS) && (FatGetStatus() != FAT_READY); i++)
+  {
+    RunPass();
+  }
+  bMounted = (FatGetStatus() == FAT_READY);
+  Check(bMounted, "fat.c mounts the volume");
+  if(!bMounted)
+  {
+    return (int)Test_u32Failures;
+  }
+
+  Check(FatLogOpen((u8*)LOG_PATH, LOG_MAX_SIZE) && WaitFat() && FatLogIsOpen(), "FatLogOpen() creates " LOG_PATH);
+  Check(LogData('D', 0, LOG_HALFWAY), "FatLogWrite() takes the first half");
+
+  /* Let the timed checkpoint make the first half durable */
+  for(u32 i = 0; i < FAT_LOG_CHECKPOINT_MS * 2; i++)
+  {
+    RunPass();
+  }
+  asFiles[1].u32Size = LOG_HALFWAY;
+  CheckVolume("After the timed checkpoint (as a power failure would leave it)", asFiles, 2);
+
+  printf("Finish the logs:\n");
+  Check(LogData('D', LOG_HALFWAY, LOG_SIZE), "FatLogWrite() takes the second half");
+  Check(CloseLog(), "FatLogClose() closes " LOG_PATH);
+
+  Check(FatLogOpen((u8*)LOG_PATH, LOG_MAX_SIZE) && !WaitFat() && (FatGetError() == FAT_ERROR_EXISTS),
+        "FatLogOpen() refuses an existing file");
+  Check(FatLogOpen((u8*)LOG2_PATH, 16384) && WaitFat() && LogData('E', 0, LOG2_SIZE) && CloseLog(),
+        "a second log in the root directory");
+
+  Check(ReadBack((u8*)LOG_PATH, 'D', LOG_SIZE), "FatRead() reads " LOG_PATH " back");
+  Check(ReadBack((u8*)LOG2_PATH, 'E', LOG2_SIZE), "FatRead() reads " LOG2_PATH " back");
+  FatGetCacheStats(&u32Hits, &u32Misses, &u32WriteBacks);
+  printf("        sector cache: %u hits, %u misses, %u write-backs\n", (unsigned)u32Hits, (unsigned)u32Misses,
+         (unsigned)u32WriteBacks);
+
+  asFiles[1].u32Size = LOG_SIZE;
+  asFiles[2].u32Size = LOG2_SIZE;
+  CheckVolume("After FatLogClose()", asFiles, 3);
+
+  SdModelClose();
+  RunFsck(pcImage);
+
+  if(pcImage == acTemp)
+  {
+    unlink(acTemp);
+  }
+  if(Test_u32Failures)
+  {
+    printf("FAILED\n");
+    return (int)Test_u32Failures;
+  }
+  if(Test_bFsckMissing)
+  {
+    printf("SKIPPED: fsck.fat not installed\n");
+    return EXIT_SKIPPED;
+  }
+  printf("passed\n");
+  return 0;
+
+} /* end main() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
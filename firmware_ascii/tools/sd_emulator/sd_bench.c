@@ -0,0 +1,374 @@
+/**********************************************************************************************************************
+File: sd_bench.c
+
+Description:
+The debug menu's SD benchmark (DebugCommandSdBenchmark() in firmware_common/application/debug.c) run on the host
+against the simulated card, so its numbers can be compared with a board's without one.  The tests, the
+DEBUG_SD_BENCH_* sizes, the random block sequence and the report line are the same as the firmware's:
+  Sequential read / write   DEBUG_SD_BENCH_CHUNK blocks per request, DEBUG_SD_BENCH_DEPTH requests in flight
+  Random read / write       DEBUG_SD_BENCH_RANDOM_OPS single-block requests, one at a time
+All requests go through SdQueueRead() / SdQueueWrite() with the unmodified SD driver, SSP and messaging tasks in the
+loop, and the request times come from SystemTimeUs() on the simulated clock.  The firmware takes its scratch area
+from the end of the gap before the FAT volume; here the volume start is read from the image's MBR (8192, the usual
+SD card alignment, if the image has none or is a new temporary file).
+
+Build and run on the host from firmware_ascii/tools/sd_emulator (link -no-pie, see sim_host.h):
+cc -std=gnu99 -O2 -no-pie -DEIE1 -DENABLE_SD -include sim_host.h -I../../../firmware_common \
+   -I../../../firmware_common/cmsis -I../../../firmware_common/drivers -I../../../firmware_common/application \
+   -I../../application -I../../bsp -I../../drivers -o sd_bench sd_bench.c sim_hardware.c \
+   sd_card_model.c ../../drivers/sdcard.c ../../../firmware_common/drivers/sam3u_ssp.c \
+   ../../../firmware_common/drivers/messaging.c ../../../firmware_common/drivers/utilities.c
+sd_bench                               (SDHC with the default timing on a temporary 64 MB image)
+sd_bench -sdsc -read-latency 800 -write-busy 2000 -multi-busy 400 -ncr 4
+sd_bench -image card.img               (the blocks before the card's first partition are overwritten)
+
+The exit status is 0 if every test completed.
+**********************************************************************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "configuration.h"
+#include "sd_card_model.h"
+#include "sim_hardware.h"
+
+#define IMAGE_BYTES               (64u * 1024u * 1024u)
+#define BENCH_VOLUME_START        (u32)8192            /* First partition block when the image has no MBR */
+#define BENCH_TIMEOUT_MS          (u32)60000           /* Longest a whole test may take */
+
+/* Everything the driver's PDC touches must be static (below 4 GB) */
+static u8 Bench_au8Buffer[DEBUG_SD_BENCH_BUFFER_SIZE];
+
+static u32 Bench_u32First;                            /* First block of the scratch area */
+static u32 Bench_u32Blocks;                           /* Blocks in the scratch area */
+static u8 Bench_u8Test;                               /* Test running (0 to DEBUG_SD_BENCH_TESTS - 1) */
+static u8 Bench_u8Depth;                              /* Requests kept in flight by the current test */
+static u32 Bench_u32Ops;                              /* Requests made by the current test */
+static u32 Bench_u32BlocksPerOp;                      /* Blocks in each request of the current test */
+static u32 Bench_u32Submitted;                        /* Requests accepted by the SD queue */
+static u32 Bench_u32Completed;                        /* Requests called back */
+static bool Bench_bFailed;                            /* Set if a request fails or cannot be queued */
+static u32 Bench_u32Seed;                             /* Random block generator */
+static u32 Bench_au32SubmitTime[DEBUG_SD_BENCH_DEPTH]; /* SystemTimeUs() when each request in flight was queued */
+static u32 Bench_u32StartTime;                        /* SystemTimeUs() when the current test started */
+static u32 Bench_u32EndTime;                          /* SystemTimeUs() when the last request was called back */
+static u32 Bench_u32MinLatency;                       /* Shortest request in us */
+static u32 Bench_u32MaxLatency;                       /* Longest request in us */
+static u32 Bench_u32TotalLatency;                     /* Sum of all request times in us */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Helpers */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/* One pass of the super loop with the tasks this build has, then sleep to the next tick */
+static void RunPass(void)
+{
+  SspRunActiveState();
+  SimUpdate();
+  MessagingRunActiveState();
+  SimUpdate();
+  SdCardRunActiveState();
+  SimUpdate();
+  SimSleep();
+}
+
+/* First partition's start block from the image's MBR, or BENCH_VOLUME_START if it has none */
+static u32 VolumeStart(const char* pcImage_)
+{
+  u8 au8Mbr[SD_BLOCK_SIZE];
+  u32 u32Start = 0;
+  FILE* pFile = fopen(pcImage_, "rb");
+
+  if( (pFile != NULL) && (fread(au8Mbr, 1, sizeof(au8Mbr), pFile) == sizeof(au8Mbr)) &&
+      (au8Mbr[510] == 0x55) && (au8Mbr[511] == 0xAA) )
+  {
+    u32Start = au8Mbr[454] | ((u32)au8Mbr[455] << 8) | ((u32)au8Mbr[456] << 16) | ((u32)au8Mbr[457] << 24);
+  }
+  if(pFile != NULL)
+  {
+    fclose(pFile);
+  }
+  return (u32Start != 0) ? u32Start : BENCH_VOLUME_START;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* The benchmark: DebugSdBenchCallback(), DebugSdBenchReport(), DebugSM_SdBenchStart() and DebugSM_SdBenchRun() */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+static void BenchCallback(u8* pu8Buffer_, bool bSuccess_)
+{
+  u32 u32Latency;
+
+  (void)pu8Buffer_;
+  Bench_u32EndTime = SystemTimeUs();
+  u32Latency = Bench_u32EndTime - Bench_au32SubmitTime[Bench_u32Completed % Bench_u8Depth];
+
+  if(u32Latency < Bench_u32MinLatency)
+  {
+    Bench_u32MinLatency = u32Latency;
+  }
+  if(u32Latency > Bench_u32MaxLatency)
+  {
+    Bench_u32MaxLatency = u32Latency;
+  }
+
+  Bench_u32TotalLatency += u32Latency;
+  Bench_u32Completed++;
+
+  if(!bSuccess_)
+  {
+    Bench_bFailed = TRUE;
+  }
+}
+
+static void BenchReport(void)
+{
+  static const char* apcTestNames[DEBUG_SD_BENCH_TESTS] =
+    {"Sequential read:  ", "Sequential write: ", "Random read:      ", "Random write:     "};
+  u32 u32Elapsed;
+  u32 u32Bytes;
+
+  printf("%s", apcTestNames[Bench_u8Test]);
+  if(Bench_bFailed)
+  {
+    printf("FAILED after %u requests\n", (unsigned)Bench_u32Completed);
+    return;
+  }
+
+  u32Elapsed = Bench_u32EndTime - Bench_u32StartTime;
+  if(u32Elapsed == 0)
+  {
+    u32Elapsed = 1;
+  }
+  u32Bytes = Bench_u32Completed * Bench_u32BlocksPerOp * SD_BLOCK_SIZE;
+
+  printf("%u KB/s  us min %u avg %u max %u\n", (unsigned)((u32Bytes * 1000) / u32Elapsed),
+         (unsigned)Bench_u32MinLatency, (unsigned)(Bench_u32TotalLatency / Bench_u32Completed),
+         (unsigned)Bench_u32MaxLatency);
+}
+
+static void BenchStart(void)
+{
+  if(Bench_u8Test < 2)
+  {
+    Bench_u8Depth = DEBUG_SD_BENCH_DEPTH;
+    Bench_u32BlocksPerOp = DEBUG_SD_BENCH_CHUNK;
+    Bench_u32Ops = Bench_u32Blocks / DEBUG_SD_BENCH_CHUNK;
+  }
+  else
+  {
+    Bench_u8Depth = 1;
+    Bench_u32BlocksPerOp = 1;
+    Bench_u32Ops = DEBUG_SD_BENCH_RANDOM_OPS;
+  }
+
+  if(Bench_u8Test & 0x01)
+  {
+    for(u32 i = 0; i < DEBUG_SD_BENCH_BUFFER_SIZE; i++)
+    {
+      Bench_au8Buffer[i] = (u8)(i / SD_BLOCK_SIZE);
+    }
+  }
+
+  Bench_u32Submitted = 0;
+  Bench_u32Completed = 0;
+  Bench_bFailed = FALSE;
+  Bench_u32Seed = DEBUG_SD_BENCH_SEED;
+  Bench_u32MinLatency = 0xFFFFFFFF;
+  Bench_u32MaxLatency = 0;
+  Bench_u32TotalLatency = 0;
+  Bench_u32StartTime = SystemTimeUs();
+  Bench_u32EndTime = Bench_u32StartTime;
+}
+
+/* TRUE once every request of the current test has been called back */
+static bool BenchRun(void)
+{
+  u32 u32Block;
+  u8* pu8Buffer;
+  u8 u8Slot;
+  bool bQueued;
+
+  while( !Bench_bFailed && (Bench_u32Submitted < Bench_u32Ops) &&
+         ((Bench_u32Submitted - Bench_u32Completed) < Bench_u8Depth) )
+  {
+    if(Bench_u8Depth == 1)
+    {
+      Bench_u32Seed = (Bench_u32Seed * 1664525) + 1013904223;
+      u32Block = Bench_u32First + ( (Bench_u32Seed >> 16) % Bench_u32Blocks );
+    }
+    else
+    {
+      u32Block = Bench_u32First + (Bench_u32Submitted * DEBUG_SD_BENCH_CHUNK);
+    }
+
+    u8Slot = Bench_u32Submitted % Bench_u8Depth;
+    pu8Buffer = Bench_au8Buffer + (u8Slot * DEBUG_SD_BENCH_CHUNK * SD_BLOCK_SIZE);
+    Bench_au32SubmitTime[u8Slot] = SystemTimeUs();
+
+    if(Bench_u8Test & 0x01)
+    {
+      bQueued = SdQueueWrite(u32Block, Bench_u32BlocksPerOp, pu8Buffer, BenchCallback);
+    }
+    else
+    {
+      bQueued = SdQueueRead(u32Block, Bench_u32BlocksPerOp, pu8Buffer, BenchCallback);
+    }
+
+    if(!bQueued)
+    {
+      if(SdGetStatus() == SD_NO_CARD)
+      {
+        Bench_bFailed = TRUE;
+      }
+      break;
+    }
+
+    Bench_u32Submitted++;
+  }
+
+  return (Bench_u32Completed == Bench_u32Submitted) && (Bench_bFailed || (Bench_u32Completed == Bench_u32Ops));
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+int main(int argc, char* argv[])
+{
+  char acTemp[] = "/tmp/sd_bench_XXXXXX";
+  SdModelConfigType sModel;
+  SdModelStatsType sStats;
+  SimStatsType sSim;
+  u32 u32VolumeStart;
+  u32 i;
+  int iFd = -1;
+  int iFailed = 0;
+
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  SdModelDefaultConfig(&sModel);
+  for(int j = 1; j < argc; j++)
+  {
+    if(!strcmp(argv[j], "-sdsc"))
+    {
+      sModel.bHighCapacity = 0;
+    }
+    else if( (j + 1 < argc) && !strcmp(argv[j], "-image") )
+    {
+      sModel.pcImage = argv[++j];
+    }
+    else if( (j + 1 < argc) && !strcmp(argv[j], "-ncr") )
+    {
+      sModel.u32NcrBytes = (u32)strtoul(argv[++j], NULL, 0);
+    }
+    else if( (j + 1 < argc) && !strcmp(argv[j], "-read-latency") )
+    {
+      sModel.u32ReadLatencyUs = (u32)strtoul(argv[++j], NULL, 0);
+    }
+    else if( (j + 1 < argc) && !strcmp(argv[j], "-write-busy") )
+    {
+      sModel.u32WriteBusyUs = (u32)strtoul(argv[++j], NULL, 0);
+    }
+    else if( (j + 1 < argc) && !strcmp(argv[j], "-multi-busy") )
+    {
+      sModel.u32MultiWriteBusyUs = (u32)strtoul(argv[++j], NULL, 0);
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-sdsc] [-image file] [-ncr bytes] [-read-latency us] [-write-busy us]\n"
+                      "       [-multi-busy us]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if(sModel.pcImage == NULL)
+  {
+    iFd = mkstemp(acTemp);
+    if( (iFd < 0) || (ftruncate(iFd, IMAGE_BYTES) != 0) )
+    {
+      perror(acTemp);
+      return 2;
+    }
+    sModel.pcImage = acTemp;
+  }
+
+  /* Same scratch area as DebugCommandSdBenchmark(): the end of the gap after the MBR, whole chunks only */
+  u32VolumeStart = VolumeStart(sModel.pcImage);
+  Bench_u32Blocks = u32VolumeStart - 1;
+  if(Bench_u32Blocks > DEBUG_SD_BENCH_BLOCKS)
+  {
+    Bench_u32Blocks = DEBUG_SD_BENCH_BLOCKS;
+  }
+  Bench_u32Blocks -= (Bench_u32Blocks % DEBUG_SD_BENCH_CHUNK);
+  Bench_u32First = u32VolumeStart - Bench_u32Blocks;
+
+  if( (Bench_u32Blocks < (DEBUG_SD_BENCH_CHUNK * DEBUG_SD_BENCH_DEPTH)) || !SdModelOpen(&sModel) )
+  {
+    fprintf(stderr, "%s: no scratch area before block %u or the image cannot be opened\n", sModel.pcImage,
+            (unsigned)u32VolumeStart);
+    return 2;
+  }
+
+  SimInitialize(TRUE, FALSE);
+  MessagingInitialize();
+  SspInitialize();
+  SdCardInitialize();
+
+  for(i = 0; (i < BENCH_TIMEOUT_MS) && (SdGetStatus() != SD_IDLE); i++)
+  {
+    RunPass();
+  }
+  if(SdGetStatus() != SD_IDLE)
+  {
+    fprintf(stderr, "card did not initialize\n");
+    return 2;
+  }
+
+  printf("%s card, NCR %u, read latency %u us, write busy %u us (%u us in CMD25)\n",
+         sModel.bHighCapacity ? "SDHC" : "SDSC", (unsigned)sModel.u32NcrBytes, (unsigned)sModel.u32ReadLatencyUs,
+         (unsigned)sModel.u32WriteBusyUs, (unsigned)sModel.u32MultiWriteBusyUs);
+  printf("SD benchmark: %u blocks from block %u\n", (unsigned)Bench_u32Blocks, (unsigned)Bench_u32First);
+
+  for(Bench_u8Test = 0; Bench_u8Test < DEBUG_SD_BENCH_TESTS; Bench_u8Test++)
+  {
+    BenchStart();
+    for(i = 0; (i < BENCH_TIMEOUT_MS) && !BenchRun(); i++)
+    {
+      RunPass();
+    }
+    if(i == BENCH_TIMEOUT_MS)
+    {
+      Bench_bFailed = TRUE;
+    }
+
+    BenchReport();
+    if(Bench_bFailed)
+    {
+      iFailed = 1;
+      break;
+    }
+  }
+
+  SdModelGetStats(&sStats);
+  SimGetStats(&sSim);
+  printf("%u blocks read, %u written, %u CRC errors, SPI busy %u%% of %u ms\n", (unsigned)sStats.u32BlocksRead,
+         (unsigned)sStats.u32BlocksWritten, (unsigned)SdGetCrcErrorCount(),
+         (unsigned)((sSim.u64BusBusyNs * 100) / SimTimeNs()), (unsigned)(SimTimeNs() / 1000000u));
+
+  SdModelClose();
+  if(iFd >= 0)
+  {
+    close(iFd);
+    unlink(acTemp);
+  }
+  return iFailed;
+
+} /* end main() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
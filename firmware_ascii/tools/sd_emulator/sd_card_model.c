@@ -0,0 +1,738 @@
+/**********************************************************************************************************************
+File: sd_card_model.c
+
+Description:
+SPI-mode SD card model for the host build of the SD driver.  The card is backed by a disk image file: block N of the
+card is bytes N * 512 to N * 512 + 511 of the file.  The model is clocked one byte at a time by SdModelExchange()
+with the byte the host sends (MOSI) and the simulated time of the byte, and returns the byte the card sends (MISO).
+Nothing happens while the host is not clocking, just like a real card, but busy and latency times keep running.
+
+Supported:
+CMD0, CMD8 (R7 echo), CMD55 + ACMD41 (idle for a configurable number of polls; SDHC needs HCS), CMD58 (R3 OCR with
+CCS), CMD16 (512 only), CMD59 (CRC on / off), CMD17, CMD18 + CMD12 (stuff byte, R1b), CMD24, CMD55 + ACMD23, CMD25
+with 0xFC / 0xFD tokens.  Everything else is answered with the illegal command bit.
+
+Responses come after u32NcrBytes of 0xFF.  CMD0 and CMD8 always need a good CRC7 and every command does once CMD59
+has turned CRC checking on; written blocks are then checked against their CRC16 as well.  Reads send a start token
+after u32ReadLatencyUs (u32ReadBlockGapUs between the blocks of CMD18) and each accepted write block holds DO low
+(busy) for u32WriteBusyUs or u32MultiWriteBusyUs.  Bad read and write CRCs can be injected to test the retries.
+
+Addresses are block numbers for SDHC and byte addresses (multiples of 512) for SDSC.  Commands for blocks past the
+end of the image get the parameter error bit and a CMD18 that runs off the end sends an out of range error token.
+**********************************************************************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "sd_card_model.h"
+
+#define BLOCK_SIZE                512u
+#define CRC_SIZE                  2u
+#define COMMAND_SIZE              6u
+#define OUT_QUEUE_SIZE            (1u + BLOCK_SIZE + CRC_SIZE + 16u)
+
+#define R1_READY                  0x00u
+#define R1_IDLE                   0x01u
+#define R1_ILLEGAL_COMMAND        0x04u
+#define R1_COM_CRC_ERROR          0x08u
+#define R1_ADDRESS_ERROR          0x20u
+#define R1_PARAMETER_ERROR        0x40u
+
+#define TOKEN_START_BLOCK         0xFEu
+#define TOKEN_START_BLOCK_MULT    0xFCu
+#define TOKEN_STOP_TRAN           0xFDu
+#define TOKEN_ERROR_OUT_OF_RANGE  0x08u
+
+#define DATA_ACCEPTED             0x05u
+#define DATA_CRC_ERROR            0x0Bu
+#define DATA_WRITE_ERROR          0x0Du
+
+#define OCR_VOLTAGES              0x00FF8000u          /* 2.7 - 3.6 V */
+#define OCR_POWER_UP_DONE         0x80000000u
+#define OCR_CCS                   0x40000000u
+#define ACMD41_HCS                0x40000000u
+
+typedef enum {MODEL_COMMAND, MODEL_READ, MODEL_WRITE_TOKEN, MODEL_WRITE_DATA} ModelModeType;
+
+
+static SdModelConfigType Model_sConfig;
+static SdModelStatsType Model_sStats;
+static FILE* Model_pImage;
+static uint32_t Model_u32Blocks;
+
+static int Model_bSelected;
+static int Model_bSpiMode;                             /* CMD0 has been received */
+static int Model_bAppCommand;                          /* CMD55 was the last command */
+static int Model_bReady;                               /* ACMD41 has finished initialization */
+static uint32_t Model_u32InitPollsLeft;
+static ModelModeType Model_eMode;
+
+static uint8_t Model_au8Command[COMMAND_SIZE];
+static uint32_t Model_u32CommandIndex;
+
+static uint8_t Model_au8Out[OUT_QUEUE_SIZE];           /* Bytes the card will send next */
+static uint32_t Model_u32OutHead;
+static uint32_t Model_u32OutCount;
+static uint32_t Model_u32PendingBusyUs;                /* Busy time that starts once the queue is empty */
+static uint64_t Model_u64BusyUntilNs;
+
+static int Model_bMultiBlock;
+static uint32_t Model_u32Block;                        /* Next block to read or write */
+static int Model_bGapArmed;                            /* Model_u64NextTokenNs is set */
+static int Model_bReadStopped;                         /* An error token was sent: wait for CMD12 */
+static uint64_t Model_u64NextTokenNs;
+static uint32_t Model_u32ReadCount;
+static uint32_t Model_u32WriteCount;
+
+static uint8_t Model_au8WriteData[BLOCK_SIZE + CRC_SIZE];
+static uint32_t Model_u32WriteIndex;
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Bit-by-bit CRCs so the firmware's tables are checked against an independent version */
+static uint8_t Crc7(const uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  uint8_t u8Crc = 0;
+
+  while(u32Size_--)
+  {
+    uint8_t u8Byte = *pu8Data_++;
+
+    for(int i = 0; i < 8; i++)
+    {
+      u8Crc <<= 1;
+      if( ((u8Byte << i) ^ u8Crc) & 0x80 )
+      {
+        u8Crc ^= 0x09;
+      }
+    }
+    u8Crc &= 0x7F;
+  }
+  return u8Crc;
+}
+
+static uint16_t Crc16(const uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  uint16_t u16Crc = 0;
+
+  while(u32Size_--)
+  {
+    u16Crc ^= (uint16_t)(*pu8Data_++ << 8);
+    for(int i = 0; i < 8; i++)
+    {
+      u16Crc = (u16Crc & 0x8000) ? (uint16_t)((u16Crc << 1) ^ 0x1021) : (uint16_t)(u16Crc << 1);
+    }
+  }
+  return u16Crc;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Trace line for a data token or response */
+static void Trace(const char* pcEvent_, uint8_t u8Token_, uint64_t u64TimeNs_)
+{
+  if(Model_sConfig.bTrace)
+  {
+    fprintf(stderr, "%10.3f ms  %s 0x%02X block %u\n", (double)u64TimeNs_ / 1e6, pcEvent_, u8Token_, Model_u32Block);
+  }
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Image access */
+static int ImageRead(uint32_t u32Block_, uint8_t* pu8Data_)
+{
+  return (fseeko(Model_pImage, (off_t)u32Block_ * BLOCK_SIZE, SEEK_SET) == 0) &&
+         (fread(pu8Data_, 1, BLOCK_SIZE, Model_pImage) == BLOCK_SIZE);
+}
+
+static int ImageWrite(uint32_t u32Block_, const uint8_t* pu8Data_)
+{
+  return (fseeko(Model_pImage, (off_t)u32Block_ * BLOCK_SIZE, SEEK_SET) == 0) &&
+         (fwrite(pu8Data_, 1, BLOCK_SIZE, Model_pImage) == BLOCK_SIZE);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Output queue */
+static void QueueByte(uint8_t u8Byte_)
+{
+  if(Model_u32OutCount < OUT_QUEUE_SIZE)
+  {
+    Model_au8Out[(Model_u32OutHead + Model_u32OutCount) % OUT_QUEUE_SIZE] = u8Byte_;
+    Model_u32OutCount++;
+  }
+}
+
+static void QueueResponse(const uint8_t* pu8Response_, uint32_t u32Size_)
+{
+  for(uint32_t i = 0; i < Model_sConfig.u32NcrBytes; i++)
+  {
+    QueueByte(0xFF);
+  }
+  while(u32Size_--)
+  {
+    QueueByte(*pu8Response_++);
+  }
+}
+
+static void QueueR1(uint8_t u8R1_)
+{
+  QueueResponse(&u8R1_, 1);
+}
+
+static void ClearQueue(void)
+{
+  Model_u32OutHead = 0;
+  Model_u32OutCount = 0;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Works out the block for a data command; returns 0 or the R1 error bits */
+static uint8_t CommandBlock(uint32_t u32Argument_, uint32_t* pu32Block_)
+{
+  if(!Model_sConfig.bHighCapacity)
+  {
+    if(u32Argument_ % BLOCK_SIZE)
+    {
+      return R1_ADDRESS_ERROR;
+    }
+    u32Argument_ /= BLOCK_SIZE;
+  }
+
+  if(u32Argument_ >= Model_u32Blocks)
+  {
+    return R1_PARAMETER_ERROR;
+  }
+
+  *pu32Block_ = u32Argument_;
+  return R1_READY;
+}
+
+/* A complete command has arrived at time u64TimeNs_ */
+static void Command(uint64_t u64TimeNs_)
+{
+  uint8_t u8Index = Model_au8Command[0] & 0x3F;
+  uint32_t u32Argument = ((uint32_t)Model_au8Command[1] << 24) | ((uint32_t)Model_au8Command[2] << 16) |
+                         ((uint32_t)Model_au8Command[3] << 8) | Model_au8Command[4];
+  int bApp = Model_bAppCommand;
+  uint8_t u8Idle = Model_bReady ? R1_READY : R1_IDLE;
+  uint8_t au8Response[5];
+  uint8_t u8Error;
+  uint32_t u32Ocr;
+
+  /* A card that is not in SPI mode yet only listens for CMD0 */
+  if( !Model_bSpiMode && (u8Index != 0) )
+  {
+    return;
+  }
+
+  if( (u8Index == 0) || (u8Index == 8) || Model_sStats.bCrcOn )
+  {
+    if( Crc7(Model_au8Command, COMMAND_SIZE - 1) != (Model_au8Command[COMMAND_SIZE - 1] >> 1) )
+    {
+      Model_sStats.u32CommandCrcErrors++;
+      Model_bAppCommand = 0;
+      QueueR1(R1_COM_CRC_ERROR | u8Idle);
+      return;
+    }
+  }
+
+  if(Model_sConfig.bTrace)
+  {
+    fprintf(stderr, "%10.3f ms  %sCMD%u 0x%08X\n", (double)u64TimeNs_ / 1e6, bApp ? "A" : "", u8Index, u32Argument);
+  }
+
+  Model_sStats.au32Commands[u8Index]++;
+  Model_bAppCommand = 0;
+  if(bApp)
+  {
+    Model_sStats.u32AppCommands++;
+  }
+
+  /* Only CMD12 is accepted while a read is streaming */
+  if( (Model_eMode == MODEL_READ) && (u8Index != 12) )
+  {
+    Model_sStats.u32IllegalCommands++;
+    return;
+  }
+
+  switch(u8Index)
+  {
+    case 0:
+    {
+      Model_bSpiMode = 1;
+      Model_bReady = 0;
+      Model_u32InitPollsLeft = Model_sConfig.u32InitPolls;
+      Model_sStats.bCrcOn = 0;
+      Model_eMode = MODEL_COMMAND;
+      QueueR1(R1_IDLE);
+      break;
+    }
+
+    case 8:
+    {
+      au8Response[0] = u8Idle;
+      au8Response[1] = 0x00;
+      au8Response[2] = 0x00;
+      au8Response[3] = (uint8_t)(u32Argument >> 8) & 0x0F;
+      au8Response[4] = (uint8_t)u32Argument;
+      QueueResponse(au8Response, 5);
+      break;
+    }
+
+    case 12:
+    {
+      /* The byte after CMD12 is a stuff byte, then the R1 and busy */
+      if(Model_eMode == MODEL_READ)
+      {
+        ClearQueue();
+        QueueByte(0xFF);
+        Model_eMode = MODEL_COMMAND;
+        Model_u32PendingBusyUs = Model_sConfig.u32StopReadBusyUs;
+      }
+      QueueR1(u8Idle);
+      break;
+    }
+
+    case 16:
+    {
+      QueueR1( (u32Argument == BLOCK_SIZE) ? u8Idle : (R1_PARAMETER_ERROR | u8Idle) );
+      break;
+    }
+
+    case 17:
+    case 18:
+    case 24:
+    case 25:
+    {
+      if(!Model_bReady)
+      {
+        Model_sStats.u32IllegalCommands++;
+        QueueR1(R1_ILLEGAL_COMMAND | R1_IDLE);
+        break;
+      }
+
+      u8Error = CommandBlock(u32Argument, &Model_u32Block);
+      QueueR1(u8Error);
+      if(u8Error != R1_READY)
+      {
+        break;
+      }
+
+      Model_bMultiBlock = (u8Index == 18) || (u8Index == 25);
+      if( (u8Index == 17) || (u8Index == 18) )
+      {
+        Model_eMode = MODEL_READ;
+        Model_bReadStopped = 0;
+        Model_bGapArmed = 1;
+        Model_u64NextTokenNs = u64TimeNs_ + ((uint64_t)Model_sConfig.u32ReadLatencyUs * 1000u);
+      }
+      else
+      {
+        Model_eMode = MODEL_WRITE_TOKEN;
+      }
+      break;
+    }
+
+    case 23:
+    {
+      if(bApp)
+      {
+        Model_sStats.u32PreEraseBlocks += u32Argument & 0x007FFFFFu;
+        QueueR1(u8Idle);
+      }
+      else
+      {
+        Model_sStats.u32IllegalCommands++;
+        QueueR1(R1_ILLEGAL_COMMAND | u8Idle);
+      }
+      break;
+    }
+
+    case 41:
+    {
+      if(!bApp)
+      {
+        Model_sStats.u32IllegalCommands++;
+        QueueR1(R1_ILLEGAL_COMMAND | u8Idle);
+        break;
+      }
+
+      /* An SDHC card stays idle for a host that does not set HCS */
+      if( (Model_u32InitPollsLeft != 0) || (Model_sConfig.bHighCapacity && !(u32Argument & ACMD41_HCS)) )
+      {
+        if(Model_u32InitPollsLeft != 0)
+        {
+          Model_u32InitPollsLeft--;
+        }
+        QueueR1(R1_IDLE);
+      }
+      else
+      {
+        Model_bReady = 1;
+        QueueR1(R1_READY);
+      }
+      break;
+    }
+
+    case 55:
+    {
+      Model_bAppCommand = 1;
+      QueueR1(u8Idle);
+      break;
+    }
+
+    case 58:
+    {
+      u32Ocr = OCR_VOLTAGES;
+      if(Model_bReady)
+      {
+        u32Ocr |= OCR_POWER_UP_DONE;
+        if(Model_sConfig.bHighCapacity)
+        {
+          u32Ocr |= OCR_CCS;
+        }
+      }
+      au8Response[0] = u8Idle;
+      au8Response[1] = (uint8_t)(u32Ocr >> 24);
+      au8Response[2] = (uint8_t)(u32Ocr >> 16);
+      au8Response[3] = (uint8_t)(u32Ocr >> 8);
+      au8Response[4] = (uint8_t)u32Ocr;
+      QueueResponse(au8Response, 5);
+      break;
+    }
+
+    case 59:
+    {
+      Model_sStats.bCrcOn = (u32Argument & 0x01) != 0;
+      QueueR1(u8Idle);
+      break;
+    }
+
+    default:
+    {
+      Model_sStats.u32IllegalCommands++;
+      QueueR1(R1_ILLEGAL_COMMAND | u8Idle);
+      break;
+    }
+  } /* end switch */
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Read stream: returns the next byte the card sends while no response is queued */
+static uint8_t ReadNext(uint64_t u64TimeNs_)
+{
+  uint8_t au8Block[BLOCK_SIZE];
+  uint16_t u16Crc;
+
+  if(Model_bReadStopped)
+  {
+    return 0xFF;
+  }
+
+  if(!Model_bGapArmed)
+  {
+    Model_bGapArmed = 1;
+    Model_u64NextTokenNs = u64TimeNs_ + ((uint64_t)Model_sConfig.u32ReadBlockGapUs * 1000u);
+  }
+
+  if(u64TimeNs_ < Model_u64NextTokenNs)
+  {
+    return 0xFF;
+  }
+
+  Model_bGapArmed = 0;
+  if( (Model_u32Block >= Model_u32Blocks) || !ImageRead(Model_u32Block, au8Block) )
+  {
+    Model_bReadStopped = 1;
+    QueueByte(TOKEN_ERROR_OUT_OF_RANGE);
+    Trace("sent error token", TOKEN_ERROR_OUT_OF_RANGE, u64TimeNs_);
+  }
+  else
+  {
+    u16Crc = Crc16(au8Block, BLOCK_SIZE);
+    Model_u32ReadCount++;
+    if( (Model_sConfig.u32ReadCrcErrorEvery != 0) && ((Model_u32ReadCount % Model_sConfig.u32ReadCrcErrorEvery) == 0) )
+    {
+      u16Crc ^= 0x0001;
+      Model_sStats.u32ReadCrcErrors++;
+    }
+
+    Trace("sent start token", TOKEN_START_BLOCK, u64TimeNs_);
+    QueueByte(TOKEN_START_BLOCK);
+    for(uint32_t i = 0; i < BLOCK_SIZE; i++)
+    {
+      QueueByte(au8Block[i]);
+    }
+    QueueByte((uint8_t)(u16Crc >> 8));
+    QueueByte((uint8_t)u16Crc);
+
+    Model_sStats.u32BlocksRead++;
+    Model_u32Block++;
+    if(!Model_bMultiBlock)
+    {
+      Model_eMode = MODEL_COMMAND;
+    }
+  }
+
+  Model_u32OutCount--;
+  return Model_au8Out[Model_u32OutHead++ % OUT_QUEUE_SIZE];
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Write stream: takes one byte from the host */
+static void WriteByte(uint8_t u8Mosi_, uint64_t u64TimeNs_)
+{
+  uint16_t u16Crc;
+  int bCrcError;
+
+  if(Model_eMode == MODEL_WRITE_TOKEN)
+  {
+    if( ((u8Mosi_ == TOKEN_START_BLOCK) && !Model_bMultiBlock) ||
+        ((u8Mosi_ == TOKEN_START_BLOCK_MULT) && Model_bMultiBlock) )
+    {
+      Trace("got start token", u8Mosi_, u64TimeNs_);
+      Model_eMode = MODEL_WRITE_DATA;
+      Model_u32WriteIndex = 0;
+    }
+    else if( (u8Mosi_ == TOKEN_STOP_TRAN) && Model_bMultiBlock )
+    {
+      Trace("got stop token", u8Mosi_, u64TimeNs_);
+      /* One stuff byte, then busy while the card finishes */
+      QueueByte(0xFF);
+      Model_u32PendingBusyUs = Model_sConfig.u32StopBusyUs;
+      Model_eMode = MODEL_COMMAND;
+    }
+    return;
+  }
+
+  Model_au8WriteData[Model_u32WriteIndex++] = u8Mosi_;
+  if(Model_u32WriteIndex < sizeof(Model_au8WriteData))
+  {
+    return;
+  }
+
+  /* The data response goes out in the byte after the CRC */
+  Model_u32WriteCount++;
+  u16Crc = (uint16_t)((Model_au8WriteData[BLOCK_SIZE] << 8) | Model_au8WriteData[BLOCK_SIZE + 1]);
+  bCrcError = Model_sStats.bCrcOn && (Crc16(Model_au8WriteData, BLOCK_SIZE) != u16Crc);
+  if( (Model_sConfig.u32WriteCrcErrorEvery != 0) && ((Model_u32WriteCount % Model_sConfig.u32WriteCrcErrorEvery) == 0) )
+  {
+    bCrcError = 1;
+  }
+
+  if(bCrcError)
+  {
+    Model_sStats.u32WriteCrcErrors++;
+    QueueByte(DATA_CRC_ERROR);
+    Trace("sent data response", DATA_CRC_ERROR, u64TimeNs_);
+  }
+  else if( (Model_u32Block >= Model_u32Blocks) || !ImageWrite(Model_u32Block, Model_au8WriteData) )
+  {
+    QueueByte(DATA_WRITE_ERROR);
+    Trace("sent data response", DATA_WRITE_ERROR, u64TimeNs_);
+  }
+  else
+  {
+    QueueByte(DATA_ACCEPTED);
+    Trace("sent data response", DATA_ACCEPTED, u64TimeNs_);
+    Model_sStats.u32BlocksWritten++;
+    Model_u32Block++;
+    Model_u32PendingBusyUs = Model_bMultiBlock ? Model_sConfig.u32MultiWriteBusyUs : Model_sConfig.u32WriteBusyUs;
+  }
+
+  /* A single block write is over; a multi-block write waits for the next token (or the stop token after an error) */
+  Model_eMode = Model_bMultiBlock ? MODEL_WRITE_TOKEN : MODEL_COMMAND;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Public functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/* Typical class 10 SDHC timing */
+void SdModelDefaultConfig(SdModelConfigType* psConfig_)
+{
+  memset(psConfig_, 0, sizeof(*psConfig_));
+  psConfig_->bHighCapacity       = 1;
+  psConfig_->u32NcrBytes         = 1;
+  psConfig_->u32InitPolls        = 10;
+  psConfig_->u32ReadLatencyUs    = 300;
+  psConfig_->u32ReadBlockGapUs   = 20;
+  psConfig_->u32WriteBusyUs      = 700;
+  psConfig_->u32MultiWriteBusyUs = 100;
+  psConfig_->u32StopBusyUs       = 500;
+  psConfig_->u32StopReadBusyUs   = 0;
+}
+
+/* Opens the image and resets the card to its power-up state */
+int SdModelOpen(const SdModelConfigType* psConfig_)
+{
+  off_t u64Size;
+
+  Model_sConfig = *psConfig_;
+  if( (Model_sConfig.u32NcrBytes < 1) || (Model_sConfig.u32NcrBytes > 8) )
+  {
+    fprintf(stderr, "sd model: NCR must be 1 to 8 bytes\n");
+    return 0;
+  }
+
+  Model_pImage = fopen(Model_sConfig.pcImage, "r+b");
+  if(Model_pImage == NULL)
+  {
+    perror(Model_sConfig.pcImage);
+    return 0;
+  }
+
+  fseeko(Model_pImage, 0, SEEK_END);
+  u64Size = ftello(Model_pImage);
+  if( (u64Size < (off_t)BLOCK_SIZE) || ((u64Size / BLOCK_SIZE) > 0xFFFFFFFFu) ||
+      (!Model_sConfig.bHighCapacity && (u64Size > 0x80000000u)) )
+  {
+    fprintf(stderr, "sd model: %s is not a usable %s image size\n", Model_sConfig.pcImage,
+            Model_sConfig.bHighCapacity ? "SDHC" : "SDSC (2 GB max)");
+    fclose(Model_pImage);
+    Model_pImage = NULL;
+    return 0;
+  }
+  Model_u32Blocks = (uint32_t)(u64Size / BLOCK_SIZE);
+
+  memset(&Model_sStats, 0, sizeof(Model_sStats));
+  Model_bSelected = 0;
+  Model_bSpiMode = 0;
+  Model_bAppCommand = 0;
+  Model_bReady = 0;
+  Model_eMode = MODEL_COMMAND;
+  Model_u32CommandIndex = 0;
+  Model_u32PendingBusyUs = 0;
+  Model_u64BusyUntilNs = 0;
+  Model_u32ReadCount = 0;
+  Model_u32WriteCount = 0;
+  ClearQueue();
+  return 1;
+}
+
+void SdModelClose(void)
+{
+  if(Model_pImage != NULL)
+  {
+    fclose(Model_pImage);
+    Model_pImage = NULL;
+  }
+}
+
+uint32_t SdModelBlocks(void)
+{
+  return Model_u32Blocks;
+}
+
+/* Chip select: a deselected card ignores the bus and any response in progress is lost */
+void SdModelSelect(int bSelected_)
+{
+  if(bSelected_ != Model_bSelected)
+  {
+    Model_bSelected = bSelected_;
+    Model_u32CommandIndex = 0;
+    if(!bSelected_)
+    {
+      ClearQueue();
+    }
+  }
+}
+
+/* One byte time on the bus */
+uint8_t SdModelExchange(uint8_t u8Mosi_, uint64_t u64TimeNs_)
+{
+  uint8_t u8Miso;
+  int bBusy = 0;
+
+  if( !Model_bSelected || (Model_pImage == NULL) )
+  {
+    return 0xFF;
+  }
+
+  /* What the card sends depends on what it had before this byte */
+  if(Model_u32OutCount != 0)
+  {
+    u8Miso = Model_au8Out[Model_u32OutHead++ % OUT_QUEUE_SIZE];
+    Model_u32OutCount--;
+    if( (Model_u32OutCount == 0) && (Model_u32PendingBusyUs != 0) )
+    {
+      Model_u64BusyUntilNs = u64TimeNs_ + ((uint64_t)Model_u32PendingBusyUs * 1000u);
+      Model_u32PendingBusyUs = 0;
+    }
+  }
+  else if(u64TimeNs_ < Model_u64BusyUntilNs)
+  {
+    u8Miso = 0x00;
+    bBusy = 1;
+  }
+  else if(Model_eMode == MODEL_READ)
+  {
+    u8Miso = ReadNext(u64TimeNs_);
+  }
+  else
+  {
+    u8Miso = 0xFF;
+  }
+
+  /* A busy card ignores the host */
+  if(bBusy)
+  {
+    return u8Miso;
+  }
+
+  if( (Model_eMode == MODEL_WRITE_TOKEN) || (Model_eMode == MODEL_WRITE_DATA) )
+  {
+    WriteByte(u8Mosi_, u64TimeNs_);
+  }
+  else if(Model_u32CommandIndex != 0)
+  {
+    Model_au8Command[Model_u32CommandIndex++] = u8Mosi_;
+    if(Model_u32CommandIndex == COMMAND_SIZE)
+    {
+      Model_u32CommandIndex = 0;
+      Command(u64TimeNs_);
+    }
+  }
+  else if( (u8Mosi_ & 0xC0) == 0x40 )
+  {
+    /* Start and transmission bits of a command */
+    Model_au8Command[0] = u8Mosi_;
+    Model_u32CommandIndex = 1;
+  }
+
+  return u8Miso;
+}
+
+void SdModelGetStats(SdModelStatsType* psStats_)
+{
+  *psStats_ = Model_sStats;
+}
+
+/* Reads blocks straight from the image so tests can compare what the host wrote */
+int SdModelReadImage(uint32_t u32Block_, uint32_t u32Count_, uint8_t* pu8Data_)
+{
+  fflush(Model_pImage);
+  for(uint32_t i = 0; i < u32Count_; i++)
+  {
+    if( (u32Block_ + i >= Model_u32Blocks) || !ImageRead(u32Block_ + i, &pu8Data_[i * BLOCK_SIZE]) )
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
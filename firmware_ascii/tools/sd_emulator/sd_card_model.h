@@ -0,0 +1,66 @@
+/**********************************************************************************************************************
+File: sd_card_model.h
+
+Description:
+Header file for sd_card_model.c
+**********************************************************************************************************************/
+
+#ifndef __SD_CARD_MODEL_H
+#define __SD_CARD_MODEL_H
+
+#include <stdint.h>
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+typedef struct
+{
+  const char* pcImage;                /* Disk image file that holds the card contents (its size is the card size) */
+  int bHighCapacity;                  /* Nonzero for SDHC (block addresses, CCS set), 0 for SDSC v2 (byte addresses) */
+  uint32_t u32NcrBytes;               /* 0xFF bytes between a command and its R1 (1 to 8) */
+  uint32_t u32InitPolls;              /* ACMD41s answered "idle" before the card is ready */
+  uint32_t u32ReadLatencyUs;          /* Time from CMD17 / CMD18 to the first start token */
+  uint32_t u32ReadBlockGapUs;         /* Time between the blocks of a CMD18 */
+  uint32_t u32WriteBusyUs;            /* Busy time after a CMD24 block */
+  uint32_t u32MultiWriteBusyUs;       /* Busy time after each CMD25 block */
+  uint32_t u32StopBusyUs;             /* Busy time after the CMD25 stop token */
+  uint32_t u32StopReadBusyUs;         /* Busy time after CMD12 stops a CMD18 */
+  uint32_t u32ReadCrcErrorEvery;      /* Send every Nth block read with a bad CRC16 (0 = never) */
+  uint32_t u32WriteCrcErrorEvery;     /* Answer every Nth block written with a CRC error token (0 = never) */
+  int bTrace;                         /* Print every command and data token on stderr */
+} SdModelConfigType;
+
+typedef struct
+{
+  uint32_t au32Commands[64];          /* Commands received by index (ACMDs counted with their CMD index) */
+  uint32_t u32AppCommands;            /* ACMDs received */
+  uint32_t u32CommandCrcErrors;       /* Commands rejected for their CRC7 */
+  uint32_t u32BlocksRead;             /* Blocks sent to the host */
+  uint32_t u32BlocksWritten;          /* Blocks accepted from the host and written to the image */
+  uint32_t u32WriteCrcErrors;         /* Written blocks rejected for their CRC16 (real or injected) */
+  uint32_t u32ReadCrcErrors;          /* Blocks sent with an injected bad CRC16 */
+  uint32_t u32PreEraseBlocks;         /* Sum of the ACMD23 block counts */
+  uint32_t u32IllegalCommands;        /* Commands answered with the illegal command bit */
+  int bCrcOn;                         /* CMD59 has turned CRC checking on */
+} SdModelStatsType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+void SdModelDefaultConfig(SdModelConfigType* psConfig_);
+int SdModelOpen(const SdModelConfigType* psConfig_);
+void SdModelClose(void);
+uint32_t SdModelBlocks(void);
+void SdModelSelect(int bSelected_);
+uint8_t SdModelExchange(uint8_t u8Mosi_, uint64_t u64TimeNs_);
+void SdModelGetStats(SdModelStatsType* psStats_);
+int SdModelReadImage(uint32_t u32Block_, uint32_t u32Count_, uint8_t* pu8Data_);
+
+
+#endif /* __SD_CARD_MODEL_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,513 @@
+/**********************************************************************************************************************
+File: sd_emulator_test.c
+
+Description:
+Runs the SD card driver (drivers/sdcard.c over sam3u_ssp.c and messaging.c, all unmodified) on the host against the
+SPI SD card model in sd_card_model.c, wired up through the simulated USART and PIO registers in sim_hardware.c.
+Each card configuration runs in its own process so the driver starts from power-up every time:
+  hc     SDHC (block addressing) with the default timing in SdModelDefaultConfig()
+  sdsc   SDSC v2 (byte addressing) with the same timing
+  crc    SDHC that sends every 17th block read with a bad CRC16 and rejects every 13th block written (few enough
+         that no transfer runs out of its SD_CRC_RETRIES)
+
+The functional tests initialize the card and check every block moved by SdWriteBlock(), SdWriteBlocks(),
+SdReadBlock(), SdReadBlocks(), SdReadBlocksDirect() and the SdQueueRead() / SdQueueWrite() request queue against the
+image, plus the CRC retries and SdGetCrcErrorCount() for the crc configuration.  The throughput figures come from the
+simulated time (see sim_hardware.c: the code itself takes no time) and use KB/s = 1000 bytes/s like sdcard.c.
+
+Build and run on the host (the PDC registers hold 32-bit pointers, so link -no-pie), from firmware_ascii/tools/sd_emulator:
+cc -std=gnu99 -O2 -no-pie -DEIE1 -DENABLE_SD -include sim_host.h -I../../../firmware_common \
+   -I../../../firmware_common/cmsis -I../../../firmware_common/drivers -I../../../firmware_common/application \
+   -I../../application -I../../bsp -I../../drivers -o sd_emulator_test sd_emulator_test.c sim_hardware.c \
+   sd_card_model.c ../../drivers/sdcard.c ../../../firmware_common/drivers/sam3u_ssp.c \
+   ../../../firmware_common/drivers/messaging.c ../../../firmware_common/drivers/utilities.c
+sd_emulator_test                       (all configurations on a temporary 64 MB image)
+sd_emulator_test -config sdsc -v       (one configuration with the driver's debug output)
+sd_emulator_test -config hc -trace     (every command and data token the card sees on stderr)
+sd_emulator_test -image card.img -read-latency 800 -write-busy 2000 -multi-busy 400 -ncr 4
+
+A given image is written from block TEST_FIRST_BLOCK on.  The timing options (in us, NCR in bytes) replace the
+defaults for every configuration.  The exit status is the number of configurations that failed.
+**********************************************************************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "configuration.h"
+#include "sd_card_model.h"
+#include "sim_hardware.h"
+
+#define IMAGE_BYTES               (64u * 1024u * 1024u)
+#define TEST_FIRST_BLOCK          (u32)4096            /* Blocks below this are never written */
+#define TEST_MULTI_BLOCKS         (u32)24              /* Blocks in each functional multi-block transfer */
+#define TEST_QUEUE_BLOCKS         (u32)4               /* Blocks in each queued request */
+#define TEST_TIMEOUT_MS           (u32)5000            /* Longest any single operation may take */
+#define BENCH_SEQUENTIAL_BLOCKS   (u32)512             /* 256 KB sequential transfers */
+#define BENCH_RANDOM_BLOCKS       (u32)200             /* Single block transfers at random addresses */
+#define BENCH_RANDOM_SPAN         (u32)65536           /* Random addresses fall in this many blocks */
+
+typedef struct
+{
+  const char* pcName;
+  bool bHighCapacity;
+  u32 u32ReadCrcErrorEvery;
+  u32 u32WriteCrcErrorEvery;
+} TestConfigType;
+
+static const TestConfigType Test_asConfigs[] =
+{
+  {"hc",   TRUE,  0, 0},
+  {"sdsc", FALSE, 0, 0},
+  {"crc",  TRUE,  17, 13},
+};
+
+/* Everything the driver's PDC touches must be static (below 4 GB) */
+static u8 Test_au8Data[BENCH_SEQUENTIAL_BLOCKS * SD_BLOCK_SIZE];
+static u8 Test_au8Check[BENCH_SEQUENTIAL_BLOCKS * SD_BLOCK_SIZE];
+static u8 Test_au8Queue[4][TEST_QUEUE_BLOCKS * SD_BLOCK_SIZE];
+
+static SdModelConfigType Test_sModel;
+static u32 Test_u32Failures;
+static u32 Test_u32Callbacks;
+static u32 Test_u32CallbackFailures;
+static u32 Test_u32Random = 12345;
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Helpers */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/* One pass of the super loop with the tasks this build has, then sleep to the next tick */
+static void RunPass(void)
+{
+  SspRunActiveState();
+  SimUpdate();
+  MessagingRunActiveState();
+  SimUpdate();
+  SdCardRunActiveState();
+  SimUpdate();
+  SimSleep();
+}
+
+static bool WaitStatus(SdCardStateType eState_)
+{
+  for(u32 i = 0; i < TEST_TIMEOUT_MS; i++)
+  {
+    if(SdGetStatus() == eState_)
+    {
+      return TRUE;
+    }
+    RunPass();
+  }
+  return SdGetStatus() == eState_;
+}
+
+static void Check(bool bPass_, const char* pcName_)
+{
+  printf("  %s  %s\n", bPass_ ? "pass" : "FAIL", pcName_);
+  if(!bPass_)
+  {
+    Test_u32Failures++;
+  }
+}
+
+static u32 Random(u32 u32Limit_)
+{
+  Test_u32Random = (Test_u32Random * 1103515245u) + 12345u;
+  return (Test_u32Random >> 8) % u32Limit_;
+}
+
+/* Data that is different for every block and every pass */
+static void Pattern(u8* pu8Data_, u32 u32Block_, u32 u32Blocks_, u8 u8Seed_)
+{
+  for(u32 i = 0; i < u32Blocks_ * SD_BLOCK_SIZE; i++)
+  {
+    pu8Data_[i] = (u8)( ((u32Block_ + (i / SD_BLOCK_SIZE)) * 31u) + (i * 7u) + u8Seed_ );
+  }
+}
+
+/* TRUE if the image holds pu8Data_ at u32Block_ */
+static bool ImageMatches(u32 u32Block_, u32 u32Blocks_, const u8* pu8Data_)
+{
+  return SdModelReadImage(u32Block_, u32Blocks_, Test_au8Check) &&
+         (memcmp(Test_au8Check, pu8Data_, u32Blocks_ * SD_BLOCK_SIZE) == 0);
+}
+
+/* Writes with SdWriteBlocks() feeding blocks as fast as the driver takes them */
+static bool WriteBlocks(u32 u32Block_, u32 u32Blocks_, const u8* pu8Data_)
+{
+  u32 u32Fed = 0;
+
+  if(!SdWriteBlocks(u32Block_, u32Blocks_))
+  {
+    return FALSE;
+  }
+
+  for(u32 i = 0; (i < TEST_TIMEOUT_MS) && (SdGetStatus() == SD_WRITING); i++)
+  {
+    while( (u32Fed < u32Blocks_) && SdPutWriteData((u8*)&pu8Data_[u32Fed * SD_BLOCK_SIZE]) )
+    {
+      u32Fed++;
+    }
+    RunPass();
+  }
+  return (u32Fed == u32Blocks_) && (SdGetStatus() == SD_IDLE);
+}
+
+/* Reads with SdReadBlocks() taking each block as soon as it is ready */
+static bool StreamBlocks(u32 u32Block_, u32 u32Blocks_, u8* pu8Data_)
+{
+  u32 u32Taken = 0;
+
+  if(!SdReadBlocks(u32Block_, u32Blocks_))
+  {
+    return FALSE;
+  }
+
+  for(u32 i = 0; (i < TEST_TIMEOUT_MS) && (u32Taken < u32Blocks_); i++)
+  {
+    while( (SdGetStatus() == SD_DATA_READY) && SdGetReadData(&pu8Data_[u32Taken * SD_BLOCK_SIZE]) )
+    {
+      u32Taken++;
+    }
+    if( (SdGetStatus() == SD_IDLE) || (SdGetStatus() == SD_CARD_ERROR) )
+    {
+      break;
+    }
+    RunPass();
+  }
+  return (u32Taken == u32Blocks_) && (SdGetStatus() == SD_IDLE);
+}
+
+static bool ReadBlock(u32 u32Block_, u8* pu8Data_)
+{
+  return SdReadBlock(u32Block_) && WaitStatus(SD_DATA_READY) && SdGetReadData(pu8Data_) && WaitStatus(SD_IDLE);
+}
+
+static void QueueCallback(u8* pu8Buffer_, bool bSuccess_)
+{
+  (void)pu8Buffer_;
+  Test_u32Callbacks++;
+  if(!bSuccess_)
+  {
+    Test_u32CallbackFailures++;
+  }
+}
+
+/* KB/s (1000 bytes/s) for u32Blocks_ blocks in u64Ns_ */
+static u32 KBps(u32 u32Blocks_, uint64_t u64Ns_)
+{
+  return (u64Ns_ == 0) ? 0 : (u32)(((uint64_t)u32Blocks_ * SD_BLOCK_SIZE * 1000000u) / u64Ns_);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Tests */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+static void FunctionalTests(const TestConfigType* psConfig_)
+{
+  SdModelStatsType sStats;
+  u32 u32Block = TEST_FIRST_BLOCK;
+  u32 u32Commands;
+
+  /* Single blocks */
+  Pattern(Test_au8Data, u32Block, 1, 1);
+  Check(SdWriteBlock(u32Block, Test_au8Data) && WaitStatus(SD_IDLE) && ImageMatches(u32Block, 1, Test_au8Data),
+        "SdWriteBlock() puts the block in the image");
+  memset(Test_au8Check, 0, SD_BLOCK_SIZE);
+  Check(ReadBlock(u32Block, &Test_au8Check[SD_BLOCK_SIZE]) &&
+        (memcmp(&Test_au8Check[SD_BLOCK_SIZE], Test_au8Data, SD_BLOCK_SIZE) == 0),
+        "SdReadBlock() returns the block");
+
+  /* Multi-block write, then all three ways to read it back */
+  u32Block += 8;
+  Pattern(Test_au8Data, u32Block, TEST_MULTI_BLOCKS, 2);
+  SdModelGetStats(&sStats);
+  u32Commands = sStats.au32Commands[SD_CMD25];
+  Check(WriteBlocks(u32Block, TEST_MULTI_BLOCKS, Test_au8Data) && ImageMatches(u32Block, TEST_MULTI_BLOCKS, Test_au8Data),
+        "SdWriteBlocks() puts every block in the image");
+  SdModelGetStats(&sStats);
+  Check((sStats.au32Commands[SD_CMD25] != u32Commands) && (sStats.u32PreEraseBlocks >= TEST_MULTI_BLOCKS),
+        "SdWriteBlocks() uses ACMD23 and CMD25");
+
+  memset(&Test_au8Data[TEST_MULTI_BLOCKS * SD_BLOCK_SIZE], 0, TEST_MULTI_BLOCKS * SD_BLOCK_SIZE);
+  Check(StreamBlocks(u32Block, TEST_MULTI_BLOCKS, &Test_au8Data[TEST_MULTI_BLOCKS * SD_BLOCK_SIZE]) &&
+        ImageMatches(u32Block, TEST_MULTI_BLOCKS, &Test_au8Data[TEST_MULTI_BLOCKS * SD_BLOCK_SIZE]),
+        "SdReadBlocks() streams every block");
+
+  memset(&Test_au8Data[TEST_MULTI_BLOCKS * SD_BLOCK_SIZE], 0, TEST_MULTI_BLOCKS * SD_BLOCK_SIZE);
+  Check(SdReadBlocksDirect(u32Block, TEST_MULTI_BLOCKS, &Test_au8Data[TEST_MULTI_BLOCKS * SD_BLOCK_SIZE]) &&
+        WaitStatus(SD_IDLE) &&
+        ImageMatches(u32Block, TEST_MULTI_BLOCKS, &Test_au8Data[TEST_MULTI_BLOCKS * SD_BLOCK_SIZE]),
+        "SdReadBlocksDirect() reads every block into the buffer");
+
+  /* Two consecutive queued writes merge into one CMD25, then read them back with two queued reads */
+  u32Block += TEST_MULTI_BLOCKS;
+  Pattern(Test_au8Queue[0], u32Block, TEST_QUEUE_BLOCKS, 3);
+  Pattern(Test_au8Queue[1], u32Block + TEST_QUEUE_BLOCKS, TEST_QUEUE_BLOCKS, 3);
+  memset(Test_au8Queue[2], 0, sizeof(Test_au8Queue[2]));
+  memset(Test_au8Queue[3], 0, sizeof(Test_au8Queue[3]));
+  Test_u32Callbacks = 0;
+  Test_u32CallbackFailures = 0;
+  SdModelGetStats(&sStats);
+  u32Commands = sStats.au32Commands[SD_CMD25];
+
+  Check(SdQueueWrite(u32Block, TEST_QUEUE_BLOCKS, Test_au8Queue[0], QueueCallback) &&
+        SdQueueWrite(u32Block + TEST_QUEUE_BLOCKS, TEST_QUEUE_BLOCKS, Test_au8Queue[1], QueueCallback) &&
+        SdQueueRead(u32Block, TEST_QUEUE_BLOCKS, Test_au8Queue[2], QueueCallback) &&
+        SdQueueRead(u32Block + TEST_QUEUE_BLOCKS, TEST_QUEUE_BLOCKS, Test_au8Queue[3], QueueCallback),
+        "SdQueueWrite() / SdQueueRead() take four requests");
+  for(u32 i = 0; (i < TEST_TIMEOUT_MS) && (Test_u32Callbacks < 4); i++)
+  {
+    RunPass();
+  }
+  SdModelGetStats(&sStats);
+  Check((Test_u32Callbacks == 4) && (Test_u32CallbackFailures == 0), "every queued request is called back with success");
+  if(psConfig_->u32WriteCrcErrorEvery == 0)
+  {
+    Check(sStats.au32Commands[SD_CMD25] == u32Commands + 1, "consecutive queued writes are merged into one CMD25");
+  }
+  Check(ImageMatches(u32Block, TEST_QUEUE_BLOCKS, Test_au8Queue[0]) &&
+        ImageMatches(u32Block + TEST_QUEUE_BLOCKS, TEST_QUEUE_BLOCKS, Test_au8Queue[1]) &&
+        (memcmp(Test_au8Queue[2], Test_au8Queue[0], sizeof(Test_au8Queue[0])) == 0) &&
+        (memcmp(Test_au8Queue[3], Test_au8Queue[1], sizeof(Test_au8Queue[1])) == 0),
+        "queued data matches the image");
+
+  /* The CRC configuration must have retried its way through every transfer above */
+  SdModelGetStats(&sStats);
+  if( (psConfig_->u32ReadCrcErrorEvery != 0) || (psConfig_->u32WriteCrcErrorEvery != 0) )
+  {
+    Check( (sStats.u32ReadCrcErrors != 0) && (sStats.u32WriteCrcErrors != 0) &&
+           (SdGetCrcErrorCount() == sStats.u32ReadCrcErrors + sStats.u32WriteCrcErrors),
+           "SdGetCrcErrorCount() counts every bad block the card sent or rejected");
+    printf("        (%u read and %u write CRC errors injected)\n",
+           (unsigned)sStats.u32ReadCrcErrors, (unsigned)sStats.u32WriteCrcErrors);
+  }
+  else
+  {
+    Check(SdGetCrcErrorCount() == 0, "no CRC errors");
+  }
+  Check( (sStats.u32CommandCrcErrors == 0) && (sStats.u32IllegalCommands == 0),
+         "every command had a good CRC7 and was legal");
+}
+
+static void ThroughputTests(void)
+{
+  SimStatsType sBusStart, sBusEnd;
+  uint64_t u64BenchStart, u64Start, u64Ns;
+  u32 u32LastKBps, u32SustainedKBps;
+  u32 u32Block = TEST_FIRST_BLOCK + 1024;
+  bool bOk;
+
+  SimGetStats(&sBusStart);
+  u64BenchStart = SimTimeNs();
+
+  Pattern(Test_au8Data, u32Block, BENCH_SEQUENTIAL_BLOCKS, 4);
+  u64Start = SimTimeNs();
+  bOk = WriteBlocks(u32Block, BENCH_SEQUENTIAL_BLOCKS, Test_au8Data);
+  u64Ns = SimTimeNs() - u64Start;
+  SdGetWriteThroughput(&u32LastKBps, &u32SustainedKBps);
+  Check(bOk && ImageMatches(u32Block, BENCH_SEQUENTIAL_BLOCKS, Test_au8Data), "sequential write");
+  printf("        %u blocks in %u us: %u KB/s (SdGetWriteThroughput() last %u KB/s)\n",
+         (unsigned)BENCH_SEQUENTIAL_BLOCKS, (unsigned)(u64Ns / 1000), (unsigned)KBps(BENCH_SEQUENTIAL_BLOCKS, u64Ns),
+         (unsigned)u32LastKBps);
+
+  u64Start = SimTimeNs();
+  bOk = SdReadBlocksDirect(u32Block, BENCH_SEQUENTIAL_BLOCKS, Test_au8Data) && WaitStatus(SD_IDLE);
+  u64Ns = SimTimeNs() - u64Start;
+  Check(bOk && ImageMatches(u32Block, BENCH_SEQUENTIAL_BLOCKS, Test_au8Data), "sequential read (SdReadBlocksDirect)");
+  printf("        %u blocks in %u us: %u KB/s\n",
+         (unsigned)BENCH_SEQUENTIAL_BLOCKS, (unsigned)(u64Ns / 1000), (unsigned)KBps(BENCH_SEQUENTIAL_BLOCKS, u64Ns));
+
+  u64Start = SimTimeNs();
+  bOk = StreamBlocks(u32Block, BENCH_SEQUENTIAL_BLOCKS, Test_au8Data);
+  u64Ns = SimTimeNs() - u64Start;
+  Check(bOk && ImageMatches(u32Block, BENCH_SEQUENTIAL_BLOCKS, Test_au8Data), "sequential read (SdReadBlocks)");
+  printf("        %u blocks in %u us: %u KB/s\n",
+         (unsigned)BENCH_SEQUENTIAL_BLOCKS, (unsigned)(u64Ns / 1000), (unsigned)KBps(BENCH_SEQUENTIAL_BLOCKS, u64Ns));
+
+  bOk = TRUE;
+  u64Start = SimTimeNs();
+  for(u32 i = 0; (i < BENCH_RANDOM_BLOCKS) && bOk; i++)
+  {
+    u32Block = TEST_FIRST_BLOCK + Random(BENCH_RANDOM_SPAN);
+    Pattern(Test_au8Data, u32Block, 1, 5);
+    bOk = SdWriteBlock(u32Block, Test_au8Data) && WaitStatus(SD_IDLE);
+  }
+  u64Ns = SimTimeNs() - u64Start;
+  Check(bOk && ImageMatches(u32Block, 1, Test_au8Data), "random single block writes");
+  printf("        %u blocks in %u us: %u KB/s, %u us per block\n", (unsigned)BENCH_RANDOM_BLOCKS,
+         (unsigned)(u64Ns / 1000), (unsigned)KBps(BENCH_RANDOM_BLOCKS, u64Ns),
+         (unsigned)(u64Ns / 1000 / BENCH_RANDOM_BLOCKS));
+
+  bOk = TRUE;
+  u64Start = SimTimeNs();
+  for(u32 i = 0; (i < BENCH_RANDOM_BLOCKS) && bOk; i++)
+  {
+    bOk = ReadBlock(TEST_FIRST_BLOCK + Random(BENCH_RANDOM_SPAN), Test_au8Data);
+  }
+  u64Ns = SimTimeNs() - u64Start;
+  Check(bOk, "random single block reads");
+  printf("        %u blocks in %u us: %u KB/s, %u us per block\n", (unsigned)BENCH_RANDOM_BLOCKS,
+         (unsigned)(u64Ns / 1000), (unsigned)KBps(BENCH_RANDOM_BLOCKS, u64Ns),
+         (unsigned)(u64Ns / 1000 / BENCH_RANDOM_BLOCKS));
+
+  SimGetStats(&sBusEnd);
+  printf("        SPI clock running %u%% of the time, %u interrupts, %u PDC transfers\n",
+         (unsigned)((sBusEnd.u64BusBusyNs - sBusStart.u64BusBusyNs) * 100u / (SimTimeNs() - u64BenchStart)),
+         (unsigned)(sBusEnd.u32Interrupts - sBusStart.u32Interrupts),
+         (unsigned)(sBusEnd.u32Transfers - sBusStart.u32Transfers));
+}
+
+/* Runs one card configuration from power-up; returns the number of failed checks */
+static u32 RunConfig(const TestConfigType* psConfig_, bool bVerbose_)
+{
+  SdModelConfigType sModel = Test_sModel;
+  SdModelStatsType sStats;
+  bool bReady;
+
+  printf("%s card (%s addressing)\n", psConfig_->pcName, psConfig_->bHighCapacity ? "block" : "byte");
+  sModel.bHighCapacity = psConfig_->bHighCapacity;
+  sModel.u32ReadCrcErrorEvery = psConfig_->u32ReadCrcErrorEvery;
+  sModel.u32WriteCrcErrorEvery = psConfig_->u32WriteCrcErrorEvery;
+  if(!SdModelOpen(&sModel))
+  {
+    return 1;
+  }
+
+  SimInitialize(TRUE, bVerbose_);
+  MessagingInitialize();
+  SspInitialize();
+  SdCardInitialize();
+
+  bReady = WaitStatus(SD_IDLE);
+  SdModelGetStats(&sStats);
+  Check(bReady, "card initializes to SD_IDLE");
+  Check(sStats.bCrcOn, "CMD59 turned CRC checking on");
+  printf("        ready after %u ms, %u ACMD41 polls\n", (unsigned)(SimTimeNs() / 1000000u),
+         (unsigned)sStats.au32Commands[SD_ACMD41]);
+
+  if(bReady)
+  {
+    FunctionalTests(psConfig_);
+    if(psConfig_->u32ReadCrcErrorEvery == 0)
+    {
+      ThroughputTests();
+    }
+  }
+
+  SdModelClose();
+  return Test_u32Failures;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+int main(int argc, char* argv[])
+{
+  char acTemp[] = "/tmp/sd_emulator_XXXXXX";
+  const char* pcConfig = NULL;
+  bool bVerbose = FALSE;
+  int iFd = -1;
+  int iStatus;
+  int iFailed = 0;
+  pid_t iChild;
+
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  SdModelDefaultConfig(&Test_sModel);
+  for(int i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "-v"))
+    {
+      bVerbose = TRUE;
+    }
+    else if(!strcmp(argv[i], "-trace"))
+    {
+      Test_sModel.bTrace = TRUE;
+    }
+    else if( (i + 1 < argc) && !strcmp(argv[i], "-image") )
+    {
+      Test_sModel.pcImage = argv[++i];
+    }
+    else if( (i + 1 < argc) && !strcmp(argv[i], "-config") )
+    {
+      pcConfig = argv[++i];
+    }
+    else if( (i + 1 < argc) && !strcmp(argv[i], "-ncr") )
+    {
+      Test_sModel.u32NcrBytes = (u32)strtoul(argv[++i], NULL, 0);
+    }
+    else if( (i + 1 < argc) && !strcmp(argv[i], "-read-latency") )
+    {
+      Test_sModel.u32ReadLatencyUs = (u32)strtoul(argv[++i], NULL, 0);
+    }
+    else if( (i + 1 < argc) && !strcmp(argv[i], "-write-busy") )
+    {
+      Test_sModel.u32WriteBusyUs = (u32)strtoul(argv[++i], NULL, 0);
+    }
+    else if( (i + 1 < argc) && !strcmp(argv[i], "-multi-busy") )
+    {
+      Test_sModel.u32MultiWriteBusyUs = (u32)strtoul(argv[++i], NULL, 0);
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-v] [-trace] [-image file] [-config hc|sdsc|crc] [-ncr bytes] [-read-latency us]\n"
+                      "       [-write-busy us] [-multi-busy us]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  /* A sparse temporary image unless one was given */
+  if(Test_sModel.pcImage == NULL)
+  {
+    iFd = mkstemp(acTemp);
+    if( (iFd < 0) || (ftruncate(iFd, IMAGE_BYTES) != 0) )
+    {
+      perror(acTemp);
+      return 2;
+    }
+    Test_sModel.pcImage = acTemp;
+  }
+
+  for(u32 i = 0; i < sizeof(Test_asConfigs) / sizeof(Test_asConfigs[0]); i++)
+  {
+    if( (pcConfig != NULL) && strcmp(pcConfig, Test_asConfigs[i].pcName) )
+    {
+      continue;
+    }
+
+    fflush(stdout);
+    iChild = fork();
+    if(iChild == 0)
+    {
+      exit(RunConfig(&Test_asConfigs[i], bVerbose) != 0);
+    }
+    if( (iChild < 0) || (waitpid(iChild, &iStatus, 0) != iChild) || !WIFEXITED(iStatus) || WEXITSTATUS(iStatus) )
+    {
+      printf("%s: FAILED\n\n", Test_asConfigs[i].pcName);
+      iFailed++;
+    }
+    else
+    {
+      printf("%s: passed\n\n", Test_asConfigs[i].pcName);
+    }
+  }
+
+  if(iFd >= 0)
+  {
+    close(iFd);
+    unlink(acTemp);
+  }
+  return iFailed;
+
+} /* end main() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
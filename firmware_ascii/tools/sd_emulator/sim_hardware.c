@@ -0,0 +1,401 @@
+/**********************************************************************************************************************
+File: sim_hardware.c
+
+Description:
+Simulated SAM3U2 hardware for the host build of the SD card driver.  The three USARTs, the PIO controllers and the PMC
+are plain register blocks (sim_host.h points the AT91C_BASE_ addresses at them) so sam3u_ssp.c and sdcard.c run
+unmodified.  USART1 is wired to the SD card model: the chip select is SD_CS_PIN on SD_BASE_PORT and the card detect
+switch always shows a card.
+
+Register writes have no effect until SimUpdate() takes them in, which the harness calls between the tasks of each
+pass of the super loop and which runs after every interrupt handler.  SimUpdate():
+  - folds US_IDR and then US_IER into US_IMR (an enable written in the same pass as a disable wins)
+  - folds the PTCR disable bits and then the enable bits into US_PTSR
+  - folds PIO_SODR and then PIO_CODR into PIO_ODSR so an asserted chip select wins, and tells the card
+  - starts a PDC transfer when the receiver and transmitter are enabled with RCR != 0 (full duplex, RCR bytes) or
+    the transmitter alone is enabled with TCR != 0 (TCR bytes, the received bytes are dropped)
+  - works out US_CSR from the counters and calls the interrupt handler while an enabled flag is set
+
+A transfer takes 8 * US_BRGR / MCK per byte and every byte is exchanged with the card at the time its last bit is
+clocked.  ENDRX, ENDTX and TXEMPTY are all set at the end of the last byte.  SimSleep() plays out the transfers (and
+the interrupts they cause) up to the next 1ms tick and then advances G_u32SystemTime1ms, like SystemSleep() waiting
+for SysTick.  Code runs in zero time: the super loop and the interrupt handlers add nothing to the timing, so the
+results are the best the driver could do with the bus and card as modeled.
+**********************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include "configuration.h"
+#include "sd_card_model.h"
+#include "sim_hardware.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_"
+***********************************************************************************************************************/
+/* Simulated versions of the globals from main.c, the bsp and debug.c */
+volatile u32 G_u32SystemFlags = 0;
+volatile u32 G_u32ApplicationFlags = 0;
+volatile u32 G_u32SystemTime1ms = 0;
+volatile u32 G_u32SystemTime1s = 0;
+volatile u32 G_u32DebugFlags = 0;
+
+/* Register blocks named in sim_host.h */
+AT91S_USART SIM_asUsart[3];
+AT91S_PIO   SIM_asPio[3];
+AT91S_PMC   SIM_sPmc;
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Sim_" and be declared as static.
+***********************************************************************************************************************/
+typedef struct
+{
+  bool bActive;                       /* A PDC transfer is on the bus */
+  bool bReceive;                      /* Full duplex: the received bytes go to RPR */
+  u32 u32Bytes;                       /* Size of the transfer */
+  uint64_t u64StartNs;                /* Time the transfer started */
+  uint64_t u64ByteNs;                 /* Time for one byte at the current baud rate */
+} SimTransferType;
+
+static SimTransferType Sim_asTransfer[3];
+static void (* const Sim_apfIsr[3])(void) = {SSP0_IRQHandler, SSP1_IRQHandler, SSP2_IRQHandler};
+static const u8 Sim_au8UsartId[3] = {AT91C_ID_US0, AT91C_ID_US1, AT91C_ID_US2};
+
+static uint64_t Sim_u64TimeNs;                         /* Simulated time */
+static u32 Sim_u32NvicEnabled;                         /* Enabled interrupt lines by peripheral ID */
+static bool Sim_bVerbose;                              /* Print the firmware's debug output */
+static SimStatsType Sim_sStats;
+
+
+/***********************************************************************************************************************
+Function Definitions
+***********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Firmware functions that are not part of the host build */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+void NVIC_EnableIRQ(int iIrq_)
+{
+  Sim_u32NvicEnabled |= (1u << iIrq_);
+}
+
+void NVIC_DisableIRQ(int iIrq_)
+{
+  Sim_u32NvicEnabled &= ~(1u << iIrq_);
+}
+
+void NVIC_ClearPendingIRQ(int iIrq_)
+{
+  (void)iIrq_;
+}
+
+void NVIC_SetPendingIRQ(int iIrq_)
+{
+  (void)iIrq_;
+}
+
+/* Same result as the bsp version but from the simulated time */
+u32 SystemTimeUs(void)
+{
+  return (u32)(Sim_u64TimeNs / 1000);
+}
+
+u32 DebugPrintf(u8* u8String_)
+{
+  if(Sim_bVerbose)
+  {
+    fputs((const char*)u8String_, stdout);
+  }
+  return 1;
+}
+
+void DebugLineFeed(void)
+{
+  if(Sim_bVerbose)
+  {
+    fputs("\n", stdout);
+  }
+}
+
+void DebugPrintNumber(u32 u32Number_)
+{
+  if(Sim_bVerbose)
+  {
+    printf("%u", (unsigned)u32Number_);
+  }
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Private functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/* Takes in the interrupt, PDC and PIO register writes */
+static void SimFoldWrites(void)
+{
+  AT91S_USART* psUsart;
+  AT91S_PIO* psPio;
+
+  for(u8 i = 0; i < 3; i++)
+  {
+    psUsart = &SIM_asUsart[i];
+    psUsart->US_IMR = (psUsart->US_IMR & ~psUsart->US_IDR) | psUsart->US_IER;
+    psUsart->US_IER = 0;
+    psUsart->US_IDR = 0;
+
+    if(psUsart->US_PTCR & AT91C_PDC_RXTDIS)
+    {
+      psUsart->US_PTSR &= ~AT91C_PDC_RXTEN;
+    }
+    if(psUsart->US_PTCR & AT91C_PDC_TXTDIS)
+    {
+      psUsart->US_PTSR &= ~AT91C_PDC_TXTEN;
+    }
+    psUsart->US_PTSR |= psUsart->US_PTCR & (AT91C_PDC_RXTEN | AT91C_PDC_TXTEN);
+    psUsart->US_PTCR = 0;
+    psUsart->US_CR = 0;
+  }
+
+  for(u8 i = 0; i < 3; i++)
+  {
+    psPio = &SIM_asPio[i];
+    psPio->PIO_ODSR = (psPio->PIO_ODSR | psPio->PIO_SODR) & ~psPio->PIO_CODR;
+    psPio->PIO_SODR = 0;
+    psPio->PIO_CODR = 0;
+  }
+
+  /* The chip select pin reads back what it drives */
+  SD_BASE_PORT->PIO_PDSR = (SD_BASE_PORT->PIO_PDSR & ~SD_CS_PIN) | (SD_BASE_PORT->PIO_ODSR & SD_CS_PIN);
+  SdModelSelect( !(SD_BASE_PORT->PIO_ODSR & SD_CS_PIN) );
+}
+
+/* Status flags from the PDC counters and the transfer in progress */
+static void SimUpdateStatus(u8 u8Usart_)
+{
+  AT91S_USART* psUsart = &SIM_asUsart[u8Usart_];
+  u32 u32Csr = 0;
+
+  if(psUsart->US_RCR == 0)
+  {
+    u32Csr |= AT91C_US_ENDRX;
+    if(psUsart->US_RNCR == 0)
+    {
+      u32Csr |= AT91C_US_RXBUFF;
+    }
+  }
+  if(psUsart->US_TCR == 0)
+  {
+    u32Csr |= AT91C_US_ENDTX;
+    if(psUsart->US_TNCR == 0)
+    {
+      u32Csr |= AT91C_US_TXBUFE;
+    }
+  }
+  if(!Sim_asTransfer[u8Usart_].bActive)
+  {
+    u32Csr |= AT91C_US_TXRDY | AT91C_US_TXEMPTY;
+  }
+
+  psUsart->US_CSR = u32Csr;
+}
+
+/* Starts a PDC transfer if the registers ask for one */
+static void SimStartTransfer(u8 u8Usart_)
+{
+  AT91S_USART* psUsart = &SIM_asUsart[u8Usart_];
+  SimTransferType* psTransfer = &Sim_asTransfer[u8Usart_];
+  u32 u32Enabled = psUsart->US_PTSR & (AT91C_PDC_RXTEN | AT91C_PDC_TXTEN);
+
+  if(psTransfer->bActive)
+  {
+    return;
+  }
+
+  if( (u32Enabled == (AT91C_PDC_RXTEN | AT91C_PDC_TXTEN)) && (psUsart->US_RCR != 0) )
+  {
+    psTransfer->bReceive = TRUE;
+    psTransfer->u32Bytes = psUsart->US_RCR;
+  }
+  else if( (u32Enabled == AT91C_PDC_TXTEN) && (psUsart->US_TCR != 0) )
+  {
+    psTransfer->bReceive = FALSE;
+    psTransfer->u32Bytes = psUsart->US_TCR;
+  }
+  else
+  {
+    return;
+  }
+
+  psTransfer->bActive = TRUE;
+  psTransfer->u64StartNs = Sim_u64TimeNs;
+  psTransfer->u64ByteNs = (8 * (uint64_t)psUsart->US_BRGR * 1000000000u) / SIM_MCK_HZ;
+  Sim_sStats.u32Transfers++;
+}
+
+/* Clocks every byte of a transfer through the card and finishes the PDC registers */
+static void SimFinishTransfer(u8 u8Usart_)
+{
+  AT91S_USART* psUsart = &SIM_asUsart[u8Usart_];
+  SimTransferType* psTransfer = &Sim_asTransfer[u8Usart_];
+  u8* pu8Tx = (u8*)(uintptr_t)psUsart->US_TPR;
+  u8* pu8Rx = (u8*)(uintptr_t)psUsart->US_RPR;
+  u8 u8Miso;
+
+  for(u32 i = 0; i < psTransfer->u32Bytes; i++)
+  {
+    u8Miso = 0xFF;
+    if(u8Usart_ == SIM_CARD_USART)
+    {
+      u8Miso = SdModelExchange(pu8Tx[i], psTransfer->u64StartNs + (i + 1) * psTransfer->u64ByteNs);
+    }
+    if(psTransfer->bReceive)
+    {
+      pu8Rx[i] = u8Miso;
+    }
+  }
+
+  psUsart->US_TPR += psTransfer->u32Bytes;
+  psUsart->US_TCR = 0;
+  if(psTransfer->bReceive)
+  {
+    psUsart->US_RPR += psTransfer->u32Bytes;
+    psUsart->US_RCR = 0;
+  }
+
+  if(u8Usart_ == SIM_CARD_USART)
+  {
+    Sim_sStats.u64BusBytes += psTransfer->u32Bytes;
+    Sim_sStats.u64BusBusyNs += psTransfer->u32Bytes * psTransfer->u64ByteNs;
+  }
+  psTransfer->bActive = FALSE;
+}
+
+/* Time the transfer on a USART ends (0 if none is running) */
+static uint64_t SimTransferEnd(u8 u8Usart_)
+{
+  SimTransferType* psTransfer = &Sim_asTransfer[u8Usart_];
+
+  if(!psTransfer->bActive)
+  {
+    return 0;
+  }
+  return psTransfer->u64StartNs + (psTransfer->u32Bytes * psTransfer->u64ByteNs);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Public functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/* Power-on state: registers cleared, chip selects high and the card detect switch closed if bCardInserted_ */
+void SimInitialize(bool bCardInserted_, bool bVerbose_)
+{
+  memset(SIM_asUsart, 0, sizeof(SIM_asUsart));
+  memset(SIM_asPio, 0, sizeof(SIM_asPio));
+  memset(&SIM_sPmc, 0, sizeof(SIM_sPmc));
+  memset(Sim_asTransfer, 0, sizeof(Sim_asTransfer));
+  memset(&Sim_sStats, 0, sizeof(Sim_sStats));
+
+  SD_BASE_PORT->PIO_ODSR = SD_CS_PIN;
+  SD_BASE_PORT->PIO_PDSR = SD_CS_PIN;
+  if(!bCardInserted_)
+  {
+    SD_BASE_PORT->PIO_PDSR |= PA_02_SD_DETECT;
+  }
+
+  Sim_u64TimeNs = 0;
+  Sim_u32NvicEnabled = 0;
+  Sim_bVerbose = bVerbose_;
+  G_u32SystemTime1ms = 0;
+  G_u32SystemTime1s = 0;
+}
+
+/* Takes in the register writes, starts transfers and runs the interrupt handlers that are due */
+void SimUpdate(void)
+{
+  u32 u32Calls;
+
+  SimFoldWrites();
+  for(u8 i = 0; i < 3; i++)
+  {
+    SimStartTransfer(i);
+    SimUpdateStatus(i);
+
+    u32Calls = 0;
+    while( (SIM_asUsart[i].US_IMR & SIM_asUsart[i].US_CSR) && (Sim_u32NvicEnabled & (1u << Sim_au8UsartId[i])) )
+    {
+      if(++u32Calls > SIM_ISR_LIMIT)
+      {
+        fprintf(stderr, "sim: USART%u interrupt stuck on (IMR 0x%08X CSR 0x%08X)\n", i,
+                (unsigned)SIM_asUsart[i].US_IMR, (unsigned)SIM_asUsart[i].US_CSR);
+        exit(2);
+      }
+
+      Sim_apfIsr[i]();
+      Sim_sStats.u32Interrupts++;
+
+      SimFoldWrites();
+      SimStartTransfer(i);
+      SimUpdateStatus(i);
+    }
+  }
+}
+
+/* Lets the hardware run until the next 1ms tick */
+void SimSleep(void)
+{
+  uint64_t u64Tick = ((uint64_t)G_u32SystemTime1ms + 1) * 1000000u;
+  uint64_t u64End;
+  uint64_t u64First;
+  u8 u8First;
+
+  SimUpdate();
+  while(1)
+  {
+    /* The transfer that ends first before the tick */
+    u64First = u64Tick + 1;
+    u8First = 0;
+    for(u8 i = 0; i < 3; i++)
+    {
+      u64End = SimTransferEnd(i);
+      if( (u64End != 0) && (u64End < u64First) )
+      {
+        u64First = u64End;
+        u8First = i;
+      }
+    }
+    if(u64First > u64Tick)
+    {
+      break;
+    }
+
+    Sim_u64TimeNs = u64First;
+    SimFinishTransfer(u8First);
+    SimUpdate();
+  }
+
+  Sim_u64TimeNs = u64Tick;
+  G_u32SystemTime1ms++;
+  if( (G_u32SystemTime1ms % 1000) == 0 )
+  {
+    G_u32SystemTime1s++;
+  }
+}
+
+uint64_t SimTimeNs(void)
+{
+  return Sim_u64TimeNs;
+}
+
+void SimGetStats(SimStatsType* psStats_)
+{
+  *psStats_ = Sim_sStats;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
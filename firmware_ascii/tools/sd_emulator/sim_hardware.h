@@ -0,0 +1,46 @@
+/**********************************************************************************************************************
+File: sim_hardware.h
+
+Description:
+Header file for sim_hardware.c
+**********************************************************************************************************************/
+
+#ifndef __SIM_HARDWARE_H
+#define __SIM_HARDWARE_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+typedef struct
+{
+  uint64_t u64BusBytes;               /* Bytes clocked on the SD card's SPI bus */
+  uint64_t u64BusBusyNs;              /* Time the SPI clock was running */
+  uint32_t u32Interrupts;             /* SSP interrupt handler calls */
+  uint32_t u32Transfers;              /* PDC transfers started */
+} SimStatsType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define SIM_MCK_HZ                (uint64_t)48000000   /* Master clock that the USART baud rate generator divides */
+#define SIM_CARD_USART            (u8)1                /* SD_SSP (USART1) is the one wired to the card */
+#define SIM_ISR_LIMIT             (u32)100             /* Interrupts in a row before the simulator gives up (stuck flag) */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+void SimInitialize(bool bCardInserted_, bool bVerbose_);
+void SimUpdate(void);
+void SimSleep(void);
+uint64_t SimTimeNs(void);
+void SimGetStats(SimStatsType* psStats_);
+
+
+#endif /* __SIM_HARDWARE_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
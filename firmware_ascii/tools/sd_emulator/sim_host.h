@@ -0,0 +1,148 @@
+/**********************************************************************************************************************
+File: sim_host.h
+
+Description:
+Force-included (cc -include sim_host.h) ahead of every firmware source in the host build of the SD card emulator.
+The firmware is compiled unmodified: this header only takes away the IAR keywords, replaces typedefs.h (so u32 is
+32 bits on a 64-bit host) and the Cortex-M3 core header, and points the peripheral base addresses that the SSP and
+SD drivers use at simulated register blocks in sim_hardware.c.
+
+The PDC pointer registers hold 32-bit addresses, so the host build must be linked -no-pie (statics below 4 GB) and
+every buffer handed to the drivers must be static.
+**********************************************************************************************************************/
+
+#ifndef __SIM_HOST_H
+#define __SIM_HOST_H
+
+#include <stdint.h>
+
+/* IAR keywords */
+#define __weak
+#define __irq
+#define __arm
+#define __ramfunc
+#define __no_init
+#define __packed
+#define __root
+#define __task
+#define __interrupt
+#define __intrinsic
+#define __nounwind
+
+/* Real register definitions first so the base addresses can be replaced below (the include guard keeps them) */
+#include "AT91SAM3U4.h"
+
+extern AT91S_USART SIM_asUsart[3];
+extern AT91S_PIO   SIM_asPio[3];
+extern AT91S_PMC   SIM_sPmc;
+
+#undef  AT91C_BASE_US0
+#undef  AT91C_BASE_US1
+#undef  AT91C_BASE_US2
+#undef  AT91C_BASE_PIOA
+#undef  AT91C_BASE_PIOB
+#undef  AT91C_BASE_PIOC
+#undef  AT91C_BASE_PMC
+#define AT91C_BASE_US0       (&SIM_asUsart[0])
+#define AT91C_BASE_US1       (&SIM_asUsart[1])
+#define AT91C_BASE_US2       (&SIM_asUsart[2])
+#define AT91C_BASE_PIOA      (&SIM_asPio[0])
+#define AT91C_BASE_PIOB      (&SIM_asPio[1])
+#define AT91C_BASE_PIOC      (&SIM_asPio[2])
+#define AT91C_BASE_PMC       (&SIM_sPmc)
+
+/* Stand-in for typedefs.h: its u32 is an unsigned long, which is 64 bits on the host */
+#define __TYPEDEFS_H
+
+typedef char CHAR;
+typedef unsigned char UCHAR;
+typedef short SHORT;
+typedef unsigned short USHORT;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef unsigned char BOOL;
+
+typedef int32_t s32;
+typedef int16_t s16;
+typedef int8_t  s8;
+typedef const int32_t sc32;
+typedef const int16_t sc16;
+typedef const int8_t  sc8;
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t  u8;
+typedef const uint32_t uc32;
+typedef const uint16_t uc16;
+typedef const uint16_t uc8;
+
+typedef void(*fnCode_type)(void);
+typedef void(*fnCode_u16_type)(u16 x);
+
+typedef enum {FALSE = 0, TRUE = !FALSE} bool;
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+typedef enum {ERROR = 0, SUCCESS = !ERROR} ErrorStatus;
+
+#define BIT0    ((u8)0x01)
+#define BIT1    ((u8)0x02)
+#define BIT2    ((u8)0x04)
+#define BIT3    ((u8)0x08)
+#define BIT4    ((u8)0x10)
+#define BIT5    ((u8)0x20)
+#define BIT6    ((u8)0x40)
+#define BIT7    ((u8)0x80)
+#define BIT8    ((u16)0x0100)
+#define BIT9    ((u16)0x0200)
+#define BIT10   ((u16)0x0400)
+#define BIT11   ((u16)0x0800)
+#define BIT12   ((u16)0x1000)
+#define BIT13   ((u16)0x2000)
+#define BIT14   ((u16)0x4000)
+#define BIT15   ((u16)0x8000)
+#define BIT16   ((u32)0x00010000)
+#define BIT17   ((u32)0x00020000)
+#define BIT18   ((u32)0x00040000)
+#define BIT19   ((u32)0x00080000)
+#define BIT20   ((u32)0x00100000)
+#define BIT21   ((u32)0x00200000)
+#define BIT22   ((u32)0x00400000)
+#define BIT23   ((u32)0x00800000)
+#define BIT24   ((u32)0x01000000)
+#define BIT25   ((u32)0x02000000)
+#define BIT26   ((u32)0x04000000)
+#define BIT27   ((u32)0x08000000)
+#define BIT28   ((u32)0x10000000)
+#define BIT29   ((u32)0x20000000)
+#define BIT30   ((u32)0x40000000)
+#define BIT31   ((u32)0x80000000)
+
+/* Stand-in for core_cm3.h: the NVIC calls are recorded by the simulator and the bit instructions are portable C */
+#define __CM3_CORE_H__
+
+void NVIC_EnableIRQ(int iIrq_);
+void NVIC_DisableIRQ(int iIrq_);
+void NVIC_ClearPendingIRQ(int iIrq_);
+void NVIC_SetPendingIRQ(int iIrq_);
+
+static inline uint32_t __RBIT(uint32_t u32Value_)
+{
+  u32Value_ = ((u32Value_ >> 1) & 0x55555555u) | ((u32Value_ & 0x55555555u) << 1);
+  u32Value_ = ((u32Value_ >> 2) & 0x33333333u) | ((u32Value_ & 0x33333333u) << 2);
+  u32Value_ = ((u32Value_ >> 4) & 0x0F0F0F0Fu) | ((u32Value_ & 0x0F0F0F0Fu) << 4);
+  u32Value_ = ((u32Value_ >> 8) & 0x00FF00FFu) | ((u32Value_ & 0x00FF00FFu) << 8);
+  return (u32Value_ >> 16) | (u32Value_ << 16);
+}
+
+static inline uint32_t __REV(uint32_t u32Value_)
+{
+  return (u32Value_ >> 24) | ((u32Value_ >> 8) & 0x0000FF00u) | ((u32Value_ << 8) & 0x00FF0000u) | (u32Value_ << 24);
+}
+
+#define __disable_interrupt()
+#define __enable_interrupt()
+#define __disable_irq()
+#define __enable_irq()
+#define __WFI()
+
+#endif /* __SIM_HOST_H */
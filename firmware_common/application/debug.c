@@ -126,14 +126,33 @@ with the function name to call for the corresponding command: */
 DebugCommandType Debug_au8Commands[DEBUG_COMMANDS] = { {DEBUG_CMD_NAME00, DebugCommandPrepareList},
                                                        {DEBUG_CMD_NAME01, DebugCommandLedTestToggle},
                                                        {DEBUG_CMD_NAME02, DebugCommandSysTimeToggle},
-                                                       {DEBUG_CMD_NAME03, DebugCommandDummy},
-                                                       {DEBUG_CMD_NAME04, DebugCommandDummy},
-                                                       {DEBUG_CMD_NAME05, DebugCommandDummy},
-                                                       {DEBUG_CMD_NAME06, DebugCommandDummy},
+                                                       {DEBUG_CMD_NAME03, DebugCommandSdCacheStats},
+                                                       {DEBUG_CMD_NAME04, DebugCommandSdBenchmark},
+                                                       {DEBUG_CMD_NAME05, DebugCommandSdWriteStats},
+                                                       {DEBUG_CMD_NAME06, DebugCommandAntBurstRates},
                                                        {DEBUG_CMD_NAME07, DebugCommandDummy} 
                                                      };
 
 static u8 Debug_au8StartupMsg[] = "\n\n\r*** RAZOR SAM3U2 ASCII LCD DEVELOPMENT BOARD ***\n\rDebug ready\n\r";
+
+/* SD benchmark */
+static u8* Debug_pu8SdBenchBuffer;                      /* FAT log buffer lent for the run: one chunk per request in flight */
+static u32 Debug_u32SdBenchFirst;                        /* First block of the scratch area */
+static u32 Debug_u32SdBenchBlocks;                       /* Blocks in the scratch area */
+static u8 Debug_u8SdBenchTest;                           /* Test running (0 to DEBUG_SD_BENCH_TESTS - 1) */
+static u8 Debug_u8SdBenchDepth;                          /* Requests kept in flight by the current test */
+static u32 Debug_u32SdBenchOps;                          /* Requests made by the current test */
+static u32 Debug_u32SdBenchBlocksPerOp;                  /* Blocks in each request of the current test */
+static u32 Debug_u32SdBenchSubmitted;                    /* Requests accepted by the SD queue */
+static volatile u32 Debug_u32SdBenchCompleted;           /* Requests called back */
+static bool Debug_bSdBenchFailed;                        /* Set if a request fails or cannot be queued */
+static u32 Debug_u32SdBenchSeed;                         /* Random block generator */
+static u32 Debug_au32SdBenchSubmitTime[DEBUG_SD_BENCH_DEPTH]; /* SystemTimeUs() when each request in flight was queued */
+static u32 Debug_u32SdBenchStartTime;                    /* SystemTimeUs() when the current test started */
+static u32 Debug_u32SdBenchEndTime;                      /* SystemTimeUs() when the last request was called back */
+static u32 Debug_u32SdBenchMinLatency;                   /* Shortest request in us */
+static u32 Debug_u32SdBenchMaxLatency;                   /* Longest request in us */
+static u32 Debug_u32SdBenchTotalLatency;                 /* Sum of all request times in us */
 #endif /* EIE1 */
 
 #ifdef MPGL2
@@ -141,7 +160,7 @@ DebugCommandType Debug_au8Commands[DEBUG_COMMANDS] = { {DEBUG_CMD_NAME00, DebugC
                                                        {DEBUG_CMD_NAME01, DebugCommandLedTestToggle},
                                                        {DEBUG_CMD_NAME02, DebugCommandSysTimeToggle},
                                                        {DEBUG_CMD_NAME03, DebugCommandCaptouchValuesToggle},
-                                                       {DEBUG_CMD_NAME04, DebugCommandDummy},
+                                                       {DEBUG_CMD_NAME04, DebugCommandAntBurstRates},
                                                        {DEBUG_CMD_NAME05, DebugCommandDummy},
                                                        {DEBUG_CMD_NAME06, DebugCommandDummy},
                                                        {DEBUG_CMD_NAME07, DebugCommandDummy} 
@@ -379,7 +398,7 @@ void SystemStatusReport(void)
   bool bNoFailedTasks = TRUE;
 
 #ifdef EIE1
-  u8 aau8AppShortNames[NUMBER_APPLICATIONS][MAX_TASK_NAME_SIZE] = {"LED", "BUTTON", "DEBUG", "LCD", "ANT", "TIMER", "ADC", "SD"};
+  u8 aau8AppShortNames[NUMBER_APPLICATIONS][MAX_TASK_NAME_SIZE] = {"LED", "BUTTON", "DEBUG", "LCD", "ANT", "TIMER", "ADC", "SD", "FAT", "RAWLOG"};
 #endif /* EIE1 */
 
 #ifdef MPGL2
@@ -803,6 +822,242 @@ static void DebugCommandSysTimeToggle(void)
   
 } /* end DebugCommandSysTimeToggle() */
 
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugCommandAntBurstRates
+
+Description:
+Prints the bytes/second of the last completed ANT burst transmit and receive (0 until one completes).
+*/
+static void DebugCommandAntBurstRates(void)
+{
+  u8 au8BurstTxMessage[] = "\n\rANT burst bytes/s tx: ";
+  u8 au8BurstRxMessage[] = "  rx: ";
+  
+  DebugPrintf(au8BurstTxMessage);
+  DebugPrintNumber(AntGetBurstTxRate());
+  DebugPrintf(au8BurstRxMessage);
+  DebugPrintNumber(AntGetBurstRxRate());
+  DebugLineFeed();
+  
+} /* end DebugCommandAntBurstRates() */
+
+#ifdef EIE1 /* EIE1 only tests */
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugCommandSdCacheStats
+
+Description:
+Prints the FAT sector cache hit, miss and write-back counts.
+*/
+static void DebugCommandSdCacheStats(void)
+{
+  u8 au8CacheHitsMessage[] = "\n\rSD cache hits: ";
+  u8 au8CacheMissesMessage[] = "  misses: ";
+  u8 au8CacheWriteBacksMessage[] = "  write-backs: ";
+  u32 u32Hits, u32Misses, u32WriteBacks;
+  
+  FatGetCacheStats(&u32Hits, &u32Misses, &u32WriteBacks);
+  
+  DebugPrintf(au8CacheHitsMessage);
+  DebugPrintNumber(u32Hits);
+  DebugPrintf(au8CacheMissesMessage);
+  DebugPrintNumber(u32Misses);
+  DebugPrintf(au8CacheWriteBacksMessage);
+  DebugPrintNumber(u32WriteBacks);
+  DebugLineFeed();
+  
+} /* end DebugCommandSdCacheStats() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugCommandSdWriteStats
+
+Description:
+Prints the measured throughput of SD multi-block writes.
+*/
+static void DebugCommandSdWriteStats(void)
+{
+  u8 au8LastWriteMessage[] = "\n\rSD write KB/s last: ";
+  u8 au8SustainedMessage[] = "  sustained: ";
+  u32 u32LastKBps, u32SustainedKBps;
+  
+  SdGetWriteThroughput(&u32LastKBps, &u32SustainedKBps);
+  
+  DebugPrintf(au8LastWriteMessage);
+  DebugPrintNumber(u32LastKBps);
+  DebugPrintf(au8SustainedMessage);
+  DebugPrintNumber(u32SustainedKBps);
+  DebugLineFeed();
+  
+} /* end DebugCommandSdWriteStats() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugCommandSdBenchmark
+
+Description:
+Starts the SD benchmark: sequential read, sequential write, random single-block read and random single-block write
+in the unused blocks between the partition table and the FAT volume.  The blocks are overwritten.  Each test prints
+its throughput and the shortest, average and longest request time.  The requests go through the SD queue, so other
+SD clients still run (and add to the times) while the benchmark is going.  The data buffer is borrowed from the FAT
+log file, so the benchmark cannot run while a log file is open.  firmware_ascii/tools/sd_emulator/sd_bench.c runs
+the same tests on a host PC against a simulated card.
+*/
+static void DebugCommandSdBenchmark(void)
+{
+  u8 au8NoVolumeMessage[] = "\n\rSD benchmark needs a card with a mounted volume\n\r";
+  u8 au8NoScratchMessage[] = "\n\rSD benchmark: no free blocks before the volume\n\r";
+  u8 au8NoBufferMessage[] = "\n\rSD benchmark: close the log file first\n\r";
+  u8 au8StartMessage1[] = "\n\rSD benchmark: ";
+  u8 au8StartMessage2[] = " blocks from block ";
+  u32 u32VolumeStart;
+  
+  if( (SdGetStatus() == SD_NO_CARD) || !FatGetVolumeStart(&u32VolumeStart) )
+  {
+    DebugPrintf(au8NoVolumeMessage);
+    return;
+  }
+  
+  /* Use the end of the gap after the MBR (block 0) so the area keeps the alignment of the volume */
+  Debug_u32SdBenchBlocks = 0;
+  if(u32VolumeStart > 1)
+  {
+    Debug_u32SdBenchBlocks = u32VolumeStart - 1;
+  }
+  
+  if(Debug_u32SdBenchBlocks > DEBUG_SD_BENCH_BLOCKS)
+  {
+    Debug_u32SdBenchBlocks = DEBUG_SD_BENCH_BLOCKS;
+  }
+  Debug_u32SdBenchBlocks -= (Debug_u32SdBenchBlocks % DEBUG_SD_BENCH_CHUNK);
+  
+  if(Debug_u32SdBenchBlocks < (DEBUG_SD_BENCH_CHUNK * DEBUG_SD_BENCH_DEPTH))
+  {
+    DebugPrintf(au8NoScratchMessage);
+    return;
+  }
+  
+  Debug_u32SdBenchFirst = u32VolumeStart - Debug_u32SdBenchBlocks;
+  
+  /* The benchmark only runs on demand, so it uses the FAT log buffer instead of RAM of its own */
+  Debug_pu8SdBenchBuffer = FatBorrowLogBuffer(DEBUG_SD_BENCH_BUFFER_SIZE);
+  if(Debug_pu8SdBenchBuffer == NULL)
+  {
+    DebugPrintf(au8NoBufferMessage);
+    return;
+  }
+  
+  DebugPrintf(au8StartMessage1);
+  DebugPrintNumber(Debug_u32SdBenchBlocks);
+  DebugPrintf(au8StartMessage2);
+  DebugPrintNumber(Debug_u32SdBenchFirst);
+  DebugLineFeed();
+  
+  Debug_u8SdBenchTest = 0;
+  Debug_pfnStateMachine = DebugSM_SdBenchStart;
+  
+} /* end DebugCommandSdBenchmark() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugSdBenchCallback
+
+Description:
+SD queue callback for benchmark requests.  Requests finish in the order they were queued.
+
+Requires:
+  - Called from the SD task for the oldest benchmark request in flight
+
+Promises:
+  - The request time is added to the statistics and Debug_u32SdBenchCompleted is incremented
+  - Debug_bSdBenchFailed is set if !bSuccess_
+*/
+static void DebugSdBenchCallback(u8* pu8Buffer_, bool bSuccess_)
+{
+  u32 u32Latency;
+  
+  Debug_u32SdBenchEndTime = SystemTimeUs();
+  u32Latency = Debug_u32SdBenchEndTime - 
+               Debug_au32SdBenchSubmitTime[Debug_u32SdBenchCompleted % Debug_u8SdBenchDepth];
+  
+  if(u32Latency < Debug_u32SdBenchMinLatency)
+  {
+    Debug_u32SdBenchMinLatency = u32Latency;
+  }
+  
+  if(u32Latency > Debug_u32SdBenchMaxLatency)
+  {
+    Debug_u32SdBenchMaxLatency = u32Latency;
+  }
+  
+  Debug_u32SdBenchTotalLatency += u32Latency;
+  Debug_u32SdBenchCompleted++;
+  
+  if(!bSuccess_)
+  {
+    Debug_bSdBenchFailed = TRUE;
+  }
+  
+} /* end DebugSdBenchCallback() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugSdBenchReport
+
+Description:
+Prints the results of the test that just finished.
+
+Requires:
+  - Debug_u32SdBenchCompleted requests of the current test are done
+
+Promises:
+  - Throughput in KB/s (1000 bytes per second) and request times in us are queued to the debug port
+*/
+static void DebugSdBenchReport(void)
+{
+  static u8 au8SeqRead[]    = "Sequential read:  ";
+  static u8 au8SeqWrite[]   = "Sequential write: ";
+  static u8 au8RandRead[]   = "Random read:      ";
+  static u8 au8RandWrite[]  = "Random write:     ";
+  static u8* apu8TestNames[DEBUG_SD_BENCH_TESTS] = {au8SeqRead, au8SeqWrite, au8RandRead, au8RandWrite};
+  u8 au8Throughput[] = " KB/s  us min ";
+  u8 au8Average[]    = " avg ";
+  u8 au8Maximum[]    = " max ";
+  u8 au8Failed[]     = "FAILED after ";
+  u8 au8Requests[]   = " requests\n\r";
+  u32 u32Elapsed;
+  u32 u32Bytes;
+  
+  DebugPrintf(apu8TestNames[Debug_u8SdBenchTest]);
+
+  if(Debug_bSdBenchFailed)
+  {
+    DebugPrintf(au8Failed);
+    DebugPrintNumber(Debug_u32SdBenchCompleted);
+    DebugPrintf(au8Requests);
+    return;
+  }
+  
+  /* Bytes per ms is KB/s; the scratch area is small enough that bytes * 1000 fits */
+  u32Elapsed = Debug_u32SdBenchEndTime - Debug_u32SdBenchStartTime;
+  if(u32Elapsed == 0)
+  {
+    u32Elapsed = 1;
+  }
+  u32Bytes = Debug_u32SdBenchCompleted * Debug_u32SdBenchBlocksPerOp * SD_BLOCK_SIZE;
+  
+  DebugPrintNumber( (u32Bytes * 1000) / u32Elapsed );
+  DebugPrintf(au8Throughput);
+  DebugPrintNumber(Debug_u32SdBenchMinLatency);
+  DebugPrintf(au8Average);
+  DebugPrintNumber(Debug_u32SdBenchTotalLatency / Debug_u32SdBenchCompleted);
+  DebugPrintf(au8Maximum);
+  DebugPrintNumber(Debug_u32SdBenchMaxLatency);
+  DebugLineFeed();
+
+} /* end DebugSdBenchReport() */
+#endif /* EIE1 only tests */
+
 #ifdef MPGL2 /* MPGL2 only tests */
 /*----------------------------------------------------------------------------------------------------------------------
 Function: DebugCommandCaptouchValuesToggle
@@ -1080,6 +1335,129 @@ void DebugSM_Error(void)
   Debug_pfnStateMachine = DebugSM_Idle;
 
 } /* end DebugSM_Error() */
+
+
+#ifdef EIE1 /* EIE1-specific states */
+/*----------------------------------------------------------------------------------------------------------------------
+Sets up the next benchmark test.  Tests 0 and 1 are sequential (DEBUG_SD_BENCH_CHUNK blocks per request with 
+DEBUG_SD_BENCH_DEPTH requests in flight), tests 2 and 3 are random (one block, one request at a time).  Odd tests
+write.  Write data is a pattern of the block offset so a card that loses blocks is easy to spot later.
+*/
+void DebugSM_SdBenchStart(void)
+{
+  u32 i;
+  
+  if(Debug_u8SdBenchTest < 2)
+  {
+    Debug_u8SdBenchDepth = DEBUG_SD_BENCH_DEPTH;
+    Debug_u32SdBenchBlocksPerOp = DEBUG_SD_BENCH_CHUNK;
+    Debug_u32SdBenchOps = Debug_u32SdBenchBlocks / DEBUG_SD_BENCH_CHUNK;
+  }
+  else
+  {
+    Debug_u8SdBenchDepth = 1;
+    Debug_u32SdBenchBlocksPerOp = 1;
+    Debug_u32SdBenchOps = DEBUG_SD_BENCH_RANDOM_OPS;
+  }
+  
+  if(Debug_u8SdBenchTest & 0x01)
+  {
+    for(i = 0; i < DEBUG_SD_BENCH_BUFFER_SIZE; i++)
+    {
+      Debug_pu8SdBenchBuffer[i] = (u8)(i / SD_BLOCK_SIZE);
+    }
+  }
+  
+  Debug_u32SdBenchSubmitted = 0;
+  Debug_u32SdBenchCompleted = 0;
+  Debug_bSdBenchFailed = FALSE;
+  Debug_u32SdBenchSeed = DEBUG_SD_BENCH_SEED;
+  Debug_u32SdBenchMinLatency = 0xFFFFFFFF;
+  Debug_u32SdBenchMaxLatency = 0;
+  Debug_u32SdBenchTotalLatency = 0;
+  Debug_u32SdBenchStartTime = SystemTimeUs();
+  Debug_u32SdBenchEndTime = Debug_u32SdBenchStartTime;
+  
+  Debug_pfnStateMachine = DebugSM_SdBenchRun;
+  
+} /* end DebugSM_SdBenchStart() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Keeps the SD queue loaded with the current test's requests until they are all called back, then reports and moves to
+the next test.  A failure ends the benchmark once the requests in flight are done.
+*/
+void DebugSM_SdBenchRun(void)
+{
+  u32 u32Block;
+  u8* pu8Buffer;
+  u8 u8Slot;
+  bool bQueued;
+  
+  /* Top up the requests in flight */
+  while( !Debug_bSdBenchFailed && (Debug_u32SdBenchSubmitted < Debug_u32SdBenchOps) &&
+         ((Debug_u32SdBenchSubmitted - Debug_u32SdBenchCompleted) < Debug_u8SdBenchDepth) )
+  {
+    if(Debug_u8SdBenchDepth == 1)
+    {
+      Debug_u32SdBenchSeed = (Debug_u32SdBenchSeed * 1664525) + 1013904223;
+      u32Block = Debug_u32SdBenchFirst + ( (Debug_u32SdBenchSeed >> 16) % Debug_u32SdBenchBlocks );
+    }
+    else
+    {
+      u32Block = Debug_u32SdBenchFirst + (Debug_u32SdBenchSubmitted * DEBUG_SD_BENCH_CHUNK);
+    }
+    
+    u8Slot = Debug_u32SdBenchSubmitted % Debug_u8SdBenchDepth;
+    pu8Buffer = Debug_pu8SdBenchBuffer + (u8Slot * DEBUG_SD_BENCH_CHUNK * SD_BLOCK_SIZE);
+    Debug_au32SdBenchSubmitTime[u8Slot] = SystemTimeUs();
+    
+    if(Debug_u8SdBenchTest & 0x01)
+    {
+      bQueued = SdQueueWrite(u32Block, Debug_u32SdBenchBlocksPerOp, pu8Buffer, DebugSdBenchCallback);
+    }
+    else
+    {
+      bQueued = SdQueueRead(u32Block, Debug_u32SdBenchBlocksPerOp, pu8Buffer, DebugSdBenchCallback);
+    }
+    
+    if(!bQueued)
+    {
+      /* A full queue is retried next pass; a missing card will never take the request */
+      if(SdGetStatus() == SD_NO_CARD)
+      {
+        Debug_bSdBenchFailed = TRUE;
+      }
+      break;
+    }
+    
+    Debug_u32SdBenchSubmitted++;
+  }
+  
+  /* Wait for everything queued to be called back */
+  if(Debug_u32SdBenchCompleted != Debug_u32SdBenchSubmitted)
+  {
+    return;
+  }
+  
+  if( Debug_bSdBenchFailed || (Debug_u32SdBenchCompleted == Debug_u32SdBenchOps) )
+  {
+    DebugSdBenchReport();
+    
+    Debug_u8SdBenchTest++;
+    if( Debug_bSdBenchFailed || (Debug_u8SdBenchTest == DEBUG_SD_BENCH_TESTS) )
+    {
+      FatReturnLogBuffer();
+      Debug_pfnStateMachine = DebugSM_Idle;
+    }
+    else
+    {
+      Debug_pfnStateMachine = DebugSM_SdBenchStart;
+    }
+  }
+  
+} /* end DebugSM_SdBenchRun() */
+#endif /* EIE1 */
              
 
           
@@ -58,11 +58,20 @@ typedef struct
 #define DEBUG_CMD_NAME00        "Show debug command list         "  /* Command 0: List all commands */
 #define DEBUG_CMD_NAME01        "Toggle LED test                 "  /* Command 1: Test that allows characters to toggle LEDs */
 #define DEBUG_CMD_NAME02        "Toggle system timing warning    "  /* Command 2: Prints message if system tick has advanced more than 1 between main loop sleeps (i.e. tasks are taking too long) */
-#define DEBUG_CMD_NAME03        "Dummy3                          "  /* Command 3: */
-#define DEBUG_CMD_NAME04        "Dummy4                          "  /* Command 4: */
-#define DEBUG_CMD_NAME05        "Dummy5                          "  /* Command 5: */
-#define DEBUG_CMD_NAME06        "Dummy6                          "  /* Command 6: */
+#define DEBUG_CMD_NAME03        "Show SD cache statistics        "  /* Command 3: Prints FAT sector cache hits, misses and write-backs */
+#define DEBUG_CMD_NAME04        "Run SD benchmark                "  /* Command 4: Times sequential and random reads and writes in the scratch area before the FAT volume */
+#define DEBUG_CMD_NAME05        "Show SD write throughput        "  /* Command 5: Prints the measured KB/s of SD multi-block writes */
+#define DEBUG_CMD_NAME06        "Show ANT burst rates            "  /* Command 6: Prints the bytes/s of the last completed ANT burst each way */
 #define DEBUG_CMD_NAME07        "Dummy7                          "  /* Command 7: */
+
+/* SD benchmark */
+#define DEBUG_SD_BENCH_BLOCKS   (u32)256            /* Most blocks of the scratch area used by the benchmark */
+#define DEBUG_SD_BENCH_CHUNK    (u32)4              /* Blocks in each sequential request */
+#define DEBUG_SD_BENCH_DEPTH    (u8)2               /* Sequential requests kept in the SD queue */
+#define DEBUG_SD_BENCH_RANDOM_OPS (u32)64           /* Single-block requests in each random test */
+#define DEBUG_SD_BENCH_SEED     (u32)0x2545F491     /* Random test seed (both random tests use the same blocks) */
+#define DEBUG_SD_BENCH_TESTS    (u8)4               /* Sequential read, sequential write, random read, random write */
+#define DEBUG_SD_BENCH_BUFFER_SIZE (u32)(DEBUG_SD_BENCH_DEPTH * DEBUG_SD_BENCH_CHUNK * SD_BLOCK_SIZE) /* Borrowed from the FAT log buffer */
 #endif /* EIE1 */
 
 #ifdef MPGL2
@@ -72,7 +81,7 @@ typedef struct
 #define DEBUG_CMD_NAME01        "Toggle LED test                 "  /* Command 1: Test that allows characters to toggle LEDs */
 #define DEBUG_CMD_NAME02        "Toggle system timing warning    "  /* Command 2: Prints message if system tick has advanced more than 1 between main loop sleeps (i.e. tasks are taking too long) */
 #define DEBUG_CMD_NAME03        "Toggle Captouch value display   "  /* Command 2: Test that shows Captouch sense values on debug port */
-#define DEBUG_CMD_NAME04        "Dummy4                          "  /* Command 4: */
+#define DEBUG_CMD_NAME04        "Show ANT burst rates            "  /* Command 4: Prints the bytes/s of the last completed ANT burst each way */
 #define DEBUG_CMD_NAME05        "Dummy5                          "  /* Command 5: */
 #define DEBUG_CMD_NAME06        "Dummy6                          "  /* Command 6: */
 #define DEBUG_CMD_NAME07        "Dummy7                          "  /* Command 7: */
@@ -123,8 +132,14 @@ static void DebugCommandDummy(void);
 static void DebugCommandLedTestToggle(void);
 static void DebugLedTestCharacter(u8 u8Char_);
 static void DebugCommandSysTimeToggle(void);
+static void DebugCommandAntBurstRates(void);
 
 #ifdef EIE1 /* EIE1-specific debug functions */
+static void DebugCommandSdCacheStats(void);
+static void DebugCommandSdBenchmark(void);
+static void DebugCommandSdWriteStats(void);
+static void DebugSdBenchCallback(u8* pu8Buffer_, bool bSuccess_);
+static void DebugSdBenchReport(void);
 #endif /* EIE1 */
 
 #ifdef MPGL2 /* MPGL2-specific debug functions  */
@@ -140,6 +155,11 @@ static void DebugSM_ProcessCmd(void);
 
 static void DebugSM_Error(void);
 
+#ifdef EIE1 /* EIE1-specific states */
+static void DebugSM_SdBenchStart(void);
+static void DebugSM_SdBenchRun(void);
+#endif /* EIE1 */
+
 
 
 #endif /* __DEBUG_H */
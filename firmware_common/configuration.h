@@ -70,6 +70,8 @@ Includes
 #include "eief1-pcb-01.h"
 #include "lcd_nhd-c0220biz.h"
 #include "sdcard.h"
+#include "fat.h"
+#include "rawlog.h"
 #endif /* EIE1 */
 
 #ifdef MPGL2
@@ -109,8 +111,10 @@ Includes
 #ifdef EIE1
 /* EIE1 specific application flags */
 #define _APPLICATION_FLAGS_SDCARD       0x00000080        /* SdCardStateMachine */
+#define _APPLICATION_FLAGS_FAT          0x00000100        /* FatStateMachine */
+#define _APPLICATION_FLAGS_RAWLOG       0x00000200        /* RawLogStateMachine */
 
-#define NUMBER_APPLICATIONS             (u8)8            /* Total number of applications */
+#define NUMBER_APPLICATIONS             (u8)10           /* Total number of applications */
 #endif /* EIE1 specific application flags */
 
 #ifdef MPGL2
@@ -1104,10 +1108,12 @@ SPI mode to communicate with an SPI SD card.
 /* USART Baud Rate Generator Register - Page 752
 BAUD = MCK / CD 
 => CD = MCK / BAUD
-BAUD desired = 1 Mbps
-=> CD = 48
+The SD card must be initialized at no more than 400 kHz.  This is the value loaded by SspRequest();
+sdcard.c switches to SD_US_BRGR_FAST once the card is ready.
+BAUD desired = 400 kbps
+=> CD = 120
 */
-#define SD_US_BRGR_INIT (u32)0x00000030  /* VERIFY SPI CLOCK! */
+#define SD_US_BRGR_INIT (u32)0x00000078
 /*
     31-20 [0] Reserved
 
@@ -1116,7 +1122,7 @@ BAUD desired = 1 Mbps
     17 [0] "
     16 [0] "
 
-    15 [0] CD = 48 = 0x30
+    15 [0] CD = 120 = 0x78
     14 [0] "
     13 [0] "
     12 [0] "
@@ -1127,16 +1133,19 @@ BAUD desired = 1 Mbps
     08 [0] "
 
     07 [0] "
-    06 [0] "
+    06 [1] "
     05 [1] "
     04 [1] "
 
-    03 [0] "
+    03 [1] "
     02 [0] "
     01 [0] "
     00 [0] "
 */
 
+/* Data transfer clock once the card is initialized: the USART SPI master minimum of CD = 6 (MCK / 6 = 8 Mbps) */
+#define SD_US_BRGR_FAST (u32)0x00000006
+
 
 /*--------------------------------------------------------------------------------------------------------------------
 Two Wire Interface setup
@@ -6,7 +6,12 @@ ANT implementation for Atmel SAM3U2 Cortex-M3 / Ant slave SPI.  This driver requ
 SPI slave connection to an AP2 or AP2-emulated ANT device (the ANT device is the Master).  
 All interface layer code is maintained here.  
 Transmitted messages use the Message task; received messages use an SSP peripheral
-with SPI_SLAVE_FLOW_CONTROL.
+with SPI_SLAVE_FLOW_CONTROL_DMA.  The SYNC and LENGTH bytes are received one at a time
+with SRDY flow control; the rest of each frame and every transmitted frame move by DMA
+with a single SRDY handshake.  The ANT task never waits for the link: each step of a 
+message exchange is a state that checks the SEN and SSP flags maintained by the SSP ISR.
+Each idle pass processes received messages for up to ANT_PROCESS_BUDGET_US and only 
+accepts a new message from ANT when the receive buffer has room for it.
 
 ------------------------------------------------------------------------------------------------------------------------
 
@@ -91,8 +96,14 @@ Global variable definitions with scope limited to this local application.
 Variable names shall start with "Ant_<type>Name" and be declared as static.
 ***********************************************************************************************************************/
 static fnCode_type Ant_pfnStateMachine;                 /* The ANT state machine function pointer */
-static u32 Ant_u32RxTimer;                              /* Dedicated timer for receiving bytes */
-static u32 Ant_u32TxTimer;                              /* Dedicated timer for transmitting bytes */
+static u32 Ant_u32RxTimer;                              /* G_u32SystemTime1ms when the current receive step started */
+static u32 Ant_u32TxTimer;                              /* G_u32SystemTime1ms when the current transmit step started */
+static u32 Ant_u32RxFrameStartCount;                    /* Ant_u32RxByteCounter before the SYNC byte of the current frame */
+static u8 *Ant_pu8TxMessage;                            /* Message being transmitted (length byte first) */
+
+static volatile u8 Ant_u8SrdyPulsesPending = 0;         /* SRDY pulses requested but not yet finished by the SRDY timer */
+static volatile bool Ant_bSrdyAsserted = FALSE;         /* TRUE while the SRDY timer is holding SRDY asserted */
+static volatile bool Ant_bSrdyFlush = FALSE;            /* TRUE while AntSM_RxFlush wants SRDY pulsed until SEN deasserts */
 
 static u32 Ant_u32TxByteCounter = 0;                    /* Counter counts callbacks on sent bytes */
 static u32 Ant_u32RxByteCounter = 0;                    /* Counter counts callbacks on received bytes */
@@ -110,10 +121,68 @@ static u8 *Ant_pu8AntRxBufferNextChar;                  /* Pointer to next char
 static u8 *Ant_pu8AntRxBufferCurrentChar;               /* Pointer to the current char in the AntRxBuffer */
 static u8 *Ant_pu8AntRxBufferUnreadMsg;                 /* Pointer to unread chars in the AntRxBuffer */
 static u8 Ant_u8AntNewRxMessages;                       /* Counter for number of new messages in AntRxBuffer */
+static u8 Ant_u8RxFrameBytes;                           /* Number of bytes in the frame body currently armed for DMA */
+static u32 Ant_u32RxBufferOverflows = 0;                /* Receptions started with less than a full message of room in Ant_au8AntRxBuffer */
+static u32 Ant_u32RxBufferDeferrals = 0;                /* Passes that left ANT waiting until processing made room in Ant_au8AntRxBuffer */
 
-static u32 Ant_u32ApplicationMessageCount = 0;          /* Counts messages queued on G_sAntApplicationMsgList */
+static AntApplicationMsgListType *Ant_psApplicationMsgTail;   /* Last message on G_sAntApplicationMsgList */
+static u32 Ant_u32ApplicationMessageCount = 0;          /* Messages currently queued on G_sAntApplicationMsgList */
 static AntOutgoingMessageListType *Ant_psDataOutgoingMsgList; /* Linked list of outgoing ANT-formatted messages */
-static u32 Ant_u32OutgoingMessageCount = 0;             /* Counts messages queued on Ant_psDataOutgoingMsgList */
+static AntOutgoingMessageListType *Ant_psDataOutgoingMsgTail; /* Last message on Ant_psDataOutgoingMsgList */
+static u32 Ant_u32OutgoingMessageCount = 0;             /* Messages currently queued on Ant_psDataOutgoingMsgList */
+
+/* Fixed-block pools for the message lists: free nodes are chained through psNextMessage.  The pools
+are placed in RAM1 by sam3u2-flash.icf where the malloc() heap used to hold the nodes. */
+#pragma location = ".ram1"
+static AntOutgoingMessageListType Ant_asOutgoingMessagePool[ANT_OUTGOING_MESSAGE_BUFFER_SIZE];
+static AntOutgoingMessageListType *Ant_psOutgoingMessageFree;   /* First free outgoing node (NULL if none) */
+#pragma location = ".ram1"
+static AntApplicationMsgListType Ant_asApplicationMessagePool[ANT_APPLICATION_MESSAGE_BUFFER_SIZE];
+static AntApplicationMsgListType *Ant_psApplicationMessageFree; /* First free application node (NULL if none) */
+static u32 Ant_u32OutgoingMessageOverflows = 0;         /* Outgoing messages refused because the pool was empty */
+static u32 Ant_u32ApplicationMessageOverflows = 0;      /* Application messages dropped because the pool was empty */
+
+/* Application subscribers: matching messages go on the subscriber's queue instead of G_sAntApplicationMsgList */
+static AntSubscriberType Ant_asSubscribers[ANT_SUBSCRIBERS];
+
+/* Channel responses in arrival order for AntReadResponse() */
+static AntMessageResponseType Ant_asResponses[ANT_RESPONSE_BUFFER_SIZE];
+static u8 Ant_u8ResponseOldest = 0;                     /* Index of the oldest unread response */
+static u8 Ant_u8ResponseCount = 0;                      /* Unread responses */
+
+/* Burst transmit: packets are made from the caller's buffer as room opens on the outgoing list */
+static AntBurstStatusType Ant_eBurstTxStatus = ANT_BURST_IDLE; /* Status of the current / last transmitted burst */
+static u8 *Ant_pu8BurstTxData;                          /* Caller's data for the burst being sent */
+static u16 Ant_u16BurstTxLength;                        /* Bytes in the burst being sent */
+static u16 Ant_u16BurstTxIndex;                         /* Next byte of Ant_pu8BurstTxData to packetize */
+static u8 Ant_u8BurstTxChannel;                         /* Channel of the burst being sent */
+static u8 Ant_u8BurstTxSequence;                        /* Sequence bits for the next packet */
+static u8 Ant_u8BurstTxPacketsQueued;                   /* Burst packets on Ant_psDataOutgoingMsgList */
+static u32 Ant_u32BurstTxStartTime;                     /* G_u32SystemTime1ms when the burst was started */
+static u32 Ant_u32BurstTxTimer;                         /* G_u32SystemTime1ms of the last burst progress */
+static u32 Ant_u32BurstTxRate = 0;                      /* Bytes/second of the last completed burst */
+
+/* Burst receive: one burst is reassembled at a time and held until the application reads it */
+static AntBurstStatusType Ant_eBurstRxStatus = ANT_BURST_IDLE; /* Status of the reassembly buffer */
+#pragma location = ".ram1"
+static u8 Ant_au8BurstRxBuffer[ANT_BURST_RX_BUFFER_SIZE]; /* Reassembled burst data (RAM1) */
+static u16 Ant_u16BurstRxLength;                        /* Bytes in Ant_au8BurstRxBuffer */
+static u8 Ant_u8BurstRxChannel;                         /* Channel of the burst being received */
+static u8 Ant_u8BurstRxSequence;                        /* Sequence bits expected on the next packet */
+static u32 Ant_u32BurstRxStartTime;                     /* G_u32SystemTime1ms of the first packet */
+static u32 Ant_u32BurstRxRate = 0;                      /* Bytes/second of the last completed burst */
+static u32 Ant_u32BurstRxDropped = 0;                   /* Bursts lost to an unread buffer, overflow or bad sequence */
+
+/* Reliable transmit: one acknowledged message per channel is with ANT at a time */
+static AntReliableChannelType Ant_asReliable[ANT_NUM_CHANNELS];
+
+/* Scanning device table: open addressing with linear probing, updated in place by AntProcessMessage() */
+static bool Ant_bScanTableEnabled = FALSE;              /* TRUE while received device data goes to the table */
+#pragma location = ".ram1"
+static AntScanDeviceType Ant_asScanTable[ANT_SCAN_TABLE_SIZE]; /* RAM1 */
+static u8 Ant_u8ScanDevices = 0;                        /* Slots in use */
+static u8 Ant_u8ScanAgeSlot = 0;                        /* Next slot AntScanTableAge() checks */
+static u32 Ant_u32ScanDropped = 0;                      /* Messages from new devices that found the table full */
 
 static u8 Ant_u8SlaveMissedMessageHigh = 0;             /* Counter for missed messages if device is a slave */
 static u8 Ant_u8SlaveMissedMessageMid = 0;              /* Counter for missed messages if device is a slave */
@@ -158,6 +227,9 @@ static void AntSyncSerialInitialize(void)
   u32 u32EventTimer;
   bool bErrorStatus = FALSE;
   
+  /* SRDY pulses are timed by a one-shot timer channel */
+  TimerAssignCallback(ANT_SRDY_TIMER, AntSrdyTimerCallback);
+
   /* Initialize buffer pointers */  
   Ant_pu8AntRxBufferNextChar    = Ant_au8AntRxBuffer;
   Ant_pu8AntRxBufferCurrentChar = Ant_au8AntRxBuffer;
@@ -201,40 +273,95 @@ static void AntSyncSerialInitialize(void)
 Function: AntSrdyPulse
 
 Description:
-Pulses Srdy with added delays on the front and middle. 
+Requests an SRDY pulse and returns immediately.  The pulse is generated by 
+AntSrdyTimerCallback() after ANT_SRDY_DELAY_TICKS; pulses requested while one is 
+in progress are queued and follow with the same spacing.  Safe to call from the
+SSP callbacks and from the main loop.
 
 Requires:
-  - 
+  - ANT_SRDY_TIMER callback is AntSrdyTimerCallback
 
 Promises:
-  - A delay controlled by ANT_SRDY_DELAY is passed
-  - SRDY is asserted
-  - A delay of ANT_SRDY_PERIOD is passed
-  - SRDY is deasserted
+  - Ant_u8SrdyPulsesPending is incremented
+  - If no pulse was in progress, ANT_SRDY_TIMER is started for the front delay
 */
 static void AntSrdyPulse(void)
 {
-  for(u32 i = 0; i < ANT_SRDY_DELAY; i++);
-  SYNC_SRDY_ASSERT();
+  /* The timer ISR also updates the pending count */
+  NVIC_DisableIRQ(IRQn_TC2);
   
-  for(u32 i = 0; i < ANT_SRDY_PERIOD; i++);
-  SYNC_SRDY_DEASSERT();
+  Ant_u8SrdyPulsesPending++;
+  if(Ant_u8SrdyPulsesPending == 1)
+  {
+    TimerSet(ANT_SRDY_TIMER, ANT_SRDY_DELAY_TICKS);
+    TimerStart(ANT_SRDY_TIMER);
+  }
+  
+  NVIC_EnableIRQ(IRQn_TC2);
 
 } /* end AntSrdyPulse() */
 
 
+/*-----------------------------------------------------------------------------
+Function: AntSrdyTimerCallback
+
+Description:
+ANT_SRDY_TIMER one-shot callback that steps through each SRDY pulse: after the 
+front delay SRDY is asserted, after the pulse period it is deasserted and the next
+pending pulse (if any) is started.  While Ant_bSrdyFlush is set, pulses continue
+for as long as ANT holds SEN asserted.
+
+Note: Since this function is called from an ISR, it should execute as quickly as possible. 
+
+Requires:
+  - Ant_u8SrdyPulsesPending > 0
+
+Promises:
+  - SRDY is asserted or deasserted and the timer is restarted for the next step if needed
+*/
+static void AntSrdyTimerCallback(void)
+{
+  /* End of the front delay: start the pulse */
+  if(!Ant_bSrdyAsserted)
+  {
+    SYNC_SRDY_ASSERT();
+    Ant_bSrdyAsserted = TRUE;
+    TimerSet(ANT_SRDY_TIMER, ANT_SRDY_PERIOD_TICKS);
+    TimerStart(ANT_SRDY_TIMER);
+    return;
+  }
+  
+  /* End of the pulse */
+  SYNC_SRDY_DEASSERT();
+  Ant_bSrdyAsserted = FALSE;
+  Ant_u8SrdyPulsesPending--;
+  
+  if( Ant_bSrdyFlush && IS_SEN_ASSERTED() && (Ant_u8SrdyPulsesPending == 0) )
+  {
+    Ant_u8SrdyPulsesPending = 1;
+  }
+  
+  if(Ant_u8SrdyPulsesPending != 0)
+  {
+    TimerSet(ANT_SRDY_TIMER, ANT_SRDY_DELAY_TICKS);
+    TimerStart(ANT_SRDY_TIMER);
+  }
+
+} /* end AntSrdyTimerCallback() */
+
+
 /*-----------------------------------------------------------------------------
 Function: AntRxMessage
 
 Description:
-Completely receive a message from ANT to the Host.  Incoming bytes are deposited directly into the receive
-buffer from the SSP ISR which should be extremely fast and complete in a maximum of 500us.  
+Completely receive a message from ANT to the Host by running the receive states until 
+they finish.  
+
+*** This function blocks for the whole message, so should only be used during initialization. ***
+The running system uses AntRxStart() from AntSM_Idle and lets the states run once per loop.
 
 Requires:
   - _SSP_CS_ASSERTED is set indicating a message is ready to come in 
-  - G_u32AntFlags _ANT_FLAGS_TX_INTERRUPTED is set if the system wanted to transmit
-    but ANT wanted to send a message at the same time (so MESG_TX_SYNC has already 
-    been received); _SSP_RX_COMPLETE must still be set from this.
   - Ant_pu8AntRxBufferCurrentChar points to the first byte of the message
 
 Promises:
@@ -242,167 +369,184 @@ Promises:
     and the message is at Ant_pu8AntRxBufferUnreadMsg in Ant_au8AntRxBuffer
   - If a good message is not received, then Ant_u8AntNewMessages is unchanged.
   - In both cases, Ant_pu8AntRxBufferNextChar points at the next empty buffer location
+    and Ant_pfnStateMachine = AntSM_Idle
 */
 static void AntRxMessage(void)
 {
-  u8 u8Checksum;
-  u8 u8Length;
-  u32 u32CurrentRxByteCount;
-  u8 au8RxTimeoutMsg[] = "AntRx: timeout\n\r";
-  u8 au8RxFailMsg[] = "AntRx: message failed\n\r";
-  bool bReceptionError = FALSE;
-  
   /* Ensure we have CS flag */
   if( !( IS_SEN_ASSERTED() ) )
   {
     return;
   }
   
-  /* Initialize the receive timer and get a snapshot of current byte count */
-  u32CurrentRxByteCount = Ant_u32RxByteCounter;
-  Ant_u32RxTimer = 0;
-  
-  /* If the Global _ANT_FLAGS_TX_INTERRUPTED flag has been set, then we have already read the TX_SYNC byte */
-  if(G_u32AntFlags & _ANT_FLAGS_TX_INTERRUPTED)
+  /* Each receive state has its own timeout so this always ends */
+  AntRxStart();
+  while( (Ant_pfnStateMachine == AntSM_RxWaitSync)  ||
+         (Ant_pfnStateMachine == AntSM_RxWaitFrame) ||
+         (Ant_pfnStateMachine == AntSM_RxFlush) )
   {
-    /* Clear flag and load the value we know was already received to allow the function to proceed*/
-    G_u32AntFlags &= ~_ANT_FLAGS_TX_INTERRUPTED;
-    
-    /* Adjust the starting byte counter since it came in during AntTxMessage */
-    u32CurrentRxByteCount--;
-    
+    Ant_pfnStateMachine();
   }
-  /* Otherwise we need to first read the sync byte  */
-  else
+  
+} /* end AntRxMessage() */
+
+
+/*-----------------------------------------------------------------------------
+Function: AntRxStart
+
+Description:
+Starts the reception of a message that ANT has signalled with SEN.  Incoming bytes are 
+deposited directly into the receive buffer from the SSP ISR, and the receive states only 
+check on their progress so no time is spent waiting.
+
+Requires:
+  - _SSP_CS_ASSERTED is set indicating a message is ready to come in 
+  - Ant_pu8AntRxBufferCurrentChar points to the first byte of the message
+
+Promises:
+  - The byte count is noted, SRDY is pulsed for the SYNC byte and 
+    Ant_pfnStateMachine = AntSM_RxWaitSync
+*/
+static void AntRxStart(void)
+{
+  if(AntRxBufferFree() < MESG_MAX_SIZE)
   {
-    /* Do short delay then cycle SRDY to get the first byte */
-    AntSrdyPulse();
+    Ant_u32RxBufferOverflows++;
+  }
+  
+  Ant_DebugRxMessageCounter++;
+  Ant_u32RxFrameStartCount = Ant_u32RxByteCounter;
+  
+  /* Do short delay then cycle SRDY to get the first byte */
+  AntSrdyPulse();
+  
+  Ant_u32RxTimer = G_u32SystemTime1ms;
+  Ant_pfnStateMachine = AntSM_RxWaitSync;
+  
+} /* end AntRxStart() */
 
-    /* Begin the receive cycle that takes place using interrupts and callbacks and is monitored by a timeout of 
-    about 500us - this should be plenty of time to receive even the longest ANT message but still only half the 
-    allowed 1ms loop time for the system. */
-    
-    /* Read the first byte when it comes in */
-    while( !(ANT_SSP_FLAGS & _SSP_RX_COMPLETE) &&
-           (Ant_u32RxTimer < ANT_ACTIVITY_TIME_COUNT) )
-    {
-      Ant_u32RxTimer++;
-    }
+
+/*-----------------------------------------------------------------------------
+Function: AntRxBufferFree
+
+Description:
+Returns the space in Ant_au8AntRxBuffer that does not hold unprocessed messages.
+
+Requires:
+  - Ant_pu8AntRxBufferUnreadMsg points to the SYNC byte of the oldest unprocessed message
+  - Ant_pu8AntRxBufferNextChar is where the next received byte goes
+
+Promises:
+  - Returns the number of bytes that can be received without overwriting an unprocessed message
+*/
+static u16 AntRxBufferFree(void)
+{
+  u16 u16Used;
+  
+  if(Ant_u8AntNewRxMessages == 0)
+  {
+    return(ANT_RX_BUFFER_SIZE);
   }
   
-  if( Ant_u32RxTimer > ANT_ACTIVITY_TIME_COUNT) 
+  /* Equal pointers with messages waiting means the buffer is full */
+  u16Used = (u16)((Ant_pu8AntRxBufferNextChar - Ant_pu8AntRxBufferUnreadMsg + ANT_RX_BUFFER_SIZE) % ANT_RX_BUFFER_SIZE);
+  if(u16Used == 0)
   {
-    AntAbortMessage();
-    DebugPrintf(au8RxTimeoutMsg);
-    return;
+    return(0);
   }
+  
+  return(ANT_RX_BUFFER_SIZE - u16Used);
+  
+} /* end AntRxBufferFree() */
 
-  /* _SSP_RX_COMPLETE flag will be set and the Rx callback will have run.  
-  The callback does NOT toggle SRDY yet.  _SSP_RX_COMPLETE should still
-  be set from AntTxMessage if that's what got us here. */
-  ANT_SSP_FLAGS &= ~_SSP_RX_COMPLETE;
-   
-  /* One way or the other, we now have a potential SYNC byte at Ant_pu8AntRxBufferCurrentChar.  
-  Proceed to test it and receive the rest of the message */
-  if (*Ant_pu8AntRxBufferCurrentChar == MESG_TX_SYNC)                     
-  {
-    /* Flag that a reception is in progress */
-    G_u32AntFlags |= _ANT_FLAGS_RX_IN_PROGRESS;
-    
-    /* Delay and then cycle SRDY to get the next byte (length) */
-    AntSrdyPulse();
-    
-    /* The SSP interrupts and Rx callback handle the rest of the reception until a full message is received. 
-    We know it is received when SEN is deasserted. */
-    while( IS_SEN_ASSERTED() && (Ant_u32RxTimer < ANT_ACTIVITY_TIME_COUNT) )
-    {
-      Ant_u32RxTimer++;
-    }
+
+/*-----------------------------------------------------------------------------
+Function: AntRxVerifyMessage
+
+Description:
+Checks the length and checksum of a frame that ANT has finished sending.
+
+Requires:
+  - Ant_pu8AntRxBufferCurrentChar points to the SYNC byte of the frame
+  - Ant_u32RxFrameStartCount is the value of Ant_u32RxByteCounter before the SYNC byte
+
+Promises:
+  - If the checksum is good, Ant_u8AntNewRxMessages is incremented
+  - Otherwise Ant_pu8AntRxBufferUnreadMsg is moved past the garbage data
+  - Ant_pu8AntRxBufferCurrentChar points to the byte after the frame
+*/
+static void AntRxVerifyMessage(void)
+{
+  u8 u8Checksum;
+  u8 u8Length;
+  u32 u32CurrentRxByteCount;
   
-    /* One way or another, this Rx is done! */
-    G_u32AntFlags &= ~_ANT_FLAGS_RX_IN_PROGRESS;
-    ANT_SSP_FLAGS &= ~_SSP_RX_COMPLETE;
+  /* Update counter to see how many bytes we should have */
+  u32CurrentRxByteCount = Ant_u32RxByteCounter - Ant_u32RxFrameStartCount;
 
-    /* Check that the above loop ended as expected and didn't time out */
-    if(Ant_u32RxTimer < ANT_ACTIVITY_TIME_COUNT)
-    {  
-      /* Update counter to see how many bytes we should have */
-      u32CurrentRxByteCount = Ant_u32RxByteCounter - u32CurrentRxByteCount;
-    
-      /* RxBufferCurrentChar is still pointing to the SYNC byte. Validate what should be a complete message now. */
-      u8Checksum = *Ant_pu8AntRxBufferCurrentChar;
-      AdvanceAntRxBufferCurrentChar();
-      
-      /* Read the length byte and add two to count the length byte and message ID but not checksum as length will be our checksum counter */
-      u8Length = *Ant_pu8AntRxBufferCurrentChar + 2;  
-      
-      /* Optional check (u8Length does not include the SYNC byte or Checksum byte so add 2) */
-      if(u32CurrentRxByteCount != (u8Length + 2) )
-      {
-        /* Could throw out the message right away - this could save some potential weird memory accesses
-        if there was any corruption or a wild u8Length value */
-        G_u32AntFlags |= _ANT_FLAGS_LENGTH_MISMATCH;
-      }
- 
-      /* Validate the remaining bytes based on u8Length*/
-      do
-      {
-        u8Checksum ^= *Ant_pu8AntRxBufferCurrentChar;                     
-        AdvanceAntRxBufferCurrentChar();
-      } while (--u8Length);
-      
-      /* AntRxBufferCurrentChar is pointing to the last received byte that should be the checksum. */
-      if (u8Checksum == *Ant_pu8AntRxBufferCurrentChar)      
-      {
-        Ant_u8AntNewRxMessages++;
-        Ant_DebugTotalRxMessages++;
-      }
-      /* If the message was not good, then move Ant_pu8AntRxBufferUnreadMsg passed the garbage data */
-      else
-      {
-        Ant_pu8AntRxBufferUnreadMsg = Ant_pu8AntRxBufferCurrentChar;
-        AdvanceAntRxBufferUnreadMsgPointer();
-      }
-    } 
-    else
-    {
-      Ant_u32RxTimeoutCounter++;
-      bReceptionError = TRUE;
-    }
-  } /* end if(*Ant_pu8AntRxBufferCurrentChar == MESG_TX_SYNC) */
-  else
+  /* RxBufferCurrentChar is still pointing to the SYNC byte. Validate what should be a complete message now. */
+  u8Checksum = *Ant_pu8AntRxBufferCurrentChar;
+  AdvanceAntRxBufferCurrentChar();
+  
+  /* Read the length byte and add two to count the length byte and message ID but not checksum as length will be our checksum counter */
+  u8Length = *Ant_pu8AntRxBufferCurrentChar + 2;  
+  
+  /* Optional check (u8Length does not include the SYNC byte or Checksum byte so add 2) */
+  if(u32CurrentRxByteCount != (u8Length + 2) )
   {
-    /* Otherwise we have received an unexpected byte -- flag it, clear Ssp flags and abandon the byte */
-    Ant_u32UnexpectedByteCounter++;
-    bReceptionError = TRUE;
+    /* Could throw out the message right away - this could save some potential weird memory accesses
+    if there was any corruption or a wild u8Length value */
+    G_u32AntFlags |= _ANT_FLAGS_LENGTH_MISMATCH;
   }
 
-  /* If a reception error has occured, */
-  if(bReceptionError)
+  /* Validate the remaining bytes based on u8Length*/
+  do
   {
-    /* Toggle SRDY until CS deasserts and throw out the message */
-    DebugPrintf(au8RxFailMsg);
-    while( IS_SEN_ASSERTED()  && (Ant_u32RxTimer < ANT_ACTIVITY_TIME_COUNT) )
-    {
-      Ant_u32RxTimer++;
-      AntSrdyPulse();
-    }
-   
-    /* Since we have flow control, we can safely assume that no other messages
-    have come in and Ant_pu8AntRxBufferNextChar is pointing to where the next 
-    valid message WILL come in - so push all the pointers there. */
-    Ant_pu8AntRxBufferCurrentChar = Ant_pu8AntRxBufferNextChar;
-    Ant_pu8AntRxBufferUnreadMsg = Ant_pu8AntRxBufferNextChar;
-    ANT_SSP_FLAGS &= ~(_SSP_TX_COMPLETE | _SSP_RX_COMPLETE);
-
+    u8Checksum ^= *Ant_pu8AntRxBufferCurrentChar;                     
+    AdvanceAntRxBufferCurrentChar();
+  } while (--u8Length);
+  
+  /* AntRxBufferCurrentChar is pointing to the last received byte that should be the checksum. */
+  if (u8Checksum == *Ant_pu8AntRxBufferCurrentChar)      
+  {
+    Ant_u8AntNewRxMessages++;
+    Ant_DebugTotalRxMessages++;
   }
+  /* If the message was not good, then move Ant_pu8AntRxBufferUnreadMsg passed the garbage data */
   else
   {
-    /* In all other cases, finish by advancing the current byte pointer */
-    AdvanceAntRxBufferCurrentChar();
+    Ant_pu8AntRxBufferUnreadMsg = Ant_pu8AntRxBufferCurrentChar;
+    AdvanceAntRxBufferUnreadMsgPointer();
   }
   
-} /* end AntRxMessage() */
+  /* Finish by advancing the current byte pointer */
+  AdvanceAntRxBufferCurrentChar();
+  
+} /* end AntRxVerifyMessage() */
+
+
+/*-----------------------------------------------------------------------------
+Function: AntRxError
+
+Description:
+Abandons the message being received.  AntSM_RxFlush clocks out whatever ANT still 
+wants to send.
+
+Requires:
+  - 
+
+Promises:
+  - The failure is reported and Ant_pfnStateMachine = AntSM_RxFlush
+*/
+static void AntRxError(void)
+{
+  DebugPrintf("AntRx: message failed\n\r");
+  G_u32AntFlags &= ~_ANT_FLAGS_RX_IN_PROGRESS;
+  
+  Ant_u32RxTimer = G_u32SystemTime1ms;
+  Ant_pfnStateMachine = AntSM_RxFlush;
+  
+} /* end AntRxError() */
 
 
 /*-----------------------------------------------------------------------------
@@ -622,6 +766,43 @@ void AntInitialize(void)
 {
   u32 u32AntPortAPins, u32AntPortBPins;
 
+  /* The lists start empty with every node in its pool */
+  G_sAntApplicationMsgList = NULL;
+  Ant_psApplicationMsgTail = NULL;
+  Ant_u32ApplicationMessageCount = 0;
+  Ant_psDataOutgoingMsgList = NULL;
+  Ant_psDataOutgoingMsgTail = NULL;
+  Ant_u32OutgoingMessageCount = 0;
+  for(u8 i = 0; i < ANT_SUBSCRIBERS; i++)
+  {
+    Ant_asSubscribers[i].bActive = FALSE;
+  }
+  Ant_u8ResponseOldest = 0;
+  Ant_u8ResponseCount = 0;
+  AntInitializeMessagePools();
+  
+  /* Start the core cycle counter that times message processing */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA;
+  ANT_DWT_CTRL |= ANT_DWT_CTRL_CYCCNTENA;
+  Ant_eBurstTxStatus = ANT_BURST_IDLE;
+  Ant_u8BurstTxPacketsQueued = 0;
+  Ant_eBurstRxStatus = ANT_BURST_IDLE;
+  AntEnableScanTable(FALSE);
+  for(u8 i = 0; i < ANT_NUM_CHANNELS; i++)
+  {
+    Ant_asReliable[i].u8Head = 0;
+    Ant_asReliable[i].u8Count = 0;
+    Ant_asReliable[i].u8Retries = ANT_RELIABLE_RETRIES_DEFAULT;
+    Ant_asReliable[i].bInFlight = FALSE;
+    Ant_asReliable[i].u32Delivered = 0;
+    Ant_asReliable[i].u32Failed = 0;
+    Ant_asReliable[i].u32Attempts = 0;
+    for(u8 j = 0; j < ANT_RELIABLE_WINDOW; j++)
+    {
+      Ant_asReliable[i].asWindow[j].eStatus = ANT_RELIABLE_UNKNOWN;
+    }
+  }
+
   if(G_u32SystemFlags & _SYSTEM_STARTUP_NO_ANT)
   {
     DebugPrintf(G_au8AntMessageNoAnt);
@@ -634,8 +815,6 @@ void AntInitialize(void)
     
     /* Announce on the debug port that ANT setup is starting and intialize pointers */
     DebugPrintf(G_au8AntMessageInit);
-    G_sAntApplicationMsgList = 0;
-    Ant_psDataOutgoingMsgList = 0;
   
   /* Initialize the G_asAntChannelConfiguration data struct */
   for(u8 i = 0; i < ANT_NUM_CHANNELS; i++)
@@ -664,7 +843,7 @@ void AntInitialize(void)
     Ant_sSspConfig.pCsGpioAddress     = ANT_SPI_CS_GPIO;
     Ant_sSspConfig.u32CsPin           = ANT_SPI_CS_PIN;
     Ant_sSspConfig.eBitOrder          = LSB_FIRST;
-    Ant_sSspConfig.eSspMode           = SPI_SLAVE_FLOW_CONTROL;
+    Ant_sSspConfig.eSspMode           = SPI_SLAVE_FLOW_CONTROL_DMA;
     Ant_sSspConfig.fnSlaveTxFlowCallback = AntTxFlowControlCallback;
     Ant_sSspConfig.fnSlaveRxFlowCallback = AntRxFlowControlCallback;
     Ant_sSspConfig.pu8RxBufferAddress = Ant_au8AntRxBuffer;
@@ -750,6 +929,9 @@ control after each byte.  Due to the speed of the chip-to-chip communications, e
 should be able to send in less than 500us so it will likely be done on the main program cycle that
 immediately follows this call.  
 
+*** This function blocks until the message is handed to the SSP task, so should only be used during initialization. ***
+The running system uses AntTxStart() from AntSM_Idle and lets the states run once per loop.
+
 Requires:
   - pu8AntTxMessage_ points to an Ant formatted message where the first data byte
     is the length byte (since ANT sends the SYNC byte) and the last byte is
@@ -757,116 +939,64 @@ Requires:
 
 Promises:
   - Returns TRUE if the transmit message is queued successfully; Ant_u32CurrentTxMessageToken holds the message token
+    and Ant_pfnStateMachine = AntSM_TransmitMessage
   - Returns FALSE if the transfer couldn't start or if receive message interrupted
-    (G_u32AntFlags _ANT_FLAGS_TX_INTERRUPTED is set;  AntRxBufferCurrentChar pointing to the received byte).
+    (Ant_pfnStateMachine = AntSM_RxWaitSync with the received byte at AntRxBufferCurrentChar).
   - MRDY is deasserted
 */
 bool AntTxMessage(u8 *pu8AntTxMessage_)
 {
-  u8 u8Byte;
-  u32 u32Length;
-  u32 u32TimeOut = G_u32SystemTime1s;
-  u8 au8TxInProgressMsg[] = "AntTx: msg already in progress\n\r";
-  u8 au8TxTimeoutMsg[]    = "AntTx: SEN timeout\n\r";
-  u8 au8TxNoTokenMsg[]    = "AntTx: No token\n\r";
-  u8 au8TxNoSyncMsg[]     = "AntTx: No SYNC\n\r";
-
-  /* Check G_u32AntFlags first */
-  if(G_u32AntFlags & (_ANT_FLAGS_TX_IN_PROGRESS | _ANT_FLAGS_RX_IN_PROGRESS) )
-  {
-    DebugPrintf(au8TxInProgressMsg);
-    return FALSE;
-  }
-  
-  /* Initialize the timeout timer and notify ANT that the Host wishes to send a message */
-  Ant_u32RxTimer = 0;
-  SYNC_MRDY_ASSERT();                          
-
-  /* Wait for SEN to be asserted indicating ANT is ready for a message */
-  while ( !IS_SEN_ASSERTED() && (Ant_u32RxTimer < ANT_ACTIVITY_TIME_COUNT) )
-  {
-    Ant_u32RxTimer++;
-  }
-  
-  /* If we timed out, then clear MRDY and exit */
-  if(Ant_u32RxTimer > ANT_ACTIVITY_TIME_COUNT)
+  if( !AntTxStart(pu8AntTxMessage_) )
   {
-    SYNC_MRDY_DEASSERT();                          
-    DebugPrintf(au8TxTimeoutMsg);
     return(FALSE);
   }
   
-  /* Else we have SEN flag; queue to read 1 byte after a short delay before toggling SRDY */
-  AntSrdyPulse();
-
-  /* Wait for the first byte to come in via the ISR / Rx Callback*/
-  while( !(ANT_SSP_FLAGS & _SSP_RX_COMPLETE) && (Ant_u32RxTimer < ANT_ACTIVITY_TIME_COUNT) )
+  /* Each transmit state has its own timeout so this always ends */
+  while( (Ant_pfnStateMachine == AntSM_TxWaitSen) ||
+         (Ant_pfnStateMachine == AntSM_TxWaitSync) )
   {
-    Ant_u32RxTimer++;
+    Ant_pfnStateMachine();
   }
 
-  /* Ok to deassert MRDY now */
-  SYNC_MRDY_DEASSERT();                     
+  /* The message is with the SSP task only if the states moved on to waiting for it */
+  return(Ant_pfnStateMachine == AntSM_TransmitMessage);
 
-  /* If we timed out now, then clear MRDY and exit.  Because CS is still asserted, the task
-  will attempt to read a message but fail and eventually abort. */
-  if(Ant_u32RxTimer > ANT_ACTIVITY_TIME_COUNT)
-  {
-   DebugPrintf(au8TxTimeoutMsg);
-   return(FALSE);
-  }
-          
-  /* When the byte comes in, the SSP module will set the _SSP_RX_COMPLETE flag and also call the 
-  Rx callback but does not toggle SRDY at this time.  We must look at this byte to determine if ANT 
-  initiated this particular communication and is telling us that a message is coming in, or if we 
-  initiated the communication and ANT is allowing us to transmit. */
+} /* end AntTxMessage() */
 
-  /* Read the byte - don't advance the pointer yet */
-  u8Byte = *Ant_pu8AntRxBufferCurrentChar;                       
 
-  /* If the byte is TX_SYNC, then ANT wants to send a message which must be done first */
-  if (u8Byte == MESG_TX_SYNC)                     
-  {
-    G_u32AntFlags |= _ANT_FLAGS_TX_INTERRUPTED;
-    return(FALSE);
-  }
+/*-----------------------------------------------------------------------------
+Function: AntTxStart
 
-  /* Since the Rx byte is in our Rx buffer, advance both pointers since it's not an incoming message */
-  AdvanceAntRxBufferCurrentChar();
-  AdvanceAntRxBufferUnreadMsgPointer();
+Description:
+Asks ANT for permission to send a message by asserting MRDY.  The transmit states wait
+for SEN and the sync byte without blocking; see AntTxMessage() for the handshake.
 
-  /* Clear the status flag and process the byte */
-  ANT_SSP_FLAGS &= ~_SSP_RX_COMPLETE; /* !!!!! Odd for this to be here, but maybe it needs to be */
-  
-  /* If the byte is RX_SYNC, then proceed to send the message */
-  if (u8Byte == MESG_RX_SYNC)                     
-  {
-    /* Flag that a transmit is in progress */
-    G_u32AntFlags |= _ANT_FLAGS_TX_IN_PROGRESS;
-    
-    /* Read the message length and add three for the length, message ID and checksum */
-    u32Length = (u32)(pu8AntTxMessage_[0] + 3); 
-    
-    /* Queue the message to the peripheral and capture the token */ 
-    Ant_u32CurrentTxMessageToken = SspWriteData(Ant_Ssp, u32Length, pu8AntTxMessage_);
+Requires:
+  - pu8AntTxMessage_ points to an Ant formatted message (first byte is the length byte)
+    that stays valid until the message is sent
 
-    /* Return TRUE only if we received a message token indicating the message has been queued */
-    if(Ant_u32CurrentTxMessageToken != 0)
-    {
-      return(TRUE);
-    }
-    else
-    {
-      DebugPrintf(au8TxNoTokenMsg);
-      return(FALSE);
-    }
+Promises:
+  - Returns TRUE, MRDY is asserted and Ant_pfnStateMachine = AntSM_TxWaitSen if the transmit is started
+  - Returns FALSE if a message is already in progress
+*/
+static bool AntTxStart(u8 *pu8AntTxMessage_)
+{
+  /* Check G_u32AntFlags first */
+  if(G_u32AntFlags & (_ANT_FLAGS_TX_IN_PROGRESS | _ANT_FLAGS_RX_IN_PROGRESS) )
+  {
+    DebugPrintf("AntTx: msg already in progress\n\r");
+    return FALSE;
   }
+  
+  /* Initialize the timeout timer and notify ANT that the Host wishes to send a message */
+  Ant_pu8TxMessage = pu8AntTxMessage_;
+  Ant_u32TxTimer = G_u32SystemTime1ms;
+  SYNC_MRDY_ASSERT();                          
+  
+  Ant_pfnStateMachine = AntSM_TxWaitSen;
+  return TRUE;
 
-  /* If we get here, not a sync byte, so return */
-  DebugPrintf(au8TxNoSyncMsg);
-  return(FALSE);
-
-} /* end AntTxMessage() */
+} /* end AntTxStart() */
 
 
 /*------------------------------------------------------------------------------
@@ -912,6 +1042,7 @@ u8 AntExpectResponse(u8 u8ExpectedMessageID_, u32 u32TimeoutMS_)
     G_u32AntFlags &= ~_ANT_FLAGS_TX_IN_PROGRESS;
     AntDeQueueOutgoingMessage();
     Ant_u32CurrentTxMessageToken = 0;
+    Ant_pfnStateMachine = AntSM_Idle;
     
     /* Wait for SEN */
     u32StartTime = G_u32SystemTime1ms;
@@ -959,8 +1090,8 @@ u8 AntExpectResponse(u8 u8ExpectedMessageID_, u32 u32TimeoutMS_)
 Function: AntTxFlowControlCallback
 
 Description:
-Callback function to toggle flow control during transmission.  The peripheral task
-sending the message must invoke this function after each byte.  
+Callback function to toggle flow control during transmission.  The SSP driver
+invokes this function when a frame is loaded into the DMA and again when it has been sent.  
 
 Note: Since this function is called from an ISR, it should execute as quickly as possible. 
 
@@ -985,40 +1116,64 @@ void AntTxFlowControlCallback(void)
 Function: AntRxFlowControlCallback
 
 Description:
-Callback function to toggle flow control during reception.  The peripheral task
-receiving the message must invoke this function after each byte.  
+Callback function to manage flow control during reception.  The SSP driver invokes this 
+function after each header byte and once more when a DMA frame body has been received.
+When the LENGTH byte of a message arrives, the rest of the frame (message ID, data and 
+checksum) is armed for DMA reception and a single SRDY pulse releases ANT to send it.
 
 Note: Since this function is called from an ISR, it should execute as quickly as possible. 
-Unfortunately, AntSrdyPulse() takes some time but the duty cycle of this interrupt
-is low enough that we can survive (this interrupt priority could be dropped below everything
-else to mitigate any issues).
+AntSrdyPulse() only starts the SRDY timer so it does not hold up the interrupt.
 
 Requires:
   - ISRs are off already since this is totally not re-entrant
-  - A received byte was just written to the Rx buffer
-  - _SSP_CS_ASSERTED in correct state: should be set on first byte, but application should 
-    clear it for all subsequent bytes so flow control is handled entirely by this function
+  - The SSP driver has already advanced Ant_pu8AntRxBufferNextChar past the received byte(s)
+  - _ANT_FLAGS_RX_IN_PROGRESS is set by AntSM_RxWaitSync once the SYNC byte is verified so the next
+    byte is the LENGTH byte
 
 Promises:
-  - Ant_pu8AntRxBufferNextChar is advanced safely so it is ready to receive the next byte
-  - Ant_u32RxByteCounter incremented
-  - SRDY is toggled if _ANT_FLAGS_RX_IN_PROGRESS is set
+  - Ant_u32RxByteCounter is incremented by the number of bytes received
+  - If the byte was a LENGTH byte, the frame body is armed for DMA and SRDY is toggled;
+    a LENGTH that is too big sets _ANT_FLAGS_RX_BAD_LENGTH instead
 */
 void AntRxFlowControlCallback(void)
 {
-  /* Count the byte and safely advance the receive buffer pointer; this is called from the
-  RX ISR, so it won't be interrupted and break Ant_pu8AntRxBufferNextChar */
-  Ant_u32RxByteCounter++;
-  Ant_pu8AntRxBufferNextChar++;
-  if(Ant_pu8AntRxBufferNextChar == &Ant_au8AntRxBuffer[ANT_RX_BUFFER_SIZE])
+  u8* pu8LengthByte;
+  
+  /* A completed DMA frame body: count it and wait for the next header */
+  if(G_u32AntFlags & _ANT_FLAGS_RX_FRAME_ARMED)
   {
-    Ant_pu8AntRxBufferNextChar = &Ant_au8AntRxBuffer[0];
+    G_u32AntFlags &= ~_ANT_FLAGS_RX_FRAME_ARMED;
+    Ant_u32RxByteCounter += Ant_u8RxFrameBytes;
+    return;
   }
   
-  /* Only toggle SRDY if a reception is flagged in progress */
+  /* Otherwise a single header byte was received */
+  Ant_u32RxByteCounter++;
+  
+  /* During a reception, the only byte after SYNC that comes in by itself is LENGTH */
   if( G_u32AntFlags & _ANT_FLAGS_RX_IN_PROGRESS )
   {
-    AntSrdyPulse();
+    pu8LengthByte = Ant_pu8AntRxBufferNextChar - 1;
+    if(Ant_pu8AntRxBufferNextChar == &Ant_au8AntRxBuffer[0])
+    {
+      pu8LengthByte = &Ant_au8AntRxBuffer[ANT_RX_BUFFER_SIZE - 1];
+    }
+    
+    /* Message ID + data + checksum remain.  A length that would not fit in a saved message is
+    flagged so AntSM_RxWaitFrame rejects the frame instead of waiting for it. */
+    if(*pu8LengthByte <= (MESG_MAX_SIZE - MESG_SAVED_FRAME_SIZE))
+    {
+      Ant_u8RxFrameBytes = *pu8LengthByte + MESG_ID_SIZE + MESG_CHECKSUM_SIZE;
+      if(SspReadFrame(Ant_Ssp, Ant_u8RxFrameBytes))
+      {
+        G_u32AntFlags |= _ANT_FLAGS_RX_FRAME_ARMED;
+        AntSrdyPulse();
+      }
+    }
+    else
+    {
+      G_u32AntFlags |= _ANT_FLAGS_RX_BAD_LENGTH;
+    }
   }
   
 } /* end AntRxFlowControlCallback() */
@@ -1057,38 +1212,37 @@ u8 AntCalculateTxChecksum(u8* pu8Message_)
 Function: AntQueueOutgoingMessage
 
 Description:
-Creates a new ANT message structure and adds it into Ant_psDataOutgoingMsgList.
-If the list is full, the message is not added.
+Takes a node from the outgoing message pool, fills it and adds it into Ant_psDataOutgoingMsgList.
+If the pool is empty (the list is full), the message is not added.
 The Outgoing message list are the messages sent from the Host to the ANT chip.
 
 Requires:
   - pu8Message_ is an ANT-formatted message starting with LENGTH and ending with CHECKSUM
-  - Enough space is available on the heap
 
 Promises:
-  - A new list item in the outgoing message linked list is created and inserted at the end
+  - A new list item in the outgoing message linked list is filled and inserted at the end
     of the list as long as there is enough room.
   - Returns TRUE if the entry is added successfully.
-  - Returns FALSE on error.
+  - Returns FALSE and Ant_u32OutgoingMessageOverflows is incremented if the pool is empty.
 */
 bool AntQueueOutgoingMessage(u8 *pu8Message_)
 {
   u8 u8Length;
-  u8 u8MessageCount = 0;
   AntOutgoingMessageListType *psNewDataMessage;
-  AntOutgoingMessageListType *psListParser;
   u8 au8AddMessageFailMsg[] = "\n\rNo space in AntQueueOutgoingMessage\n\r";
   
   /* Add to the number of queued message */
   Ant_DebugQueuedDataMessages++;
 
-  /* Allocate space for the new message - always do maximum message size */
-  psNewDataMessage = malloc( sizeof(AntOutgoingMessageListType) );
-  if (psNewDataMessage == NULL)
+  /* Take a node from the pool - every node holds the maximum message size */
+  psNewDataMessage = Ant_psOutgoingMessageFree;
+  if( (psNewDataMessage == NULL) || (Ant_u32OutgoingMessageCount >= ANT_OUTGOING_MESSAGE_BUFFER_SIZE) )
   {
+    Ant_u32OutgoingMessageOverflows++;
     DebugPrintf(au8AddMessageFailMsg);
     return(FALSE);
   }
+  Ant_psOutgoingMessageFree = psNewDataMessage->psNextMessage;
   
   /* Fill in all the fields of the newly allocated message structure */
   u8Length = *pu8Message_ + 3;
@@ -1100,37 +1254,18 @@ bool AntQueueOutgoingMessage(u8 *pu8Message_)
   psNewDataMessage->u32TimeStamp  = G_u32SystemTime1ms;
   psNewDataMessage->psNextMessage = NULL;
 
-  /* Insert into an empty list */
+  /* Insert into an empty list, otherwise link it after the tail */
   if(Ant_psDataOutgoingMsgList == NULL)
   {
     Ant_psDataOutgoingMsgList = psNewDataMessage;
-    Ant_u32OutgoingMessageCount++;
   }
-
-  /* Otherwise traverse the list to find the end where the new message will be inserted */
   else
   {
-    psListParser = Ant_psDataOutgoingMsgList;
-    while(psListParser->psNextMessage != NULL)  
-    {
-      psListParser = psListParser->psNextMessage;
-      u8MessageCount++;
-    }
-    
-    /* Check for a full list */
-    if(u8MessageCount < ANT_OUTGOING_MESSAGE_BUFFER_SIZE)
-    {
-      /* Insert the new message at the end of the list */
-      psListParser->psNextMessage = psNewDataMessage;
-      Ant_u32OutgoingMessageCount++;
-    }
-    else
-    {
-      DebugPrintf(au8AddMessageFailMsg);
-      return(FALSE);
-    }
+    Ant_psDataOutgoingMsgTail->psNextMessage = psNewDataMessage;
   }
     
+  Ant_psDataOutgoingMsgTail = psNewDataMessage;
+  Ant_u32OutgoingMessageCount++;
   return(TRUE);
   
 } /* end AntQueueOutgoingMessage() */
@@ -1146,7 +1281,8 @@ Requires:
   - G_sAntApplicationMsgList points to the start of the list which is the entry to remove
 
 Promises:
-  - G_sAntApplicationMsgList = G_sAntApplicationMsgList.
+  - G_sAntApplicationMsgList = G_sAntApplicationMsgList->psNextMessage and the node is back in
+    the application message pool
 */
 void AntDeQueueApplicationMessage(void)
 {
@@ -1156,458 +1292,1914 @@ void AntDeQueueApplicationMessage(void)
   {
     psMessageToKill = G_sAntApplicationMsgList;
     G_sAntApplicationMsgList = G_sAntApplicationMsgList->psNextMessage;
+    if(G_sAntApplicationMsgList == NULL)
+    {
+      Ant_psApplicationMsgTail = NULL;
+    }
 
-    /* The doomed message is properly disconnected, so kill it */
-    free(psMessageToKill);
+    AntReleaseApplicationMessage(psMessageToKill);
     Ant_u32ApplicationMessageCount--;
   }
   
 } /* end AntDeQueueApplicationMessage() */
 
 
-/* ANT private Interface-layer Functions */
+/*-----------------------------------------------------------------------------/
+Function: AntGetMessageOverflows
 
-                                    
-/*------------------------------------------------------------------------------
-Function: AntProcessMessage
+Description:
+Reports how many messages were lost because a message pool was empty.
+
+Requires:
+  - The pointers are valid
+
+Promises:
+  - *pu32Outgoing_ and *pu32Application_ are loaded with the overflow counts since AntInitialize()
+*/
+void AntGetMessageOverflows(u32* pu32Outgoing_, u32* pu32Application_)
+{
+  *pu32Outgoing_    = Ant_u32OutgoingMessageOverflows;
+  *pu32Application_ = Ant_u32ApplicationMessageOverflows;
+  
+} /* end AntGetMessageOverflows() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetQueueDepths
 
 Description:
-Reads the lastest received Ant message and updates system information accordingly. 
+Reports how many messages are waiting on the outgoing and application lists.
+
+Requires:
+  - The pointers are valid
+
+Promises:
+  - *pu32Outgoing_ and *pu32Application_ are loaded with the current list lengths
+*/
+void AntGetQueueDepths(u32* pu32Outgoing_, u32* pu32Application_)
+{
+  *pu32Outgoing_    = Ant_u32OutgoingMessageCount;
+  *pu32Application_ = Ant_u32ApplicationMessageCount;
   
+} /* end AntGetQueueDepths() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntReadResponse
+
+Description:
+Reads the oldest channel response (the reply ANT sends to each command) that has
+not been read yet.  Unlike G_stMessageResponse, no response is missed when several
+arrive between reads, so commands can be matched to their responses after queuing
+many of them at once.
+
 Requires:
-  - Ant_u8AntNewRxMessages holds the number of unprocessed messages in the message queue
-  - GGpu8AntRxBufferUnreadMsg points to the first byte of an unread verified ANT message
+  - psResponse_ points to space for one response
 
 Promises:
-  - Returns 1 if Ant_u8AntNewRxMessages == 0 or the message exceeds the maximum allowed length
-  - Otherwise, returns 0 and:
-    - Ant_u8AntNewRxMessages--
-    - GGpu8AntRxBufferUnreadMsg points to the first byte of the next unread verified ANT message
-    - System flags are updated
+  - Returns TRUE and loads *psResponse_ with the oldest unread response, which is removed
+  - Returns FALSE if there is none
 */
-static u8 AntProcessMessage(void)
+bool AntReadResponse(AntMessageResponseType* psResponse_)
 {
-  u8 u8MessageLength;
-  u8 u8Channel;
-  u8 au8MessageCopy[MESG_MAX_SIZE];
-  AntExtendedDataType sExtendedData;
+  if(Ant_u8ResponseCount == 0)
+  {
+    return(FALSE);
+  }
   
-   /* Exit immediately if there are no messages in the RxBuffer */
-	if (!Ant_u8AntNewRxMessages)
-    return(1);
+  *psResponse_ = Ant_asResponses[Ant_u8ResponseOldest];
+  Ant_u8ResponseOldest = (Ant_u8ResponseOldest + 1) % ANT_RESPONSE_BUFFER_SIZE;
+  Ant_u8ResponseCount--;
+  return(TRUE);
   
-  Ant_DebugProcessRxMessages++;
+} /* end AntReadResponse() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetRxBufferStats
+
+Description:
+Reports how often Ant_au8AntRxBuffer ran short of space.  Deferrals are harmless
+(ANT waits under flow control) but show that ANT_PROCESS_BUDGET_US is tight; overflows 
+mean a message may have overwritten one that was not processed yet.
+
+Requires:
+  - The pointers are valid
+
+Promises:
+  - *pu32Overflows_ and *pu32Deferrals_ are loaded with the counts since power up
+*/
+void AntGetRxBufferStats(u32* pu32Overflows_, u32* pu32Deferrals_)
+{
+  *pu32Overflows_ = Ant_u32RxBufferOverflows;
+  *pu32Deferrals_ = Ant_u32RxBufferDeferrals;
   
-  /* Otherwise decrement counter, and get a copy of the message (necessary since the rx buffer is circular)
-  and we want to index the various bytes using the ANT byte definitions. */  
-  Ant_u8AntNewRxMessages--;
-  AdvanceAntRxBufferUnreadMsgPointer();
-  u8MessageLength = *Ant_pu8AntRxBufferUnreadMsg;
+} /* end AntGetRxBufferStats() */
+
+
+/* ANT Public Interface-layer Functions */
+
+/*-----------------------------------------------------------------------------/
+Function: AntQueueBurstMessage
+
+Description:
+Starts a burst transfer of u16Length_ bytes on eChannel_.  The data is sent as 8-byte 
+MESG_BURST_DATA_ID packets; the last packet is padded with zeros.  Packets are made 
+from pu8Data_ as room opens on the outgoing list, so the buffer must not change until 
+AntGetBurstTxStatus() no longer returns ANT_BURST_BUSY.
+
+Requires:
+  - eChannel_ is open
+  - pu8Data_ points to u16Length_ bytes that stay valid for the whole transfer
+
+Promises:
+  - Returns TRUE and Ant_eBurstTxStatus = ANT_BURST_BUSY if the burst is started
+  - Returns FALSE if a burst is already in progress or u16Length_ is 0
+*/
+bool AntQueueBurstMessage(AntChannelNumberType eChannel_, u8* pu8Data_, u16 u16Length_)
+{
+  if( (Ant_eBurstTxStatus == ANT_BURST_BUSY) || (u16Length_ == 0) )
+  {
+    return(FALSE);
+  }
   
-  /* Check to ensure the message size is legit.  !!!!! Clean up pointers if not */
-  if(u8MessageLength > MESG_MAX_SIZE)
+  Ant_pu8BurstTxData     = pu8Data_;
+  Ant_u16BurstTxLength   = u16Length_;
+  Ant_u16BurstTxIndex    = 0;
+  Ant_u8BurstTxChannel   = (u8)eChannel_;
+  Ant_u8BurstTxSequence  = 0;
+  Ant_u8BurstTxPacketsQueued = 0;
+  Ant_u32BurstTxStartTime = G_u32SystemTime1ms;
+  Ant_u32BurstTxTimer    = G_u32SystemTime1ms;
+  Ant_eBurstTxStatus     = ANT_BURST_BUSY;
+  
+  /* Get the first packets on the list right away */
+  AntBurstFeed();
+  return(TRUE);
+  
+} /* end AntQueueBurstMessage() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetBurstTxStatus
+
+Description:
+Returns the status of the current or last burst started with AntQueueBurstMessage().
+
+Requires:
+  - 
+
+Promises:
+  - Returns ANT_BURST_IDLE if no burst was sent yet, ANT_BURST_BUSY while sending,
+    ANT_BURST_COMPLETE once ANT reports the transfer completed or ANT_BURST_FAILED
+*/
+AntBurstStatusType AntGetBurstTxStatus(void)
+{
+  return(Ant_eBurstTxStatus);
+  
+} /* end AntGetBurstTxStatus() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetBurstRxStatus
+
+Description:
+Returns the status of the burst reassembly buffer.
+
+Requires:
+  - 
+
+Promises:
+  - Returns ANT_BURST_IDLE if it is empty, ANT_BURST_BUSY while a burst is coming in,
+    ANT_BURST_COMPLETE when a burst is waiting for AntReadBurstMessage() or ANT_BURST_FAILED
+    if the last burst was lost
+*/
+AntBurstStatusType AntGetBurstRxStatus(void)
+{
+  return(Ant_eBurstRxStatus);
+  
+} /* end AntGetBurstRxStatus() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntReadBurstMessage
+
+Description:
+Copies a completely received burst to the application and frees the reassembly buffer
+for the next burst.  The received length is always a multiple of 8 bytes since 
+ANT does not carry the length of the last packet's data.
+
+Requires:
+  - pu8Target_ points to u16Size_ bytes
+  - pu8Channel_ points to where the burst's channel number is written
+
+Promises:
+  - If Ant_eBurstRxStatus is ANT_BURST_COMPLETE, up to u16Size_ bytes are copied, *pu8Channel_
+    is loaded, Ant_eBurstRxStatus = ANT_BURST_IDLE and the burst length is returned
+  - Otherwise returns 0 and nothing is changed
+*/
+u16 AntReadBurstMessage(u8* pu8Target_, u16 u16Size_, u8* pu8Channel_)
+{
+  u16 u16Length;
+  
+  if(Ant_eBurstRxStatus != ANT_BURST_COMPLETE)
   {
-    return(1);
+    return(0);
   }
   
-  /* Copy the message so it can be indexed easily */ 
-  for(u8 i = 0; i < (u8MessageLength + MESG_FRAME_SIZE - MESG_SYNC_SIZE); i++)
+  u16Length = Ant_u16BurstRxLength;
+  if(u16Length > u16Size_)
   {
-    au8MessageCopy[i] = *Ant_pu8AntRxBufferUnreadMsg;
-    AdvanceAntRxBufferUnreadMsgPointer();
+    u16Length = u16Size_;
   }
-  /* Note: Ant_pu8AntRxBufferUnreadMsg is now pointing at the next unread message */
   
-  /* Get the channel number since it is needed for many things below (this value
-  will NOT be the channel for messages that do not include the channel number,
-  but that should be fine as long as the value is used in the correct context. */
-  u8Channel = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM];
+  for(u16 i = 0; i < u16Length; i++)
+  {
+    *(pu8Target_ + i) = Ant_au8BurstRxBuffer[i];
+  }
   
-  /* Decide what to do based on the Message ID */
-  switch( au8MessageCopy[BUFFER_INDEX_MESG_ID] )
+  *pu8Channel_ = Ant_u8BurstRxChannel;
+  Ant_eBurstRxStatus = ANT_BURST_IDLE;
+  return(Ant_u16BurstRxLength);
+  
+} /* end AntReadBurstMessage() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetBurstTxRate
+
+Description:
+Returns the throughput of the last completed burst transmit.
+
+Requires:
+  - 
+
+Promises:
+  - Returns bytes/second from AntQueueBurstMessage() to EVENT_TRANSFER_TX_COMPLETED (0 if none)
+*/
+u32 AntGetBurstTxRate(void)
+{
+  return(Ant_u32BurstTxRate);
+  
+} /* end AntGetBurstTxRate() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetBurstRxRate
+
+Description:
+Returns the throughput of the last completely received burst.
+
+Requires:
+  - 
+
+Promises:
+  - Returns bytes/second from the first to the last packet of the burst (0 if none)
+*/
+u32 AntGetBurstRxRate(void)
+{
+  return(Ant_u32BurstRxRate);
+  
+} /* end AntGetBurstRxRate() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntQueueReliableMessage
+
+Description:
+Queues 8 bytes to be sent as an acknowledged message that is retransmitted after each
+EVENT_TRANSFER_TX_FAILED until it is acknowledged or the channel's retries run out.
+Messages on a channel are delivered in order, one at a time.  Do not mix this with 
+AntQueueAcknowledgedMessage() or bursts on the same channel since their results can't be 
+told apart.
+
+Requires:
+  - eChannel_ is open (queued messages fail if it is not)
+  - pu8Data_ points to ANT_APPLICATION_MESSAGE_BYTES of data (copied here)
+
+Promises:
+  - Returns a handle for AntGetReliableStatus()
+  - Returns ANT_RELIABLE_NO_HANDLE if the channel already has ANT_RELIABLE_WINDOW messages unfinished
+*/
+u16 AntQueueReliableMessage(AntChannelNumberType eChannel_, u8* pu8Data_)
+{
+  AntReliableChannelType* psReliable;
+  AntReliableMessageType* psMessage;
+  u8 u8Slot;
+  
+  if( (eChannel_ >= ANT_NUM_CHANNELS) || (Ant_asReliable[eChannel_].u8Count == ANT_RELIABLE_WINDOW) )
   {
-    case MESG_RESPONSE_EVENT_ID:
-    { 
-      /* Channel Message received: it is a Channel Response or Channel Event */
-      if( au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID] != MESG_EVENT_ID )
-      {
-        /* We have a Channel Response: parse it out based on the message ID to which the 
-        response applies and post the result */
-        G_stMessageResponse.u8Channel = u8Channel;
-        G_stMessageResponse.u8MessageNumber = au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID];
-        G_stMessageResponse.u8ResponseCode  = au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE];      
-        
-        switch(au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID])
-        {
-          case MESG_OPEN_SCAN_CHANNEL_ID:
-            DebugPrintf("Scanning ");
-            /* Fall through */
-            
-          case MESG_OPEN_CHANNEL_ID:
-            G_au8AntMessageOpen[12] = u8Channel + 0x30;
-            DebugPrintf(G_au8AntMessageOpen);
-            
-            /* Only change the flags if the command was successful */
-            if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR )
-            {
-              G_asAntChannelConfiguration[u8Channel].AntFlags |= _ANT_FLAGS_CHANNEL_OPEN;
-              G_asAntChannelConfiguration[u8Channel].AntFlags &= ~_ANT_FLAGS_CHANNEL_OPEN_PENDING;
-            }
-            break;
+    return(ANT_RELIABLE_NO_HANDLE);
+  }
+  
+  psReliable = &Ant_asReliable[eChannel_];
+  u8Slot = (psReliable->u8Head + psReliable->u8Count) % ANT_RELIABLE_WINDOW;
+  psMessage = &psReliable->asWindow[u8Slot];
+  
+  psMessage->u8Generation++;
+  psMessage->u8Attempts = 0;
+  for(u8 i = 0; i < ANT_APPLICATION_MESSAGE_BYTES; i++)
+  {
+    psMessage->au8Data[i] = pu8Data_[i];
+  }
+  psMessage->eStatus = ANT_RELIABLE_QUEUED;
+  psReliable->u8Count++;
+  
+  /* The handle is generation : channel : slot so a reused slot is not mistaken for this message */
+  return( (u16)(psMessage->u8Generation << 8) | (u16)(eChannel_ << 4) | u8Slot );
+  
+} /* end AntQueueReliableMessage() */
 
-          case MESG_CLOSE_CHANNEL_ID:
-            G_au8AntMessageClose[12] = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM] + 0x30;
-            DebugPrintf(G_au8AntMessageClose);
 
-            /* Only change the flags if the command was successful */
-            if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR )
-            {
-              G_asAntChannelConfiguration[u8Channel].AntFlags &= ~(_ANT_FLAGS_CHANNEL_CLOSE_PENDING | _ANT_FLAGS_CHANNEL_OPEN);
-            }
-            break;
+/*-----------------------------------------------------------------------------/
+Function: AntGetReliableStatus
 
-          case MESG_ASSIGN_CHANNEL_ID:
-            G_au8AntMessageAssign[12] = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM] + 0x30;
-            DebugPrintf(G_au8AntMessageAssign);
-            break;
+Description:
+Reports where a reliable message is in its delivery.  The result stays available
+until the slot is reused ANT_RELIABLE_WINDOW messages later.
 
-          case MESG_UNASSIGN_CHANNEL_ID:
-            G_au8AntMessageUnassign[12] = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM] + 0x30;
-            DebugPrintf(G_au8AntMessageUnassign);
+Requires:
+  - u16Handle_ was returned by AntQueueReliableMessage()
 
-            /* Only change the flags if the command was successful */
-            if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR )
-            {
-              G_asAntChannelConfiguration[u8Channel].AntFlags &= ~(_ANT_FLAGS_CHANNEL_OPEN_PENDING | _ANT_FLAGS_CHANNEL_CLOSE_PENDING | _ANT_FLAGS_CHANNEL_OPEN); /* !!!! 2016-06-14 */
-            }
-            break;
- 
-          default:
-            G_au8AntMessageUnhandled[12] = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM] + 0x30;
-            G_au8AntMessageUnhandled[24] = HexToASCIICharLower( (au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID] >> 4) & 0x0F );
-            G_au8AntMessageUnhandled[25] = HexToASCIICharLower( (au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID] & 0x0F) );
-            G_au8AntMessageUnhandled[36] = HexToASCIICharLower( (au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] >> 4) & 0x0F );
-            G_au8AntMessageUnhandled[37] = HexToASCIICharLower( (au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] & 0x0F) );
-            DebugPrintf(G_au8AntMessageUnhandled);
-            break;
-        } /* end switch */
-        
-        /* All messages print an "ok" or "fail" */
-        if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR ) 
+Promises:
+  - Returns ANT_RELIABLE_QUEUED, ANT_RELIABLE_SENDING, ANT_RELIABLE_DELIVERED or ANT_RELIABLE_FAILED
+  - Returns ANT_RELIABLE_UNKNOWN for an invalid handle or one whose slot has been reused
+*/
+AntReliableStatusType AntGetReliableStatus(u16 u16Handle_)
+{
+  u8 u8Channel = (u8)((u16Handle_ >> 4) & 0x0F);
+  u8 u8Slot    = (u8)(u16Handle_ & 0x0F);
+  AntReliableMessageType* psMessage;
+
+  if( (u16Handle_ == ANT_RELIABLE_NO_HANDLE) || (u8Channel >= ANT_NUM_CHANNELS) || (u8Slot >= ANT_RELIABLE_WINDOW) )
+  {
+    return(ANT_RELIABLE_UNKNOWN);
+  }
+  
+  psMessage = &Ant_asReliable[u8Channel].asWindow[u8Slot];
+  if(psMessage->u8Generation != (u8)(u16Handle_ >> 8))
+  {
+    return(ANT_RELIABLE_UNKNOWN);
+  }
+  
+  return(psMessage->eStatus);
+  
+} /* end AntGetReliableStatus() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntSetReliableRetries
+
+Description:
+Sets how many times a reliable message on a channel is retransmitted after 
+EVENT_TRANSFER_TX_FAILED before it is reported as failed.
+
+Requires:
+  - 
+
+Promises:
+  - The new budget applies from the next failed attempt on eChannel_
+*/
+void AntSetReliableRetries(AntChannelNumberType eChannel_, u8 u8Retries_)
+{
+  if(eChannel_ < ANT_NUM_CHANNELS)
+  {
+    Ant_asReliable[eChannel_].u8Retries = u8Retries_;
+  }
+  
+} /* end AntSetReliableRetries() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetReliableStats
+
+Description:
+Reports the reliable transmit counters for a channel.  Delivered / attempts is the
+link efficiency; delivered over a period of time is the throughput achieved.
+
+Requires:
+  - The pointers are valid
+
+Promises:
+  - *pu32Delivered_, *pu32Failed_ and *pu32Attempts_ are loaded with the counts since AntInitialize()
+*/
+void AntGetReliableStats(AntChannelNumberType eChannel_, u32* pu32Delivered_, u32* pu32Failed_, u32* pu32Attempts_)
+{
+  if(eChannel_ >= ANT_NUM_CHANNELS)
+  {
+    return;
+  }
+  
+  *pu32Delivered_ = Ant_asReliable[eChannel_].u32Delivered;
+  *pu32Failed_    = Ant_asReliable[eChannel_].u32Failed;
+  *pu32Attempts_  = Ant_asReliable[eChannel_].u32Attempts;
+  
+} /* end AntGetReliableStats() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntSubscribe
+
+Description:
+Gives an application its own queue of ANT_DATA and / or ANT_TICK messages.  A 
+received message goes to the first active subscriber whose filters all match; 
+messages that no subscriber takes stay on G_sAntApplicationMsgList for
+AntReadAppMessageBuffer().  The device ID filter applies to ANT_DATA only and
+needs channel ID extended data enabled (ticks always pass it).
+
+Requires:
+  - u8ChannelMask_ has bit n set for each channel n to accept
+  - u8MessageTypes_ is ANT_SUBSCRIBE_DATA, ANT_SUBSCRIBE_TICK or both
+  - u16DeviceID_ is the device ID to accept or ANT_SUBSCRIBE_ANY_DEVICE
+
+Promises:
+  - Returns the subscriber number to use with AntPeekAppMessage() etc.
+  - Returns ANT_NO_SUBSCRIBER if all ANT_SUBSCRIBERS are in use
+*/
+u8 AntSubscribe(u8 u8ChannelMask_, u8 u8MessageTypes_, u16 u16DeviceID_)
+{
+  AntSubscriberType* psSubscriber;
+  
+  for(u8 i = 0; i < ANT_SUBSCRIBERS; i++)
+  {
+    psSubscriber = &Ant_asSubscribers[i];
+    if(!psSubscriber->bActive)
+    {
+      psSubscriber->u8ChannelMask  = u8ChannelMask_;
+      psSubscriber->u8MessageTypes = u8MessageTypes_;
+      psSubscriber->u16DeviceID    = u16DeviceID_;
+      psSubscriber->psHead         = NULL;
+      psSubscriber->psTail         = NULL;
+      psSubscriber->u32Count       = 0;
+      psSubscriber->u32Overflows   = 0;
+      psSubscriber->bActive        = TRUE;
+      return(i);
+    }
+  }
+  
+  return(ANT_NO_SUBSCRIBER);
+
+} /* end AntSubscribe() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntUnsubscribe
+
+Description:
+Stops a subscriber and frees any messages still on its queue.
+
+Requires:
+  - u8Subscriber_ was returned by AntSubscribe()
+
+Promises:
+  - The subscriber is free and its messages are back in the application message pool
+*/
+void AntUnsubscribe(u8 u8Subscriber_)
+{
+  if(u8Subscriber_ < ANT_SUBSCRIBERS)
+  {
+    while(Ant_asSubscribers[u8Subscriber_].psHead != NULL)
+    {
+      AntConsumeAppMessage(u8Subscriber_);
+    }
+    
+    Ant_asSubscribers[u8Subscriber_].bActive = FALSE;
+  }
+
+} /* end AntUnsubscribe() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntPeekAppMessage
+
+Description:
+Returns the oldest message on a subscriber's queue without copying it.  The message
+stays valid and in place until AntConsumeAppMessage() is called.
+
+Requires:
+  - u8Subscriber_ was returned by AntSubscribe()
+
+Promises:
+  - Returns a pointer to the oldest message, or NULL if the queue is empty
+*/
+AntApplicationMsgListType* AntPeekAppMessage(u8 u8Subscriber_)
+{
+  if( (u8Subscriber_ >= ANT_SUBSCRIBERS) || !Ant_asSubscribers[u8Subscriber_].bActive )
+  {
+    return(NULL);
+  }
+  
+  return(Ant_asSubscribers[u8Subscriber_].psHead);
+
+} /* end AntPeekAppMessage() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntConsumeAppMessage
+
+Description:
+Removes the oldest message from a subscriber's queue once the application is done with it.
+
+Requires:
+  - u8Subscriber_ was returned by AntSubscribe()
+  - The application no longer uses the pointer from AntPeekAppMessage()
+
+Promises:
+  - The oldest message (if any) is back in the application message pool
+*/
+void AntConsumeAppMessage(u8 u8Subscriber_)
+{
+  AntSubscriberType* psSubscriber;
+  AntApplicationMsgListType* psMessageToKill;
+  
+  if(u8Subscriber_ >= ANT_SUBSCRIBERS)
+  {
+    return;
+  }
+  
+  psSubscriber = &Ant_asSubscribers[u8Subscriber_];
+  if(psSubscriber->psHead != NULL)
+  {
+    psMessageToKill = psSubscriber->psHead;
+    psSubscriber->psHead = psMessageToKill->psNextMessage;
+    if(psSubscriber->psHead == NULL)
+    {
+      psSubscriber->psTail = NULL;
+    }
+    
+    AntReleaseApplicationMessage(psMessageToKill);
+    psSubscriber->u32Count--;
+  }
+
+} /* end AntConsumeAppMessage() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetSubscriberOverflows
+
+Description:
+Reports how many messages for a subscriber were dropped because its queue was full.
+
+Requires:
+  - u8Subscriber_ was returned by AntSubscribe()
+
+Promises:
+  - Returns the drop count since AntSubscribe() (0 for an invalid subscriber)
+*/
+u32 AntGetSubscriberOverflows(u8 u8Subscriber_)
+{
+  if(u8Subscriber_ >= ANT_SUBSCRIBERS)
+  {
+    return(0);
+  }
+  
+  return(Ant_asSubscribers[u8Subscriber_].u32Overflows);
+
+} /* end AntGetSubscriberOverflows() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntEnableScanTable
+
+Description:
+Starts or stops the scanning device table.  While it is enabled, every ANT_DATA message
+with channel ID extended data updates its device's entry instead of being queued to
+G_sAntApplicationMsgList (a subscriber that matches still gets it).  Meant for use with 
+AntOpenScanningChannel() where many devices are in range.
+
+Requires:
+  - Channel ID extended data is on (the default G_au8AntLibConfig); RSSI extended data for RSSI
+
+Promises:
+  - The table is emptied
+  - Ant_bScanTableEnabled = bEnable_
+*/
+void AntEnableScanTable(bool bEnable_)
+{
+  for(u8 i = 0; i < ANT_SCAN_TABLE_SIZE; i++)
+  {
+    Ant_asScanTable[i].bUsed = FALSE;
+  }
+  
+  Ant_u8ScanDevices = 0;
+  Ant_u8ScanAgeSlot = 0;
+  Ant_u32ScanDropped = 0;
+  Ant_bScanTableEnabled = bEnable_;
+  
+} /* end AntEnableScanTable() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetScanDevice
+
+Description:
+Copies one slot of the scanning device table.  Loop u8Slot_ from 0 to 
+ANT_SCAN_TABLE_SIZE - 1 to see every device.
+
+Requires:
+  - psDevice_ points to space for one entry
+
+Promises:
+  - Returns TRUE and loads *psDevice_ if the slot holds a device
+  - Returns FALSE if the slot is empty or out of range
+*/
+bool AntGetScanDevice(u8 u8Slot_, AntScanDeviceType* psDevice_)
+{
+  if( (u8Slot_ >= ANT_SCAN_TABLE_SIZE) || !Ant_asScanTable[u8Slot_].bUsed )
+  {
+    return(FALSE);
+  }
+  
+  *psDevice_ = Ant_asScanTable[u8Slot_];
+  return(TRUE);
+  
+} /* end AntGetScanDevice() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntFindScanDevice
+
+Description:
+Looks up one device in the scanning device table.
+
+Requires:
+  - psDevice_ points to space for one entry
+
+Promises:
+  - Returns TRUE and loads *psDevice_ if the device is in the table
+  - Returns FALSE if it is not
+*/
+bool AntFindScanDevice(u16 u16DeviceID_, u8 u8DeviceType_, u8 u8TransType_, AntScanDeviceType* psDevice_)
+{
+  u8 u8Slot;
+  
+  /* A full table can return another device's slot */
+  u8Slot = AntScanTableLookup(u16DeviceID_, u8DeviceType_, u8TransType_);
+  if( !Ant_asScanTable[u8Slot].bUsed ||
+      (Ant_asScanTable[u8Slot].u16DeviceID  != u16DeviceID_)  ||
+      (Ant_asScanTable[u8Slot].u8DeviceType != u8DeviceType_) ||
+      (Ant_asScanTable[u8Slot].u8TransType  != u8TransType_) )
+  {
+    return(FALSE);
+  }
+  
+  *psDevice_ = Ant_asScanTable[u8Slot];
+  return(TRUE);
+  
+} /* end AntFindScanDevice() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntGetScanTableStats
+
+Description:
+Reports how full the scanning device table is.
+
+Requires:
+  - The pointers are valid
+
+Promises:
+  - *pu8Devices_ is the number of devices in the table
+  - *pu32Dropped_ is the number of messages from new devices that did not fit since AntEnableScanTable()
+*/
+void AntGetScanTableStats(u8* pu8Devices_, u32* pu32Dropped_)
+{
+  *pu8Devices_  = Ant_u8ScanDevices;
+  *pu32Dropped_ = Ant_u32ScanDropped;
+  
+} /* end AntGetScanTableStats() */
+
+
+/* ANT private Interface-layer Functions */
+
+                                    
+/*------------------------------------------------------------------------------
+Function: AntProcessMessage
+
+Description:
+Reads the lastest received Ant message and updates system information accordingly. 
+  
+Requires:
+  - Ant_u8AntNewRxMessages holds the number of unprocessed messages in the message queue
+  - GGpu8AntRxBufferUnreadMsg points to the first byte of an unread verified ANT message
+
+Promises:
+  - Returns 1 if Ant_u8AntNewRxMessages == 0 or the message exceeds the maximum allowed length
+  - Otherwise, returns 0 and:
+    - Ant_u8AntNewRxMessages--
+    - GGpu8AntRxBufferUnreadMsg points to the first byte of the next unread verified ANT message
+    - System flags are updated
+*/
+static u8 AntProcessMessage(void)
+{
+  u8 u8MessageLength;
+  u8 u8Channel;
+  u8 au8MessageCopy[MESG_MAX_SIZE];
+  AntExtendedDataType sExtendedData;
+  
+   /* Exit immediately if there are no messages in the RxBuffer */
+	if (!Ant_u8AntNewRxMessages)
+    return(1);
+  
+  Ant_DebugProcessRxMessages++;
+  
+  /* Otherwise decrement counter, and get a copy of the message (necessary since the rx buffer is circular)
+  and we want to index the various bytes using the ANT byte definitions. */  
+  Ant_u8AntNewRxMessages--;
+  AdvanceAntRxBufferUnreadMsgPointer();
+  u8MessageLength = *Ant_pu8AntRxBufferUnreadMsg;
+  
+  /* Check to ensure the message size is legit.  !!!!! Clean up pointers if not */
+  if(u8MessageLength > MESG_MAX_SIZE)
+  {
+    return(1);
+  }
+  
+  /* Copy the message so it can be indexed easily */ 
+  for(u8 i = 0; i < (u8MessageLength + MESG_FRAME_SIZE - MESG_SYNC_SIZE); i++)
+  {
+    au8MessageCopy[i] = *Ant_pu8AntRxBufferUnreadMsg;
+    AdvanceAntRxBufferUnreadMsgPointer();
+  }
+  /* Note: Ant_pu8AntRxBufferUnreadMsg is now pointing at the next unread message */
+  
+  /* Get the channel number since it is needed for many things below (this value
+  will NOT be the channel for messages that do not include the channel number,
+  but that should be fine as long as the value is used in the correct context. */
+  u8Channel = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM];
+  
+  /* Decide what to do based on the Message ID */
+  switch( au8MessageCopy[BUFFER_INDEX_MESG_ID] )
+  {
+    case MESG_RESPONSE_EVENT_ID:
+    { 
+      /* Channel Message received: it is a Channel Response or Channel Event */
+      if( au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID] != MESG_EVENT_ID )
+      {
+        /* We have a Channel Response: parse it out based on the message ID to which the 
+        response applies and post the result */
+        G_stMessageResponse.u8Channel = u8Channel;
+        G_stMessageResponse.u8MessageNumber = au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID];
+        G_stMessageResponse.u8ResponseCode  = au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE];      
+        
+        /* Keep every response in order for AntReadResponse(); the oldest goes if nobody is reading */
+        if(Ant_u8ResponseCount == ANT_RESPONSE_BUFFER_SIZE)
+        {
+          Ant_u8ResponseOldest = (Ant_u8ResponseOldest + 1) % ANT_RESPONSE_BUFFER_SIZE;
+          Ant_u8ResponseCount--;
+        }
+        Ant_asResponses[(Ant_u8ResponseOldest + Ant_u8ResponseCount) % ANT_RESPONSE_BUFFER_SIZE] = G_stMessageResponse;
+        Ant_u8ResponseCount++;
+        
+        switch(au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID])
+        {
+          case MESG_OPEN_SCAN_CHANNEL_ID:
+            DebugPrintf("Scanning ");
+            /* Fall through */
+            
+          case MESG_OPEN_CHANNEL_ID:
+            G_au8AntMessageOpen[12] = u8Channel + 0x30;
+            DebugPrintf(G_au8AntMessageOpen);
+            
+            /* Only change the flags if the command was successful */
+            if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR )
+            {
+              G_asAntChannelConfiguration[u8Channel].AntFlags |= _ANT_FLAGS_CHANNEL_OPEN;
+              G_asAntChannelConfiguration[u8Channel].AntFlags &= ~_ANT_FLAGS_CHANNEL_OPEN_PENDING;
+            }
+            break;
+
+          case MESG_CLOSE_CHANNEL_ID:
+            G_au8AntMessageClose[12] = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM] + 0x30;
+            DebugPrintf(G_au8AntMessageClose);
+
+            /* Only change the flags if the command was successful */
+            if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR )
+            {
+              G_asAntChannelConfiguration[u8Channel].AntFlags &= ~(_ANT_FLAGS_CHANNEL_CLOSE_PENDING | _ANT_FLAGS_CHANNEL_OPEN);
+            }
+            break;
+
+          case MESG_ASSIGN_CHANNEL_ID:
+            G_au8AntMessageAssign[12] = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM] + 0x30;
+            DebugPrintf(G_au8AntMessageAssign);
+            break;
+
+          case MESG_BURST_DATA_ID:
+            /* ANT only responds to a burst packet when it is rejected (e.g. TRANSFER_SEQUENCE_NUMBER_ERROR) */
+            if( (Ant_eBurstTxStatus == ANT_BURST_BUSY) &&
+                ((u8Channel & CHANNEL_NUMBER_MASK) == Ant_u8BurstTxChannel) )
+            {
+              AntBurstTxEnd(ANT_BURST_FAILED);
+            }
+            break;
+
+          case MESG_UNASSIGN_CHANNEL_ID:
+            G_au8AntMessageUnassign[12] = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM] + 0x30;
+            DebugPrintf(G_au8AntMessageUnassign);
+
+            /* Only change the flags if the command was successful */
+            if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR )
+            {
+              G_asAntChannelConfiguration[u8Channel].AntFlags &= ~(_ANT_FLAGS_CHANNEL_OPEN_PENDING | _ANT_FLAGS_CHANNEL_CLOSE_PENDING | _ANT_FLAGS_CHANNEL_OPEN); /* !!!! 2016-06-14 */
+            }
+            break;
+ 
+          default:
+            G_au8AntMessageUnhandled[12] = au8MessageCopy[BUFFER_INDEX_CHANNEL_NUM] + 0x30;
+            G_au8AntMessageUnhandled[24] = HexToASCIICharLower( (au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID] >> 4) & 0x0F );
+            G_au8AntMessageUnhandled[25] = HexToASCIICharLower( (au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID] & 0x0F) );
+            G_au8AntMessageUnhandled[36] = HexToASCIICharLower( (au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] >> 4) & 0x0F );
+            G_au8AntMessageUnhandled[37] = HexToASCIICharLower( (au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] & 0x0F) );
+            DebugPrintf(G_au8AntMessageUnhandled);
+            break;
+        } /* end switch */
+        
+        /* All messages print an "ok" or "fail" */
+        if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR ) 
+        {
+          DebugPrintf(G_au8AntMessageOk);
+        }
+        else
+        {
+          DebugPrintf(G_au8AntMessageFail);
+          G_u32AntFlags |= _ANT_FLAGS_CMD_ERROR;
+        }
+
+      }
+      else /* The message is a Channel Event, so the Event Code must be parsed out */
+      { 
+        switch ( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] )
+        {
+          case RESPONSE_NO_ERROR: 
+          {
+            AntTickExtended(RESPONSE_NO_ERROR);
+            break;
+          }
+
+          case EVENT_RX_FAIL: /* slave did not receive a message when expected */
+          {
+            /* The slave missed a message it was expecting: communicate this to the
+            application in case it matters. Could also queue a debug message here. */
+            if(++Ant_u8SlaveMissedMessageLow == 0)
+            {
+              if(++Ant_u8SlaveMissedMessageMid == 0)
+              {
+                ++Ant_u8SlaveMissedMessageHigh;
+              }
+            }
+            
+            /* Queue an ANT_TICK message to the application message list. */
+            AntTickExtended(au8MessageCopy);
+            break;
+          }
+
+          case EVENT_RX_FAIL_GO_TO_SEARCH: /* slave has lost sync with Master (channel still open) */
+          {
+            /* The slave missed enough consecutive messages so it goes back to search: communicate this to the
+            application in case it matters. Could also queue a debug message here. */
+            AntTickExtended(au8MessageCopy);
+            break;
+          }
+
+          case EVENT_TX: /* ANT has sent a data message */
+          {
+            /* If this is a master device, then EVENT_TX means it's time to queue the 
+            next message */
+            if(G_asAntChannelConfiguration[u8Channel].AntChannelType == CHANNEL_TYPE_MASTER)
+            {
+              AntTickExtended(au8MessageCopy);
+            }
+            break;
+          } 
+
+          case EVENT_TRANSFER_TX_START: /* ANT has started sending a burst */
+          {
+            if( (Ant_eBurstTxStatus == ANT_BURST_BUSY) && (u8Channel == Ant_u8BurstTxChannel) )
+            {
+              Ant_u32BurstTxTimer = G_u32SystemTime1ms;
+            }
+            break;
+          }
+
+          case EVENT_TRANSFER_TX_COMPLETED: /* ACK received from an acknowledged data message or a burst is done */
+          { 
+            /* A burst uses the same events, so only an acknowledged message touches the ACK state */
+            if( (Ant_eBurstTxStatus == ANT_BURST_BUSY) && (u8Channel == Ant_u8BurstTxChannel) )
+            {
+              /* The burst is only complete once its last packet has gone to ANT */
+              if( (Ant_u16BurstTxIndex >= Ant_u16BurstTxLength) && (Ant_u8BurstTxPacketsQueued == 0) )
+              {
+                AntBurstTxEnd(ANT_BURST_COMPLETE);
+              }
+            }
+            else
+            {
+              G_asAntChannelConfiguration[u8Channel].AntFlags |= _ANT_FLAGS_GOT_ACK;
+              AntReliableResult(u8Channel, TRUE);
+            }
+
+            AntTickExtended(au8MessageCopy);
+            break;
+          } 
+
+          case EVENT_TRANSFER_TX_FAILED: /* ACK was not received from an acknowledged data message or a burst failed */
+          { 
+            if( (Ant_eBurstTxStatus == ANT_BURST_BUSY) && (u8Channel == Ant_u8BurstTxChannel) )
+            {
+              AntBurstTxEnd(ANT_BURST_FAILED);
+            }
+            else
+            {
+              AntReliableResult(u8Channel, FALSE);
+            }
+
+            /* Regardless of complete or fail, it is time to send the next message */
+            AntTickExtended(au8MessageCopy);
+            break;
+          } 
+
+          case EVENT_TRANSFER_RX_FAILED: /* A burst being received was not completed */
+          {
+            if( (Ant_eBurstRxStatus == ANT_BURST_BUSY) && (u8Channel == Ant_u8BurstRxChannel) )
+            {
+              Ant_eBurstRxStatus = ANT_BURST_FAILED;
+              Ant_u32BurstRxDropped++;
+            }
+            
+            AntTickExtended(au8MessageCopy);
+            break;
+          }
+
+          case EVENT_RX_SEARCH_TIMEOUT: /* The ANT channel is going to close due to search timeout */
+          {
+            /* Forward this to application */
+            AntTickExtended(au8MessageCopy);
+            break;
+          }
+ 
+          case EVENT_CHANNEL_CLOSED: /* The ANT channel is now closed */
+          {
+            DebugPrintf("Channel closed\n\r");
+            G_asAntChannelConfiguration[u8Channel].AntFlags &= ~(_ANT_FLAGS_CHANNEL_CLOSE_PENDING | _ANT_FLAGS_CHANNEL_OPEN);
+            break;
+          }
+          
+          /* All other messages are unexpected for now */
+          default:
+            DebugPrintNumber(au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE]);
+            DebugPrintf(": unexpected channel event\n\r");
+
+            G_u32AntFlags |= _ANT_FLAGS_UNEXPECTED_EVENT;
+            break;
+        } /* end Ant_pu8AntRxBufferUnreadMsg[EVENT_CODE_INDEX] */
+      } /* end else RF event */
+      
+      break; 
+    } /* end case MESG_RESPONSE_EVENT_ID */
+
+    case MESG_ACKNOWLEDGED_DATA_ID: /* An acknowledged data message was received */
+    /* Fall through */
+      
+    case MESG_BROADCAST_DATA_ID: /* A broadcast data message was received */
+    { 
+      /* Parse the extended data and put the message to the application buffer.  Device data
+      kept in the scanning device table is only queued if a subscriber asks for it. */
+      AntParseExtendedData(au8MessageCopy, &sExtendedData);
+      if( !AntScanTableUpdate(&sExtendedData, &au8MessageCopy[BUFFER_INDEX_MESG_DATA]) ||
+          (AntFindSubscriber(ANT_DATA, &sExtendedData) != NULL) )
+      {
+        AntQueueExtendedApplicationMessage(ANT_DATA, &au8MessageCopy[BUFFER_INDEX_MESG_DATA], &sExtendedData);
+      }
+      
+      /* If this is a slave device, then a data message received means it's time to send */
+      if(G_asAntChannelConfiguration[u8Channel].AntChannelType == CHANNEL_TYPE_SLAVE)
+      {
+        AntTickExtended(RESPONSE_NO_ERROR);
+      }
+      
+      break;
+    } /* end case MESG_BROADCAST_DATA_ID */
+    
+    case MESG_BURST_DATA_ID: /* A burst packet was received: the channel byte also carries the sequence */
+    {
+      AntBurstReceive(au8MessageCopy);
+      break;
+    } /* end case MESG_BURST_DATA_ID */
+    
+    case MESG_CHANNEL_STATUS_ID: /* Message sent in response to a channel status request */
+    { 
+      break;
+    } /* end case ChannelStatus_CMD */
+    
+    case MESG_VERSION_ID:
+    {
+      for(u8 i = 0; i < MESG_VERSION_SIZE; i++)
+      {
+        Ant_u8AntVersion[i] = au8MessageCopy[BUFFER_INDEX_VERSION_BYTE0 + i];
+      }
+      
+      /* If we get a version message, we know that ANT comms is good */
+      G_u32ApplicationFlags |= _APPLICATION_FLAGS_ANT;
+      
+      break;
+    } /* end case MESG_VERSION_ID */
+
+    case MESG_RESTART_ID:
+    {
+      G_u32AntFlags |= _ANT_FLAGS_RESTART;  
+      break;
+    } /* end case MESG_RESTART_ID */
+    
+    default:
+      G_u32AntFlags |= _ANT_FLAGS_UNEXPECTED_MSG;
+      break;
+  } /* end switch( Ant_pu8AntRxBufferUnreadMsg[MESG_ID_OFFSET] ) */
+           
+  return(0);
+  
+} /* end AntProcessMessage() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntTickExtended
+
+Description:
+Queues an ANT_TICK message to the application message queue.
+
+Requires:
+  - u8Code_ is payload byte indicating system info that may be relavent to the application
+
+Promises:
+  - A MESSAGE_ANT_TICK is queued to G_sAntApplicationMsgList
+*/
+static void AntTickExtended(u8* pu8AntMessage_)
+{
+  u8 au8Message[ANT_APPLICATION_MESSAGE_BYTES];
+  AntExtendedDataType sExtData;
+
+  /* Update data to communicate the ANT_TICK to the application */
+  au8Message[ANT_TICK_MSG_ID_INDEX]               = MESSAGE_ANT_TICK;
+  au8Message[ANT_TICK_MSG_CHANNEL_INDEX]          = *(pu8AntMessage_ + BUFFER_INDEX_CHANNEL_NUM);
+  au8Message[ANT_TICK_MSG_RESPONSE_TYPE_INDEX]    = *(pu8AntMessage_ + BUFFER_INDEX_RESPONSE_MESG_ID);
+  au8Message[ANT_TICK_MSG_EVENT_CODE_INDEX]       = *(pu8AntMessage_ + BUFFER_INDEX_RESPONSE_CODE);
+  au8Message[ANT_TICK_MSG_SENTINEL3_INDEX]        = MESSAGE_ANT_TICK;
+  au8Message[ANT_TICK_MSG_MISSED_HIGH_BYTE_INDEX] = Ant_u8SlaveMissedMessageHigh;
+  au8Message[ANT_TICK_MSG_MISSED_MID_BYTE_INDEX]  = Ant_u8SlaveMissedMessageMid;
+  au8Message[ANT_TICK_MSG_MISSED_LOW_BYTE_INDEX]  = Ant_u8SlaveMissedMessageLow;
+
+  /* Extended data is not valid for an ANT_TICK message */
+  sExtData.u8Channel    = au8Message[ANT_TICK_MSG_CHANNEL_INDEX];
+  sExtData.u16DeviceID  = 0xFF;
+  sExtData.u8DeviceType = 0xFF;
+  sExtData.u8TransType  = 0xFF;
+  sExtData.s8RSSI       = 0xFF;
+  sExtData.u8Flags      = 0xFF;
+  
+  /* Data is ready so queue it in to the application buffer */
+  AntQueueExtendedApplicationMessage(ANT_TICK, 
+                                     &au8Message[ANT_TICK_MSG_ID_INDEX],
+                                     &sExtData);
+
+} /* end AntTickExtended() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntQueueExtendedApplicationMessage
+
+Description:
+Takes a node from the application message pool, fills it and adds it to the queue of the
+first matching subscriber, or to G_sAntApplicationMsgList if no subscriber wants it.
+The Application list used to communicate message information between the ANT driver and
+the ANT_API simplified interface task.
+
+Requires:
+  - eMessageType_ specifies the type of message
+  - pu8DataSource_ is a pointer to the first element of an array of 8 data bytes
+  - psExtData_ points to the extended data for the message
+
+Promises:
+  - A new list item in the target linked list is filled and inserted at the end
+    of the list.
+  - Returns TRUE if the entry is added successfully.
+  - Returns FALSE and Ant_u32ApplicationMessageOverflows is incremented if the pool or
+    the target queue is full.
+*/
+static bool AntQueueExtendedApplicationMessage(AntApplicationMessageType eMessageType_, 
+                                               u8* pu8DataSource_, 
+                                               AntExtendedDataType* psExtData_)
+{
+  AntApplicationMsgListType *psNewMessage;
+  AntSubscriberType *psSubscriber;
+  u8 au8AddMessageFailMsg[] = "\n\rNo space in AntQueueApplicationMessage\n\r";
+  
+  /* Take a node from the pool if the target queue has room */
+  psSubscriber = AntFindSubscriber(eMessageType_, psExtData_);
+  psNewMessage = Ant_psApplicationMessageFree;
+  if( (psNewMessage == NULL) || 
+      ( (psSubscriber == NULL) && (Ant_u32ApplicationMessageCount >= ANT_APPLICATION_MESSAGE_BUFFER_SIZE) ) ||
+      ( (psSubscriber != NULL) && (psSubscriber->u32Count >= ANT_SUBSCRIBER_QUEUE_DEPTH) ) )
+  {
+    if(psSubscriber != NULL)
+    {
+      psSubscriber->u32Overflows++;
+    }
+    Ant_u32ApplicationMessageOverflows++;
+    DebugPrintf(au8AddMessageFailMsg);
+    return(FALSE);
+  }
+  Ant_psApplicationMessageFree = psNewMessage->psNextMessage;
+  
+  /* Fill in all the fields of the newly allocated message structure */
+  for(u8 i = 0; i < ANT_APPLICATION_MESSAGE_BYTES; i++)
+  {
+    psNewMessage->au8MessageData[i] = *(pu8DataSource_ + i);
+  }
+  
+  /* Copy basic items */
+  psNewMessage->u32TimeStamp  = G_u32SystemTime1ms;
+  psNewMessage->eMessageType  = eMessageType_;
+  
+  /* Copy all extended data fields */
+  psNewMessage->sExtendedData.u8Channel    = psExtData_->u8Channel;
+  psNewMessage->sExtendedData.u16DeviceID  = psExtData_->u16DeviceID;
+  psNewMessage->sExtendedData.u8DeviceType = psExtData_->u8DeviceType;
+  psNewMessage->sExtendedData.u8TransType  = psExtData_->u8TransType;
+  psNewMessage->sExtendedData.u8Flags      = psExtData_->u8Flags;
+  psNewMessage->sExtendedData.s8RSSI       = psExtData_->s8RSSI;
+    
+  psNewMessage->psNextMessage = NULL;
+
+  /* A subscriber's message goes on its own queue */
+  if(psSubscriber != NULL)
+  {
+    if(psSubscriber->psHead == NULL)
+    {
+      psSubscriber->psHead = psNewMessage;
+    }
+    else
+    {
+      psSubscriber->psTail->psNextMessage = psNewMessage;
+    }
+    
+    psSubscriber->psTail = psNewMessage;
+    psSubscriber->u32Count++;
+    return(TRUE);
+  }
+
+  /* Insert into an empty list, otherwise link it after the tail */
+  if(G_sAntApplicationMsgList == NULL)
+  {
+    G_sAntApplicationMsgList = psNewMessage;
+  }
+  else
+  {
+    Ant_psApplicationMsgTail->psNextMessage = psNewMessage;
+  }
+    
+  Ant_psApplicationMsgTail = psNewMessage;
+  Ant_u32ApplicationMessageCount++;
+  return(TRUE);
+    
+} /* end AntQueueExtendedApplicationMessage() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntDeQueueOutgoingMessage
+
+Description:
+Removes the first entry of Ant_psDataOutgoingMsgList.
+
+Requires:
+  - 
+
+Promises:
+  - Ant_psDataOutgoingMsgList = Ant_psDataOutgoingMsgList->psNextMessage 
+  and the node is back in the outgoing message pool
+*/
+static void AntDeQueueOutgoingMessage(void)
+{
+  AntOutgoingMessageListType *psMessageToKill;
+  
+  if(Ant_psDataOutgoingMsgList != NULL)
+  {
+    psMessageToKill = Ant_psDataOutgoingMsgList;
+    Ant_psDataOutgoingMsgList = Ant_psDataOutgoingMsgList->psNextMessage;
+    if( (psMessageToKill->au8MessageData[BUFFER_INDEX_MESG_ID] == MESG_BURST_DATA_ID) &&
+        (Ant_u8BurstTxPacketsQueued != 0) )
+    {
+      /* A packet going to ANT counts as burst progress */
+      Ant_u8BurstTxPacketsQueued--;
+      Ant_u32BurstTxTimer = G_u32SystemTime1ms;
+    }
+    if(Ant_psDataOutgoingMsgList == NULL)
+    {
+      Ant_psDataOutgoingMsgTail = NULL;
+    }
+  
+    /* The doomed message is properly disconnected, so return it to the pool */
+    psMessageToKill->psNextMessage = Ant_psOutgoingMessageFree;
+    Ant_psOutgoingMessageFree = psMessageToKill;
+    Ant_u32OutgoingMessageCount--;
+  }
+  
+} /* end AntDeQueueOutgoingMessage() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntInitializeMessagePools
+
+Description:
+Puts every outgoing and application message node on its pool's free list.
+
+Requires:
+  - No node is in use (the message lists are empty)
+
+Promises:
+  - Ant_psOutgoingMessageFree and Ant_psApplicationMessageFree chain all of their pool's nodes
+*/
+static void AntInitializeMessagePools(void)
+{
+  Ant_psOutgoingMessageFree = NULL;
+  for(u32 i = 0; i < ANT_OUTGOING_MESSAGE_BUFFER_SIZE; i++)
+  {
+    Ant_asOutgoingMessagePool[i].psNextMessage = Ant_psOutgoingMessageFree;
+    Ant_psOutgoingMessageFree = &Ant_asOutgoingMessagePool[i];
+  }
+
+  Ant_psApplicationMessageFree = NULL;
+  for(u32 i = 0; i < ANT_APPLICATION_MESSAGE_BUFFER_SIZE; i++)
+  {
+    Ant_asApplicationMessagePool[i].psNextMessage = Ant_psApplicationMessageFree;
+    Ant_psApplicationMessageFree = &Ant_asApplicationMessagePool[i];
+  }
+  
+} /* end AntInitializeMessagePools() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntReleaseApplicationMessage
+
+Description:
+Returns an application message node to its pool.
+
+Requires:
+  - psMessage_ has already been unlinked from its list
+
+Promises:
+  - psMessage_ is the first node on Ant_psApplicationMessageFree
+*/
+static void AntReleaseApplicationMessage(AntApplicationMsgListType* psMessage_)
+{
+  psMessage_->psNextMessage = Ant_psApplicationMessageFree;
+  Ant_psApplicationMessageFree = psMessage_;
+  
+} /* end AntReleaseApplicationMessage() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntFindSubscriber
+
+Description:
+Finds the subscriber that should receive a message.
+
+Requires:
+  - psExtData_->u8Channel holds the message's channel
+
+Promises:
+  - Returns the first active subscriber whose channel, type and device ID filters 
+    match, or NULL if none do
+*/
+static AntSubscriberType* AntFindSubscriber(AntApplicationMessageType eMessageType_, AntExtendedDataType* psExtData_)
+{
+  AntSubscriberType* psSubscriber;
+  u8 u8TypeBit;
+  
+  u8TypeBit = (eMessageType_ == ANT_TICK) ? ANT_SUBSCRIBE_TICK : ANT_SUBSCRIBE_DATA;
+  for(u8 i = 0; i < ANT_SUBSCRIBERS; i++)
+  {
+    psSubscriber = &Ant_asSubscribers[i];
+    if( !psSubscriber->bActive || 
+        !(psSubscriber->u8MessageTypes & u8TypeBit) ||
+        (psExtData_->u8Channel >= ANT_NUM_CHANNELS) ||
+        !(psSubscriber->u8ChannelMask & (1 << psExtData_->u8Channel)) )
+    {
+      continue;
+    }
+    
+    /* Only data messages carry a device ID (and only with channel ID extended data) */
+    if( (eMessageType_ == ANT_DATA) && (psSubscriber->u16DeviceID != ANT_SUBSCRIBE_ANY_DEVICE) &&
+        ( !(psExtData_->u8Flags & LIB_CONFIG_CHANNEL_ID_FLAG) || 
+          (psExtData_->u16DeviceID != psSubscriber->u16DeviceID) ) )
+    {
+      continue;
+    }
+    
+    return(psSubscriber);
+  }
+  
+  return(NULL);
+  
+} /* end AntFindSubscriber() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntBurstFeed
+
+Description:
+Keeps up to ANT_BURST_TX_QUEUE_DEPTH packets of the current burst on the outgoing list
+so ANT always has the next packet ready.  Other outgoing messages still get pool nodes
+since the burst never takes more than its share.  A burst that makes no progress
+for ANT_BURST_TIMEOUT_MS is failed.
+
+Requires:
+  - Called every pass through AntSM_Idle
+
+Promises:
+  - If a burst is in progress, new packets are queued with the next sequence number
+    and ANT_BURST_LAST_PACKET set on the final one
+*/
+static void AntBurstFeed(void)
+{
+  u8 au8BurstMessage[] = {MESG_DATA_SIZE, MESG_BURST_DATA_ID, CH, D_0, D_1, D_2, D_3, D_4, D_5, D_6, D_7, CS};
+  
+  if(Ant_eBurstTxStatus != ANT_BURST_BUSY)
+  {
+    return;
+  }
+  
+  while( (Ant_u16BurstTxIndex < Ant_u16BurstTxLength) &&
+         (Ant_u8BurstTxPacketsQueued < ANT_BURST_TX_QUEUE_DEPTH) &&
+         (Ant_psOutgoingMessageFree != NULL) )
+  {
+    /* Channel byte carries the sequence, and the last packet flag if the data ends in this packet */
+    au8BurstMessage[BUFFER_INDEX_CHANNEL_NUM] = Ant_u8BurstTxChannel | Ant_u8BurstTxSequence;
+    if( (Ant_u16BurstTxLength - Ant_u16BurstTxIndex) <= ANT_DATA_BYTES )
+    {
+      au8BurstMessage[BUFFER_INDEX_CHANNEL_NUM] |= ANT_BURST_LAST_PACKET;
+    }
+    
+    for(u8 i = 0; i < ANT_DATA_BYTES; i++)
+    {
+      if(Ant_u16BurstTxIndex < Ant_u16BurstTxLength)
+      {
+        au8BurstMessage[BUFFER_INDEX_MESG_DATA + i] = *(Ant_pu8BurstTxData + Ant_u16BurstTxIndex);
+        Ant_u16BurstTxIndex++;
+      }
+      else
+      {
+        au8BurstMessage[BUFFER_INDEX_MESG_DATA + i] = 0;
+      }
+    }
+    
+    au8BurstMessage[11] = AntCalculateTxChecksum(au8BurstMessage);
+    AntQueueOutgoingMessage(au8BurstMessage);
+    Ant_u8BurstTxPacketsQueued++;
+    Ant_u32BurstTxTimer = G_u32SystemTime1ms;
+    
+    /* The first packet is sequence 0, then the sequence runs 1, 2, 3, 1, 2, 3... */
+    if(Ant_u8BurstTxSequence == SEQUENCE_NUMBER_ROLLOVER)
+    {
+      Ant_u8BurstTxSequence = SEQUENCE_NUMBER_INC;
+    }
+    else
+    {
+      Ant_u8BurstTxSequence += SEQUENCE_NUMBER_INC;
+    }
+  }
+  
+  if( IsTimeUp(&Ant_u32BurstTxTimer, ANT_BURST_TIMEOUT_MS) )
+  {
+    DebugPrintf("ANT burst timeout\n\r");
+    AntBurstTxEnd(ANT_BURST_FAILED);
+  }
+  
+} /* end AntBurstFeed() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntBurstReceive
+
+Description:
+Adds a received burst packet to Ant_au8BurstRxBuffer.  A packet with sequence 0 starts 
+a new burst; every following packet must carry the next sequence on the same channel.
+
+Requires:
+  - pu8Message_ is a complete MESG_BURST_DATA_ID message
+
+Promises:
+  - The packet's data is appended and Ant_eBurstRxStatus = ANT_BURST_COMPLETE after the last packet
+  - A burst that overflows the buffer, arrives out of sequence or arrives while a complete 
+    burst is still unread is dropped and counted in Ant_u32BurstRxDropped
+*/
+static void AntBurstReceive(u8* pu8Message_)
+{
+  u8 u8Channel  = pu8Message_[BUFFER_INDEX_CHANNEL_NUM] & CHANNEL_NUMBER_MASK;
+  u8 u8Sequence = pu8Message_[BUFFER_INDEX_CHANNEL_NUM] & ANT_BURST_SEQUENCE_BITS;
+  
+  /* First packet of a new burst */
+  if(u8Sequence == 0)
+  {
+    if(Ant_eBurstRxStatus == ANT_BURST_COMPLETE)
+    {
+      Ant_u32BurstRxDropped++;
+      return;
+    }
+    
+    Ant_eBurstRxStatus      = ANT_BURST_BUSY;
+    Ant_u8BurstRxChannel    = u8Channel;
+    Ant_u16BurstRxLength    = 0;
+    Ant_u8BurstRxSequence   = SEQUENCE_NUMBER_INC;
+    Ant_u32BurstRxStartTime = G_u32SystemTime1ms;
+  }
+  
+  /* Packets in the middle of a burst that is not being received are ignored */
+  else if( (Ant_eBurstRxStatus != ANT_BURST_BUSY) || (u8Channel != Ant_u8BurstRxChannel) )
+  {
+    return;
+  }
+  
+  else if(u8Sequence != Ant_u8BurstRxSequence)
+  {
+    DebugPrintf("ANT burst rx sequence error\n\r");
+    Ant_eBurstRxStatus = ANT_BURST_FAILED;
+    Ant_u32BurstRxDropped++;
+    return;
+  }
+  
+  else
+  {
+    Ant_u8BurstRxSequence = (u8Sequence == SEQUENCE_NUMBER_ROLLOVER) ? SEQUENCE_NUMBER_INC : (u8Sequence + SEQUENCE_NUMBER_INC);
+  }
+  
+  if( (Ant_u16BurstRxLength + ANT_DATA_BYTES) > ANT_BURST_RX_BUFFER_SIZE )
+  {
+    DebugPrintf("ANT burst rx overflow\n\r");
+    Ant_eBurstRxStatus = ANT_BURST_FAILED;
+    Ant_u32BurstRxDropped++;
+    return;
+  }
+  
+  for(u8 i = 0; i < ANT_DATA_BYTES; i++)
+  {
+    Ant_au8BurstRxBuffer[Ant_u16BurstRxLength++] = pu8Message_[BUFFER_INDEX_MESG_DATA + i];
+  }
+  
+  if(pu8Message_[BUFFER_INDEX_CHANNEL_NUM] & ANT_BURST_LAST_PACKET)
+  {
+    Ant_u32BurstRxRate = AntBurstRate(Ant_u16BurstRxLength, Ant_u32BurstRxStartTime);
+    Ant_eBurstRxStatus = ANT_BURST_COMPLETE;
+  }
+  
+} /* end AntBurstReceive() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntBurstTxEnd
+
+Description:
+Finishes the current burst transmit and records the result.
+
+Requires:
+  - eStatus_ is ANT_BURST_COMPLETE or ANT_BURST_FAILED
+
+Promises:
+  - Ant_eBurstTxStatus = eStatus_; no more packets are queued for this burst
+  - Ant_u32BurstTxRate is updated if the burst completed
+  - A failed burst's packets still waiting on Ant_psDataOutgoingMsgList are removed
+*/
+static void AntBurstTxEnd(AntBurstStatusType eStatus_)
+{
+  AntOutgoingMessageListType *psPrevious;
+  AntOutgoingMessageListType *psMessage;
+  
+
+  Ant_eBurstTxStatus = eStatus_;
+  
+  if(eStatus_ == ANT_BURST_COMPLETE)
+  {
+    Ant_u32BurstTxRate = AntBurstRate(Ant_u16BurstTxLength, Ant_u32BurstTxStartTime);
+  }
+  else
+  {
+    /* Packets left behind would go to ANT out of sequence and break the next burst.  The head 
+    of the list stays if it is being transmitted. */
+    psPrevious = NULL;
+    psMessage = Ant_psDataOutgoingMsgList;
+    if( (psMessage != NULL) && (Ant_u32CurrentTxMessageToken != 0) )
+    {
+      psPrevious = psMessage;
+      psMessage = psMessage->psNextMessage;
+    }
+    
+    while(psMessage != NULL)
+    {
+      if( (psMessage->au8MessageData[BUFFER_INDEX_MESG_ID] == MESG_BURST_DATA_ID) &&
+          ((psMessage->au8MessageData[BUFFER_INDEX_CHANNEL_NUM] & CHANNEL_NUMBER_MASK) == Ant_u8BurstTxChannel) )
+      {
+        /* Unlink the packet and return it to the pool */
+        if(psPrevious == NULL)
         {
-          DebugPrintf(G_au8AntMessageOk);
+          Ant_psDataOutgoingMsgList = psMessage->psNextMessage;
         }
         else
         {
-          DebugPrintf(G_au8AntMessageFail);
-          G_u32AntFlags |= _ANT_FLAGS_CMD_ERROR;
+          psPrevious->psNextMessage = psMessage->psNextMessage;
         }
-
-      }
-      else /* The message is a Channel Event, so the Event Code must be parsed out */
-      { 
-        switch ( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] )
+        
+        if(Ant_psDataOutgoingMsgTail == psMessage)
         {
-          case RESPONSE_NO_ERROR: 
-          {
-            AntTickExtended(RESPONSE_NO_ERROR);
-            break;
-          }
+          Ant_psDataOutgoingMsgTail = psPrevious;
+        }
+        
+        psMessage->psNextMessage = Ant_psOutgoingMessageFree;
+        Ant_psOutgoingMessageFree = psMessage;
+        Ant_u32OutgoingMessageCount--;
+        
+        psMessage = (psPrevious == NULL) ? Ant_psDataOutgoingMsgList : psPrevious->psNextMessage;
+      }
+      else
+      {
+        psPrevious = psMessage;
+        psMessage = psMessage->psNextMessage;
+      }
+    }
+    
+    /* A packet still being transmitted no longer counts toward a burst */
+    Ant_u8BurstTxPacketsQueued = 0;
+  }
+  
+} /* end AntBurstTxEnd() */
 
-          case EVENT_RX_FAIL: /* slave did not receive a message when expected */
-          {
-            /* The slave missed a message it was expecting: communicate this to the
-            application in case it matters. Could also queue a debug message here. */
-            if(++Ant_u8SlaveMissedMessageLow == 0)
-            {
-              if(++Ant_u8SlaveMissedMessageMid == 0)
-              {
-                ++Ant_u8SlaveMissedMessageHigh;
-              }
-            }
-            
-            /* Queue an ANT_TICK message to the application message list. */
-            AntTickExtended(au8MessageCopy);
-            break;
-          }
 
-          case EVENT_RX_FAIL_GO_TO_SEARCH: /* slave has lost sync with Master (channel still open) */
-          {
-            /* The slave missed enough consecutive messages so it goes back to search: communicate this to the
-            application in case it matters. Could also queue a debug message here. */
-            AntTickExtended(au8MessageCopy);
-            break;
-          }
+/*-----------------------------------------------------------------------------/
+Function: AntBurstRate
 
-          case EVENT_TX: /* ANT has sent a data message */
-          {
-            /* If this is a master device, then EVENT_TX means it's time to queue the 
-            next message */
-            if(G_asAntChannelConfiguration[u8Channel].AntChannelType == CHANNEL_TYPE_MASTER)
-            {
-              AntTickExtended(au8MessageCopy);
-            }
-            break;
-          } 
+Description:
+Calculates the throughput of a burst.
 
-          case EVENT_TRANSFER_TX_COMPLETED: /* ACK received from an acknowledged data message */
-          { 
-            G_asAntChannelConfiguration[u8Channel].AntFlags |= _ANT_FLAGS_GOT_ACK;
+Requires:
+  - u32StartTime_ is the G_u32SystemTime1ms value when the burst started
 
-            AntTickExtended(au8MessageCopy);
-            break;
-          } 
+Promises:
+  - Returns u16Bytes_ per second up to now (a burst inside 1ms counts as 1ms)
+*/
+static u32 AntBurstRate(u16 u16Bytes_, u32 u32StartTime_)
+{
+  u32 u32ElapsedMs = G_u32SystemTime1ms - u32StartTime_;
+  
+  if(u32ElapsedMs == 0)
+  {
+    u32ElapsedMs = 1;
+  }
+  
+  return( ((u32)u16Bytes_ * 1000) / u32ElapsedMs );
+  
+} /* end AntBurstRate() */
 
-          case EVENT_TRANSFER_TX_FAILED: /* ACK was not received from an acknowledged data message */
-          { 
-            /* Regardless of complete or fail, it is time to send the next message */
-            AntTickExtended(au8MessageCopy);
-            break;
-          } 
 
-          case EVENT_RX_SEARCH_TIMEOUT: /* The ANT channel is going to close due to search timeout */
-          {
-            /* Forward this to application */
-            AntTickExtended(au8MessageCopy);
-            break;
-          }
- 
-          case EVENT_CHANNEL_CLOSED: /* The ANT channel is now closed */
-          {
-            DebugPrintf("Channel closed\n\r");
-            G_asAntChannelConfiguration[u8Channel].AntFlags &= ~(_ANT_FLAGS_CHANNEL_CLOSE_PENDING | _ANT_FLAGS_CHANNEL_OPEN);
-            break;
-          }
-          
-          /* All other messages are unexpected for now */
-          default:
-            DebugPrintNumber(au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE]);
-            DebugPrintf(": unexpected channel event\n\r");
+/*-----------------------------------------------------------------------------/
+Function: AntReliableService
 
-            G_u32AntFlags |= _ANT_FLAGS_UNEXPECTED_EVENT;
-            break;
-        } /* end Ant_pu8AntRxBufferUnreadMsg[EVENT_CODE_INDEX] */
-      } /* end else RF event */
-      
-      break; 
-    } /* end case MESG_RESPONSE_EVENT_ID */
+Description:
+Gives the next reliable message on each channel to ANT when the previous one is
+finished.  An attempt that gets no result in time counts as failed, and messages
+for a channel that is not open fail without being sent.
 
-    case MESG_ACKNOWLEDGED_DATA_ID: /* An acknowledged data message was received */
-    /* Fall through */
-      
-    case MESG_BROADCAST_DATA_ID: /* A broadcast data message was received */
-    { 
-      /* Parse the extended data and put the message to the application buffer */
-      AntParseExtendedData(au8MessageCopy, &sExtendedData);
-      AntQueueExtendedApplicationMessage(ANT_DATA, &au8MessageCopy[BUFFER_INDEX_MESG_DATA], &sExtendedData);
-      
-      /* If this is a slave device, then a data message received means it's time to send */
-      if(G_asAntChannelConfiguration[u8Channel].AntChannelType == CHANNEL_TYPE_SLAVE)
+Requires:
+  - Called every pass of AntSM_Idle
+
+Promises:
+  - Each channel with unfinished reliable messages has its head message with ANT
+    if there is room on the outgoing list
+*/
+static void AntReliableService(void)
+{
+  AntReliableChannelType* psReliable;
+  AntReliableMessageType* psMessage;
+  u8 au8Message[] = {MESG_DATA_SIZE, MESG_ACKNOWLEDGED_DATA_ID, CH, D_0, D_1, D_2, D_3, D_4, D_5, D_6, D_7, CS};
+  
+  for(u8 i = 0; i < ANT_NUM_CHANNELS; i++)
+  {
+    psReliable = &Ant_asReliable[i];
+    if(psReliable->bInFlight)
+    {
+      if( IsTimeUp(&psReliable->u32AttemptTime, ANT_RELIABLE_ATTEMPT_TIMEOUT_MS) )
       {
-        AntTickExtended(RESPONSE_NO_ERROR);
+        AntReliableResult(i, FALSE);
       }
-      
-      break;
-    } /* end case MESG_BROADCAST_DATA_ID */
+      continue;
+    }
     
-    case MESG_CHANNEL_STATUS_ID: /* Message sent in response to a channel status request */
-    { 
-      break;
-    } /* end case ChannelStatus_CMD */
+    if(psReliable->u8Count == 0)
+    {
+      continue;
+    }
     
-    case MESG_VERSION_ID:
+    psMessage = &psReliable->asWindow[psReliable->u8Head];
+    if( !(G_asAntChannelConfiguration[i].AntFlags & _ANT_FLAGS_CHANNEL_OPEN) )
     {
-      for(u8 i = 0; i < MESG_VERSION_SIZE; i++)
-      {
-        Ant_u8AntVersion[i] = au8MessageCopy[BUFFER_INDEX_VERSION_BYTE0 + i];
-      }
-      
-      /* If we get a version message, we know that ANT comms is good */
-      G_u32ApplicationFlags |= _APPLICATION_FLAGS_ANT;
-      
-      break;
-    } /* end case MESG_VERSION_ID */
-
-    case MESG_RESTART_ID:
+      psMessage->eStatus = ANT_RELIABLE_FAILED;
+      psReliable->u32Failed++;
+      psReliable->u8Head = (psReliable->u8Head + 1) % ANT_RELIABLE_WINDOW;
+      psReliable->u8Count--;
+      continue;
+    }
+    
+    au8Message[BUFFER_INDEX_CHANNEL_NUM] = i;
+    for(u8 j = 0; j < ANT_APPLICATION_MESSAGE_BYTES; j++)
     {
-      G_u32AntFlags |= _ANT_FLAGS_RESTART;  
-      break;
-    } /* end case MESG_RESTART_ID */
+      au8Message[BUFFER_INDEX_MESG_DATA + j] = psMessage->au8Data[j];
+    }
+    au8Message[BUFFER_INDEX_MESG_DATA + ANT_APPLICATION_MESSAGE_BYTES] = AntCalculateTxChecksum(au8Message);
     
-    default:
-      G_u32AntFlags |= _ANT_FLAGS_UNEXPECTED_MSG;
-      break;
-  } /* end switch( Ant_pu8AntRxBufferUnreadMsg[MESG_ID_OFFSET] ) */
-           
-  return(0);
+    /* If the outgoing list is full, try again next time */
+    if( AntQueueOutgoingMessage(au8Message) )
+    {
+      psMessage->eStatus = ANT_RELIABLE_SENDING;
+      psMessage->u8Attempts++;
+      psReliable->u32Attempts++;
+      psReliable->bInFlight = TRUE;
+      psReliable->u32AttemptTime = G_u32SystemTime1ms;
+    }
+  }
   
-} /* end AntProcessMessage() */
+} /* end AntReliableService() */
 
 
 /*-----------------------------------------------------------------------------/
-Function: AntTickExtended
+Function: AntReliableResult
 
 Description:
-Queues an ANT_TICK message to the application message queue.
+Applies the result of an acknowledged transfer to the reliable message in flight on
+a channel.  A failed attempt is sent again while retries remain.
 
 Requires:
-  - u8Code_ is payload byte indicating system info that may be relavent to the application
+  - bDelivered_ is TRUE for EVENT_TRANSFER_TX_COMPLETED, FALSE for a failed or timed out attempt
 
 Promises:
-  - A MESSAGE_ANT_TICK is queued to G_sAntApplicationMsgList
+  - If no reliable message is in flight on u8Channel_, nothing changes
+  - The head message is DELIVERED, FAILED, or left QUEUED for AntReliableService() to resend
 */
-static void AntTickExtended(u8* pu8AntMessage_)
+static void AntReliableResult(u8 u8Channel_, bool bDelivered_)
 {
-  u8 au8Message[ANT_APPLICATION_MESSAGE_BYTES];
-  AntExtendedDataType sExtData;
+  AntReliableChannelType* psReliable;
+  AntReliableMessageType* psMessage;
+  
+  if( (u8Channel_ >= ANT_NUM_CHANNELS) || !Ant_asReliable[u8Channel_].bInFlight )
+  {
+    return;
+  }
+  
+  psReliable = &Ant_asReliable[u8Channel_];
+  psMessage = &psReliable->asWindow[psReliable->u8Head];
+  psReliable->bInFlight = FALSE;
+  
+  if( !bDelivered_ && (psMessage->u8Attempts <= psReliable->u8Retries) )
+  {
+    psMessage->eStatus = ANT_RELIABLE_QUEUED;
+    return;
+  }
+  
+  if(bDelivered_)
+  {
+    psMessage->eStatus = ANT_RELIABLE_DELIVERED;
+    psReliable->u32Delivered++;
+  }
+  else
+  {
+    psMessage->eStatus = ANT_RELIABLE_FAILED;
+    psReliable->u32Failed++;
+  }
+  
+  psReliable->u8Head = (psReliable->u8Head + 1) % ANT_RELIABLE_WINDOW;
+  psReliable->u8Count--;
+  
+} /* end AntReliableResult() */
 
-  /* Update data to communicate the ANT_TICK to the application */
-  au8Message[ANT_TICK_MSG_ID_INDEX]               = MESSAGE_ANT_TICK;
-  au8Message[ANT_TICK_MSG_CHANNEL_INDEX]          = *(pu8AntMessage_ + BUFFER_INDEX_CHANNEL_NUM);
-  au8Message[ANT_TICK_MSG_RESPONSE_TYPE_INDEX]    = *(pu8AntMessage_ + BUFFER_INDEX_RESPONSE_MESG_ID);
-  au8Message[ANT_TICK_MSG_EVENT_CODE_INDEX]       = *(pu8AntMessage_ + BUFFER_INDEX_RESPONSE_CODE);
-  au8Message[ANT_TICK_MSG_SENTINEL3_INDEX]        = MESSAGE_ANT_TICK;
-  au8Message[ANT_TICK_MSG_MISSED_HIGH_BYTE_INDEX] = Ant_u8SlaveMissedMessageHigh;
-  au8Message[ANT_TICK_MSG_MISSED_MID_BYTE_INDEX]  = Ant_u8SlaveMissedMessageMid;
-  au8Message[ANT_TICK_MSG_MISSED_LOW_BYTE_INDEX]  = Ant_u8SlaveMissedMessageLow;
 
-  /* Extended data is not valid for an ANT_TICK message */
-  sExtData.u8Channel    = au8Message[ANT_TICK_MSG_CHANNEL_INDEX];
-  sExtData.u16DeviceID  = 0xFF;
-  sExtData.u8DeviceType = 0xFF;
-  sExtData.u8TransType  = 0xFF;
-  sExtData.s8RSSI       = 0xFF;
-  sExtData.u8Flags      = 0xFF;
+/*-----------------------------------------------------------------------------/
+Function: AntScanTableHash
+
+Description:
+Returns the home slot of a device in the scanning device table.
+
+Requires:
+  - 
+
+Promises:
+  - Returns a slot index from 0 to ANT_SCAN_TABLE_SIZE - 1
+*/
+static u8 AntScanTableHash(u16 u16DeviceID_, u8 u8DeviceType_, u8 u8TransType_)
+{
+  u16 u16Hash;
+  
+  /* Device numbers are often sequential so mix the high byte and the other keys into the low bits */
+  u16Hash = u16DeviceID_ ^ (u16DeviceID_ >> 8) ^ ((u16)u8DeviceType_ * 7) ^ ((u16)u8TransType_ * 13);
+  return( (u8)(u16Hash & ANT_SCAN_TABLE_MASK) );
+  
+} /* end AntScanTableHash() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntScanTableLookup
+
+Description:
+Probes the scanning device table for a device.
+
+Requires:
+  - 
+
+Promises:
+  - Returns the slot holding the device, or the first empty slot in its probe sequence 
+    if it is not in the table (a used slot is returned only if it is the device or
+    the table is full, so check the key when bUsed is set)
+*/
+static u8 AntScanTableLookup(u16 u16DeviceID_, u8 u8DeviceType_, u8 u8TransType_)
+{
+  u8 u8Slot;
+  
+  u8Slot = AntScanTableHash(u16DeviceID_, u8DeviceType_, u8TransType_);
+  for(u8 i = 0; i < ANT_SCAN_TABLE_SIZE; i++)
+  {
+    if( !Ant_asScanTable[u8Slot].bUsed ||
+        ( (Ant_asScanTable[u8Slot].u16DeviceID  == u16DeviceID_)  &&
+          (Ant_asScanTable[u8Slot].u8DeviceType == u8DeviceType_) &&
+          (Ant_asScanTable[u8Slot].u8TransType  == u8TransType_) ) )
+    {
+      return(u8Slot);
+    }
+    
+    u8Slot = (u8Slot + 1) & ANT_SCAN_TABLE_MASK;
+  }
   
-  /* Data is ready so queue it in to the application buffer */
-  AntQueueExtendedApplicationMessage(ANT_TICK, 
-                                     &au8Message[ANT_TICK_MSG_ID_INDEX],
-                                     &sExtData);
-
-} /* end AntTickExtended() */
+  return(u8Slot);
+  
+} /* end AntScanTableLookup() */
 
 
 /*-----------------------------------------------------------------------------/
-Function: AntQueueExtendedApplicationMessage
+Function: AntScanTableUpdate
 
 Description:
-Creates a new ANT data message structure and adds it to G_sAntApplicationMsgList.
-The Application list used to communicate message information between the ANT driver and
-the ANT_API simplified interface task.
+Records a received data message in its device's entry, adding the device if it is new.
 
 Requires:
-  - eMessageType_ specifies the type of message
-  - pu8DataSource_ is a pointer to the first element of an array of 8 data bytes
-  - psTargetList_ is a pointer to the list pointer that is being updated
-  - Enough space is available on the heap
+  - psExtData_ was filled by AntParseExtendedData()
+  - pu8Data_ points to the ANT_APPLICATION_MESSAGE_BYTES of payload
 
 Promises:
-  - A new list item in the target linked list is created and inserted at the end
-    of the list.
-  - Returns TRUE if the entry is added successfully.
-  - Returns FALSE if the malloc fails or the list is full.
+  - Returns TRUE if the table is enabled, the message has a channel ID and the device's 
+    entry is updated (last seen time, packet count, payload and RSSI)
+  - Returns FALSE otherwise; Ant_u32ScanDropped is incremented if a new device did not fit
 */
-static bool AntQueueExtendedApplicationMessage(AntApplicationMessageType eMessageType_, 
-                                               u8* pu8DataSource_, 
-                                               AntExtendedDataType* psExtData_)
+static bool AntScanTableUpdate(AntExtendedDataType* psExtData_, u8* pu8Data_)
 {
-  AntApplicationMsgListType *psNewMessage;
-  AntApplicationMsgListType *psListParser;
-  u8 u8MessageCount = 0;
-  u8 au8AddMessageFailMsg[] = "\n\rNo space in AntQueueApplicationMessage\n\r";
+  AntScanDeviceType* psDevice;
+  u8 u8Slot;
   
-  /* Allocate space for the new message - always do maximum message size */
-  psNewMessage = malloc( sizeof(AntApplicationMsgListType) );
-  if (psNewMessage == NULL)
+  if( !Ant_bScanTableEnabled || !(psExtData_->u8Flags & LIB_CONFIG_CHANNEL_ID_FLAG) )
   {
-    DebugPrintf(au8AddMessageFailMsg);
     return(FALSE);
   }
   
-  /* Fill in all the fields of the newly allocated message structure */
-  for(u8 i = 0; i < ANT_APPLICATION_MESSAGE_BYTES; i++)
+  u8Slot = AntScanTableLookup(psExtData_->u16DeviceID, psExtData_->u8DeviceType, psExtData_->u8TransType);
+  psDevice = &Ant_asScanTable[u8Slot];
+  
+  /* A new device takes the empty slot */
+  if(!psDevice->bUsed)
   {
-    psNewMessage->au8MessageData[i] = *(pu8DataSource_ + i);
+    psDevice->bUsed         = TRUE;
+    psDevice->u16DeviceID   = psExtData_->u16DeviceID;
+    psDevice->u8DeviceType  = psExtData_->u8DeviceType;
+    psDevice->u8TransType   = psExtData_->u8TransType;
+    psDevice->u32FirstSeen  = G_u32SystemTime1ms;
+    psDevice->u32Packets    = 0;
+    psDevice->s8RssiAverage = (s8)0xFF;
+    psDevice->bRssiSeeded   = FALSE;
+    Ant_u8ScanDevices++;
   }
   
-  /* Copy basic items */
-  psNewMessage->u32TimeStamp  = G_u32SystemTime1ms;
-  psNewMessage->eMessageType  = eMessageType_;
+  /* A full table returns a slot that belongs to another device */
+  else if( (psDevice->u16DeviceID  != psExtData_->u16DeviceID)  ||
+           (psDevice->u8DeviceType != psExtData_->u8DeviceType) ||
+           (psDevice->u8TransType  != psExtData_->u8TransType) )
+  {
+    Ant_u32ScanDropped++;
+    return(FALSE);
+  }
   
-  /* Copy all extended data fields */
-  psNewMessage->sExtendedData.u8Channel    = psExtData_->u8Channel;
-  psNewMessage->sExtendedData.u16DeviceID  = psExtData_->u16DeviceID;
-  psNewMessage->sExtendedData.u8DeviceType = psExtData_->u8DeviceType;
-  psNewMessage->sExtendedData.u8TransType  = psExtData_->u8TransType;
-  psNewMessage->sExtendedData.u8Flags      = psExtData_->u8Flags;
-  psNewMessage->sExtendedData.s8RSSI       = psExtData_->s8RSSI;
-    
-  psNewMessage->psNextMessage = NULL;
-
-  /* Insert into an empty list */
-  if(G_sAntApplicationMsgList == NULL)
+  psDevice->u8Channel  = psExtData_->u8Channel;
+  psDevice->u32LastSeen = G_u32SystemTime1ms;
+  psDevice->u32Packets++;
+  for(u8 i = 0; i < ANT_APPLICATION_MESSAGE_BYTES; i++)
   {
-    G_sAntApplicationMsgList = psNewMessage;
-    Ant_u32ApplicationMessageCount++;
+    psDevice->au8LastData[i] = pu8Data_[i];
   }
-
-  /* Otherwise traverse the list to find the end where the new message will be inserted */
-  else
+  
+  /* Exponential average of the RSSI in fixed point, started from the first message that carries RSSI 
+  (without the flag s8RSSI is only the 0xFF placeholder) */
+  psDevice->s8RssiLast = psExtData_->s8RSSI;
+  if(psExtData_->u8Flags & LIB_CONFIG_RSSI_FLAG)
   {
-    psListParser = G_sAntApplicationMsgList;
-    while(psListParser->psNextMessage != NULL) 
-    {
-      psListParser = psListParser->psNextMessage;
-      u8MessageCount++;
-    }
-    
-    /* Check for full list */
-    if(u8MessageCount < ANT_APPLICATION_MESSAGE_BUFFER_SIZE)
+    if(psDevice->bRssiSeeded)
     {
-      /* Insert the new message at the end of the list */
-      psListParser->psNextMessage = psNewMessage;
-      Ant_u32ApplicationMessageCount++;
+      psDevice->s16RssiFilter += ( ((s16)psExtData_->s8RSSI << ANT_SCAN_RSSI_SCALE) - psDevice->s16RssiFilter ) 
+                                 >> ANT_SCAN_RSSI_SHIFT;
     }
-    /* Handle a full list */
     else
     {
-      DebugPrintf(au8AddMessageFailMsg);
-      return(FALSE);
+      psDevice->s16RssiFilter = (s16)psExtData_->s8RSSI << ANT_SCAN_RSSI_SCALE;
+      psDevice->bRssiSeeded = TRUE;
     }
+    psDevice->s8RssiAverage = (s8)(psDevice->s16RssiFilter >> ANT_SCAN_RSSI_SCALE);
   }
-    
+  
   return(TRUE);
+  
+} /* end AntScanTableUpdate() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntScanTableRemove
+
+Description:
+Empties a slot of the scanning device table.  Later entries of the same probe run 
+are moved back so lookups never stop early at the new hole.
+
+Requires:
+  - u8Slot_ holds a device
+
+Promises:
+  - The device is removed and every other device is still found by AntScanTableLookup()
+*/
+static void AntScanTableRemove(u8 u8Slot_)
+{
+  u8 u8Next = u8Slot_;
+  u8 u8Home;
+  
+  /* At most one lap: a full table has no empty slot to end the run */
+  for(u8 i = 0; i < (ANT_SCAN_TABLE_SIZE - 1); i++)
+  {
+    u8Next = (u8Next + 1) & ANT_SCAN_TABLE_MASK;
+    if(!Ant_asScanTable[u8Next].bUsed)
+    {
+      break;
+    }
     
-} /* end AntQueueExtendedApplicationMessage() */
+    /* Entries whose home slot is cyclically in (u8Slot_, u8Next] are already reachable */
+    u8Home = AntScanTableHash(Ant_asScanTable[u8Next].u16DeviceID, 
+                              Ant_asScanTable[u8Next].u8DeviceType, 
+                              Ant_asScanTable[u8Next].u8TransType);
+    if( ((u8Home - u8Slot_ - 1) & ANT_SCAN_TABLE_MASK) < ((u8Next - u8Slot_) & ANT_SCAN_TABLE_MASK) )
+    {
+      continue;
+    }
+    
+    Ant_asScanTable[u8Slot_] = Ant_asScanTable[u8Next];
+    u8Slot_ = u8Next;
+  }
+  
+  Ant_asScanTable[u8Slot_].bUsed = FALSE;
+  Ant_u8ScanDevices--;
+  
+} /* end AntScanTableRemove() */
 
 
 /*-----------------------------------------------------------------------------/
-Function: AntDeQueueOutgoingMessage
+Function: AntScanTableAge
 
 Description:
-Removes the first entry of Ant_psDataOutgoingMsgList.
+Checks one slot of the scanning device table per call and removes the device if it
+has not been heard from for ANT_SCAN_STALE_MS.  The whole table is checked every
+ANT_SCAN_TABLE_SIZE passes.
 
 Requires:
-  - 
+  - Called every pass of AntSM_Idle
 
 Promises:
-  - Ant_psDataOutgoingMsgList = Ant_psDataOutgoingMsgList->psNextMessage 
-  and the memory is freed
+  - A stale device in the checked slot is removed
 */
-static void AntDeQueueOutgoingMessage(void)
+static void AntScanTableAge(void)
 {
-  AntOutgoingMessageListType *psMessageToKill;
+  AntScanDeviceType* psDevice;
   
-  if(Ant_psDataOutgoingMsgList != NULL)
+  if(!Ant_bScanTableEnabled)
   {
-    psMessageToKill = Ant_psDataOutgoingMsgList;
-    Ant_psDataOutgoingMsgList = Ant_psDataOutgoingMsgList->psNextMessage;
+    return;
+  }
   
-    /* The doomed message is properly disconnected, so kill it */
-    free(psMessageToKill);
+  psDevice = &Ant_asScanTable[Ant_u8ScanAgeSlot];
+  if( psDevice->bUsed && IsTimeUp(&psDevice->u32LastSeen, ANT_SCAN_STALE_MS) )
+  {
+    /* Another device may move into this slot, so check it again next time */
+    AntScanTableRemove(Ant_u8ScanAgeSlot);
+    return;
   }
   
-} /* end AntDeQueueOutgoingMessage() */
+  Ant_u8ScanAgeSlot = (Ant_u8ScanAgeSlot + 1) & ANT_SCAN_TABLE_MASK;
+  
+} /* end AntScanTableAge() */
 
 
 /***********************************************************************************************************************
@@ -1623,6 +3215,7 @@ void AntSM_Idle(void)
 {
   u32 u32MsgBitMask = 0x01;
   u8 u8MsgIndex = 0;
+  u32 u32StartCycles;
   static u8 au8AntFlagAlert[] = "ANT flags:\n\r"; 
   
   /* Error messages: must match order of G_u32AntFlags Error / event flags */
@@ -1655,48 +3248,263 @@ void AntSM_Idle(void)
     G_u32AntFlags &= ~ANT_ERROR_FLAGS_MASK;
   }
   
-  /* Process messages received from ANT */
-  AntProcessMessage();
+  /* Process as many received messages as fit in the time budget */
+  u32StartCycles = ANT_DWT_CYCCNT;
+  while( (AntProcessMessage() == 0) && 
+         ((ANT_DWT_CYCCNT - u32StartCycles) < ANT_PROCESS_BUDGET_CYCLES) );
+  
+  /* Top up the outgoing list with the current burst's packets */
+  AntBurstFeed();
+  
+  /* Send or time out reliable messages */
+  AntReliableService();
+  
+  /* Remove devices that have gone quiet */
+  AntScanTableAge();
 
-  /* Handle messages coming in from ANT */
+  /* Handle messages coming in from ANT once there is room for a whole message; until 
+  then ANT holds it because SRDY is not toggled */
   if( IS_SEN_ASSERTED() )
   {
-    Ant_pfnStateMachine = AntSM_ReceiveMessage;
+    if(AntRxBufferFree() >= MESG_MAX_SIZE)
+    {
+      AntRxStart();
+    }
+    else
+    {
+      Ant_u32RxBufferDeferrals++;
+    }
   }
   
   /* Send a message if the system is ready and there is one to send */ 
   else if( (Ant_u32CurrentTxMessageToken == 0 ) && 
            (Ant_psDataOutgoingMsgList != NULL) )
   {
-    /* Give the message to AntTx which will set Ant_u32CurrentTxMessageToken */
-    if(AntTxMessage(Ant_psDataOutgoingMsgList->au8MessageData))
+    /* The message stays at the head of the list until it is sent */
+    AntTxStart(Ant_psDataOutgoingMsgList->au8MessageData);
+  }
+  
+} /* end AntSM_Idle() */
+
+
+/*------------------------------------------------------------------------------
+Wait for the first byte of a message from ANT.  The SSP ISR sets _SSP_RX_COMPLETE 
+when it arrives.  This is also where a transmit ends up if ANT wanted to send at 
+the same time (the byte is already in).
+*/
+void AntSM_RxWaitSync(void)
+{
+  if( !(ANT_SSP_FLAGS & _SSP_RX_COMPLETE) )
+  {
+    if( IsTimeUp(&Ant_u32RxTimer, ANT_SERIAL_TIMEOUT_MS) )
     {
-      Ant_u32TxTimer = G_u32SystemTime1ms;
-      Ant_pfnStateMachine = AntSM_TransmitMessage;
+      AntAbortMessage();
+      DebugPrintf("AntRx: timeout\n\r");
+      Ant_pfnStateMachine = AntSM_Idle;
     }
-    else
+    
+    return;
+  }
+  
+  /* The Rx callback has run but does NOT toggle SRDY for the first byte */
+  ANT_SSP_FLAGS &= ~_SSP_RX_COMPLETE;
+  
+  /* We now have a potential SYNC byte at Ant_pu8AntRxBufferCurrentChar */
+  if(*Ant_pu8AntRxBufferCurrentChar == MESG_TX_SYNC)                     
+  {
+    /* Flag that a reception is in progress so the Rx callback arms the DMA for the frame when 
+    the length byte arrives.  Then cycle SRDY to get the length byte. */
+    G_u32AntFlags |= _ANT_FLAGS_RX_IN_PROGRESS;
+    AntSrdyPulse();
+    
+    Ant_u32RxTimer = G_u32SystemTime1ms;
+    Ant_pfnStateMachine = AntSM_RxWaitFrame;
+  }
+  else
+  {
+    /* Otherwise we have received an unexpected byte -- flag it and abandon the message */
+    Ant_u32UnexpectedByteCounter++;
+    AntRxError();
+  }
+  
+} /* end AntSM_RxWaitSync() */
+
+
+/*------------------------------------------------------------------------------
+Wait for the rest of the frame.  The SSP finishes the frame with one interrupt and 
+we know it is all in when SEN is deasserted.  Reception is very fast and should complete
+in less than 600us for a 15-byte message.
+*/
+void AntSM_RxWaitFrame(void)
+{
+  /* A frame too big for the receive buffer was never armed so throw it out now */
+  if(G_u32AntFlags & _ANT_FLAGS_RX_BAD_LENGTH)
+  {
+    G_u32AntFlags &= ~_ANT_FLAGS_RX_BAD_LENGTH;
+    DebugPrintf("\n\rUnexpected ANT message size\n\n\r");
+    AntRxError();
+    return;
+  }
+  
+  if( IS_SEN_ASSERTED() )
+  {
+    if( IsTimeUp(&Ant_u32RxTimer, ANT_SERIAL_TIMEOUT_MS) )
     {
-      /* Transmit attempt failed.  !!!! Do something? */
+      Ant_u32RxTimeoutCounter++;
+      AntRxError();
     }
+    
+    return;
   }
   
-} /* end AntSM_Idle() */
+  /* One way or another, this Rx is done! */
+  G_u32AntFlags &= ~_ANT_FLAGS_RX_IN_PROGRESS;
+  ANT_SSP_FLAGS &= ~_SSP_RX_COMPLETE;
+  
+  AntRxVerifyMessage();
+  Ant_pfnStateMachine = AntSM_Idle;
+
+} /* end AntSM_RxWaitFrame() */
 
 
 /*------------------------------------------------------------------------------
-Completely receive an ANT message.  Reception is very fast and should complete
-in less than 600us for a 15-byte message.  AntRxMessage could just be called from Idle,
-but giving it its own state minimizes the total time and allows for easier future
-updates should they be required.
+A reception failed: toggle SRDY until SEN deasserts to throw out the rest of the
+message.  The SRDY timer keeps pulsing on its own while Ant_bSrdyFlush is set,
+so this state only has to watch for the end.
 */
-void AntSM_ReceiveMessage(void)
+void AntSM_RxFlush(void)
 {
-  Ant_DebugRxMessageCounter++;
-  AntRxMessage();
+  if( !Ant_bSrdyFlush && IS_SEN_ASSERTED() )
+  {
+    Ant_bSrdyFlush = TRUE;
+    AntSrdyPulse();
+  }
+  
+  if( IS_SEN_ASSERTED() && !IsTimeUp(&Ant_u32RxTimer, ANT_SERIAL_TIMEOUT_MS) )
+  {
+    return;
+  }
+  
+  Ant_bSrdyFlush = FALSE;
+  
+  /* Since we have flow control, we can safely assume that no other messages
+  have come in and Ant_pu8AntRxBufferNextChar is pointing to where the next 
+  valid message WILL come in - so push all the pointers there. */
+  Ant_pu8AntRxBufferCurrentChar = Ant_pu8AntRxBufferNextChar;
+  Ant_pu8AntRxBufferUnreadMsg = Ant_pu8AntRxBufferNextChar;
+  ANT_SSP_FLAGS &= ~(_SSP_TX_COMPLETE | _SSP_RX_COMPLETE);
   
   Ant_pfnStateMachine = AntSM_Idle;
+  
+} /* end AntSM_RxFlush() */
+
+
+/*------------------------------------------------------------------------------
+MRDY is asserted: wait for ANT to acknowledge with SEN, then clock in the byte
+that says whether we may transmit.
+*/
+void AntSM_TxWaitSen(void)
+{
+  if( IS_SEN_ASSERTED() )
+  {
+    /* Queue to read 1 byte after a short delay before toggling SRDY.  If ANT is sending 
+    a message instead, this is its SYNC byte so start the receive byte count here. */
+    if(AntRxBufferFree() < MESG_MAX_SIZE)
+    {
+      Ant_u32RxBufferOverflows++;
+    }
+    Ant_u32RxFrameStartCount = Ant_u32RxByteCounter;
+    AntSrdyPulse();
+    
+    Ant_u32TxTimer = G_u32SystemTime1ms;
+    Ant_pfnStateMachine = AntSM_TxWaitSync;
+  }
+  
+  /* If we timed out, then clear MRDY and let Idle try again */
+  else if( IsTimeUp(&Ant_u32TxTimer, ANT_SERIAL_TIMEOUT_MS) )
+  {
+    SYNC_MRDY_DEASSERT();                          
+    DebugPrintf("AntTx: SEN timeout\n\r");
+    Ant_pfnStateMachine = AntSM_Idle;
+  }
+  
+} /* end AntSM_TxWaitSen() */
+
+
+/*------------------------------------------------------------------------------
+Wait for the byte from ANT.  We must look at it to determine if ANT initiated this 
+particular communication and is telling us that a message is coming in, or if we 
+initiated the communication and ANT is allowing us to transmit.
+*/
+void AntSM_TxWaitSync(void)
+{
+  u8 u8Byte;
+  u32 u32Length;
+  
+  if( !(ANT_SSP_FLAGS & _SSP_RX_COMPLETE) )
+  {
+    /* If we timed out, then clear MRDY and exit.  Because CS is still asserted, Idle 
+    will attempt to read a message but fail and flush it. */
+    if( IsTimeUp(&Ant_u32TxTimer, ANT_SERIAL_TIMEOUT_MS) )
+    {
+      SYNC_MRDY_DEASSERT();                          
+      DebugPrintf("AntTx: SEN timeout\n\r");
+      Ant_pfnStateMachine = AntSM_Idle;
+    }
+    
+    return;
+  }
+  
+  /* Ok to deassert MRDY now */
+  SYNC_MRDY_DEASSERT();                     
+
+  /* Read the byte - don't advance the pointer yet */
+  u8Byte = *Ant_pu8AntRxBufferCurrentChar;                       
+
+  /* If the byte is TX_SYNC, then ANT wants to send a message which must be done first.
+  _SSP_RX_COMPLETE stays set so the receive picks up the byte right away. */
+  if (u8Byte == MESG_TX_SYNC)                     
+  {
+    Ant_u32RxTimer = G_u32SystemTime1ms;
+    Ant_pfnStateMachine = AntSM_RxWaitSync;
+    return;
+  }
 
-} /* end AntSM_ReceiveMessage() */
+  /* Since the Rx byte is in our Rx buffer, advance both pointers since it's not an incoming message */
+  AdvanceAntRxBufferCurrentChar();
+  AdvanceAntRxBufferUnreadMsgPointer();
+  ANT_SSP_FLAGS &= ~_SSP_RX_COMPLETE;
+  Ant_pfnStateMachine = AntSM_Idle;
+  
+  /* If the byte is RX_SYNC, then proceed to send the message */
+  if (u8Byte == MESG_RX_SYNC)                     
+  {
+    /* Flag that a transmit is in progress */
+    G_u32AntFlags |= _ANT_FLAGS_TX_IN_PROGRESS;
+    
+    /* Read the message length and add three for the length, message ID and checksum */
+    u32Length = (u32)(Ant_pu8TxMessage[0] + 3); 
+    
+    /* Queue the message to the peripheral and capture the token */ 
+    Ant_u32CurrentTxMessageToken = SspWriteData(Ant_Ssp, u32Length, Ant_pu8TxMessage);
+    if(Ant_u32CurrentTxMessageToken != 0)
+    {
+      Ant_u32TxTimer = G_u32SystemTime1ms;
+      Ant_pfnStateMachine = AntSM_TransmitMessage;
+    }
+    else
+    {
+      G_u32AntFlags &= ~_ANT_FLAGS_TX_IN_PROGRESS;
+      DebugPrintf("AntTx: No token\n\r");
+    }
+  }
+  else
+  {
+    /* If we get here, not a sync byte */
+    DebugPrintf("AntTx: No SYNC\n\r");
+  }
+  
+} /* end AntSM_TxWaitSync() */
 
 
 /*------------------------------------------------------------------------------
@@ -1706,7 +3514,6 @@ and underway.
 */
 void AntSM_TransmitMessage(void)
 {
-  static u8 au8TxTimeoutMsg[] = "\n\rTransmit message timeout\n\r";
   MessageStateType eCurrentMsgStatus;
   
   eCurrentMsgStatus = QueryMessageStatus(Ant_u32CurrentTxMessageToken);
@@ -1722,23 +3529,9 @@ void AntSM_TransmitMessage(void)
       G_u32AntFlags &= ~_ANT_FLAGS_TX_IN_PROGRESS;
 
       /* Wait for SEN to deassert so we know ANT is totally ready for the next
-      transaction.  This takes about 170us, so block in this state until that's over */
-      while ( IS_SEN_ASSERTED() && (Ant_u32TxTimer < ANT_ACTIVITY_TIME_COUNT) )
-      {
-        Ant_u32TxTimer++;
-      }
-
-      /* If we timed out, then ANT is stuck so print error and unstick ANT */
-      if(Ant_u32RxTimer > ANT_ACTIVITY_TIME_COUNT)
-      {
-        DebugPrintf(au8TxTimeoutMsg);
-        while( IS_SEN_ASSERTED() )
-        {
-          AntSrdyPulse();
-        }
-      }
-      
-      Ant_pfnStateMachine = AntSM_Idle;
+      transaction.  This takes about 170us. */
+      Ant_u32TxTimer = G_u32SystemTime1ms;
+      Ant_pfnStateMachine = AntSM_TxWaitRelease;
       break;
       
     default:
@@ -1750,6 +3543,27 @@ void AntSM_TransmitMessage(void)
 } /* end AntSM_TransmitMessage() */
 
 
+/*------------------------------------------------------------------------------
+The message is sent: wait for ANT to release SEN before anything else starts.
+*/
+void AntSM_TxWaitRelease(void)
+{
+  if( !IS_SEN_ASSERTED() )
+  {
+    Ant_pfnStateMachine = AntSM_Idle;
+  }
+  
+  /* If we timed out, then ANT is stuck so print error and unstick ANT */
+  else if( IsTimeUp(&Ant_u32TxTimer, ANT_SERIAL_TIMEOUT_MS) )
+  {
+    DebugPrintf("\n\rTransmit message timeout\n\r");
+    Ant_u32RxTimer = G_u32SystemTime1ms;
+    Ant_pfnStateMachine = AntSM_RxFlush;
+  }
+  
+} /* end AntSM_TxWaitRelease() */
+
+
 /*------------------------------------------------------------------------------
 Do-nothing state if ANT is dead (requires restart to retry initialization)
 */
@@ -23,13 +23,52 @@ Search "####" for ANT Channel ID defaults
 #define ANT_MAX_ACTIVITY_TIME     (u32)500      /* Target time in microseconds for max time to allow the ANT task to do something */
 #define MICRO_PER_SECOND          (u32)1000000  /* Microseconds per second */
 #define ANT_ACTIVITY_TIME_COUNT   (u32)10000    /* Value used in a while loop that is waiting for an activity to be completed */
-#define ANT_SRDY_DELAY            (u32)200      /* A loop-kill delay to provide guaranteed minimum space for SRDY messages */
-#define ANT_SRDY_PERIOD           (u32)20       /* A loop-kill delay to stretch the SRDY pulse out */
+#define ANT_SRDY_TIMER            TIMER_CHANNEL2 /* One-shot timer channel that times the SRDY pulses */
+#define ANT_SRDY_DELAY_TICKS      (u16)400      /* Timer ticks (41.7ns) of guaranteed minimum space before each SRDY pulse (~16.7us) */
+#define ANT_SRDY_PERIOD_TICKS     (u16)40       /* Timer ticks (41.7ns) SRDY is held asserted (~1.7us) */
 
 #define ANT_TX_TIMEOUT            (u32)100      /* Time in ms max to wait for Tx to ANT */
+#define ANT_SERIAL_TIMEOUT_MS     (u32)5        /* Time in ms max for any one step of a message exchange with ANT */
+#define ANT_RESPONSE_BUFFER_SIZE  (u8)16        /* Channel responses kept for AntReadResponse() (oldest dropped when full) */
+#define ANT_PROCESS_BUDGET_US     (u32)200      /* Max time in us for each AntSM_Idle pass to process received messages */
+#define ANT_PROCESS_BUDGET_CYCLES (u32)(ANT_PROCESS_BUDGET_US * (u32)(CCLK_VALUE / 1000000))
+
+/* Cortex-M3 DWT cycle counter used to time message processing */
+#define ANT_DWT_CTRL              (*(volatile u32*)0xE0001000)
+#define ANT_DWT_CYCCNT            (*(volatile u32*)0xE0001004)
+#define ANT_DWT_CTRL_CYCCNTENA    (u32)0x00000001
 
 #define ANT_APPLICATION_MESSAGE_BYTES       (u8)8
 
+/* Burst transfers */
+#define ANT_BURST_RX_BUFFER_SIZE  (u16)512      /* Reassembly space for one received burst (multiple of 8) */
+#define ANT_BURST_TX_QUEUE_DEPTH  (u8)4         /* Burst packets kept waiting on the outgoing list */
+#define ANT_BURST_TIMEOUT_MS      (u32)2000     /* Max time without progress before a burst is failed */
+#define ANT_BURST_SEQUENCE_BITS   (u8)0x60      /* Packet sequence bits in the channel byte (0 = first packet) */
+#define ANT_BURST_LAST_PACKET     (u8)0x80      /* Channel byte bit set on the last packet of a burst */
+
+/* Reliable (acknowledged with retries) transmit */
+#define ANT_RELIABLE_WINDOW       (u8)4         /* Reliable messages queued or in flight per channel (max 16) */
+#define ANT_RELIABLE_RETRIES_DEFAULT (u8)3      /* Retransmits after EVENT_TRANSFER_TX_FAILED before a message fails */
+#define ANT_RELIABLE_ATTEMPT_TIMEOUT_MS (u32)2500 /* Max wait for the result of one attempt (longer than any channel period) */
+#define ANT_RELIABLE_NO_HANDLE    (u16)0xFFFF   /* Returned by AntQueueReliableMessage() when the window is full */
+
+/* Scanning device table */
+#define ANT_SCAN_TABLE_SIZE       (u8)32        /* Devices tracked (power of 2) */
+#define ANT_SCAN_TABLE_MASK       (u8)(ANT_SCAN_TABLE_SIZE - 1)
+#define ANT_SCAN_STALE_MS         (u32)10000    /* A device not heard from for this long is removed */
+#define ANT_SCAN_RSSI_SHIFT       (u8)3         /* Smoothed RSSI moves 1/8 of the way to each new reading */
+#define ANT_SCAN_RSSI_SCALE       (u8)4         /* Fraction bits kept in s16RssiFilter */
+
+/* Application message subscribers */
+#define ANT_SUBSCRIBERS           (u8)4         /* Max applications with their own message queue */
+#define ANT_SUBSCRIBER_QUEUE_DEPTH (u32)8       /* Max messages waiting on one subscriber queue */
+#define ANT_NO_SUBSCRIBER         (u8)0xFF      /* Returned by AntSubscribe() when no subscriber is free */
+#define ANT_SUBSCRIBE_DATA        (u8)0x01      /* u8MessageTypes_ bit: ANT_DATA messages */
+#define ANT_SUBSCRIBE_TICK        (u8)0x02      /* u8MessageTypes_ bit: ANT_TICK messages */
+#define ANT_SUBSCRIBE_ALL_CHANNELS (u8)0xFF     /* u8ChannelMask_ with every channel bit set */
+#define ANT_SUBSCRIBE_ANY_DEVICE  (u16)0x0000   /* u16DeviceID_ that accepts data from any device */
+
 /* Network number */
 #define ANT_NETWORK_NUMBER_BYTES  (u8)8
 #define ANT_DEFAULT_NETWORK_KEY   (u8)0
@@ -61,6 +100,9 @@ Search "####" for ANT Channel ID defaults
 typedef enum {ANT_UNCONFIGURED = 0, ANT_CONFIGURED = 1, ANT_OPENING = 2, 
               ANT_OPEN = 3, ANT_CLOSING = 4, ANT_CLOSED = 1} AntChannelStatusType;
 typedef enum {ANT_EMPTY, ANT_DATA, ANT_TICK} AntApplicationMessageType;
+typedef enum {ANT_BURST_IDLE, ANT_BURST_BUSY, ANT_BURST_COMPLETE, ANT_BURST_FAILED} AntBurstStatusType;
+typedef enum {ANT_RELIABLE_UNKNOWN, ANT_RELIABLE_QUEUED, ANT_RELIABLE_SENDING, 
+              ANT_RELIABLE_DELIVERED, ANT_RELIABLE_FAILED} AntReliableStatusType;
 typedef enum {ANT_GENERIC_MSG_READY, ANT_GENERIC_MSG_BUSY, ANT_GENERIC_MSG_OK, ANT_GENERIC_MSG_FAIL} AntApplicationGenericMsgStatus;
 typedef enum {ANT_CHANNEL_0 = 0, ANT_CHANNEL_1, ANT_CHANNEL_2, ANT_CHANNEL_3,
               ANT_CHANNEL_4, ANT_CHANNEL_5, ANT_CHANNEL_6, ANT_CHANNEL_7,
@@ -88,6 +130,59 @@ typedef struct
   void *psNextMessage;                               /* Pointer to AntDataMessageStructType */
 } AntApplicationMsgListType;
 
+/* One acknowledged message in a channel's reliable window */
+typedef struct
+{
+  AntReliableStatusType eStatus;                     /* Where the message is in its delivery */
+  u8 u8Generation;                                   /* Bumped each time the slot is reused (part of the handle) */
+  u8 u8Attempts;                                     /* Times the message has been given to ANT */
+  u8 au8Data[ANT_APPLICATION_MESSAGE_BYTES];         /* Message payload */
+} AntReliableMessageType;
+
+/* One device in the scanning device table */
+typedef struct
+{
+  bool bUsed;                                        /* TRUE if the slot holds a device */
+  u8 u8DeviceType;                                   /* Device type (key) */
+  u16 u16DeviceID;                                   /* Device ID (key) */
+  u8 u8TransType;                                    /* Transmission type (key) */
+  u8 u8Channel;                                      /* Channel the device was last heard on */
+  s8 s8RssiLast;                                     /* Most recent RSSI (0xFF if RSSI extended data is off) */
+  s8 s8RssiAverage;                                  /* Smoothed RSSI (0xFF until a message carries RSSI) */
+  s16 s16RssiFilter;                                 /* Smoothed RSSI with ANT_SCAN_RSSI_SCALE fraction bits */
+  bool bRssiSeeded;                                  /* TRUE once s16RssiFilter holds a real reading */
+  u8 au8LastData[ANT_APPLICATION_MESSAGE_BYTES];     /* Payload of the latest message */
+  u32 u32FirstSeen;                                  /* G_u32SystemTime1ms of the first message */
+  u32 u32LastSeen;                                   /* G_u32SystemTime1ms of the latest message */
+  u32 u32Packets;                                    /* Messages received from the device */
+} AntScanDeviceType;
+
+/* Reliable window of one channel: a FIFO of slots whose head is the message in flight */
+typedef struct
+{
+  AntReliableMessageType asWindow[ANT_RELIABLE_WINDOW]; /* Message slots */
+  u8 u8Head;                                         /* Slot of the oldest unfinished message */
+  u8 u8Count;                                        /* Unfinished messages */
+  u8 u8Retries;                                      /* Retransmits allowed per message */
+  bool bInFlight;                                    /* TRUE while ANT has the head message */
+  u32 u32AttemptTime;                                /* G_u32SystemTime1ms when the head message was queued to ANT */
+  u32 u32Delivered;                                  /* Messages acknowledged */
+  u32 u32Failed;                                     /* Messages that used up their retries */
+  u32 u32Attempts;                                   /* Transmissions including retries */
+} AntReliableChannelType;
+
+typedef struct
+{
+  bool bActive;                                      /* TRUE while the subscriber is in use */
+  u8 u8ChannelMask;                                  /* Bit n set to accept messages from channel n */
+  u8 u8MessageTypes;                                 /* ANT_SUBSCRIBE_DATA and / or ANT_SUBSCRIBE_TICK */
+  u16 u16DeviceID;                                   /* Device ID required on ANT_DATA (ANT_SUBSCRIBE_ANY_DEVICE for all) */
+  AntApplicationMsgListType *psHead;                 /* Oldest message for this subscriber */
+  AntApplicationMsgListType *psTail;                 /* Newest message for this subscriber */
+  u32 u32Count;                                      /* Messages on the queue */
+  u32 u32Overflows;                                  /* Messages dropped because the queue or pool was full */
+} AntSubscriberType;
+
 #if 0
 typedef struct 
 {
@@ -176,7 +271,8 @@ typedef struct
 #define _ANT_FLAGS_FIRST_BYTE             (u32)0x02000000        /* The first byte in an ANT transmission is coming in */
 #define _ANT_FLAGS_RX_IN_PROGRESS         (u32)0x04000000        /* Set when an ANT frame reception starts */
 #define _ANT_FLAGS_TX_IN_PROGRESS         (u32)0x08000000        /* Set when an ANT frame transmission starts */
-#define _ANT_FLAGS_TX_INTERRUPTED         (u32)0x10000000        /* An attempt to transmit was interrupted */
+#define _ANT_FLAGS_RX_FRAME_ARMED         (u32)0x20000000        /* The body of the incoming frame is being received by DMA */
+#define _ANT_FLAGS_RX_BAD_LENGTH          (u32)0x40000000        /* The LENGTH byte of the incoming frame is too big */
 /* end G_u32AntFlags */
 
 
@@ -186,6 +282,7 @@ typedef struct
 #define _ANT_FLAGS_CHANNEL_OPEN           (u8)0x04               /* Set when the ANT channel is open */
 #define _ANT_FLAGS_CHANNEL_CLOSE_PENDING  (u8)0x08               /* Set when a request to close the ANT channel has been sent */
 #define _ANT_FLAGS_GOT_ACK                (u8)0x10               /* Set when an Acked data message gets acked */
+#define _ANT_FLAGS_CHANNEL_ASSIGN_PENDING (u8)0x20               /* Set while the channel's configuration commands are outstanding */
 
 
 
@@ -232,13 +329,41 @@ typedef struct
 /* ANT Private Serial-layer Functions */
 static void AntSyncSerialInitialize(void);
 static void AntSrdyPulse(void);
+static void AntSrdyTimerCallback(void);
 static void AntRxMessage(void);
+static void AntRxStart(void);
+static void AntRxVerifyMessage(void);
+static void AntRxError(void);
+static bool AntTxStart(u8 *pu8AntTxMessage_);
+static u16 AntRxBufferFree(void);
 static void AntAbortMessage(void);
 static void AdvanceAntRxBufferCurrentChar(void);
 static void AdvanceAntRxBufferUnreadMsgPointer(void);
 static bool AntParseExtendedData(u8* pu8SourceMessage, AntExtendedDataType* psExtDataTarget_);
 
 
+/* ANT Public Interface-layer Functions */
+bool AntQueueBurstMessage(AntChannelNumberType eChannel_, u8* pu8Data_, u16 u16Length_);
+AntBurstStatusType AntGetBurstTxStatus(void);
+AntBurstStatusType AntGetBurstRxStatus(void);
+u16 AntReadBurstMessage(u8* pu8Target_, u16 u16Size_, u8* pu8Channel_);
+u32 AntGetBurstTxRate(void);
+u32 AntGetBurstRxRate(void);
+u16 AntQueueReliableMessage(AntChannelNumberType eChannel_, u8* pu8Data_);
+AntReliableStatusType AntGetReliableStatus(u16 u16Handle_);
+void AntSetReliableRetries(AntChannelNumberType eChannel_, u8 u8Retries_);
+void AntGetReliableStats(AntChannelNumberType eChannel_, u32* pu32Delivered_, u32* pu32Failed_, u32* pu32Attempts_);
+void AntEnableScanTable(bool bEnable_);
+bool AntGetScanDevice(u8 u8Slot_, AntScanDeviceType* psDevice_);
+bool AntFindScanDevice(u16 u16DeviceID_, u8 u8DeviceType_, u8 u8TransType_, AntScanDeviceType* psDevice_);
+void AntGetScanTableStats(u8* pu8Devices_, u32* pu32Dropped_);
+u8 AntSubscribe(u8 u8ChannelMask_, u8 u8MessageTypes_, u16 u16DeviceID_);
+void AntUnsubscribe(u8 u8Subscriber_);
+AntApplicationMsgListType* AntPeekAppMessage(u8 u8Subscriber_);
+void AntConsumeAppMessage(u8 u8Subscriber_);
+u32 AntGetSubscriberOverflows(u8 u8Subscriber_);
+
+
 /* ANT Protected Interface-layer Functions */
 void AntInitialize(void);
 void AntRunActiveState(void);
@@ -249,6 +374,10 @@ void AntRxFlowControlCallback(void);
 u8 AntCalculateTxChecksum(u8* pu8Message_);
 bool AntQueueOutgoingMessage(u8 *pu8Message_);
 void AntDeQueueApplicationMessage(void);
+void AntGetMessageOverflows(u32* pu32Outgoing_, u32* pu32Application_);
+void AntGetQueueDepths(u32* pu32Outgoing_, u32* pu32Application_);
+bool AntReadResponse(AntMessageResponseType* psResponse_);
+void AntGetRxBufferStats(u32* pu32Overflows_, u32* pu32Deferrals_);
 
 
 /* ANT private Interface-layer Functions */
@@ -259,12 +388,31 @@ static bool AntQueueApplicationMessage(AntApplicationMessageType eMessageType_,
 static void AntTickExtended(u8* pu8AntMessage_);
 static bool AntQueueExtendedApplicationMessage(AntApplicationMessageType eMessageType_, u8* pu8DataSource_, AntExtendedDataType* psExtData_);
 static void AntDeQueueOutgoingMessage(void);
+static void AntInitializeMessagePools(void);
+static void AntReleaseApplicationMessage(AntApplicationMsgListType* psMessage_);
+static AntSubscriberType* AntFindSubscriber(AntApplicationMessageType eMessageType_, AntExtendedDataType* psExtData_);
+static void AntBurstFeed(void);
+static void AntBurstReceive(u8* pu8Message_);
+static void AntBurstTxEnd(AntBurstStatusType eStatus_);
+static u32 AntBurstRate(u16 u16Bytes_, u32 u32StartTime_);
+static void AntReliableService(void);
+static void AntReliableResult(u8 u8Channel_, bool bDelivered_);
+static u8 AntScanTableHash(u16 u16DeviceID_, u8 u8DeviceType_, u8 u8TransType_);
+static u8 AntScanTableLookup(u16 u16DeviceID_, u8 u8DeviceType_, u8 u8TransType_);
+static bool AntScanTableUpdate(AntExtendedDataType* psExtData_, u8* pu8Data_);
+static void AntScanTableRemove(u8 u8Slot_);
+static void AntScanTableAge(void);
 
 
 /* ANT State Machine Definition */
 void AntSM_Idle(void);
-void AntSM_ReceiveMessage(void);
+void AntSM_RxWaitSync(void);
+void AntSM_RxWaitFrame(void);
+void AntSM_RxFlush(void);
+void AntSM_TxWaitSen(void);
+void AntSM_TxWaitSync(void);
 void AntSM_TransmitMessage(void);
+void AntSM_TxWaitRelease(void);
 void AntSM_NoResponse(void);
 
 #endif /* __ANT_H */
\ No newline at end of file
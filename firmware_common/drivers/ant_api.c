@@ -9,8 +9,10 @@ Once the ANT radio has been configured, all messaging from the ANT device is han
 the incoming queue G_sAntApplicationMsgList.  The application is responsible for checking this
 queue for messages that belong to it and must manage timing and handle appropriate updates per 
 the ANT messaging protocol.  This should be no problem on the regular 1ms loop timing of the main 
-system (assuming ANT message rate is less than 1kHz).  Faster systems or burst messaging will need 
-to be handled seperately as an add-on to this API.
+system (assuming ANT message rate is less than 1kHz).  Burst transfers do not use the queue: 
+ant.c packetizes outgoing bursts and reassembles an incoming burst in its own buffer.
+An application can instead subscribe with AntSubscribe() to get only its own channels, message
+types and device on a private queue that it reads in place with AntPeekAppMessage().
 
 
 ------------------------------------------------------------------------------------------------------------------------
@@ -40,6 +42,12 @@ AntChannelStatusType
 AntApplicationMessageType
 {ANT_EMPTY, ANT_DATA, ANT_TICK}
 
+AntBurstStatusType
+{ANT_BURST_IDLE, ANT_BURST_BUSY, ANT_BURST_COMPLETE, ANT_BURST_FAILED}
+
+AntReliableStatusType
+{ANT_RELIABLE_UNKNOWN, ANT_RELIABLE_QUEUED, ANT_RELIABLE_SENDING, ANT_RELIABLE_DELIVERED, ANT_RELIABLE_FAILED}
+
 AntApplicationGenericMsgStatus
 {ANT_GENERIC_MSG_READY, ANT_GENERIC_MSG_BUSY, ANT_GENERIC_MSG_OK, ANT_GENERIC_MSG_FAIL}
 
@@ -47,6 +55,8 @@ Structs
 AntExtendedDataType
 AntApplicationMsgListType
 AntAssignChannelInfoType
+AntSubscriberType (used inside ant.c only)
+AntScanDeviceType
 
 *** ANT CONFIGURATION / STATUS FUNCTIONS ***
 
@@ -63,7 +73,9 @@ eAntCurrentStatus = AntRadioStatusChannel(ANT_CHANNEL_1);
 
 bool AntAssignChannel(AntAssignChannelInfoType* psAntSetupInfo_)
 Updates all configuration messages to completely configure an ANT channel with an application's 
-required parameters for communication.  The application should monitor AntRadioStatusChannel()
+required parameters for communication and queues them all at once.  Several channels may be assigned 
+back to back without waiting; returns FALSE if the outgoing list is too full right now.  
+The application should monitor AntRadioStatusChannel()
 to see if all of the configuration messages are sent and the channel is configured properly.
 e.g.
   AntAssignChannelInfoType sChannelInfo;
@@ -95,6 +107,18 @@ e.g.
   // Go to a wait state that exits when AntRadioStatusChannel(ANT_CHANNEL_0) no longer returns ANT_UNCONFIGURED)
 
 
+bool AntGetAssignFailure(AntChannelNumberType eChannel_, u8* pu8MessageId_, u8* pu8ResponseCode_)
+If an assignment finished without configuring the channel, returns TRUE with the message ID of the first 
+command that failed and ANT's response code (ANT_ASSIGN_NO_RESPONSE if ANT never answered).
+e.g.
+u8 u8FailedMessage, u8FailedCode;
+
+if(AntGetAssignFailure(ANT_CHANNEL_0, &u8FailedMessage, &u8FailedCode))
+{
+  // Report it or fix the channel settings and call AntAssignChannel() again
+}
+
+
 bool AntUnassignChannelNumber(AntChannelNumberType eChannel_)
 Queues message to unassign the specified ANT channel so it can be reconfigured.
 e.g.
@@ -174,6 +198,52 @@ u8 u8DataToSend[ANT_DATA_BYTES] = {0x07, 0x06, 0x05, 0x04, 0x03, 0xdd, 0xee, 0xf
 AntQueueAcknowledgedMessage(ANT_CHANNEL_1, u8DataToSend);
 
 
+u16 AntQueueReliableMessage(AntChannelNumberType eChannel_, u8* pu8Data_)
+Queue an acknowledged data message that ant.c retransmits after each failed attempt, up to the
+channel's retry budget (ANT_RELIABLE_RETRIES_DEFAULT, or set with AntSetReliableRetries()).
+Up to ANT_RELIABLE_WINDOW messages per channel can be waiting; they are delivered in order.  
+Returns a handle for AntGetReliableStatus(), or ANT_RELIABLE_NO_HANDLE if the window is full.
+Don't use AntQueueAcknowledgedMessage() or bursts on the same channel at the same time.
+AntGetReliableStats() gives delivered, failed and attempt counts for measuring the link.
+e.g.
+static u16 u16Handle;
+u8 au8Reading[ANT_DATA_BYTES] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+
+u16Handle = AntQueueReliableMessage(ANT_CHANNEL_1, au8Reading);
+...
+if(AntGetReliableStatus(u16Handle) == ANT_RELIABLE_FAILED)
+{
+  // The reading did not get through even with retries
+}
+
+
+bool AntQueueBurstMessage(AntChannelNumberType eChannel_, u8* pu8Data_, u16 u16Length_)
+Start a burst transfer of any number of bytes (sent in 8-byte packets, the last one padded with 0).
+The data is read while the burst runs, so leave it alone until AntGetBurstTxStatus() is
+no longer ANT_BURST_BUSY.  AntGetBurstTxRate() then gives the achieved bytes/second.
+e.g.
+static u8 au8Blob[100];
+if(AntGetBurstTxStatus() != ANT_BURST_BUSY)
+{
+  AntQueueBurstMessage(ANT_CHANNEL_1, au8Blob, sizeof(au8Blob));
+}
+
+
+u16 AntReadBurstMessage(u8* pu8Target_, u16 u16Size_, u8* pu8Channel_)
+Incoming bursts are reassembled by ant.c (up to ANT_BURST_RX_BUFFER_SIZE bytes).  When 
+AntGetBurstRxStatus() returns ANT_BURST_COMPLETE, read the burst out to free the buffer for
+the next one.  Returns the burst length (a multiple of 8), or 0 if no burst is waiting.
+e.g.
+u8 au8Burst[ANT_BURST_RX_BUFFER_SIZE];
+u8 u8BurstChannel;
+u16 u16BurstLength;
+
+if(AntGetBurstRxStatus() == ANT_BURST_COMPLETE)
+{
+  u16BurstLength = AntReadBurstMessage(au8Burst, sizeof(au8Burst), &u8BurstChannel);
+}
+
+
 bool AntReadAppMessageBuffer(void)
 Check the incoming message buffer for any message from the ANT system (either ANT_TICK or ANT_DATA).  
 If no messages are present, returns FALSE.  If a message is there, returns TRUE and application can read:
@@ -211,6 +281,63 @@ if(AntReadAppMessageBuffer())
 }
 
 
+u8 AntSubscribe(u8 u8ChannelMask_, u8 u8MessageTypes_, u16 u16DeviceID_)
+Gives the application its own queue of the messages that match all of the filters:
+u8ChannelMask_ has bit n set for channel n (ANT_SUBSCRIBE_ALL_CHANNELS for all), u8MessageTypes_ is 
+ANT_SUBSCRIBE_DATA and / or ANT_SUBSCRIBE_TICK, and u16DeviceID_ limits ANT_DATA to one device 
+(needs channel ID extended data) or is ANT_SUBSCRIBE_ANY_DEVICE.  A message goes to the first matching
+subscriber only and never reaches AntReadAppMessageBuffer().  Returns the subscriber number, or 
+ANT_NO_SUBSCRIBER if all ANT_SUBSCRIBERS are taken.  Each queue holds ANT_SUBSCRIBER_QUEUE_DEPTH messages;
+AntGetSubscriberOverflows() counts any that were dropped.  AntUnsubscribe() frees the subscriber.
+e.g.
+static u8 UserApp1_u8AntSubscriber;
+UserApp1_u8AntSubscriber = AntSubscribe(1 << ANT_CHANNEL_1, ANT_SUBSCRIBE_DATA | ANT_SUBSCRIBE_TICK, 
+                                        ANT_SUBSCRIBE_ANY_DEVICE);
+
+
+AntApplicationMsgListType* AntPeekAppMessage(u8 u8Subscriber_)
+void AntConsumeAppMessage(u8 u8Subscriber_)
+Read a subscriber's messages in place, oldest first.  AntPeekAppMessage() returns NULL if the 
+queue is empty.  The message stays valid until AntConsumeAppMessage() removes it.
+e.g.
+AntApplicationMsgListType* psAntMessage;
+
+while( (psAntMessage = AntPeekAppMessage(UserApp1_u8AntSubscriber)) != NULL )
+{
+  if(psAntMessage->eMessageType == ANT_DATA)
+  {
+    UserApp1HandleData(psAntMessage->au8MessageData, psAntMessage->sExtendedData.s8RSSI);
+  }
+  AntConsumeAppMessage(UserApp1_u8AntSubscriber);
+}
+
+
+void AntEnableScanTable(bool bEnable_)
+For a scanning channel with many devices in range, ant.c can keep one AntScanDeviceType entry per 
+device (device ID, device type and transmission type) instead of queueing every data message.  
+Each entry has the latest payload, packet count, first / last seen times and a smoothed RSSI.  
+Devices not heard for ANT_SCAN_STALE_MS are removed.  While enabled, data messages that are
+recorded in the table only reach a subscriber that matches them; they are not passed to 
+AntReadAppMessageBuffer().  Enabling or disabling empties the table.
+AntFindScanDevice() looks up one device; AntGetScanTableStats() gives the device count and
+the number of messages from new devices that did not fit in the ANT_SCAN_TABLE_SIZE slots.
+e.g.
+AntScanDeviceType sDevice;
+
+AntEnableScanTable(TRUE);
+...
+for(u8 i = 0; i < ANT_SCAN_TABLE_SIZE; i++)
+{
+  if(AntGetScanDevice(i, &sDevice))
+  {
+    DebugPrintNumber(sDevice.u16DeviceID);
+    DebugPrintf(": ");
+    DebugPrintNumber(sDevice.u32Packets);
+    DebugLineFeed();
+  }
+}
+
+
 ***********************************************************************************************************************/
 
 #include "configuration.h"
@@ -271,7 +398,14 @@ Global variable definitions with scope limited to this local application.
 Variable names shall start with "AntApi_<type>Name" and be declared as static.
 ***********************************************************************************************************************/
 static fnCode_type AntApi_StateMachine;             /* The state machine function pointer */
-static u32 AntApi_u32Timeout;                       /* Timeout counter used across states */
+
+/* Channel configuration: every queued command waits here, oldest first, until ANT responds to it */
+static AntApiPendingCommandType AntApi_asPendingCommands[ANT_ASSIGN_PENDING_SIZE];
+static u8 AntApi_u8PendingCommands = 0;                          /* Entries used in AntApi_asPendingCommands */
+static u8 AntApi_au8AssignStepsLeft[ANT_NUM_CHANNELS];           /* Responses still expected for each channel */
+static u32 AntApi_au32AssignTimer[ANT_NUM_CHANNELS];             /* G_u32SystemTime1ms when each assignment was queued */
+static u8 AntApi_au8AssignFailedId[ANT_NUM_CHANNELS];            /* Message ID of the first failed step (0 if none) */
+static u8 AntApi_au8AssignFailedCode[ANT_NUM_CHANNELS];          /* Response code of the first failed step */
 
 /* Message for channel assignment.  Set ANT_ASSIGN_MESSAGES for number of messages. */
 static u8* AntApi_apu8AntAssignChannel[] = {G_au8AntSetNetworkKey, G_au8AntLibConfig, G_au8AntAssignChannel, G_au8AntSetChannelID, 
@@ -290,29 +424,43 @@ Function Definitions
 Function: AntAssignChannel
 Description:
 Updates all configuration messages to completely configure an ANT channel with an application's 
-required parameters for communication.  The ANT API state machine then sends and monitors the commands
-to ensure the requested channel is setup properly.  The application should monitor AntRadioStatusChannel()
-to see if the channel is configured properly.
+required parameters for communication and queues all of them at once.  The ANT API state machine then 
+matches ANT's responses to the commands, so several channels can be configured at the same time.  
+The application should monitor AntRadioStatusChannel() to see if the channel is configured properly
+and can use AntGetAssignFailure() to find out which step failed if it is not.
 
 Requires:
   - psAntSetupInfo_ points to a complete AntAssignChannelInfoType with all the required channel information.
   - The ANT channel should not be currently assigned.
 
 Promises:
-  - Channel, Channel ID, message period, radio frequency and radio power are configured.
-  - Returns TRUE if the channel is ready to be set up; all global setup messages are updated with the values
+  - Channel, Channel ID, message period, radio frequency and radio power commands are queued.
+  - Returns TRUE if the commands are queued; all global setup messages are updated with the values
     from psAntSetupInfo; 
-  - Returns FALSE if the channel is already configured
+  - Returns FALSE if the channel is already configured or being configured, or if the outgoing
+    list does not have room for all of the commands (try again later)
 */
 bool AntAssignChannel(AntAssignChannelInfoType* psAntSetupInfo_)
 {
+  u8 u8Channel;
+  u32 u32OutgoingDepth, u32ApplicationDepth;
+  
   /* Check to ensure the selected channel is available */
-  if(AntRadioStatusChannel(psAntSetupInfo_->AntChannel) != ANT_UNCONFIGURED)
+  u8Channel = psAntSetupInfo_->AntChannel;
+  if( (AntRadioStatusChannel(psAntSetupInfo_->AntChannel) != ANT_UNCONFIGURED) ||
+      (G_asAntChannelConfiguration[u8Channel].AntFlags & _ANT_FLAGS_CHANNEL_ASSIGN_PENDING) )
   {
     DebugPrintf("AntAssignChannel error: channel is not unconfigured\n\r");
     return FALSE;
   }
   
+  /* All of the commands go out together so make sure they fit */
+  AntGetQueueDepths(&u32OutgoingDepth, &u32ApplicationDepth);
+  if( (ANT_OUTGOING_MESSAGE_BUFFER_SIZE - u32OutgoingDepth) < ANT_ASSIGN_MESSAGES )
+  {
+    return FALSE;
+  }
+  
   /* Setup the library config message (for extended data) - use defaults for now */
   G_au8AntLibConfig[4] = AntCalculateTxChecksum(G_au8AntLibConfig);
 
@@ -375,9 +523,21 @@ bool AntAssignChannel(AntAssignChannelInfoType* psAntSetupInfo_)
 
   G_au8AntSetChannelPower[4] = AntCalculateTxChecksum(G_au8AntSetChannelPower);
      
-  /* Set the next state to begin transferring */
-  AntApi_u32Timeout = G_u32SystemTime1ms;
-  AntApi_StateMachine = AntApiSM_AssignChannel;
+  /* Queue every command and note the response each one should get */
+  for(u8 i = 0; i < ANT_ASSIGN_MESSAGES; i++)
+  {
+    AntApi_asPendingCommands[AntApi_u8PendingCommands].u8MessageId = AntApi_apu8AntAssignChannel[i][BUFFER_INDEX_MESG_ID];
+    AntApi_asPendingCommands[AntApi_u8PendingCommands].u8Channel   = AntApi_apu8AntAssignChannel[i][BUFFER_INDEX_CHANNEL_NUM];
+    AntApi_asPendingCommands[AntApi_u8PendingCommands].u8Owner     = u8Channel;
+    AntApi_u8PendingCommands++;
+    AntQueueOutgoingMessage(AntApi_apu8AntAssignChannel[i]);
+  }
+  
+  AntApi_au8AssignStepsLeft[u8Channel]  = ANT_ASSIGN_MESSAGES;
+  AntApi_au32AssignTimer[u8Channel]     = G_u32SystemTime1ms;
+  AntApi_au8AssignFailedId[u8Channel]   = 0;
+  AntApi_au8AssignFailedCode[u8Channel] = RESPONSE_NO_ERROR;
+  G_asAntChannelConfiguration[u8Channel].AntFlags |= _ANT_FLAGS_CHANNEL_ASSIGN_PENDING;
   return TRUE;
 
 } /* end AntAssignChannel() */
@@ -618,7 +778,8 @@ Function: AntReadAppMessageBuffer
 
 Description:
 Checks for any new messages from ANT.  New messages are buffered by ant.c and 
-made available to the application on a FIFO basis.  Whenever this function
+made available to the application on a FIFO basis.  Messages taken by a subscriber
+(see AntSubscribe()) are not seen here.  Whenever this function
 is called, the global parameters are updated:
 G_u32AntApiCurrentMessageTimeStamp
 G_eAntApiCurrentMessageClass
@@ -678,6 +839,35 @@ bool AntReadAppMessageBuffer(void)
 } /* end AntReadAppMessageBuffer() */
 
 
+/*-----------------------------------------------------------------------------/
+Function: AntGetAssignFailure
+
+Description:
+Reports which configuration step failed in the last AntAssignChannel() for a channel.
+
+Requires:
+  - The pointers are valid
+
+Promises:
+  - Returns TRUE if the last assignment failed: *pu8MessageId_ is the message ID of the first
+    failed command and *pu8ResponseCode_ is ANT's response code (ANT_ASSIGN_NO_RESPONSE if it timed out)
+  - Returns FALSE if the last assignment succeeded or is still in progress
+*/
+bool AntGetAssignFailure(AntChannelNumberType eChannel_, u8* pu8MessageId_, u8* pu8ResponseCode_)
+{
+  if( (G_asAntChannelConfiguration[eChannel_].AntFlags & _ANT_FLAGS_CHANNEL_ASSIGN_PENDING) ||
+      (AntApi_au8AssignFailedId[eChannel_] == 0) )
+  {
+    return FALSE;
+  }
+  
+  *pu8MessageId_    = AntApi_au8AssignFailedId[eChannel_];
+  *pu8ResponseCode_ = AntApi_au8AssignFailedCode[eChannel_];
+  return TRUE;
+  
+} /* end AntGetAssignFailure() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Protected functions                                                                                                */
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -732,81 +922,175 @@ void AntApiRunActiveState(void)
 } /* end AntApiRunActiveState */
 
 
-/**********************************************************************************************************************
-State Machine Function Definitions
-**********************************************************************************************************************/
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Private functions                                                                                                  */
+/*--------------------------------------------------------------------------------------------------------------------*/
 
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Wait for a message to be queued */
-static void AntApiSM_Idle(void)
-{
-  /* Monitor requests to send generic ANT messages */
-  
-} /* end AntApiSM_Idle() */
-     
+/*-----------------------------------------------------------------------------/
+Function: AntApiAssignResponse
 
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Send all configuration messages to ANT to fully assign the channel.
-The selected channel has already been verified unconfigured, and all required setup
-messages are ready to go.  */
-static void  AntApiSM_AssignChannel(void)          
+Description:
+Matches a response from ANT to the oldest pending configuration command with the same
+message ID and channel byte.  ANT answers commands in order, so this is the command
+the response belongs to even when several channels are being configured.
+
+Requires:
+  - psResponse_ points to a response read with AntReadResponse()
+
+Promises:
+  - The matching command (if any) is removed and its channel's step count goes down
+  - A failed step is recorded for AntGetAssignFailure()
+  - The channel's assignment is finished when its last response arrives
+*/
+static void AntApiAssignResponse(AntMessageResponseType* psResponse_)
 {
-  static u8 u8CurrentMessageToSend = 0;
-  static u8 u8CurrentMesssageId = 0;
-  static bool bMessageInProgress = FALSE;
+  u8 u8Owner;
   
-  /* Queue the next message if it's time */
-  if(bMessageInProgress == FALSE)
+  for(u8 i = 0; i < AntApi_u8PendingCommands; i++)
   {
-    u8CurrentMesssageId = *(AntApi_apu8AntAssignChannel[u8CurrentMessageToSend] + BUFFER_INDEX_MESG_ID); 
-    AntQueueOutgoingMessage(AntApi_apu8AntAssignChannel[u8CurrentMessageToSend]);
-    bMessageInProgress = TRUE;
+    if( (AntApi_asPendingCommands[i].u8MessageId == psResponse_->u8MessageNumber) &&
+        (AntApi_asPendingCommands[i].u8Channel == psResponse_->u8Channel) )
+    {
+      u8Owner = AntApi_asPendingCommands[i].u8Owner;
+      
+      /* Close the gap to keep the commands in order */
+      AntApi_u8PendingCommands--;
+      for(u8 j = i; j < AntApi_u8PendingCommands; j++)
+      {
+        AntApi_asPendingCommands[j] = AntApi_asPendingCommands[j + 1];
+      }
+      
+      if( (psResponse_->u8ResponseCode != RESPONSE_NO_ERROR) && (AntApi_au8AssignFailedId[u8Owner] == 0) )
+      {
+        AntApi_au8AssignFailedId[u8Owner]   = psResponse_->u8MessageNumber;
+        AntApi_au8AssignFailedCode[u8Owner] = psResponse_->u8ResponseCode;
+      }
+      
+      AntApi_au8AssignStepsLeft[u8Owner]--;
+      if(AntApi_au8AssignStepsLeft[u8Owner] == 0)
+      {
+        AntApiAssignDone(u8Owner);
+      }
+      
+      return;
+    }
   }
   
-  /* Check message status */
-  if( u8CurrentMesssageId == G_stMessageResponse.u8MessageNumber )
-  { 
-    if(G_stMessageResponse.u8ResponseCode == RESPONSE_NO_ERROR)
+  /* Anything else is a response to a command that is not part of a channel configuration */
+  
+} /* end AntApiAssignResponse() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntApiAssignTimeout
+
+Description:
+Gives up on a channel whose configuration responses did not all arrive in time.
+
+Requires:
+  - u8Channel_ has _ANT_FLAGS_CHANNEL_ASSIGN_PENDING set
+
+Promises:
+  - The channel's pending commands are removed and the first one is reported as the failed step
+  - The channel's assignment is finished
+*/
+static void AntApiAssignTimeout(u8 u8Channel_)
+{
+  u8 u8Kept = 0;
+  
+  for(u8 i = 0; i < AntApi_u8PendingCommands; i++)
+  {
+    if(AntApi_asPendingCommands[i].u8Owner == u8Channel_)
     {
-      /* Increment message pointer and check if complete */
-      u8CurrentMessageToSend++;
-      if(u8CurrentMessageToSend == ANT_ASSIGN_MESSAGES)
+      if(AntApi_au8AssignFailedId[u8Channel_] == 0)
       {
-        /* Print OK message and update the channel flags */
-        G_au8AntMessageAssign[12] = G_stMessageResponse.u8Channel;
-        DebugPrintf(G_au8AntMessageAssign);
-        DebugPrintf(G_au8AntMessageOk);
-        G_asAntChannelConfiguration[G_stMessageResponse.u8Channel].AntFlags |= _ANT_FLAGS_CHANNEL_CONFIGURED;
-
-        /* Clean up and exit this state */
-        u8CurrentMessageToSend = 0;
-        AntApi_StateMachine = AntApiSM_Idle;
+        AntApi_au8AssignFailedId[u8Channel_]   = AntApi_asPendingCommands[i].u8MessageId;
+        AntApi_au8AssignFailedCode[u8Channel_] = ANT_ASSIGN_NO_RESPONSE;
       }
-    } 
+    }
     else
     {
-      /* Report the error and return.  Channel flags will remain clear for application to check. */
-      DebugPrintf(G_au8AntMessageAssign);
-      DebugPrintf(G_au8AntMessageFail);
-      AntApi_StateMachine = AntApiSM_Idle;
+      AntApi_asPendingCommands[u8Kept++] = AntApi_asPendingCommands[i];
     }
+  }
+  
+  AntApi_u8PendingCommands = u8Kept;
+  AntApi_au8AssignStepsLeft[u8Channel_] = 0;
+  AntApiAssignDone(u8Channel_);
+  
+} /* end AntApiAssignTimeout() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: AntApiAssignDone
 
-    /* In either case, clean up the following: */
-    bMessageInProgress = FALSE;
+Description:
+Finishes a channel assignment once all of its commands are answered or it timed out.
 
-  } /* end if( u8CurrentMesssageId == G_stMessageResponse.u8MessageNumber ) */
+Requires:
+  - AntApi_au8AssignFailedId[u8Channel_] is 0 if every step succeeded
+
+Promises:
+  - _ANT_FLAGS_CHANNEL_ASSIGN_PENDING is cleared
+  - _ANT_FLAGS_CHANNEL_CONFIGURED is set if every step succeeded
+  - The result is printed
+*/
+static void AntApiAssignDone(u8 u8Channel_)
+{
+  G_asAntChannelConfiguration[u8Channel_].AntFlags &= ~_ANT_FLAGS_CHANNEL_ASSIGN_PENDING;
+  G_au8AntMessageAssign[12] = u8Channel_ + 0x30;
+  DebugPrintf(G_au8AntMessageAssign);
   
-  /* Check for timeout */
-  if(IsTimeUp(&AntApi_u32Timeout, ANT_ACTIVITY_TIME_COUNT) )
+  if(AntApi_au8AssignFailedId[u8Channel_] == 0)
+  {
+    DebugPrintf(G_au8AntMessageOk);
+    G_asAntChannelConfiguration[u8Channel_].AntFlags |= _ANT_FLAGS_CHANNEL_CONFIGURED;
+  }
+  else
   {
-    /* Report the error and return.  Channel flags will remain clear for application to check. */
-    DebugPrintf(G_au8AntMessageAssign);
+    /* Channel flags will remain clear for application to check. */
     DebugPrintf(G_au8AntMessageFail);
-    AntApi_StateMachine = AntApiSM_Idle;
+    DebugPrintf("Failed step: ");
+    DebugPrintNumber(AntApi_au8AssignFailedId[u8Channel_]);
+    DebugPrintf(" code ");
+    DebugPrintNumber(AntApi_au8AssignFailedCode[u8Channel_]);
+    DebugLineFeed();
   }
   
-} /* end AntApiSM_AssignChannel() */
+} /* end AntApiAssignDone() */
+
 
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for a message to be queued.  Channel configuration commands are all queued by
+AntAssignChannel(), so this state only matches their responses and watches for timeouts. */
+static void AntApiSM_Idle(void)
+{
+  AntMessageResponseType sResponse;
+  
+  /* Match every new response to its configuration command */
+  while( AntReadResponse(&sResponse) )
+  {
+    AntApiAssignResponse(&sResponse);
+  }
+  
+  /* Give up on any channel that has been waiting too long */
+  for(u8 i = 0; i < ANT_NUM_CHANNELS; i++)
+  {
+    if( (G_asAntChannelConfiguration[i].AntFlags & _ANT_FLAGS_CHANNEL_ASSIGN_PENDING) &&
+        IsTimeUp(&AntApi_au32AssignTimer[i], ANT_ASSIGN_TIMEOUT_MS) )
+    {
+      AntApiAssignTimeout(i);
+    }
+  }
+  
+  /* Monitor requests to send generic ANT messages */
+  
+} /* end AntApiSM_Idle() */
+     
 
 #if 0
 /*-------------------------------------------------------------------------------------------------------------------*/
@@ -13,6 +13,9 @@
 Constants
 **********************************************************************************************************************/
 #define ANT_ASSIGN_MESSAGES                 (u8)7    /* Number of messages in AntAssignChannel */       
+#define ANT_ASSIGN_PENDING_SIZE             (u8)(ANT_NUM_CHANNELS * ANT_ASSIGN_MESSAGES) /* Commands awaiting a response */
+#define ANT_ASSIGN_TIMEOUT_MS               (u32)1000 /* Max time for all of a channel's configuration responses */
+#define ANT_ASSIGN_NO_RESPONSE              (u8)0xFF /* Failure code reported when a configuration command got no response */
 
 #define ANT_OUTGOING_MESSAGE_BUFFER_SIZE    (u32)32
 #define ANT_APPLICATION_MESSAGE_BUFFER_SIZE (u32)32
@@ -22,6 +25,14 @@ Constants
 /**********************************************************************************************************************
 Type definitions
 **********************************************************************************************************************/
+/* A channel configuration command that has been queued and is waiting for its response */
+typedef struct
+{
+  u8 u8MessageId;                          /* Message ID of the command (and of its response) */
+  u8 u8Channel;                            /* Channel byte of the command as echoed in the response */
+  u8 u8Owner;                              /* Channel being configured */
+  u8 u8Dummy;                              /* Pad for 4-byte alignment */
+} AntApiPendingCommandType;
 
 
 /**********************************************************************************************************************
@@ -80,6 +91,7 @@ bool AntQueueBroadcastMessage(AntChannelNumberType eChannel_, u8 *pu8Data_);
 bool AntQueueAcknowledgedMessage(AntChannelNumberType eChannel_, u8 *pu8Data_);
 
 bool AntReadAppMessageBuffer(void);
+bool AntGetAssignFailure(AntChannelNumberType eChannel_, u8* pu8MessageId_, u8* pu8ResponseCode_);
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Protected functions                                                                                                */
@@ -90,6 +102,9 @@ void AntApiRunActiveState(void);
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Private functions                                                                                                  */
 /*--------------------------------------------------------------------------------------------------------------------*/
+static void AntApiAssignResponse(AntMessageResponseType* psResponse_);
+static void AntApiAssignTimeout(u8 u8Channel_);
+static void AntApiAssignDone(u8 u8Channel_);
 
 
 
@@ -97,7 +112,6 @@ void AntApiRunActiveState(void);
 State Machine Declarations
 ***********************************************************************************************************************/
 static void AntApiSM_Idle(void);    
-static void  AntApiSM_AssignChannel(void);       
 
 static void AntApiSM_Error(void);         
 static void AntApiSM_FailedInit(void);        
@@ -150,6 +150,7 @@
 #define EVENT_TRANSFER_TX_FAILED                   ((UCHAR)0x06)             
 #define EVENT_CHANNEL_CLOSED                       ((UCHAR)0x07)
 #define EVENT_RX_FAIL_GO_TO_SEARCH                 ((UCHAR)0x08)
+#define EVENT_TRANSFER_TX_START                    ((UCHAR)0x0A)           ///< sent when ANT starts transmitting a burst
 
 #define CHANNEL_IN_WRONG_STATE                     ((UCHAR)0x15)           ///< returned on attempt to perform an action from the wrong channel state
 #define CHANNEL_NOT_OPENED                         ((UCHAR)0x16)           ///< returned on attempt to communicate on a channel that is not open
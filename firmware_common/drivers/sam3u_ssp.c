@@ -9,9 +9,13 @@ the multitude of variants in slave device !CS requirements.
 This driver should work for SPI slaves with or without flow control, though you may need to make adjustments
 to how data is timed.  A slave with flow control requires callback functions to manage flow control lines.
 
-If LSB first transmission is required, we can't use the DMA if we let the SSP task manage the bit flipping.
-For high-traffic or low-power devices, you might consider flipping at the task level so that DMA
-can be used (the bytes would have to be pre-flipped for transmit and post-flipped on receive).
+LSB first transmission is supported on the DMA paths by flipping the buffers inside the driver: 
+transmit messages are pre-flipped in the message pool just before the PDC is loaded and received data is 
+post-flipped in the receive buffer when the transfer completes.  SspReverseBits() does a word at a time 
+(RBIT + REV) so the cost is about one cycle per byte (tools/ssp_bitreverse_bench.c checks and times it on a 
+host against the byte-at-a-time versions).  SPI_SLAVE (no flow control) receive is still MSB first only.
+SPI_SLAVE_FLOW_CONTROL_DMA uses the same bulk pass: the header bytes of a frame are still received 
+one at a time, but the rest of the frame and all transmitted frames move through the PDC with one interrupt per frame.
 
 API:
 SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)  BLADE_SSP
@@ -45,6 +49,30 @@ Creates a dummy byte array to transmit and subsequently receive u32Size_ bytes.
 to see when the message has been sent, and thus when the received data should be in the pre-configured receive buffer.
 e.g. u32CurrentMessageToken = SspReadData(&MyTaskSsp, 10);
 
+bool SspTransferData(SspPeripheralType* psSspPeripheral_, u16 u16Size_, u8* pu8TxData_)
+Like SspReadData() but the u16Size_ bytes clocked out come straight from pu8TxData_ instead of dummies.  Nothing is
+copied into the message pool, so the data must stay unchanged until the transfer completes and large blocks are not
+split into MAX_TX_MESSAGE_LENGTH messages.  The bytes received at the same time land in the receive buffer.  MSB_FIRST only.
+e.g. SspTransferData(MyTaskSsp, sizeof(au8Frame), au8Frame);
+
+bool SspReceiveData(SspPeripheralType* psSspPeripheral_, u16 u16Size_, u8* pu8RxData_, u8* pu8TxData_)
+Like SspTransferData() but the received bytes go straight to pu8RxData_ instead of the receive buffer, so a large
+block can be read into its final place with no copy and no limit from the receive buffer size.  pu8TxData_ supplies
+the u16Size_ bytes clocked out (e.g. a constant array of idle bytes).  MSB_FIRST only.
+e.g. SspReceiveData(MyTaskSsp, 512, au8Block, au8IdleBytes);
+
+If fnMasterRxCallback is set in the configuration, it is called from the ENDRX interrupt each time a read or transfer 
+finishes (the data is at the start of the receive buffer unless SspReceiveData() was used).  Calling SspReadData(),
+SspTransferData() or SspReceiveData() from inside the callback starts the next one immediately from the ISR so a device
+like an SD card can stream without waiting for the state machine.
+
+SPI_SLAVE_FLOW_CONTROL_DMA only:
+bool SspReadFrame(SspPeripheralType* psSspPeripheral_, u16 u16Size_)
+Arms the PDC to receive the next u16Size_ bytes of the current frame directly into the circular receive buffer.
+Call this (usually from the Rx flow control callback) as soon as the frame length is known, then release the
+master with the flow control line.  The Rx callback runs once more when the whole frame has arrived.
+e.g. SspReadFrame(MyTaskSsp, u8LengthByte + 2);
+
 
 INITIALIZATION (should take place in application's initialization function):
 1. Create a variable of SspConfigurationType in your application and initialize it to the desired SSP peripheral,
@@ -91,6 +119,15 @@ is queued, it is sent as soon as possible.  Different SSP resources may transmit
 Per the SPI protocol, a receive byte is always read with every transmit byte.  Your application must process the received bytes
 and determine if they are dummy bytes or useful data.
 
+SLAVE FLOW CONTROL DMA DATA TRANSFER:
+Single bytes are received with the RXRDY interrupt exactly like SPI_SLAVE_FLOW_CONTROL except that the driver
+advances the application's next-byte pointer itself.  After SspReadFrame() the RXRDY interrupt is turned off and 
+the PDC fills the buffer (wrapping at the end with the next pointer/counter registers).  RXBUFF signals the end of 
+the frame: the bytes are bit-reversed in place if required, the next-byte pointer is advanced over the frame, 
+_SSP_RX_COMPLETE is set and the Rx callback is invoked.  Transmit messages are bit-reversed in the message pool 
+and sent with the PDC; the Tx callback runs once when the frame is loaded and once at ENDTX.  The dummy bytes
+clocked in during a transmit are discarded and RXRDY is re-enabled when the master deasserts CS.
+
 
 **********************************************************************************************************************/
 
@@ -140,6 +177,29 @@ static u32 SSP_u32Int2Count = 0;                 /* Debug counter for SSP2 inter
 static u32 SSP_u32AntCounter = 0;                /* Debug counter */
 static u32 SSP_u32RxCounter = 0;                 /* Debug counter */
 
+#ifndef __ICCARM__
+/* Host builds have no RBIT / REV instructions, so bit reversal falls back to a lookup table */
+static const u8 SSP_au8BitReverseTable[256] =
+{
+  0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+  0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+  0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+  0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+  0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+  0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+  0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+  0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+  0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+  0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+  0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+  0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+  0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+  0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+  0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+  0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
+};
+#endif /* __ICCARM__ */
+
 /***********************************************************************************************************************
 Function Definitions
 ***********************************************************************************************************************/
@@ -156,12 +216,14 @@ and the peripheral is made ready to use in the application. The peripheral will
 for different SSP modes.  The following modes are supported:
 SPI_MASTER: transmit and receive using peripheral DMA controller; transmit occurs through the Message API
 SPI_SLAVE: transmit through Message Task; receive set up per-byte using current and next DMA pointers and managed into circular buffer.
-SPI_SLAVE_FLOW_CONTROL:
+SPI_SLAVE_FLOW_CONTROL: transmit and receive byte-by-byte on interrupts with flow control callbacks after each byte.
+SPI_SLAVE_FLOW_CONTROL_DMA: header bytes received byte-by-byte; frame bodies received with SspReadFrame() and all
+transmit frames sent using the PDC with flow control callbacks per frame.
 
 Requires:
   - SSP peripheral register initialization values in configuration.h must be set correctly; currently this does not support
     different SSP configurations for multiple slaves on the same bus - all peripherals on the bus must work with
-    the same setup.
+    the same setup except for the clock: a non-zero psSspConfig_->u32ClockDivider replaces USARTx_US_BRGR_INIT.
   - psSspConfig_ has the SSP peripheral number, address of the RxBuffer and the RxBuffer size
   - the calling application is ready to start using the peripheral
 
@@ -218,6 +280,12 @@ SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)
     }
   } /* end switch */
   
+  /* Each device on the bus may run at its own clock */
+  if(psSspConfig_->u32ClockDivider != 0)
+  {
+    u32TargetBRGR = psSspConfig_->u32ClockDivider;
+  }
+  
   /* If the requested peripheral is already assigned, return NULL now */
   if(psRequestedSsp->u32PrivateFlags & _SSP_PERIPHERAL_ASSIGNED)
   {
@@ -233,6 +301,7 @@ SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)
   psRequestedSsp->eSspMode       = psSspConfig_->eSspMode;
   psRequestedSsp->fnSlaveTxFlowCallback = psSspConfig_->fnSlaveTxFlowCallback;
   psRequestedSsp->fnSlaveRxFlowCallback = psSspConfig_->fnSlaveRxFlowCallback;
+  psRequestedSsp->fnMasterRxCallback    = psSspConfig_->fnMasterRxCallback;
   psRequestedSsp->pu8RxBuffer     = psSspConfig_->pu8RxBufferAddress;
   psRequestedSsp->ppu8RxNextByte  = psSspConfig_->ppu8RxNextByte;
   psRequestedSsp->u16RxBufferSize = psSspConfig_->u16RxBufferSize;
@@ -258,7 +327,8 @@ SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)
     psRequestedSsp->pBaseAddress->US_IER = AT91C_US_CTSIC;
   }
 
-  if(psRequestedSsp->eSspMode == SPI_SLAVE_FLOW_CONTROL)
+  if( (psRequestedSsp->eSspMode == SPI_SLAVE_FLOW_CONTROL) ||
+      (psRequestedSsp->eSspMode == SPI_SLAVE_FLOW_CONTROL_DMA) )
   {
     /* Enable the CS and receiver requests so they are ready to go if the Master starts clocking */
     psRequestedSsp->pBaseAddress->US_IER = (AT91C_US_CTSIC | AT91C_US_RXRDY);
@@ -307,6 +377,9 @@ void SspRelease(SspPeripheralType* psSspPeripheral_)
   psSspPeripheral_->u32PrivateFlags = 0;
   psSspPeripheral_->fnSlaveTxFlowCallback = NULL;
   psSspPeripheral_->fnSlaveRxFlowCallback = NULL;
+  psSspPeripheral_->fnMasterRxCallback    = NULL;
+  psSspPeripheral_->pu8TxSource           = NULL;
+  psSspPeripheral_->pu8RxDestination      = NULL;
 
   /* Empty the transmit buffer if there were leftover messages */
   while(psSspPeripheral_->psTransmitBuffer != NULL)
@@ -486,8 +559,8 @@ bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_)
 {
   u8 au8MsgTooBig[] = "\r\nSSP message to large\n\r";
   
-  /* Do not allow if requested size is too large */
-  if(u16Size_ > MAX_TX_MESSAGE_LENGTH)
+  /* Do not allow if requested size is too large: the receive buffer is both the destination and the dummy source */
+  if(u16Size_ > psSspPeripheral_->u16RxBufferSize)
   {
     DebugPrintf(au8MsgTooBig);
     return FALSE;
@@ -506,6 +579,150 @@ bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_)
 } /* end SspReadData() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspTransferData
+
+Description:
+Full duplex master transfer that transmits directly from the caller's buffer with the PDC.  The received bytes go 
+to the start of the receive buffer exactly as for SspReadData() and completion is checked the same way.
+
+Requires:
+  - If CS is under manual control for the target SSP peripheral, it should already be asserted
+  - pu8TxData_ points to u16Size_ bytes that stay valid and unchanged until the transfer is complete
+  - The peripheral is MSB_FIRST (the caller's data is not flipped)
+
+Promises:
+  - Returns TRUE and the transfer is queued (started from SspSM_Idle, or immediately if called from fnMasterRxCallback)
+  - Returns FALSE if the transfer is too big for the receive buffer, the bit order is LSB_FIRST, or the 
+    peripheral already has a read request
+*/
+bool SspTransferData(SspPeripheralType* psSspPeripheral_, u16 u16Size_, u8* pu8TxData_)
+{
+  /* The receive buffer holds the bytes that come back */
+  if( (u16Size_ > psSspPeripheral_->u16RxBufferSize) || 
+      (psSspPeripheral_->eBitOrder == LSB_FIRST) )
+  {
+    return FALSE;
+  }
+  
+  /* Make sure no receive function is already in progress based on the bytes in the buffer */
+  if( psSspPeripheral_->u16RxBytes != 0)
+  {
+    return FALSE;
+  }
+  
+  /* Load the source and counter and return success */
+  psSspPeripheral_->pu8TxSource = pu8TxData_;
+  psSspPeripheral_->u16RxBytes  = u16Size_;
+  return TRUE;
+    
+} /* end SspTransferData() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspReceiveData
+
+Description:
+Full duplex master transfer that receives directly into the caller's buffer with the PDC.  The bytes clocked out come
+from pu8TxData_.  Completion is checked (or the fnMasterRxCallback runs) exactly as for SspReadData().
+
+Requires:
+  - If CS is under manual control for the target SSP peripheral, it should already be asserted
+  - pu8RxData_ has room for u16Size_ bytes and is not touched by the application until the transfer is complete
+  - pu8TxData_ points to u16Size_ bytes that stay valid and unchanged until the transfer is complete
+  - The peripheral is MSB_FIRST (the received data is not flipped)
+
+Promises:
+  - Returns TRUE and the transfer is queued (started from SspSM_Idle, or immediately if called from fnMasterRxCallback)
+  - Returns FALSE if a buffer is missing, the bit order is LSB_FIRST, or the peripheral already has a read request
+*/
+bool SspReceiveData(SspPeripheralType* psSspPeripheral_, u16 u16Size_, u8* pu8RxData_, u8* pu8TxData_)
+{
+  if( (pu8RxData_ == NULL) || (pu8TxData_ == NULL) || (u16Size_ == 0) ||
+      (psSspPeripheral_->eBitOrder == LSB_FIRST) )
+  {
+    return FALSE;
+  }
+  
+  /* Make sure no receive function is already in progress based on the bytes in the buffer */
+  if( psSspPeripheral_->u16RxBytes != 0)
+  {
+    return FALSE;
+  }
+  
+  /* Load the buffers and counter and return success */
+  psSspPeripheral_->pu8RxDestination = pu8RxData_;
+  psSspPeripheral_->pu8TxSource      = pu8TxData_;
+  psSspPeripheral_->u16RxBytes       = u16Size_;
+  return TRUE;
+    
+} /* end SspReceiveData() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspReadFrame
+
+Description:
+SPI_SLAVE_FLOW_CONTROL_DMA only.  Sets up the PDC to receive the remaining bytes of the current frame into the 
+circular receive buffer starting at the application's next-byte pointer.  If the frame will wrap past the end of the 
+buffer, the second part is loaded into the next pointer / next counter registers so the PDC handles the wrap.  
+
+Requires:
+  - psSspPeripheral_ was requested in SPI_SLAVE_FLOW_CONTROL_DMA mode
+  - u16Size_ is the number of bytes left in the frame and is not larger than the receive buffer
+  - The master has not yet been released (flow control) to send the bytes; this function may be called from
+    the Rx flow control callback
+
+Promises:
+  - Returns TRUE and the frame reception is armed: RXRDY interrupt is disabled, RXBUFF is enabled
+  - Returns FALSE if the peripheral is in the wrong mode, the size is invalid or a frame is already being received
+*/
+bool SspReadFrame(SspPeripheralType* psSspPeripheral_, u16 u16Size_)
+{
+  u32 u32BytesToEnd;
+  u8* pu8RxNextByte;
+  
+  /* Validate the request */
+  if( (psSspPeripheral_->eSspMode != SPI_SLAVE_FLOW_CONTROL_DMA) ||
+      (u16Size_ == 0) || (u16Size_ > psSspPeripheral_->u16RxBufferSize) ||
+      (psSspPeripheral_->u32PrivateFlags & _SSP_PERIPHERAL_RX) )
+  {
+    return FALSE;
+  }
+
+  /* Flag the frame in progress so the state machine does not treat u16RxBytes as a master read */
+  psSspPeripheral_->u32PrivateFlags |= _SSP_PERIPHERAL_RX;
+  psSspPeripheral_->u16RxBytes = u16Size_;
+  
+  /* Stop byte interrupts: the PDC now takes every byte until the frame is complete */
+  psSspPeripheral_->pBaseAddress->US_IDR = AT91C_US_RXRDY;
+
+  /* Split the frame at the end of the circular buffer if necessary */
+  pu8RxNextByte = *psSspPeripheral_->ppu8RxNextByte;
+  u32BytesToEnd = (u32)(psSspPeripheral_->pu8RxBuffer + psSspPeripheral_->u16RxBufferSize - pu8RxNextByte);
+  
+  psSspPeripheral_->pBaseAddress->US_RPR = (u32)pu8RxNextByte;
+  if(u16Size_ <= u32BytesToEnd)
+  {
+    psSspPeripheral_->pBaseAddress->US_RNCR = 0;
+    psSspPeripheral_->pBaseAddress->US_RCR  = u16Size_;
+  }
+  else
+  {
+    psSspPeripheral_->pBaseAddress->US_RNPR = (u32)psSspPeripheral_->pu8RxBuffer;
+    psSspPeripheral_->pBaseAddress->US_RNCR = u16Size_ - u32BytesToEnd;
+    psSspPeripheral_->pBaseAddress->US_RCR  = u32BytesToEnd;
+  }
+  
+  /* Loading RCR clears RXBUFF so the interrupt is safe to enable; then start the receiver */
+  psSspPeripheral_->pBaseAddress->US_IER  = AT91C_US_RXBUFF;
+  psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN;
+  
+  return TRUE;
+  
+} /* end SspReadFrame() */
+
+
 /*----------------------------------------------------------------------------------------------------------------------
 Function: SspQueryReceiveStatus
 
@@ -756,6 +973,8 @@ Handles the enabled interrupts for the current SSP.
 Chip select: only enabled for SLAVE peripherals.  A Slave peripheral needs this signal to know it is communicating.  
 If it is supposed to be transmitting and does not have any flow control, the data should already be ready.
 Transmit: An End Transmit interrupt will occur when the PDC has finished sending all of the bytes for Master or Slave.
+For a Master the last byte is still in the shift register at ENDTX, so TXEMPTY is enabled as a second stage that
+releases CS and completes the message once the byte is really out.  Nothing in the ISR waits on the SPI clock.
 Receive: An End Receive interrupt will occur when the PDC has finished receiving all of the expected bytes for Master or a single byte for Slave.
 Receive RXBUFF: An Rx Buffer empty interrupt occurs on a Slave when both the current and next send counters are 0.
 
@@ -772,7 +991,6 @@ Promises:
 void SspGenericHandler(void)
 {
   u32 u32Byte;
-  u32 u32Timeout;
   u32 u32Current_CSR;
   
   /* Get a copy of CSR because reading it changes it */
@@ -799,12 +1017,45 @@ void SspGenericHandler(void)
       {
         SSP_psCurrentISR->pBaseAddress->US_RCR  = 1;
       }
+      
+      /* Flow control DMA devices finish the transaction here */
+      if(SSP_psCurrentISR->eSspMode == SPI_SLAVE_FLOW_CONTROL_DMA)
+      {
+        /* Close out a frame that the master ended early */
+        if(SSP_psCurrentISR->u32PrivateFlags & _SSP_PERIPHERAL_RX)
+        {
+          SspFrameComplete();
+        }
+        
+        /* Drop any dummy bytes left from a DMA transmit and go back to byte reception */
+        u32Byte = SSP_psCurrentISR->pBaseAddress->US_RHR;
+        SSP_psCurrentISR->pBaseAddress->US_CR  = AT91C_US_RSTSTA;
+        SSP_psCurrentISR->pBaseAddress->US_IER = AT91C_US_RXRDY;
+      }
     }
   } /* end CS change state interrupt */
 
+  /*** SSP ISR end of transmit stage for Master devices (enabled at ENDTX) ***/
+  if( (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_TXEMPTY) && 
+      (u32Current_CSR & AT91C_US_TXEMPTY) &&
+      (SSP_psCurrentISR->eSspMode != SPI_SLAVE_FLOW_CONTROL) )
+  {
+    /* The shift register is empty so the slave has every bit */
+    SSP_psCurrentISR->pBaseAddress->US_IDR = AT91C_US_TXEMPTY;
+    
+    /* Deassert chip select for SPI_MASTER_AUTO_CS transfers */
+    if(SSP_psCurrentISR->eSspMode == SPI_MASTER_AUTO_CS)
+    {
+      SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+    }
+    
+    SspTransmitComplete();
+  } /* end Master AT91C_US_TXEMPTY */
+
   /*** SSP ISR transmit handling for flow-control devices that do not use DMA ***/
   if( (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_TXEMPTY) && 
-      (u32Current_CSR & AT91C_US_TXEMPTY) )
+      (u32Current_CSR & AT91C_US_TXEMPTY) &&
+      (SSP_psCurrentISR->eSspMode == SPI_SLAVE_FLOW_CONTROL) )
   {
     /* Decrement counter and read the dummy byte so the SSP peripheral doesn't overrun */
     SSP_psCurrentISR->u32CurrentTxBytesRemaining--;
@@ -864,12 +1115,26 @@ void SspGenericHandler(void)
     /* Send the byte to the Rx buffer; since we only do one byte at a time in this mode, then _SSP_RX_COMPLETE */
     **(SSP_psCurrentISR->ppu8RxNextByte) = (u8)u32Byte;
     *SSP_pu32SspApplicationFlagsISR |= _SSP_RX_COMPLETE;
+    
+    /* In DMA frame mode the driver owns the circular buffer pointer since the PDC writes there too */
+    if(SSP_psCurrentISR->eSspMode == SPI_SLAVE_FLOW_CONTROL_DMA)
+    {
+      SspAdvanceRxNextByte(SSP_psCurrentISR, 1);
+    }
 
     /* Invoke callback */
     SSP_psCurrentISR->fnSlaveRxFlowCallback();
   }
 
   
+  /*** SSP ISR handling for Slave Rx frames with flow control (DMA) ***/
+  if( (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_RXBUFF) && 
+      (u32Current_CSR & AT91C_US_RXBUFF) )
+  {
+    SspFrameComplete();
+  }
+  
+  
   /*** SSP ISR responses for non-flow-control devices that use DMA (master or slave) ***/
     
   /* ENDRX Interrupt when all requested bytes have been received */
@@ -880,14 +1145,22 @@ void SspGenericHandler(void)
     if( (SSP_psCurrentISR->eSspMode == SPI_MASTER_AUTO_CS) ||
         (SSP_psCurrentISR->eSspMode == SPI_MASTER_MANUAL_CS) ) 
     {
-      /* Reset the byte counter and clear the RX flag */
+      /* Post-flip the received data for LSB first devices */
+      if(SSP_psCurrentISR->eBitOrder == LSB_FIRST)
+      {
+        SspReverseBits(SSP_psCurrentISR->pu8RxBuffer, SSP_psCurrentISR->u16RxBytes);
+      }
+      
+      /* Reset the byte counter, transmit source and receive destination and clear the RX flag */
       SSP_psCurrentISR->u16RxBytes = 0;
+      SSP_psCurrentISR->pu8TxSource = NULL;
+      SSP_psCurrentISR->pu8RxDestination = NULL;
       SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_RX;
       SSP_psCurrentISR->u32PrivateFlags |=  _SSP_PERIPHERAL_RX_COMPLETE;
       SSP_u32RxCounter++;
       
       /* Deassert CS for SPI_MASTER_AUTO_CS transfers */
-      if(SSP_psCurrentSsp->eSspMode == SPI_MASTER_AUTO_CS)
+      if(SSP_psCurrentISR->eSspMode == SPI_MASTER_AUTO_CS)
       {
         SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
       }
@@ -895,6 +1168,20 @@ void SspGenericHandler(void)
       /* Disable the receiver and transmitter */
       SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
       SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDRX;
+      
+      /* The application may chain another read from its callback: start it now instead of in SspSM_Idle */
+      if(SSP_psCurrentISR->fnMasterRxCallback != NULL)
+      {
+        SSP_psCurrentISR->fnMasterRxCallback();
+        if(SSP_psCurrentISR->u16RxBytes != 0)
+        {
+          if(SSP_psCurrentISR->eSspMode == SPI_MASTER_AUTO_CS)
+          {
+            SSP_psCurrentISR->pCsGpioAddress->PIO_CODR = SSP_psCurrentISR->u32CsPin;
+          }
+          SspStartReceive(SSP_psCurrentISR);
+        }
+      }
     }
     /* Otherwise the peripheral is a Slave that just received a byte */
     /* ENDRX Interrupt when a byte has been received (RNCR is moved to RCR; RNPR is copied to RPR))*/
@@ -920,31 +1207,27 @@ void SspGenericHandler(void)
   if( (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDTX) && 
       (u32Current_CSR & AT91C_US_ENDTX) )
   {
-    /* Update this message token status and then DeQueue it */
-    UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-    DeQueueMessage( &SSP_psCurrentISR->psTransmitBuffer );
-    SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;
-        
     /* Disable the transmitter and interrupt source */
     SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
     SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
 
-    /* Allow the peripheral to finish clocking out the Tx byte */
-    u32Timeout = 0;
-    while ( !(SSP_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_TXEMPTY) && 
-            u32Timeout < SSP_TXEMPTY_TIMEOUT)
+    /* A Master still has the last byte in the shift register: finish in the TXEMPTY stage */
+    if( (SSP_psCurrentISR->eSspMode == SPI_MASTER_AUTO_CS) ||
+        (SSP_psCurrentISR->eSspMode == SPI_MASTER_MANUAL_CS) ) 
     {
-      u32Timeout++;
-    } 
-    
-    if(SSP_psCurrentISR->eSspMode == SPI_MASTER_AUTO_CS)
+      SSP_psCurrentISR->pBaseAddress->US_IER = AT91C_US_TXEMPTY;
+    }
+    /* A Slave is done once the PDC has loaded the last byte since the master owns the clock */
+    else
     {
-      /* Deassert chip select when the buffer and shift register are totally empty */
-      if(SSP_psCurrentSsp->eSspMode == SPI_MASTER_AUTO_CS)
+      SspTransmitComplete();
+      
+      /* A flow control slave lets the master clock out the last byte; byte reception resumes on CS deassert */
+      if(SSP_psCurrentISR->eSspMode == SPI_SLAVE_FLOW_CONTROL_DMA)
       {
-        SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+        *SSP_pu32SspApplicationFlagsISR |= _SSP_TX_COMPLETE; 
+        SSP_psCurrentISR->fnSlaveTxFlowCallback();
       }
-      //SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
     }
   } /* end ENDTX interrupt handling */
 
@@ -952,6 +1235,236 @@ void SspGenericHandler(void)
 } /* end SspGenericHandler() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspStartReceive
+
+Description:
+Starts a master read of u16RxBytes into the start of the receive buffer (or pu8RxDestination from SspReceiveData()).
+The receive buffer also sources the dummy bytes that are transmitted to clock the data in unless pu8TxSource is set.
+
+Requires:
+  - psSspPeripheral_ is a master that is not transmitting or receiving and u16RxBytes != 0
+  - CS is asserted (SPI_MASTER_MANUAL_CS by the application; SPI_MASTER_AUTO_CS by the caller)
+  - Called from SspSM_Idle() or from the ENDRX interrupt when a read is chained
+
+Promises:
+  - _SSP_PERIPHERAL_RX is set; unless pu8RxDestination is set, the first u16RxBytes of the receive buffer are SSP_DUMMY_BYTE
+  - The PDC receiver and transmitter are running and ENDRX is enabled
+*/
+void SspStartReceive(SspPeripheralType* psSspPeripheral_)
+{
+  /* Receiving: flag that the peripheral is now busy */
+  psSspPeripheral_->u32PrivateFlags |= _SSP_PERIPHERAL_RX;    
+  
+  /* Load the PDC counter and pointer registers */
+  if(psSspPeripheral_->pu8RxDestination != NULL)
+  {
+    /* SspReceiveData() always supplies the transmit bytes so the destination is not touched before the PDC */
+    psSspPeripheral_->pBaseAddress->US_RPR = (unsigned int)psSspPeripheral_->pu8RxDestination; 
+  }
+  else
+  {
+    /* Clear the part of the receive buffer that will be used so we can see (most) data changes but also so we send
+    predictable dummy bytes since we'll point to this buffer to source the transmit dummies */
+    memset(psSspPeripheral_->pu8RxBuffer, SSP_DUMMY_BYTE, psSspPeripheral_->u16RxBytes);
+    psSspPeripheral_->pBaseAddress->US_RPR = (unsigned int)psSspPeripheral_->pu8RxBuffer; 
+  }
+  if(psSspPeripheral_->pu8TxSource != NULL)
+  {
+    psSspPeripheral_->pBaseAddress->US_TPR = (unsigned int)psSspPeripheral_->pu8TxSource; 
+  }
+  else
+  {
+    psSspPeripheral_->pBaseAddress->US_TPR = (unsigned int)psSspPeripheral_->pu8RxBuffer; 
+  }
+  psSspPeripheral_->pBaseAddress->US_RCR = psSspPeripheral_->u16RxBytes;
+  psSspPeripheral_->pBaseAddress->US_TCR = psSspPeripheral_->u16RxBytes;
+
+  /* When RCR is loaded, the ENDRX flag is cleared so it is safe to enable the interrupt */
+  psSspPeripheral_->pBaseAddress->US_IER = AT91C_US_ENDRX;
+  
+  /* Enable the receiver and transmitter to start the transfer */
+  psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN | AT91C_PDC_TXTEN;
+  
+} /* end SspStartReceive() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspTransmitComplete
+
+Description:
+Finishes the PDC transmit message at the front of the current ISR peripheral's transmit queue.
+
+Requires:
+  - Called from SspGenericHandler() so SSP_psCurrentISR is valid
+  - The PDC transmitter and ENDTX interrupt are already disabled
+
+Promises:
+  - The message status is COMPLETE and it is removed from the transmit queue
+  - _SSP_PERIPHERAL_TX is cleared so SspSM_Idle can start the next transfer
+*/
+void SspTransmitComplete(void)
+{
+  UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
+  DeQueueMessage( &SSP_psCurrentISR->psTransmitBuffer );
+  SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;
+  
+} /* end SspTransmitComplete() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspFrameComplete
+
+Description:
+Finishes a SPI_SLAVE_FLOW_CONTROL_DMA frame reception when RXBUFF fires or CS ends the frame early.  
+
+Requires:
+  - Called from SspGenericHandler() so SSP_psCurrentISR and SSP_pu32SspApplicationFlagsISR are valid
+  - A frame was armed with SspReadFrame() and *ppu8RxNextByte still points to its first byte
+
+Promises:
+  - The PDC receiver and RXBUFF interrupt are disabled 
+  - Received bytes are bit-reversed in place for LSB_FIRST
+  - *ppu8RxNextByte is advanced past the received bytes, _SSP_RX_COMPLETE is set and the Rx callback is invoked
+  - u16RxBytes is 0, _SSP_PERIPHERAL_RX is cleared and RXRDY is re-enabled
+*/
+void SspFrameComplete(void)
+{
+  u32 u32Received;
+  u32 u32BytesToEnd;
+  u8* pu8FrameStart;
+  
+  /* Stop the PDC and find how many bytes actually arrived (all of them unless CS ended the frame early) */
+  SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_RXTDIS;
+  SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_RXBUFF;
+  u32Received = SSP_psCurrentISR->u16RxBytes - 
+                (SSP_psCurrentISR->pBaseAddress->US_RCR + SSP_psCurrentISR->pBaseAddress->US_RNCR);
+  
+  /* Flip the frame in place, in two pieces if it wrapped around the end of the buffer */
+  if(SSP_psCurrentISR->eBitOrder == LSB_FIRST)
+  {
+    pu8FrameStart = *SSP_psCurrentISR->ppu8RxNextByte;
+    u32BytesToEnd = (u32)(SSP_psCurrentISR->pu8RxBuffer + SSP_psCurrentISR->u16RxBufferSize - pu8FrameStart);
+    
+    if(u32Received <= u32BytesToEnd)
+    {
+      SspReverseBits(pu8FrameStart, u32Received);
+    }
+    else
+    {
+      SspReverseBits(pu8FrameStart, u32BytesToEnd);
+      SspReverseBits(SSP_psCurrentISR->pu8RxBuffer, u32Received - u32BytesToEnd);
+    }
+  }
+  
+  /* Hand the frame to the application */
+  SspAdvanceRxNextByte(SSP_psCurrentISR, u32Received);
+  *SSP_pu32SspApplicationFlagsISR |= _SSP_RX_COMPLETE;
+  SSP_psCurrentISR->fnSlaveRxFlowCallback();
+  
+  /* Clean up and go back to byte reception for the next frame header */
+  SSP_psCurrentISR->u16RxBytes = 0;
+  SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_RX;
+  SSP_psCurrentISR->u32PrivateFlags |=  _SSP_PERIPHERAL_RX_COMPLETE;
+  SSP_psCurrentISR->pBaseAddress->US_IER = AT91C_US_RXRDY;
+  
+} /* end SspFrameComplete() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspAdvanceRxNextByte
+
+Description:
+Moves the application's circular receive buffer pointer forward with wrap-around.
+
+Requires:
+  - psSspPeripheral_ is a SPI_SLAVE_FLOW_CONTROL_DMA peripheral
+  - u32Bytes_ is not larger than the receive buffer size
+
+Promises:
+  - *ppu8RxNextByte is advanced u32Bytes_ positions in the circular receive buffer
+*/
+void SspAdvanceRxNextByte(SspPeripheralType* psSspPeripheral_, u32 u32Bytes_)
+{
+  u8* pu8NextByte;
+  
+  pu8NextByte = *psSspPeripheral_->ppu8RxNextByte + u32Bytes_;
+  if(pu8NextByte >= (psSspPeripheral_->pu8RxBuffer + psSspPeripheral_->u16RxBufferSize) )
+  {
+    pu8NextByte -= psSspPeripheral_->u16RxBufferSize;
+  }
+  
+  *psSspPeripheral_->ppu8RxNextByte = pu8NextByte;
+  
+} /* end SspAdvanceRxNextByte() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspReverseBits
+
+Description:
+Reverses the bit order of every byte in a buffer so LSB-first devices can use the PDC.  
+The aligned middle of the buffer is processed a word at a time: RBIT reverses all 32 bits (which also 
+reverses the byte order) and REV puts the bytes back where they were, so each byte ends up flipped in place
+in two instructions per four bytes.  Unaligned head and tail bytes are done one at a time.
+
+Requires:
+  - pu8Data_ points to the first byte to flip
+  - u32Size_ is the number of bytes to flip
+
+Promises:
+  - Each byte in the buffer has its bit order reversed in place
+*/
+void SspReverseBits(u8* pu8Data_, u32 u32Size_)
+{
+  u32* pu32Word;
+  u32 u32Word;
+  
+  /* Flip single bytes until the pointer is word-aligned */
+  while( (u32Size_ != 0) && ((u32)pu8Data_ & 0x03) )
+  {
+#ifdef __ICCARM__
+    *pu8Data_ = (u8)(__RBIT((u32)*pu8Data_) >> 24);
+#else
+    *pu8Data_ = SSP_au8BitReverseTable[*pu8Data_];
+#endif /* __ICCARM__ */
+    pu8Data_++;
+    u32Size_--;
+  }
+  
+  /* Flip whole words */
+  pu32Word = (u32*)pu8Data_;
+  while(u32Size_ >= 4)
+  {
+    u32Word = *pu32Word;
+#ifdef __ICCARM__
+    *pu32Word = __REV(__RBIT(u32Word));
+#else
+    *pu32Word = ( (u32)SSP_au8BitReverseTable[u32Word & 0xFF]               ) |
+                ( (u32)SSP_au8BitReverseTable[(u32Word >> 8) & 0xFF]  << 8  ) |
+                ( (u32)SSP_au8BitReverseTable[(u32Word >> 16) & 0xFF] << 16 ) |
+                ( (u32)SSP_au8BitReverseTable[u32Word >> 24]          << 24 );
+#endif /* __ICCARM__ */
+    pu32Word++;
+    u32Size_ -= 4;
+  }
+  
+  /* Flip any bytes left over */
+  pu8Data_ = (u8*)pu32Word;
+  while(u32Size_ != 0)
+  {
+#ifdef __ICCARM__
+    *pu8Data_ = (u8)(__RBIT((u32)*pu8Data_) >> 24);
+#else
+    *pu8Data_ = SSP_au8BitReverseTable[*pu8Data_];
+#endif /* __ICCARM__ */
+    pu8Data_++;
+    u32Size_--;
+  }
+  
+} /* end SspReverseBits() */
+
+
 /***********************************************************************************************************************
 State Machine Function Definitions
 
@@ -987,24 +1500,7 @@ void SspSM_Idle(void)
     /* Check if the message is receiving based on expected byte count */
     if(SSP_psCurrentSsp->u16RxBytes !=0)
     {
-      /* Receiving: flag that the peripheral is now busy */
-      SSP_psCurrentSsp->u32PrivateFlags |= _SSP_PERIPHERAL_RX;    
-      
-      /* Clear the receive buffer so we can see (most) data changes but also so we send
-      predictable dummy bytes since we'll point to this buffer to source the transmit dummies */
-      memset(SSP_psCurrentSsp->pu8RxBuffer, SSP_DUMMY_BYTE, SSP_psCurrentSsp->u16RxBufferSize);
-
-      /* Load the PDC counter and pointer registers */
-      SSP_psCurrentSsp->pBaseAddress->US_RPR = (unsigned int)SSP_psCurrentSsp->pu8RxBuffer; 
-      SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->pu8RxBuffer; 
-      SSP_psCurrentSsp->pBaseAddress->US_RCR = SSP_psCurrentSsp->u16RxBytes;
-      SSP_psCurrentSsp->pBaseAddress->US_TCR = SSP_psCurrentSsp->u16RxBytes;
-
-      /* When RCR is loaded, the ENDRX flag is cleared so it is safe to enable the interrupt */
-      SSP_psCurrentSsp->pBaseAddress->US_IER = AT91C_US_ENDRX;
-      
-      /* Enable the receiver and transmitter to start the transfer */
-      SSP_psCurrentSsp->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN | AT91C_PDC_TXTEN;
+      SspStartReceive(SSP_psCurrentSsp);
     } /* End of receive function */
     else
     {
@@ -1038,10 +1534,40 @@ void SspSM_Idle(void)
         SSP_psCurrentSsp->fnSlaveTxFlowCallback();
       }
       
+      /* TRANSMIT SPI_SLAVE_FLOW_CONTROL_DMA */
+      /* A Slave device with frame flow control sends the whole message with the PDC */
+      else if(SSP_psCurrentSsp->eSspMode == SPI_SLAVE_FLOW_CONTROL_DMA)
+      {
+        /* The message is a copy in the message pool, so it can be flipped in place in one pass */
+        if(SSP_psCurrentSsp->eBitOrder == LSB_FIRST)
+        {
+          SspReverseBits(SSP_psCurrentSsp->psTransmitBuffer->pu8Message, SSP_psCurrentSsp->psTransmitBuffer->u32Size);
+        }
+        
+        /* Reset the transmitter as in byte mode and stop byte reception since the dummy bytes
+        clocked in during the frame are not wanted (RXRDY is re-enabled when CS deasserts) */
+        SSP_psCurrentSsp->pBaseAddress->US_CR = (AT91C_US_RSTTX);
+        SSP_psCurrentSsp->pBaseAddress->US_CR = (AT91C_US_TXEN);
+        SSP_psCurrentSsp->pBaseAddress->US_IDR = AT91C_US_RXRDY;
+
+        /* Load the PDC, enable ENDTX and release the master for the whole frame */
+        SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->psTransmitBuffer->pu8Message; 
+        SSP_psCurrentSsp->pBaseAddress->US_TCR = SSP_psCurrentSsp->psTransmitBuffer->u32Size;
+        SSP_psCurrentSsp->pBaseAddress->US_IER = AT91C_US_ENDTX;
+        SSP_psCurrentSsp->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
+        SSP_psCurrentSsp->fnSlaveTxFlowCallback();
+      }
+      
       /* TRANSMIT SPI_MASTER_AUTO_CS, SPI_MASTER_MANUAL_CS, SPI_SLAVE NO FLOW CONTROL */
       /* A Master or Slave device without flow control uses the PDC */
       else
       {
+        /* Pre-flip the message in the message pool for LSB first devices */
+        if(SSP_psCurrentSsp->eBitOrder == LSB_FIRST)
+        {
+          SspReverseBits(SSP_psCurrentSsp->psTransmitBuffer->pu8Message, SSP_psCurrentSsp->psTransmitBuffer->u32Size);
+        }
+        
         /* Load the PDC counter and pointer registers */
         SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->psTransmitBuffer->pu8Message; 
         SSP_psCurrentSsp->pBaseAddress->US_TCR = SSP_psCurrentSsp->psTransmitBuffer->u32Size;
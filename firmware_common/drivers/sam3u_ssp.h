@@ -15,7 +15,7 @@ Type Definitions
 **********************************************************************************************************************/
 typedef enum {MSB_FIRST, LSB_FIRST} SspeBitOrderType;
 typedef enum {SSP_FULL_DUPLEX, SSP_HALF_DUPLEX} SspDuplexModeType;
-typedef enum {SPI_MASTER_AUTO_CS, SPI_MASTER_MANUAL_CS, SPI_SLAVE, SPI_SLAVE_FLOW_CONTROL} SspModeType;
+typedef enum {SPI_MASTER_AUTO_CS, SPI_MASTER_MANUAL_CS, SPI_SLAVE, SPI_SLAVE_FLOW_CONTROL, SPI_SLAVE_FLOW_CONTROL_DMA} SspModeType;
 typedef enum {SSP_RX_EMPTY = 0, SSP_RX_WAITING, SSP_RX_RECEIVING, SSP_RX_COMPLETE, SSP_RX_TIMEOUT} SspRxStatusType;
 
 typedef struct 
@@ -23,13 +23,15 @@ typedef struct
   PeripheralType SspPeripheral;       /* Easy name of peripheral */
   AT91PS_PIO pCsGpioAddress;          /* Base address for GPIO port for chip select line */
   u32 u32CsPin;                       /* Pin location for SSEL line */
-  SspeBitOrderType eBitOrder;         /* MSB_FIRST or LSB_FIRST: this is only available in SPI_SLAVE_FLOW_CONTROL mode */
+  SspeBitOrderType eBitOrder;         /* MSB_FIRST or LSB_FIRST: LSB_FIRST is not available for SPI_SLAVE receive */
   SspModeType eSspMode;               /* Type of SPI configured */
   fnCode_type fnSlaveTxFlowCallback;  /* Callback function for SPI_SLAVE_FLOW_CONTROL transmit */
   fnCode_type fnSlaveRxFlowCallback;  /* Callback function for SPI_SLAVE_FLOW_CONTROL receive */
+  fnCode_type fnMasterRxCallback;     /* Optional callback from the ENDRX interrupt when a master read finishes (NULL if not used) */
   u8* pu8RxBufferAddress;             /* Address to circular receive buffer */
-  u8** ppu8RxNextByte;                /* Location of pointer to next byte to write in buffer for SPI_SLAVE_FLOW_CONTROL only */
+  u8** ppu8RxNextByte;                /* Location of pointer to next byte to write in buffer for SPI_SLAVE_FLOW_CONTROL(_DMA) only */
   u16 u16RxBufferSize;                /* Size of receive buffer in bytes */
+  u32 u32ClockDivider;                /* Master SPI clock = MCK / u32ClockDivider; 0 uses the USARTx_US_BRGR_INIT value */
 } SspConfigurationType;
 
 typedef struct 
@@ -37,22 +39,25 @@ typedef struct
   AT91PS_USART pBaseAddress;          /* Base address of the associated peripheral */
   AT91PS_PIO pCsGpioAddress;          /* Base address for GPIO port for chip select line */
   u32 u32CsPin;                       /* Pin location for SSEL line */
-  SspeBitOrderType eBitOrder;         /* MSB_FIRST or LSB_FIRST: this is only available in SPI_SLAVE_FLOW_CONTROL mode */
+  SspeBitOrderType eBitOrder;         /* MSB_FIRST or LSB_FIRST: LSB_FIRST is not available for SPI_SLAVE receive */
   SspModeType eSspMode;               /* Type of SPI configured */
   u16 u16Pad;                         /* Preserve 4-byte alignment */
   u32 u32PrivateFlags;                /* Private peripheral flags */
   fnCode_type fnSlaveTxFlowCallback;  /* Callback function for SPI SLAVE transmit that uses flow control */
   fnCode_type fnSlaveRxFlowCallback;  /* Callback function for SPI SLAVE receive that uses flow control */
+  fnCode_type fnMasterRxCallback;     /* Callback function when a SPI master read finishes; may chain the next read */
   u8* pu8RxBuffer;                    /* Pointer to receive buffer in user application */
-  u8** ppu8RxNextByte;                /* Pointer to buffer location where next received byte will be placed (SPI_SLAVE_FLOW_CONTROL only) */
+  u8** ppu8RxNextByte;                /* Pointer to buffer location where next received byte will be placed (SPI_SLAVE_FLOW_CONTROL(_DMA) only) */
   u16 u16RxBufferSize;                /* Size of receive buffer in bytes */
-  u16 u16RxBytes;                     /* Number of bytes to receive (DMA transfers) */
+  u16 u16RxBytes;                     /* Number of bytes to receive (DMA transfers and SPI_SLAVE_FLOW_CONTROL_DMA frames) */
   u8 u8PeripheralId;                  /* Simple peripheral ID number */
 //  u8 u8Pad;                           /* Preserve 4-byte alignment */
   MessageType* psTransmitBuffer;      /* Pointer to the transmit message struct linked list */
 //  MessageType* psReceiveBuffer;       /* Pointer to the transmit message struct linked list */
   u32 u32CurrentTxBytesRemaining;     /* Counter for bytes remaining in current transfer */
   u8* pu8CurrentTxData;               /* Pointer to current location in the Tx buffer */
+  u8* pu8TxSource;                    /* Transmit source for SspTransferData(); NULL sends dummies from the receive buffer */
+  u8* pu8RxDestination;               /* Receive destination for SspReceiveData(); NULL receives into the receive buffer */
 } SspPeripheralType;
 
 /* u32PrivateFlags */
@@ -82,8 +87,6 @@ Constants / Definitions
 
 #define SSP_DUMMY_BYTE                (u8)0x00          /* Byte to send for dummy */
 
-#define SSP_TXEMPTY_TIMEOUT           (u32)100           /* Instruction cycles of a while loop that waits for a register to clear */
-
 
 /**********************************************************************************************************************
 * Function Declarations
@@ -103,6 +106,9 @@ u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* u8Data_)
 
 bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_);
 bool SspReadByte(SspPeripheralType* psSspPeripheral_);
+bool SspTransferData(SspPeripheralType* psSspPeripheral_, u16 u16Size_, u8* pu8TxData_);
+bool SspReceiveData(SspPeripheralType* psSspPeripheral_, u16 u16Size_, u8* pu8RxData_, u8* pu8TxData_);
+bool SspReadFrame(SspPeripheralType* psSspPeripheral_, u16 u16Size_);
 SspRxStatusType SspQueryReceiveStatus(SspPeripheralType* psSspPeripheral_);
 
 
@@ -122,6 +128,11 @@ void SSP0_IRQHandler(void);
 void SSP1_IRQHandler(void);
 void SSP2_IRQHandler(void);
 void SspGenericHandler(void);
+void SspStartReceive(SspPeripheralType* psSspPeripheral_);
+void SspTransmitComplete(void);
+void SspFrameComplete(void);
+void SspReverseBits(u8* pu8Data_, u32 u32Size_);
+void SspAdvanceRxNextByte(SspPeripheralType* psSspPeripheral_, u32 u32Bytes_);
 
 
 /***********************************************************************************************************************
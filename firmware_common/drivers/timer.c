@@ -33,6 +33,13 @@ void UserAppCallBack(void)
 Note: any callback should execute as quickly as possible since it runs during
 the timer interrupt handler.
 
+TIMER_CHANNEL2 is a one-shot with 41.7ns ticks: set the delay with TimerSet() and each 
+TimerStart() calls the channel 2 callback once after that delay.
+e.g.
+TimerAssignCallback(TIMER_CHANNEL2, UserAppDelayDone);
+TimerSet(TIMER_CHANNEL2, 240);    // 10us
+TimerStart(TIMER_CHANNEL2);
+
 
 Protected System functions:
 void TimerInitialize(void)
@@ -69,6 +76,7 @@ Variable names shall start with "Timer_" and be declared as static.
 ***********************************************************************************************************************/
 static fnCode_type Timer_StateMachine;            /* The state machine function pointer */
 static fnCode_type fpTimer1Callback;              /* Timer1 ISR callback function pointer */
+static fnCode_type fpTimer2Callback;              /* Timer2 (one-shot) ISR callback function pointer */
 
 //static u32 Timer_u32Timeout;                      /* Timeout counter used across states */
 
@@ -211,6 +219,7 @@ void TimerAssignCallback(TimerChannelType eTimerChannel_, fnCode_type fpUserCall
     }
     case TIMER_CHANNEL2:
     {
+      fpTimer2Callback = fpUserCallback_;
       break;
     }
     default:
@@ -236,7 +245,7 @@ Requires:
   -
 
 Promises:
-  - Timer 1 is configured per timer.h INIT settings
+  - Timers 1 and 2 are configured per timer.h INIT settings
 */
 void TimerInitialize(void)
 {
@@ -256,7 +265,14 @@ void TimerInitialize(void)
  
   fpTimer1Callback = TimerDefaultCallback;
 
-  /* Channel 2 settings not configured at this time */
+  /* Load Channel 2 (one-shot) settings and set the default callback */
+  AT91C_BASE_TC2->TC_CMR = TC2_CMR_INIT;
+  AT91C_BASE_TC2->TC_RC  = TC2_RC_INIT;
+  AT91C_BASE_TC2->TC_IER = TC2_IER_INIT;
+  AT91C_BASE_TC2->TC_IDR = TC2_IDR_INIT;
+  AT91C_BASE_TC2->TC_CCR = TC2_CCR_INIT;
+ 
+  fpTimer2Callback = TimerDefaultCallback;
   
   /* If good initialization, set state to Idle */
   if( 1 )
@@ -264,6 +280,8 @@ void TimerInitialize(void)
     /* Enable required interrupts */
     NVIC_ClearPendingIRQ(IRQn_TC1);
     NVIC_EnableIRQ(IRQn_TC1);
+    NVIC_ClearPendingIRQ(IRQn_TC2);
+    NVIC_EnableIRQ(IRQn_TC2);
     Timer_StateMachine = TimerSM_Idle;
     DebugPrintf(au8TimerStarted);
     
@@ -351,6 +369,32 @@ void TC1_IrqHandler(void)
 } /* end TC1_IrqHandler() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+ISR: TC2_IrqHandler
+
+Description:
+Handles the end of a Timer Channel 2 one-shot.  The clock has already stopped at RC.
+
+Requires:
+  - 
+
+Promises:
+  - If Channel2 RC: the channel 2 callback is called
+*/
+void TC2_IrqHandler(void)
+{
+  /* Check for RC compare interrupt - reading TC_SR clears the bit if set */
+  if(AT91C_BASE_TC2->TC_SR & AT91C_TC_CPCS)
+  {
+    fpTimer2Callback();
+  }
+
+  /* Clear the TC2 pending flag and exit */
+  NVIC->ICPR[0] = (1 << IRQn_TC2);
+  
+} /* end TC2_IrqHandler() */
+
+
 /**********************************************************************************************************************
 State Machine Function Definitions
 **********************************************************************************************************************/
@@ -167,6 +167,98 @@ PB6 is an open pin available for TIOB1 I/O function if set for Peripheral A
 */
 
 
+/* Timer Channel 2 Setup
+Channel 2 is a one-shot: every TimerStart() counts from 0 up to RC, interrupts once and stops.
+It runs from TIMER_CLOCK1 for short, precise delays (used by the ANT driver for SRDY timing).
+*/
+
+/* Default Timer 2 delay of about 10us (1 tick = 41.7ns); max 65535 */
+#define TC2_RC_INIT (u32)240
+
+#define TC2_CCR_INIT (u32)0x00000002
+/*
+    31-04 [0] Reserved
+
+    03 [0] Reserved
+    02 [0] SWTRG no software trigger
+    01 [1] CLKDIS Clock disabled to start
+    00 [0] CLKEN Clock not enabled 
+*/
+
+#define TC2_CMR_INIT (u32)0x0000C040
+/*
+    31 [0] BSWTRG no software trigger effect on TIOB
+    30 [0] "
+    29 [0] BEEVT no external event effect on TIOB
+    28 [0] "
+
+    27 [0] BCPC no RC compare effect on TIOB
+    26 [0] "
+    25 [0] BCPB no RB compare effect on TIOB
+    24 [0] "
+
+    23 [0] ASWTRG no TIOA software trigger effect
+    22 [0] "
+    21 [0] AEEVT no TIOA effect on external compare
+    20 [0] "
+
+    19 [0] ACPC no RC compare effect on TIOA
+    18 [0] "
+    17 [0] ACPA No RA compare effect on TIOA
+    16 [0] "
+
+    15 [1] WAVE Waveform Mode is enabled
+    14 [1] WAVSEL Up to RC mode
+    13 [0] "
+    12 [0] ENETRG external event has no effect
+
+    11 [0] EEVT external event assigned to TIOB
+    10 [0] "
+    09 [0] EEVTEDG no external event trigger
+    08 [0] "
+
+    07 [0] CPCDIS clock is NOT disabled when reaches RC
+    06 [1] CPCSTOP clock is stopped when reaches RC (one-shot)
+    05 [0] BURST not gated
+    04 [0] "
+
+    03 [0] CLKI Counter incremented on rising edge
+    02 [0] TCCLKS TIMER_CLOCK1 (MCK/2 = 41.7ns / tick)
+    01 [0] "
+    00 [0] "
+*/
+
+#define TC2_IER_INIT (u32)0x00000010
+/*
+    31 -08 [0] Reserved 
+
+    07 [0] ETRGS RC Load interrupt not enabled
+    06 [0] LDRBS RB Load interrupt not enabled
+    05 [0] LDRAS RA Load interrupt not enabled
+    04 [1] CPCS RC compare interrupt is enabled
+
+    03 [0] CPBS RB compare interrupt not enabled
+    02 [0] CPAS RA Compare Interrupt not enabled
+    01 [0] LOVRS Load Overrun interrupt not enabled 
+    00 [0] COVFS Counter Overflow interrupt not enabled
+*/
+
+#define TC2_IDR_INIT (u32)0x000000EF
+/*
+    31-08 [0] Reserved 
+
+    07 [1] ETRGS RC Load interrupt disabled
+    06 [1] LDRBS RB Load interrupt disabled
+    05 [1] LDRAS RA Load interrupt disabled
+    04 [0] CPCS RC compare interrupt not disabled
+
+    03 [1] CPBS RB compare interrupt disabled
+    02 [1] CPAS RA Compare Interrupt disabled
+    01 [1] LOVRS Load Overrun interrupt disabled 
+    00 [1] COVFS Counter Overflow interrupt disabled
+*/
+
+
 /**********************************************************************************************************************
 Function Declarations
 **********************************************************************************************************************/
@@ -53,6 +53,8 @@ u8 HexToASCIICharUpper(u8 u8Char_);
 u8 HexToASCIICharLower(u8 u8Char_);
 u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_);
 bool SearchString(u8* pu8TargetString_, u8* pu8MatchString_);
+u8 Crc7(u8* pu8Data_, u32 u32Size_);
+u16 Crc16Ccitt(u8* pu8Data_, u32 u32Size_);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
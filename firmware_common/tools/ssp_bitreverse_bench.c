@@ -0,0 +1,296 @@
+/**********************************************************************************************************************
+File: ssp_bitreverse_bench.c
+
+Description:
+Host microbenchmark for the bit reversal that lets LSB-first SSP devices use the PDC (SspReverseBits() in
+drivers/sam3u_ssp.c).  Four ways of flipping a buffer are checked against a bit-by-bit reference for every alignment
+and then timed over SSP-sized buffers:
+
+byte shift    : one byte at a time with a portable 32-bit bit reversal (what __RBIT(byte) >> 24 does on the target)
+byte table    : one byte at a time through the 256-byte table
+word RBIT+REV : a word at a time with portable equivalents of RBIT and REV (the target path of SspReverseBits())
+word table    : a word at a time through the table (the host fallback of SspReverseBits())
+
+The host has no RBIT or REV instructions so the RBIT+REV lines only show the shape of the loop, not the target
+speed.  On the Cortex-M3 the word loop is LDR, RBIT, REV, STR, SUBS, CMP and a branch: about 9 cycles for 4 bytes
+against about 9 cycles for every byte in the byte loop.  The estimate at the end uses those counts at 48 MHz with
+no flash wait states.
+
+Build and run on the host with any C99 compiler, e.g.
+cc -std=c99 -O2 -o ssp_bitreverse_bench ssp_bitreverse_bench.c
+ssp_bitreverse_bench             (512 byte buffers)
+ssp_bitreverse_bench 64          (buffer size in bytes)
+**********************************************************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#define DEFAULT_SIZE              512u                 /* One SD block */
+#define MAX_SIZE                  65536u
+#define TARGET_MHZ                48u                  /* CCLK_VALUE in eief1-pcb-01.h */
+#define TARGET_CYCLES_PER_BYTE    9u                   /* Byte loop: LDRB, RBIT, LSR, STRB, ADDS, SUBS, branch */
+#define TARGET_CYCLES_PER_WORD    9u                   /* Word loop: LDR, RBIT, REV, STR, SUBS, CMP, branch */
+#define TARGET_CYCLES_PER_CALL    30u                  /* Call, alignment checks and return */
+#define CHECK_LENGTH              40u
+#define MIN_TIME_NS               200000000.0          /* Time each method for at least 0.2 s */
+
+
+/* Same values as SSP_au8BitReverseTable in sam3u_ssp.c */
+static const uint8_t au8BitReverseTable[256] =
+{
+  0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+  0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+  0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+  0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+  0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+  0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+  0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+  0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+  0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+  0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+  0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+  0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+  0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+  0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+  0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+  0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
+};
+
+typedef void (*ReverseFunctionType)(uint8_t* pu8Data_, uint32_t u32Size_);
+
+
+/* Portable RBIT: reverses all 32 bits */
+static uint32_t Rbit(uint32_t u32Word_)
+{
+  u32Word_ = ((u32Word_ >> 1) & 0x55555555u) | ((u32Word_ & 0x55555555u) << 1);
+  u32Word_ = ((u32Word_ >> 2) & 0x33333333u) | ((u32Word_ & 0x33333333u) << 2);
+  u32Word_ = ((u32Word_ >> 4) & 0x0F0F0F0Fu) | ((u32Word_ & 0x0F0F0F0Fu) << 4);
+  u32Word_ = ((u32Word_ >> 8) & 0x00FF00FFu) | ((u32Word_ & 0x00FF00FFu) << 8);
+  return (u32Word_ >> 16) | (u32Word_ << 16);
+}
+
+/* Portable REV: reverses the byte order */
+static uint32_t Rev(uint32_t u32Word_)
+{
+  return (u32Word_ >> 24) | ((u32Word_ >> 8) & 0x0000FF00u) | ((u32Word_ << 8) & 0x00FF0000u) | (u32Word_ << 24);
+}
+
+static void ReverseByteShift(uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  while(u32Size_--)
+  {
+    *pu8Data_ = (uint8_t)(Rbit(*pu8Data_) >> 24);
+    pu8Data_++;
+  }
+}
+
+static void ReverseByteTable(uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  while(u32Size_--)
+  {
+    *pu8Data_ = au8BitReverseTable[*pu8Data_];
+    pu8Data_++;
+  }
+}
+
+/* Same structure as SspReverseBits(): unaligned head, whole words, tail.  bRbit_ picks the target or host path. */
+static void ReverseWords(uint8_t* pu8Data_, uint32_t u32Size_, int bRbit_)
+{
+  uint32_t u32Word;
+
+  while( (u32Size_ != 0) && ((uintptr_t)pu8Data_ & 0x03) )
+  {
+    *pu8Data_ = au8BitReverseTable[*pu8Data_];
+    pu8Data_++;
+    u32Size_--;
+  }
+
+  while(u32Size_ >= 4)
+  {
+    /* memcpy keeps the host compiler happy about aliasing; it becomes a single load and store */
+    memcpy(&u32Word, pu8Data_, 4);
+    if(bRbit_)
+    {
+      u32Word = Rev(Rbit(u32Word));
+    }
+    else
+    {
+      u32Word = ( (uint32_t)au8BitReverseTable[u32Word & 0xFF]               ) |
+                ( (uint32_t)au8BitReverseTable[(u32Word >> 8) & 0xFF]  << 8  ) |
+                ( (uint32_t)au8BitReverseTable[(u32Word >> 16) & 0xFF] << 16 ) |
+                ( (uint32_t)au8BitReverseTable[u32Word >> 24]          << 24 );
+    }
+    memcpy(pu8Data_, &u32Word, 4);
+    pu8Data_ += 4;
+    u32Size_ -= 4;
+  }
+
+  while(u32Size_ != 0)
+  {
+    *pu8Data_ = au8BitReverseTable[*pu8Data_];
+    pu8Data_++;
+    u32Size_--;
+  }
+}
+
+static void ReverseWordRbit(uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  ReverseWords(pu8Data_, u32Size_, 1);
+}
+
+static void ReverseWordTable(uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  ReverseWords(pu8Data_, u32Size_, 0);
+}
+
+static uint8_t ReferenceReverse(uint8_t u8Byte_)
+{
+  uint8_t u8Result = 0;
+
+  for(int i = 0; i < 8; i++)
+  {
+    if(u8Byte_ & (1u << i))
+    {
+      u8Result |= (uint8_t)(0x80u >> i);
+    }
+  }
+  return u8Result;
+}
+
+/* Flips every length up to CHECK_LENGTH at every alignment and makes sure nothing outside the range changes */
+static int Check(ReverseFunctionType pfReverse_)
+{
+  uint8_t au8Buffer[CHECK_LENGTH + 8];
+
+  for(uint32_t u32Offset = 0; u32Offset < 4; u32Offset++)
+  {
+    for(uint32_t u32Length = 0; u32Length <= CHECK_LENGTH; u32Length++)
+    {
+      for(uint32_t i = 0; i < sizeof(au8Buffer); i++)
+      {
+        au8Buffer[i] = (uint8_t)((i * 37) + u32Length);
+      }
+
+      pfReverse_(&au8Buffer[u32Offset], u32Length);
+
+      for(uint32_t i = 0; i < sizeof(au8Buffer); i++)
+      {
+        uint8_t u8Expected = (uint8_t)((i * 37) + u32Length);
+
+        if( (i >= u32Offset) && (i < (u32Offset + u32Length)) )
+        {
+          u8Expected = ReferenceReverse(u8Expected);
+        }
+        if(au8Buffer[i] != u8Expected)
+        {
+          return 0;
+        }
+      }
+    }
+  }
+  return 1;
+}
+
+static double NowNs(void)
+{
+  struct timespec sTime;
+
+  clock_gettime(CLOCK_MONOTONIC, &sTime);
+  return ((double)sTime.tv_sec * 1e9) + (double)sTime.tv_nsec;
+}
+
+/* Returns the average time in ns to flip a buffer of u32Size_ bytes */
+static double Time(ReverseFunctionType pfReverse_, uint8_t* pu8Buffer_, uint32_t u32Size_)
+{
+  unsigned long u32Rounds = 1000;
+  double dStart, dElapsed;
+
+  for(;;)
+  {
+    dStart = NowNs();
+    for(unsigned long i = 0; i < u32Rounds; i++)
+    {
+      pfReverse_(pu8Buffer_, u32Size_);
+    }
+    dElapsed = NowNs() - dStart;
+    if(dElapsed >= MIN_TIME_NS)
+    {
+      return dElapsed / (double)u32Rounds;
+    }
+    u32Rounds *= 4;
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  static const struct
+  {
+    const char* pcName;
+    ReverseFunctionType pfReverse;
+  } asMethods[] =
+  {
+    {"byte shift   ", ReverseByteShift},
+    {"byte table   ", ReverseByteTable},
+    {"word RBIT+REV", ReverseWordRbit},
+    {"word table   ", ReverseWordTable},
+  };
+  uint32_t u32Size = DEFAULT_SIZE;
+  uint8_t* pu8Buffer;
+  int bFailed = 0;
+
+  if(argc > 1)
+  {
+    u32Size = (uint32_t)strtoul(argv[1], NULL, 0);
+    if( (u32Size == 0) || (u32Size > MAX_SIZE) )
+    {
+      fprintf(stderr, "usage: %s [buffer bytes 1-%u]\n", argv[0], MAX_SIZE);
+      return 1;
+    }
+  }
+
+  /* Spare bytes so the buffer can also be timed unaligned */
+  pu8Buffer = malloc(u32Size + 4);
+  if(pu8Buffer == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for(uint32_t i = 0; i < u32Size + 4; i++)
+  {
+    pu8Buffer[i] = (uint8_t)rand();
+  }
+
+  printf("%lu byte buffer          check   aligned ns   unaligned ns   ns/byte   MB/s\n", (unsigned long)u32Size);
+  for(size_t m = 0; m < sizeof(asMethods) / sizeof(asMethods[0]); m++)
+  {
+    int bOk = Check(asMethods[m].pfReverse);
+    double dAligned = Time(asMethods[m].pfReverse, pu8Buffer, u32Size);
+    double dUnaligned = Time(asMethods[m].pfReverse, pu8Buffer + 1, u32Size);
+
+    bFailed |= !bOk;
+    printf("%s            %s  %11.1f  %13.1f  %8.3f  %5.0f\n", asMethods[m].pcName, bOk ? "pass" : "FAIL",
+           dAligned, dUnaligned, dAligned / (double)u32Size, ((double)u32Size * 1e3) / dAligned);
+  }
+
+  /* Target estimate from the instruction counts above */
+  printf("\nestimated at %u MHz: byte loop %lu cycles (%.1f us), word loop %lu cycles (%.1f us)\n", TARGET_MHZ,
+         (unsigned long)(TARGET_CYCLES_PER_CALL + (u32Size * TARGET_CYCLES_PER_BYTE)),
+         (double)(TARGET_CYCLES_PER_CALL + (u32Size * TARGET_CYCLES_PER_BYTE)) / TARGET_MHZ,
+         (unsigned long)(TARGET_CYCLES_PER_CALL + ((u32Size / 4) * TARGET_CYCLES_PER_WORD) + ((u32Size % 4) * TARGET_CYCLES_PER_BYTE)),
+         (double)(TARGET_CYCLES_PER_CALL + ((u32Size / 4) * TARGET_CYCLES_PER_WORD) + ((u32Size % 4) * TARGET_CYCLES_PER_BYTE)) / TARGET_MHZ);
+
+  free(pu8Buffer);
+  return bFailed;
+
+} /* end main() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
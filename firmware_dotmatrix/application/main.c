@@ -58,6 +58,7 @@ void main(void)
 
   /* Debug messages through DebugPrintf() are available from here */
 
+  TimerInitialize();  
   SspInitialize();
   TWIInitialize();
   
@@ -86,6 +87,7 @@ void main(void)
     LedUpdate();
     ButtonRunActiveState();
     UartRunActiveState();
+    TimerRunActiveState(); 
     SspRunActiveState();
     TWIRunActiveState();
     CapTouchRunActiveState(); /* This function violates 1ms loop timing every 25ms */ 